@@ -745,6 +745,13 @@ Result<void> FileInstance::Flock(int operation) {
   return {};
 }
 
+int FileInstance::Fstat(struct stat* buf) {
+  errno = 0;
+  int rval = TEMP_FAILURE_RETRY(fstat(fd_, buf));
+  errno_ = errno;
+  return rval;
+}
+
 int FileInstance::GetSockName(struct sockaddr* addr, socklen_t* addrlen) {
   errno = 0;
   int rval = TEMP_FAILURE_RETRY(getsockname(fd_, addr, addrlen));
@@ -277,6 +277,7 @@ class FileInstance {
   int Fcntl(int command, int value);
 
   Result<void> Flock(int operation);
+  int Fstat(struct stat* buf);
 
   int GetErrno() const { return errno_; }
   int GetSockName(struct sockaddr* addr, socklen_t* addrlen);
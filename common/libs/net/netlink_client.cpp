@@ -20,10 +20,14 @@
 #include <sys/socket.h>
 #include <sys/uio.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 #include "ostream"  // for operator<<, basic_ostream
 
 #include <android-base/logging.h>
@@ -41,6 +45,7 @@ class NetlinkClientImpl : public NetlinkClient {
   virtual ~NetlinkClientImpl() = default;
 
   virtual bool Send(const NetlinkRequest& message);
+  bool SendBatch(const std::vector<NetlinkRequest>& messages) override;
 
   // Initialize NetlinkClient instance.
   // Open netlink channel and initialize interface list.
@@ -48,9 +53,12 @@ class NetlinkClientImpl : public NetlinkClient {
   // NETLINK_ROUTE.
   // Returns true, if initialization was successful.
   bool OpenNetlink(int type);
+  // Uses a socket that is already open.
+  void UseSocket(SharedFD socket) { netlink_fd_ = std::move(socket); }
 
  private:
   bool CheckResponse(uint32_t seq_no);
+  bool CheckResponses(std::set<uint32_t> seq_nos);
 
   SharedFD netlink_fd_;
   sockaddr_nl address_;
@@ -115,6 +123,74 @@ bool NetlinkClientImpl::CheckResponse(uint32_t seq_no) {
   return false;
 }
 
+bool NetlinkClientImpl::CheckResponses(std::set<uint32_t> seq_nos) {
+  bool success = true;
+  char buf[4096];
+  while (!seq_nos.empty()) {
+    struct iovec iov = {buf, sizeof(buf)};
+    struct sockaddr_nl sa;
+    struct msghdr msg {};
+    msg.msg_name = &sa;
+    msg.msg_namelen = sizeof(sa);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    int result = netlink_fd_->RecvMsg(&msg, 0);
+    if (result < 0) {
+      LOG(ERROR) << "Netlink error: " << strerror(errno);
+      return false;
+    }
+    uint32_t len = static_cast<uint32_t>(result);
+    for (auto nh = reinterpret_cast<nlmsghdr*>(buf); NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len)) {
+      // Only the acks of this batch are expected on the socket. Anything
+      // else means the replies can't be trusted to belong to our requests.
+      if (nh->nlmsg_type != NLMSG_ERROR || seq_nos.erase(nh->nlmsg_seq) == 0) {
+        LOG(ERROR) << "Unexpected netlink message of type " << nh->nlmsg_type
+                   << " for sequence number " << nh->nlmsg_seq;
+        success = false;
+        continue;
+      }
+      auto err = reinterpret_cast<nlmsgerr*>(NLMSG_DATA(nh));
+      if (err->error < 0) {
+        LOG(ERROR) << "Failed to complete netlink request " << nh->nlmsg_seq
+                   << ": " << strerror(-err->error);
+        success = false;
+      }
+    }
+  }
+  return success;
+}
+
+bool NetlinkClientImpl::SendBatch(
+    const std::vector<NetlinkRequest>& messages) {
+  // Every message is acknowledged separately, keep the acknowledgements of
+  // one batch well within the socket's receive buffer.
+  static constexpr size_t kMaxMessagesPerBatch = 64;
+  bool success = true;
+  for (size_t start = 0; start < messages.size();
+       start += kMaxMessagesPerBatch) {
+    auto end = std::min(messages.size(), start + kMaxMessagesPerBatch);
+    std::vector<iovec> iovs;
+    std::set<uint32_t> seq_nos;
+    for (size_t i = start; i < end; i++) {
+      iovs.push_back({messages[i].RequestData(), messages[i].RequestLength()});
+      seq_nos.insert(messages[i].SeqNo());
+    }
+    // Without an address the messages go to the kernel, or to the peer of the
+    // socket given to NewNetlinkClient().
+    struct msghdr msg {};
+    msg.msg_iov = iovs.data();
+    msg.msg_iovlen = iovs.size();
+    if (netlink_fd_->SendMsg(&msg, 0) < 0) {
+      LOG(ERROR) << "Failed to send netlink messages: " << strerror(errno);
+      return false;
+    }
+    success &= CheckResponses(std::move(seq_nos));
+  }
+  return success;
+}
+
 bool NetlinkClientImpl::Send(const NetlinkRequest& message) {
   struct sockaddr_nl netlink_addr;
   struct iovec netlink_iov = {
@@ -172,6 +248,20 @@ class NetlinkClientFactoryImpl : public NetlinkClientFactory {
 
 }  // namespace
 
+bool NetlinkClient::SendBatch(const std::vector<NetlinkRequest>& messages) {
+  bool success = true;
+  for (const auto& message : messages) {
+    success &= Send(message);
+  }
+  return success;
+}
+
+std::unique_ptr<NetlinkClient> NewNetlinkClient(SharedFD socket) {
+  auto client = std::make_unique<NetlinkClientImpl>();
+  client->UseSocket(std::move(socket));
+  return client;
+}
+
 NetlinkClientFactory* NetlinkClientFactory::Default() {
   static NetlinkClientFactory &factory = *new NetlinkClientFactoryImpl();
   return &factory;
@@ -17,7 +17,9 @@
 #define COMMON_LIBS_NET_NETLINK_CLIENT_H_
 
 #include <memory>
+#include <vector>
 
+#include "common/libs/fs/shared_fd.h"
 #include "common/libs/net/netlink_request.h"
 
 namespace cuttlefish {
@@ -31,6 +33,12 @@ class NetlinkClient {
   // Send netlink message to kernel.
   virtual bool Send(const NetlinkRequest& message) = 0;
 
+  // Send several netlink messages to kernel, packed together to save round
+  // trips. The kernel handles them in order, and keeps going after one of
+  // them fails. Returns true if all of them succeeded, false also when a
+  // reply doesn't match any of them.
+  virtual bool SendBatch(const std::vector<NetlinkRequest>& messages);
+
  private:
   NetlinkClient(const NetlinkClient&);
   NetlinkClient& operator= (const NetlinkClient&);
@@ -49,6 +57,11 @@ class NetlinkClientFactory {
   virtual ~NetlinkClientFactory() = default;
 };
 
+// Creates a client for a socket that is already open, e.g. one end of a
+// socket pair whose other end plays the kernel in tests. Only SendBatch()
+// works with sockets other than netlink ones.
+std::unique_ptr<NetlinkClient> NewNetlinkClient(SharedFD socket);
+
 }  // namespace cuttlefish
 
 #endif  // COMMON_LIBS_NET_NETLINK_CLIENT_H_
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/libs/net/netlink_client.h"
+
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/net/netlink_request.h"
+
+namespace cuttlefish {
+namespace {
+
+// The client talks to one end of a socket pair, the test plays the kernel on
+// the other. Acks can be queued up before the batch is sent, since the
+// sequence numbers are known once the requests exist.
+class NetlinkClientBatchTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    SharedFD client_end;
+    ASSERT_TRUE(SharedFD::SocketPair(AF_UNIX, SOCK_SEQPACKET, 0, &client_end,
+                                     &kernel_));
+    client_ = NewNetlinkClient(client_end);
+    ASSERT_NE(client_, nullptr);
+  }
+
+  std::vector<NetlinkRequest> Requests(size_t count) {
+    std::vector<NetlinkRequest> requests;
+    for (size_t i = 0; i < count; i++) {
+      requests.emplace_back(RTM_SETLINK, 0);
+      requests.back().AddString(IFLA_IFNAME, "cvd-test" + std::to_string(i));
+    }
+    return requests;
+  }
+
+  static std::vector<char> Ack(uint32_t seq, int error) {
+    std::vector<char> ack(NLMSG_LENGTH(sizeof(nlmsgerr)));
+    auto header = reinterpret_cast<nlmsghdr*>(ack.data());
+    header->nlmsg_len = ack.size();
+    header->nlmsg_type = NLMSG_ERROR;
+    header->nlmsg_seq = seq;
+    auto err = reinterpret_cast<nlmsgerr*>(NLMSG_DATA(header));
+    err->error = error;
+    err->msg.nlmsg_seq = seq;
+    return ack;
+  }
+
+  // Sends acks together in one datagram.
+  void SendAcks(const std::vector<std::vector<char>>& acks) {
+    std::vector<char> datagram;
+    for (const auto& ack : acks) {
+      datagram.insert(datagram.end(), ack.begin(), ack.end());
+    }
+    ASSERT_EQ(kernel_->Write(datagram.data(), datagram.size()),
+              static_cast<ssize_t>(datagram.size()));
+  }
+
+  // The sequence numbers of the messages in the next datagram the client
+  // sent.
+  std::vector<uint32_t> ReceivedSeqNos() {
+    std::vector<char> buffer(1 << 16);
+    auto length = kernel_->Read(buffer.data(), buffer.size());
+    std::vector<uint32_t> seq_nos;
+    if (length < 0) {
+      ADD_FAILURE() << "Nothing was sent: " << kernel_->StrError();
+      return seq_nos;
+    }
+    uint32_t remaining = length;
+    for (auto nh = reinterpret_cast<nlmsghdr*>(buffer.data());
+         NLMSG_OK(nh, remaining); nh = NLMSG_NEXT(nh, remaining)) {
+      EXPECT_EQ(nh->nlmsg_type, RTM_SETLINK);
+      EXPECT_TRUE(nh->nlmsg_flags & NLM_F_ACK);
+      seq_nos.push_back(nh->nlmsg_seq);
+    }
+    EXPECT_EQ(remaining, 0);
+    return seq_nos;
+  }
+
+  static std::vector<uint32_t> SeqNos(
+      const std::vector<NetlinkRequest>& requests, size_t start = 0,
+      size_t end = SIZE_MAX) {
+    std::vector<uint32_t> seq_nos;
+    for (size_t i = start; i < std::min(end, requests.size()); i++) {
+      seq_nos.push_back(requests[i].SeqNo());
+    }
+    return seq_nos;
+  }
+
+  SharedFD kernel_;
+  std::unique_ptr<NetlinkClient> client_;
+};
+
+TEST_F(NetlinkClientBatchTest, SendsTheBatchTogether) {
+  auto requests = Requests(3);
+  for (const auto& request : requests) {
+    SendAcks({Ack(request.SeqNo(), 0)});
+  }
+
+  EXPECT_TRUE(client_->SendBatch(requests));
+  EXPECT_EQ(ReceivedSeqNos(), SeqNos(requests));
+}
+
+TEST_F(NetlinkClientBatchTest, MatchesAcksInAnyOrder) {
+  auto requests = Requests(3);
+  SendAcks({Ack(requests[2].SeqNo(), 0), Ack(requests[0].SeqNo(), 0)});
+  SendAcks({Ack(requests[1].SeqNo(), 0)});
+
+  EXPECT_TRUE(client_->SendBatch(requests));
+}
+
+TEST_F(NetlinkClientBatchTest, FailsWhenAnyMessageFails) {
+  auto requests = Requests(3);
+  SendAcks({Ack(requests[0].SeqNo(), 0), Ack(requests[1].SeqNo(), -EEXIST),
+            Ack(requests[2].SeqNo(), 0)});
+
+  EXPECT_FALSE(client_->SendBatch(requests));
+  EXPECT_EQ(ReceivedSeqNos(), SeqNos(requests));
+
+  // Every ack of the failed batch was consumed, none is left to be mistaken
+  // for an ack of the next one.
+  auto next = Requests(1);
+  SendAcks({Ack(next[0].SeqNo(), 0)});
+  EXPECT_TRUE(client_->SendBatch(next));
+}
+
+TEST_F(NetlinkClientBatchTest, FailsOnAcksOfOtherRequests) {
+  auto requests = Requests(2);
+  auto other = Requests(1);
+  SendAcks({Ack(requests[0].SeqNo(), 0), Ack(other[0].SeqNo(), 0),
+            Ack(requests[1].SeqNo(), 0)});
+
+  EXPECT_FALSE(client_->SendBatch(requests));
+}
+
+TEST_F(NetlinkClientBatchTest, SplitsLargeBatches) {
+  auto requests = Requests(100);
+  for (const auto& request : requests) {
+    SendAcks({Ack(request.SeqNo(), 0)});
+  }
+
+  EXPECT_TRUE(client_->SendBatch(requests));
+  EXPECT_EQ(ReceivedSeqNos(), SeqNos(requests, 0, 64));
+  EXPECT_EQ(ReceivedSeqNos(), SeqNos(requests, 64));
+}
+
+}  // namespace
+}  // namespace cuttlefish
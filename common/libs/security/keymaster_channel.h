@@ -35,12 +35,24 @@ struct keymaster_message {
   std::uint8_t payload[0];
 };
 
+/**
+ * keymaster_request_id_header - Prefix for each keymaster_message sent over a
+ * multiplexed channel.
+ * @request_id: chosen by the client when sending a request, and copied by the
+ *              server into the matching response. Responses may arrive in a
+ *              different order than the requests were sent.
+ */
+struct keymaster_request_id_header {
+  std::uint32_t request_id;
+};
+
 }  // namespace keymaster
 
 namespace cuttlefish {
 
 using keymaster::AndroidKeymasterCommand;
 using keymaster::keymaster_message;
+using keymaster::keymaster_request_id_header;
 
 /**
  * A destroyer for keymaster_message instances created with
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/libs/security/keymaster_channel_multiplexed.h"
+
+#include <cstring>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <keymaster/android_keymaster_messages.h>
+#include <keymaster/mem.h>
+#include <keymaster/serializable.h>
+
+#include "common/libs/fs/shared_buf.h"
+
+namespace cuttlefish {
+
+SharedFdMultiplexedKeymasterChannel::SharedFdMultiplexedKeymasterChannel(
+    SharedFD input, SharedFD output)
+    : input_(input), output_(output) {}
+
+bool SharedFdMultiplexedKeymasterChannel::SendRequest(
+    std::uint32_t request_id, AndroidKeymasterCommand command,
+    const keymaster::Serializable& message) {
+  std::vector<std::uint8_t> payload(message.SerializedSize());
+  message.Serialize(payload.data(), payload.data() + payload.size());
+  return SendMessage(request_id, command, false, payload.data(),
+                     payload.size());
+}
+
+bool SharedFdMultiplexedKeymasterChannel::SendResponse(
+    std::uint32_t request_id, AndroidKeymasterCommand command,
+    const keymaster::Serializable& message) {
+  std::vector<std::uint8_t> payload(message.SerializedSize());
+  message.Serialize(payload.data(), payload.data() + payload.size());
+  return SendResponse(request_id, command, payload);
+}
+
+bool SharedFdMultiplexedKeymasterChannel::SendResponse(
+    std::uint32_t request_id, AndroidKeymasterCommand command,
+    const std::vector<std::uint8_t>& payload) {
+  return SendMessage(request_id, command, true, payload.data(),
+                     payload.size());
+}
+
+bool SharedFdMultiplexedKeymasterChannel::SendMessage(
+    std::uint32_t request_id, AndroidKeymasterCommand command,
+    bool is_response, const std::uint8_t* payload, std::size_t payload_size) {
+  LOG(VERBOSE) << "Sending message " << request_id << " with id: " << command
+               << " and size " << payload_size;
+  keymaster_request_id_header id_header{.request_id = request_id};
+  auto message = CreateKeymasterMessage(command, is_response, payload_size);
+  std::memcpy(message->payload, payload, payload_size);
+
+  // Build the whole frame up front so concurrent senders never interleave.
+  std::vector<char> frame(sizeof(id_header) + sizeof(keymaster_message) +
+                          payload_size);
+  std::memcpy(frame.data(), &id_header, sizeof(id_header));
+  std::memcpy(frame.data() + sizeof(id_header), message.get(),
+              sizeof(keymaster_message) + payload_size);
+
+  std::lock_guard lock(write_mutex_);
+  auto written = WriteAll(output_, frame);
+  keymaster::Eraser(frame.data(), frame.size());
+  if (written != frame.size()) {
+    LOG(ERROR) << "Could not write Keymaster Message: " << output_->StrError();
+    return false;
+  }
+  return true;
+}
+
+MultiplexedKeymasterMessage
+SharedFdMultiplexedKeymasterChannel::ReceiveMessage() {
+  keymaster_request_id_header id_header;
+  auto read = ReadExactBinary(input_, &id_header);
+  if (read != sizeof(id_header)) {
+    LOG(ERROR) << "Could not read Keymaster request id: "
+               << input_->StrError();
+    return {};
+  }
+  struct keymaster_message message_header;
+  read = ReadExactBinary(input_, &message_header);
+  if (read != sizeof(keymaster_message)) {
+    LOG(ERROR) << "Expected " << sizeof(keymaster_message) << ", received "
+               << read;
+    LOG(ERROR) << "Could not read Keymaster Message: " << input_->StrError();
+    return {};
+  }
+  LOG(VERBOSE) << "Received message " << id_header.request_id
+               << " with id: " << message_header.cmd << " and size "
+               << message_header.payload_size;
+  auto message =
+      CreateKeymasterMessage(message_header.cmd, message_header.is_response,
+                             message_header.payload_size);
+  auto message_bytes = reinterpret_cast<char*>(message->payload);
+  read = ReadExact(input_, message_bytes, message->payload_size);
+  if (read != message->payload_size) {
+    LOG(ERROR) << "Could not read Keymaster Message: " << input_->StrError();
+    return {};
+  }
+  return {id_header.request_id, std::move(message)};
+}
+
+MultiplexedKeymasterClient::MultiplexedKeymasterClient(SharedFD input,
+                                                       SharedFD output)
+    : channel_(input, output),
+      receive_thread_([this]() { ReceiveLoop(); }) {}
+
+MultiplexedKeymasterClient::~MultiplexedKeymasterClient() {
+  if (receive_thread_.joinable()) {
+    receive_thread_.join();
+  }
+}
+
+ManagedKeymasterMessage MultiplexedKeymasterClient::Call(
+    AndroidKeymasterCommand command, const keymaster::Serializable& request) {
+  std::uint32_t request_id;
+  std::future<ManagedKeymasterMessage> response;
+  {
+    std::lock_guard lock(pending_mutex_);
+    if (closed_) {
+      return {};
+    }
+    request_id = next_request_id_++;
+    response = pending_[request_id].get_future();
+  }
+  if (!channel_.SendRequest(request_id, command, request)) {
+    LOG(ERROR) << "Failed to send keymaster message: " << command;
+    std::lock_guard lock(pending_mutex_);
+    pending_.erase(request_id);
+    return {};
+  }
+  return response.get();
+}
+
+void MultiplexedKeymasterClient::ReceiveLoop() {
+  while (true) {
+    auto received = channel_.ReceiveMessage();
+    if (!received.message) {
+      break;
+    }
+    std::lock_guard lock(pending_mutex_);
+    auto it = pending_.find(received.request_id);
+    if (it == pending_.end()) {
+      LOG(ERROR) << "Received response for unknown request "
+                 << received.request_id;
+      continue;
+    }
+    it->second.set_value(std::move(received.message));
+    pending_.erase(it);
+  }
+  std::lock_guard lock(pending_mutex_);
+  closed_ = true;
+  for (auto& [request_id, response] : pending_) {
+    response.set_value({});
+  }
+  pending_.clear();
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <keymaster/android_keymaster_messages.h>
+#include <keymaster/serializable.h>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/security/keymaster_channel.h"
+
+namespace cuttlefish {
+
+/** A keymaster_message together with the request id it was tagged with. */
+struct MultiplexedKeymasterMessage {
+  std::uint32_t request_id;
+  ManagedKeymasterMessage message;
+};
+
+/*
+ * Channel where every keymaster_message is prefixed with a
+ * keymaster_request_id_header, allowing several requests to be in flight at
+ * the same time and their responses to complete out of order.
+ *
+ * Sending is thread safe, each message is written with a single write call.
+ * Receiving is expected to happen from a single thread.
+ */
+class SharedFdMultiplexedKeymasterChannel {
+ public:
+  SharedFdMultiplexedKeymasterChannel(SharedFD input, SharedFD output);
+
+  bool SendRequest(std::uint32_t request_id, AndroidKeymasterCommand command,
+                   const keymaster::Serializable& message);
+  bool SendResponse(std::uint32_t request_id, AndroidKeymasterCommand command,
+                    const keymaster::Serializable& message);
+  /* Sends a response whose payload was already serialized. */
+  bool SendResponse(std::uint32_t request_id, AndroidKeymasterCommand command,
+                    const std::vector<std::uint8_t>& payload);
+  MultiplexedKeymasterMessage ReceiveMessage();
+
+ private:
+  SharedFD input_;
+  SharedFD output_;
+  std::mutex write_mutex_;
+
+  bool SendMessage(std::uint32_t request_id, AndroidKeymasterCommand command,
+                   bool is_response, const std::uint8_t* payload,
+                   std::size_t payload_size);
+};
+
+/*
+ * Client side of a multiplexed channel. Any number of threads can call Call()
+ * concurrently, a background thread routes each response to its caller using
+ * the request id.
+ */
+class MultiplexedKeymasterClient {
+ public:
+  MultiplexedKeymasterClient(SharedFD input, SharedFD output);
+  /* The peer must close the connection before the client is destroyed. */
+  ~MultiplexedKeymasterClient();
+
+  /*
+   * Sends a request and blocks until its response arrives. Returns null if the
+   * request could not be sent or the channel was closed before the response
+   * was received.
+   */
+  ManagedKeymasterMessage Call(AndroidKeymasterCommand command,
+                               const keymaster::Serializable& request);
+
+ private:
+  void ReceiveLoop();
+
+  SharedFdMultiplexedKeymasterChannel channel_;
+  std::mutex pending_mutex_;
+  std::uint32_t next_request_id_ = 0;
+  bool closed_ = false;
+  std::map<std::uint32_t, std::promise<ManagedKeymasterMessage>> pending_;
+  std::thread receive_thread_;
+};
+
+}  // namespace cuttlefish
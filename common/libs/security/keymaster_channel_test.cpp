@@ -17,9 +17,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <sys/socket.h>
+
 #include <string>
+#include <thread>
 
 #include "common/libs/fs/shared_fd.h"
+#include "common/libs/security/keymaster_channel_multiplexed.h"
 #include "common/libs/security/keymaster_channel_sharedfd.h"
 #include "gtest/gtest.h"
 
@@ -75,4 +79,85 @@ TEST(KeymasterChannel, SendAndReceiveResponse) {
   ASSERT_TRUE(std::equal(request.begin(), request.end(), read.begin()));
 }
 
+TEST(KeymasterChannel, MultiplexedRequestIdRoundTrip) {
+  SharedFD read_fd;
+  SharedFD write_fd;
+  ASSERT_TRUE(SharedFD::Pipe(&read_fd, &write_fd)) << "Failed to create pipe";
+
+  SharedFdMultiplexedKeymasterChannel channel{read_fd, write_fd};
+
+  char buffer[] = {1, 2, 3, 4, 5, 6};
+  keymaster::Buffer request(buffer, sizeof(buffer));
+
+  ASSERT_TRUE(channel.SendRequest(7, keymaster::GET_VERSION, request))
+      << "Failed to send request";
+  ASSERT_TRUE(channel.SendResponse(3, keymaster::GENERATE_KEY, request))
+      << "Failed to send response";
+
+  auto first = channel.ReceiveMessage();
+  ASSERT_TRUE(first.message) << "Failed to receive request";
+  EXPECT_EQ(first.request_id, 7);
+  EXPECT_EQ(first.message->cmd, keymaster::GET_VERSION) << "Command mismatch";
+  EXPECT_FALSE(first.message->is_response) << "Request/response mismatch";
+
+  auto second = channel.ReceiveMessage();
+  ASSERT_TRUE(second.message) << "Failed to receive response";
+  EXPECT_EQ(second.request_id, 3);
+  EXPECT_EQ(second.message->cmd, keymaster::GENERATE_KEY) << "Command mismatch";
+  EXPECT_TRUE(second.message->is_response) << "Request/response mismatch";
+
+  keymaster::Buffer read;
+  const uint8_t* read_data = second.message->payload;
+  EXPECT_TRUE(
+      read.Deserialize(&read_data, read_data + second.message->payload_size))
+      << "Failed to deserialize response";
+  ASSERT_EQ(request.end() - request.begin(), read.end() - read.begin());
+  ASSERT_TRUE(std::equal(request.begin(), request.end(), read.begin()));
+}
+
+TEST(KeymasterChannel, MultiplexedClientOutOfOrderResponses) {
+  SharedFD client_fd;
+  SharedFD server_fd;
+  ASSERT_TRUE(
+      SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &client_fd, &server_fd))
+      << "Failed to create socket pair";
+
+  SharedFdMultiplexedKeymasterChannel server{server_fd, server_fd};
+  std::thread server_thread([&server]() {
+    // Answer both requests in reverse order, echoing the command back as the
+    // payload so callers can tell the responses apart.
+    auto first = server.ReceiveMessage();
+    auto second = server.ReceiveMessage();
+    ASSERT_TRUE(first.message && second.message);
+    for (auto* received : {&second, &first}) {
+      uint8_t cmd = received->message->cmd;
+      keymaster::Buffer payload(&cmd, sizeof(cmd));
+      server.SendResponse(received->request_id, received->message->cmd,
+                          payload);
+    }
+  });
+
+  {
+    MultiplexedKeymasterClient client{client_fd, client_fd};
+    auto call = [&client](keymaster::AndroidKeymasterCommand command) {
+      keymaster::Buffer empty;
+      auto response = client.Call(command, empty);
+      ASSERT_TRUE(response) << "No response for " << command;
+      EXPECT_EQ(response->cmd, command);
+      keymaster::Buffer read;
+      const uint8_t* read_data = response->payload;
+      ASSERT_TRUE(
+          read.Deserialize(&read_data, read_data + response->payload_size));
+      ASSERT_EQ(read.available_read(), 1);
+      EXPECT_EQ(*read.begin(), command);
+    };
+    std::thread first_caller(call, keymaster::GET_VERSION);
+    std::thread second_caller(call, keymaster::GENERATE_KEY);
+    first_caller.join();
+    second_caller.join();
+    server_thread.join();
+    server_fd->Shutdown(SHUT_RDWR);
+  }
+}
+
 }  // namespace cuttlefish
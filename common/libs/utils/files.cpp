@@ -265,6 +265,24 @@ bool Copy(const std::string& from, const std::string& to) {
   return true;
 }
 
+Result<void> CloneFile(const std::string& from, const std::string& to) {
+  android::base::unique_fd fd_from(open(from.c_str(), O_RDONLY | O_CLOEXEC));
+  CF_EXPECT(fd_from.get() >= 0,
+            "Could not open \"" << from << "\": " << strerror(errno));
+  android::base::unique_fd fd_to(
+      open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  CF_EXPECT(fd_to.get() >= 0,
+            "Could not open \"" << to << "\": " << strerror(errno));
+  if (ioctl(fd_to.get(), FICLONE, fd_from.get()) < 0) {
+    auto error = errno;
+    fd_to.reset();
+    RemoveFile(to);
+    return CF_ERR("Could not clone \"" << from << "\" to \"" << to
+                                        << "\": " << strerror(error));
+  }
+  return {};
+}
+
 std::string AbsolutePath(const std::string& path) {
   if (path.empty()) {
     return {};
@@ -39,6 +39,9 @@ bool CanAccess(const std::string& path, const int mode);
 bool IsDirectoryEmpty(const std::string& path);
 bool RecursivelyRemoveDirectory(const std::string& path);
 bool Copy(const std::string& from, const std::string& to);
+// Makes `to` a copy-on-write clone of `from` that shares its storage until
+// either file is modified. Fails if the filesystem doesn't support reflinks.
+Result<void> CloneFile(const std::string& from, const std::string& to);
 off_t FileSize(const std::string& path);
 bool RemoveFile(const std::string& file);
 Result<std::string> RenameFile(const std::string& current_filepath,
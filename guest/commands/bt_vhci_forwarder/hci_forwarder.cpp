@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hci_forwarder.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <ios>
+
+#include "android-base/logging.h"
+
+// Copied from net/bluetooth/hci.h
+#define HCI_ACLDATA_PKT 0x02
+#define HCI_SCODATA_PKT 0x03
+#define HCI_EVENT_PKT 0x04
+#define HCI_ISODATA_PKT 0x05
+#define HCI_VENDOR_PKT 0xff
+#define HCI_MAX_ACL_SIZE 1024
+#define HCI_MAX_FRAME_SIZE (HCI_MAX_ACL_SIZE + 4)
+
+namespace cuttlefish {
+namespace {
+
+// Include H4 header byte, and reserve more buffer size in the case of excess
+// packet.
+constexpr size_t kPacketBufferSize = (HCI_MAX_FRAME_SIZE + 1) * 2;
+
+// Limits on the work done for one direction per wakeup, so a flood in one
+// direction can't delay the other one indefinitely.
+constexpr int kMaxVhciPacketsPerWakeup = 32;
+constexpr int kMaxConsoleReadsPerWakeup = 4;
+constexpr size_t kConsoleReadSize = 16 * 1024;
+// Packets from vhci held back while the host side of the console is away,
+// the most recent ones are kept.
+constexpr size_t kMaxHeldPackets = 64;
+static_assert(kMaxVhciPacketsPerWakeup <= kMaxHeldPackets);
+
+// The host side of the console is gone. Sockets report EOF with RDHUP.
+constexpr uint32_t kConsoleHangUpEvents = EPOLLHUP | EPOLLRDHUP;
+
+bool SetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+std::chrono::microseconds AverageLatency(
+    const HciForwarder::DirectionCounters& counters) {
+  if (counters.writes == 0) {
+    return std::chrono::microseconds(0);
+  }
+  return counters.total_latency / counters.writes;
+}
+
+void LogDirection(const char* name,
+                  const HciForwarder::DirectionCounters& current,
+                  const HciForwarder::DirectionCounters& previous,
+                  std::chrono::seconds interval) {
+  LOG(INFO) << name << ": " << current.packets << " packets, "
+            << current.bytes << " bytes ("
+            << (current.bytes - previous.bytes) / interval.count()
+            << " bytes/s), " << current.writes << " writes, "
+            << current.dropped_packets << " dropped, latency avg "
+            << AverageLatency(current).count() << "us max "
+            << current.max_latency.count() << "us";
+}
+
+}  // namespace
+
+HciForwarder::HciForwarder(int vhci_fd, int console_fd,
+                           std::chrono::seconds stats_interval)
+    : vhci_fd_(vhci_fd),
+      console_fd_(console_fd),
+      stats_interval_(stats_interval),
+      h4_parser_(
+          [](const std::vector<uint8_t>& /* raw_command */) {
+            LOG(ERROR) << "Unexpected command: command pkt shouldn't be sent "
+                          "as response.";
+          },
+          [this](const std::vector<uint8_t>& raw_event) {
+            SendToVhci(HCI_EVENT_PKT, raw_event);
+          },
+          [this](const std::vector<uint8_t>& raw_acl) {
+            SendToVhci(HCI_ACLDATA_PKT, raw_acl);
+          },
+          [this](const std::vector<uint8_t>& raw_sco) {
+            SendToVhci(HCI_SCODATA_PKT, raw_sco);
+          },
+          [this](const std::vector<uint8_t>& raw_iso) {
+            SendToVhci(HCI_ISODATA_PKT, raw_iso);
+          }) {}
+
+HciForwarder::~HciForwarder() {
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+bool HciForwarder::Run() {
+  if (!SetUp()) {
+    return false;
+  }
+  while (true) {
+    int timeout_ms = -1;
+    if (stats_interval_.count() > 0) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          next_log_ - Clock::now());
+      timeout_ms = std::max<int>(remaining.count(), 0);
+    }
+    struct epoll_event events[2];
+    int count =
+        TEMP_FAILURE_RETRY(epoll_wait(epoll_fd_, events, 2, timeout_ms));
+    if (count < 0) {
+      PLOG(ERROR) << "epoll_wait failed";
+      return false;
+    }
+    uint32_t vhci_events = 0;
+    uint32_t console_events = 0;
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.fd == vhci_fd_) {
+        vhci_events = events[i].events;
+      } else {
+        console_events = events[i].events;
+      }
+    }
+    if (console_hung_up_ && console_events == 0) {
+      // The host side coming back doesn't always wake the edge triggered
+      // watch up, so every wakeup checks whether it's still away.
+      console_events = PollConsole();
+    }
+    // Before forwarding from vhci, so that its packets are held back as soon
+    // as the host side is gone and go out as soon as it's back.
+    UpdateConsoleHangUp(console_events);
+    if (vhci_events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+      if (!ForwardFromVhci()) {
+        return false;
+      }
+    }
+    if (!console_hung_up_ && (console_events & (EPOLLIN | EPOLLERR))) {
+      ForwardFromConsole();
+    }
+    MaybeLogCounters();
+  }
+}
+
+bool HciForwarder::SetUp() {
+  if (!SetNonBlocking(vhci_fd_) || !SetNonBlocking(console_fd_)) {
+    PLOG(ERROR) << "Failed to make the descriptors non blocking";
+    return false;
+  }
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    PLOG(ERROR) << "epoll_create1 failed";
+    return false;
+  }
+  for (int fd : {vhci_fd_, console_fd_}) {
+    uint32_t events = fd == console_fd_ ? EPOLLIN | EPOLLRDHUP : EPOLLIN;
+    struct epoll_event event = {.events = events, .data = {.fd = fd}};
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+      PLOG(ERROR) << "Failed to watch fd " << fd;
+      return false;
+    }
+  }
+  vhci_buffer_.resize(kMaxVhciPacketsPerWakeup * kPacketBufferSize);
+  console_buffer_.resize(kConsoleReadSize);
+  next_log_ = Clock::now() + stats_interval_;
+  return true;
+}
+
+bool HciForwarder::ForwardFromVhci() {
+  // vhci returns one packet per read, all of them go out in a single writev.
+  struct iovec iov[kMaxVhciPacketsPerWakeup];
+  int packets = 0;
+  bool closed = false;
+  Clock::time_point first_read_time;
+  for (int i = 0; i < kMaxVhciPacketsPerWakeup; i++) {
+    uint8_t* buf = vhci_buffer_.data() + i * kPacketBufferSize;
+    ssize_t count = TEMP_FAILURE_RETRY(read(vhci_fd_, buf, kPacketBufferSize));
+    if (count < 0 && errno != EAGAIN) {
+      PLOG(ERROR) << "vhci read failed";
+    }
+    if (count == 0) {
+      LOG(ERROR) << "vhci closed";
+      closed = true;
+    }
+    if (count <= 0) {
+      break;
+    }
+    // TODO(b/182245475) Ignore HCI_VENDOR_PKT
+    // because root-canal cannot handle it.
+    if (buf[0] == HCI_VENDOR_PKT) {
+      LOG(INFO) << "ignore 0x" << std::hex << std::setw(2)
+                << std::setfill('0') << (unsigned)buf[0] << " packet";
+      continue;
+    }
+    if (packets == 0) {
+      first_read_time = Clock::now();
+    }
+    iov[packets++] = {buf, static_cast<size_t>(count)};
+  }
+  before_first_command_ = false;
+  if (packets > 0) {
+    SendToConsole(iov, packets, first_read_time);
+  }
+  return !closed;
+}
+
+void HciForwarder::SendToConsole(const struct iovec* packets, int count,
+                                 Clock::time_point read_time) {
+  auto& counters = counters_.vhci_to_console;
+  int written = 0;
+  if (!console_hung_up_) {
+    // WriteAll moves the buffers along as they are written.
+    struct iovec iov[kMaxHeldPackets];
+    std::copy(packets, packets + count, iov);
+    bool succeeded = WriteAll(console_fd_, iov, count, &written);
+    for (int i = 0; i < written; i++) {
+      counters.packets++;
+      counters.bytes += packets[i].iov_len;
+    }
+    if (written > 0) {
+      RecordWrite(counters, read_time);
+    }
+    if (succeeded) {
+      return;
+    }
+    PLOG(ERROR) << "vhci to virtio-console failed";
+    if (!(PollConsole() & kConsoleHangUpEvents)) {
+      counters.dropped_packets += count - written;
+      return;
+    }
+    SetConsoleHungUp(true);
+  }
+  // The controller waits for the guest to reset it once it's back, the
+  // packets are held back until then.
+  for (int i = written; i < count; i++) {
+    if (held_packets_.size() == kMaxHeldPackets) {
+      held_packets_.pop_front();
+      counters.dropped_packets++;
+    }
+    auto data = static_cast<const uint8_t*>(packets[i].iov_base);
+    held_packets_.push_back(
+        {read_time, std::vector<uint8_t>(data, data + packets[i].iov_len)});
+  }
+}
+
+void HciForwarder::FlushHeldPackets() {
+  if (held_packets_.empty()) {
+    return;
+  }
+  LOG(INFO) << "Sending " << held_packets_.size()
+            << " packets held back while the host side was away";
+  // Those that can't be written are held back again.
+  auto held = std::move(held_packets_);
+  held_packets_.clear();
+  struct iovec iov[kMaxHeldPackets];
+  for (size_t i = 0; i < held.size(); i++) {
+    iov[i] = {held[i].data.data(), held[i].data.size()};
+  }
+  SendToConsole(iov, held.size(), held.front().read_time);
+}
+
+uint32_t HciForwarder::PollConsole() {
+  // poll and epoll share the event bits.
+  struct pollfd pfd = {
+      .fd = console_fd_, .events = POLLIN | POLLRDHUP, .revents = 0};
+  if (TEMP_FAILURE_RETRY(poll(&pfd, 1, 0)) < 0) {
+    PLOG(ERROR) << "virtio-console poll failed";
+    return 0;
+  }
+  return pfd.revents;
+}
+
+void HciForwarder::UpdateConsoleHangUp(uint32_t events) {
+  bool hung_up = events & kConsoleHangUpEvents;
+  if (hung_up == console_hung_up_) {
+    return;
+  }
+  if (hung_up) {
+    LOG(ERROR) << "PollHUP";
+  } else {
+    LOG(INFO) << "HCI socket device connected again";
+  }
+  SetConsoleHungUp(hung_up);
+  if (!hung_up) {
+    FlushHeldPackets();
+  }
+}
+
+void HciForwarder::ForwardFromConsole() {
+  if (before_first_command_) {
+    // Drop any data left in the virtio-console from a previous reset.
+    ssize_t bytes = TEMP_FAILURE_RETRY(
+        read(console_fd_, console_buffer_.data(), console_buffer_.size()));
+    if (bytes < 0) {
+      PLOG(ERROR) << "virtio_fd ready, but read failed";
+    } else {
+      LOG(INFO) << "Discarding " << bytes << " bytes from virtio_fd.";
+    }
+    return;
+  }
+  for (int i = 0; i < kMaxConsoleReadsPerWakeup; i++) {
+    ssize_t count = TEMP_FAILURE_RETRY(
+        read(console_fd_, console_buffer_.data(), console_buffer_.size()));
+    if (count < 0) {
+      if (errno != EAGAIN) {
+        PLOG(ERROR) << "virtio-console read failed";
+      }
+      return;
+    }
+    if (count == 0) {
+      if (!console_hung_up_) {
+        LOG(INFO) << "HCI socket device disconnected";
+        SetConsoleHungUp(true);
+      }
+      return;
+    }
+    console_read_time_ = Clock::now();
+    // vhci expects full packets, but the data from virtio-console could be
+    // partial, the parser puts them back together.
+    const uint8_t* data = console_buffer_.data();
+    for (ssize_t left = count; left > 0;) {
+      ssize_t chunk = std::min<ssize_t>(left, h4_parser_.BytesRequested());
+      if (!h4_parser_.Consume(data, chunk)) {
+        LOG(ERROR) << "Invalid H4 data from virtio-console";
+        h4_parser_.Reset();
+        break;
+      }
+      data += chunk;
+      left -= chunk;
+    }
+    if (static_cast<size_t>(count) < console_buffer_.size()) {
+      // Nothing else is ready.
+      return;
+    }
+  }
+}
+
+void HciForwarder::SetConsoleHungUp(bool hung_up) {
+  // POLLHUP is reported for as long as the host side is away. Edge triggered
+  // notifications only come when the port's state changes, e.g. when the host
+  // connects again and the port turns writable, so the wait doesn't spin.
+  uint32_t events = EPOLLIN | EPOLLRDHUP;
+  if (hung_up) {
+    events |= EPOLLOUT | EPOLLET;
+  }
+  struct epoll_event event = {.events = events, .data = {.fd = console_fd_}};
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, console_fd_, &event) < 0) {
+    PLOG(ERROR) << "Failed to update the virtio-console watch";
+  }
+  console_hung_up_ = hung_up;
+  // A packet cut short by the disconnection won't be completed.
+  h4_parser_.Reset();
+}
+
+bool HciForwarder::WriteAll(int fd, struct iovec* iov, int iovcnt,
+                            int* completed) {
+  int done = 0;
+  while (done < iovcnt) {
+    ssize_t written =
+        TEMP_FAILURE_RETRY(writev(fd, iov + done, iovcnt - done));
+    if (written < 0 && errno == EAGAIN) {
+      // Wait for room instead of spinning.
+      struct pollfd pfd = {.fd = fd, .events = POLLOUT, .revents = 0};
+      TEMP_FAILURE_RETRY(poll(&pfd, 1, -1));
+      if ((pfd.revents & POLLHUP) && !(pfd.revents & POLLOUT)) {
+        // Nobody is left to make room.
+        errno = EPIPE;
+        break;
+      }
+      continue;
+    }
+    if (written < 0) {
+      break;
+    }
+    while (done < iovcnt && static_cast<size_t>(written) >= iov[done].iov_len) {
+      written -= iov[done].iov_len;
+      done++;
+    }
+    if (done < iovcnt) {
+      iov[done].iov_base = static_cast<uint8_t*>(iov[done].iov_base) + written;
+      iov[done].iov_len -= written;
+    }
+  }
+  if (completed) {
+    *completed = done;
+  }
+  return done == iovcnt;
+}
+
+void HciForwarder::SendToVhci(uint8_t type,
+                              const std::vector<uint8_t>& packet) {
+  auto& counters = counters_.console_to_vhci;
+  // vhci takes exactly one packet per write.
+  struct iovec iov[] = {{&type, sizeof(type)},
+                        {const_cast<uint8_t*>(packet.data()), packet.size()}};
+  if (!WriteAll(vhci_fd_, iov, sizeof(iov) / sizeof(iov[0]))) {
+    PLOG(ERROR) << "virtio-console to vhci failed";
+    counters.dropped_packets++;
+    return;
+  }
+  counters.packets++;
+  counters.bytes += packet.size() + sizeof(type);
+  RecordWrite(counters, console_read_time_);
+}
+
+void HciForwarder::RecordWrite(DirectionCounters& counters,
+                               Clock::time_point read_time) {
+  auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - read_time);
+  counters.writes++;
+  counters.total_latency += latency;
+  counters.max_latency = std::max(counters.max_latency, latency);
+}
+
+void HciForwarder::MaybeLogCounters() {
+  if (stats_interval_.count() <= 0 || Clock::now() < next_log_) {
+    return;
+  }
+  next_log_ = Clock::now() + stats_interval_;
+  auto& current = counters_;
+  auto& previous = logged_counters_;
+  bool idle =
+      current.vhci_to_console.packets == previous.vhci_to_console.packets &&
+      current.console_to_vhci.packets == previous.console_to_vhci.packets &&
+      current.vhci_to_console.dropped_packets ==
+          previous.vhci_to_console.dropped_packets &&
+      current.console_to_vhci.dropped_packets ==
+          previous.console_to_vhci.dropped_packets;
+  if (idle) {
+    return;
+  }
+  LogDirection("vhci to virtio-console", current.vhci_to_console,
+               previous.vhci_to_console, stats_interval_);
+  LogDirection("virtio-console to vhci", current.console_to_vhci,
+               previous.console_to_vhci, stats_interval_);
+  previous = current;
+}
+
+}  // namespace cuttlefish
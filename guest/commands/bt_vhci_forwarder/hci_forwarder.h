@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "model/hci/h4_parser.h"
+
+namespace cuttlefish {
+
+/*
+ * Forwards HCI traffic between /dev/vhci and the virtio-console connected to
+ * the host side controller (rootcanal).
+ *
+ * Every wakeup drains all the packets that are ready, up to a limit that keeps
+ * one direction from starving the other. The packets read from vhci are
+ * written to the console with a single writev. vhci takes exactly one packet
+ * per write, so the other direction is only batched on the read side.
+ *
+ * While the host side of the console is away the packets from vhci are held
+ * back, the controller waits for the guest to reset it when it comes back.
+ */
+class HciForwarder {
+ public:
+  struct DirectionCounters {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    // Completed writes, lower than packets when writes are coalesced.
+    uint64_t writes = 0;
+    uint64_t dropped_packets = 0;
+    // Per write, from the read of its oldest packet to its completion.
+    std::chrono::microseconds total_latency{0};
+    std::chrono::microseconds max_latency{0};
+  };
+
+  struct Counters {
+    DirectionCounters vhci_to_console;
+    DirectionCounters console_to_vhci;
+  };
+
+  // Takes ownership of neither descriptor. Counters are logged every
+  // stats_interval while there is traffic, never if it is zero.
+  HciForwarder(int vhci_fd, int console_fd,
+               std::chrono::seconds stats_interval);
+  HciForwarder(const HciForwarder&) = delete;
+  HciForwarder& operator=(const HciForwarder&) = delete;
+  ~HciForwarder();
+
+  // Sets up the descriptors and forwards until vhci is closed or an
+  // unrecoverable error.
+  bool Run();
+
+  const Counters& counters() const { return counters_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct HeldPacket {
+    Clock::time_point read_time;
+    std::vector<uint8_t> data;
+  };
+
+  bool SetUp();
+  bool ForwardFromVhci();
+  void SendToConsole(const struct iovec* packets, int count,
+                     Clock::time_point read_time);
+  void FlushHeldPackets();
+  uint32_t PollConsole();
+  void UpdateConsoleHangUp(uint32_t events);
+  void ForwardFromConsole();
+  void SetConsoleHungUp(bool hung_up);
+  // Sets |*completed| to the number of buffers written in full, also on
+  // failure.
+  bool WriteAll(int fd, struct iovec* iov, int iovcnt,
+                int* completed = nullptr);
+  void SendToVhci(uint8_t type, const std::vector<uint8_t>& packet);
+  void RecordWrite(DirectionCounters& counters, Clock::time_point read_time);
+  void MaybeLogCounters();
+
+  const int vhci_fd_;
+  const int console_fd_;
+  const std::chrono::seconds stats_interval_;
+  int epoll_fd_ = -1;
+  // Whether the host side of the console is gone and the console is only
+  // watched for the event that brings it back.
+  bool console_hung_up_ = false;
+  // Packets from vhci waiting for the host side of the console to come back.
+  std::deque<HeldPacket> held_packets_;
+  // Data left in the console from before a reset is dropped until the first
+  // packet from vhci.
+  bool before_first_command_ = true;
+  rootcanal::H4Parser h4_parser_;
+  Clock::time_point console_read_time_;
+  std::vector<uint8_t> vhci_buffer_;
+  std::vector<uint8_t> console_buffer_;
+  Counters counters_;
+  Counters logged_counters_;
+  Clock::time_point next_log_;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hci_forwarder.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+const Bytes kResetCommand = {0x01, 0x03, 0x0c, 0x00};
+
+// The next |size| bytes from |fd|, fewer if they don't come within a few
+// seconds.
+Bytes ReadBytes(int fd, size_t size) {
+  Bytes data;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (data.size() < size && std::chrono::steady_clock::now() < deadline) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, 100) <= 0) {
+      continue;
+    }
+    uint8_t buf[4096];
+    ssize_t count = read(fd, buf, std::min(sizeof(buf), size - data.size()));
+    if (count <= 0) {
+      break;
+    }
+    data.insert(data.end(), buf, buf + count);
+  }
+  return data;
+}
+
+// The next packet from a SOCK_SEQPACKET socket, empty if none comes within a
+// few seconds.
+Bytes ReadPacket(int fd) {
+  struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+  if (poll(&pfd, 1, 10000) <= 0) {
+    return {};
+  }
+  uint8_t buf[4096];
+  ssize_t count = read(fd, buf, sizeof(buf));
+  return Bytes(buf, buf + std::max<ssize_t>(count, 0));
+}
+
+void Write(int fd, const Bytes& data) {
+  ASSERT_EQ(write(fd, data.data(), data.size()),
+            static_cast<ssize_t>(data.size()));
+}
+
+// The guest's vhci and the host side of the console are played by the ends
+// of socket pairs.
+class HciForwarderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int vhci[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, vhci), 0);
+    vhci_fd_ = vhci[0];
+    vhci_ = vhci[1];
+  }
+
+  void TearDown() override {
+    Stop();
+    for (int fd : {vhci_fd_, vhci_, console_fd_, console_}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  void UseSocketConsole() {
+    int console[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, console), 0);
+    console_fd_ = console[0];
+    console_ = console[1];
+  }
+
+  void Start() {
+    forwarder_ = std::make_unique<HciForwarder>(vhci_fd_, console_fd_,
+                                                std::chrono::seconds(0));
+    runner_ = std::thread([this]() { EXPECT_FALSE(forwarder_->Run()); });
+  }
+
+  // Closing vhci makes the forwarder return, its counters can be checked
+  // after this.
+  void Stop() {
+    if (runner_.joinable()) {
+      close(vhci_);
+      vhci_ = -1;
+      runner_.join();
+    }
+  }
+
+  int vhci_fd_ = -1;
+  int vhci_ = -1;
+  int console_fd_ = -1;
+  int console_ = -1;
+  std::unique_ptr<HciForwarder> forwarder_;
+  std::thread runner_;
+};
+
+TEST_F(HciForwarderTest, WritesReadyPacketsWithOneWrite) {
+  UseSocketConsole();
+  Bytes expected;
+  for (uint8_t i = 0; i < 3; i++) {
+    Bytes packet = {0x01, i, 0x0c, 0x01, i};
+    Write(vhci_, packet);
+    expected.insert(expected.end(), packet.begin(), packet.end());
+  }
+  // Vendor packets are dropped.
+  Write(vhci_, {0xff, 0x01});
+  Start();
+
+  EXPECT_EQ(ReadBytes(console_, expected.size()), expected);
+  Stop();
+  auto& counters = forwarder_->counters().vhci_to_console;
+  EXPECT_EQ(counters.packets, 3);
+  EXPECT_EQ(counters.bytes, expected.size());
+  EXPECT_EQ(counters.writes, 1);
+  EXPECT_EQ(counters.dropped_packets, 0);
+}
+
+TEST_F(HciForwarderTest, CompletesPartialWrites) {
+  UseSocketConsole();
+  int size = 4096;
+  ASSERT_EQ(setsockopt(console_fd_, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)),
+            0);
+  Bytes expected;
+  for (int i = 0; i < 32; i++) {
+    // An ACL packet, much more than the console takes at once all together.
+    Bytes packet(1000, static_cast<uint8_t>(i));
+    packet[0] = 0x02;
+    Write(vhci_, packet);
+    expected.insert(expected.end(), packet.begin(), packet.end());
+  }
+  Start();
+
+  EXPECT_EQ(ReadBytes(console_, expected.size()), expected);
+  Stop();
+  auto& counters = forwarder_->counters().vhci_to_console;
+  EXPECT_EQ(counters.packets, 32);
+  EXPECT_EQ(counters.writes, 1);
+}
+
+TEST_F(HciForwarderTest, ReassemblesPacketsFromTheConsole) {
+  UseSocketConsole();
+  Start();
+  // Data from the console is only forwarded after the first command.
+  Write(vhci_, kResetCommand);
+  ASSERT_EQ(ReadBytes(console_, kResetCommand.size()), kResetCommand);
+
+  Bytes events = {0x04, 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00,
+                  0x04, 0x0f, 0x01, 0x00};
+  Write(console_, Bytes(events.begin(), events.begin() + 2));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  Write(console_, Bytes(events.begin() + 2, events.end()));
+
+  EXPECT_EQ(ReadPacket(vhci_), Bytes(events.begin(), events.begin() + 7));
+  EXPECT_EQ(ReadPacket(vhci_), Bytes(events.begin() + 7, events.end()));
+  Stop();
+  EXPECT_EQ(forwarder_->counters().console_to_vhci.packets, 2);
+}
+
+// A pty reports POLLHUP while its slave is closed, like a virtio-console
+// while the host side is away.
+class HciForwarderHangUpTest : public HciForwarderTest {
+ protected:
+  void SetUp() override {
+    HciForwarderTest::SetUp();
+    console_fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+    ASSERT_GE(console_fd_, 0);
+    ASSERT_EQ(grantpt(console_fd_), 0);
+    ASSERT_EQ(unlockpt(console_fd_), 0);
+    Connect();
+  }
+
+  void Connect() {
+    console_ = open(ptsname(console_fd_), O_RDWR | O_NOCTTY);
+    ASSERT_GE(console_, 0);
+    struct termios attrs;
+    ASSERT_EQ(tcgetattr(console_, &attrs), 0);
+    cfmakeraw(&attrs);
+    ASSERT_EQ(tcsetattr(console_, TCSANOW, &attrs), 0);
+  }
+
+  void HangUp() {
+    close(console_);
+    console_ = -1;
+  }
+};
+
+TEST_F(HciForwarderHangUpTest, HoldsPacketsUntilTheHostComesBack) {
+  Start();
+  Write(vhci_, kResetCommand);
+  ASSERT_EQ(ReadBytes(console_, kResetCommand.size()), kResetCommand);
+
+  HangUp();
+  Bytes held = {0x01, 0x01, 0x10, 0x00};
+  Write(vhci_, held);
+  Connect();
+  // The host waits for the guest's reset, which is what wakes the forwarder.
+  Write(vhci_, kResetCommand);
+  Bytes expected = held;
+  expected.insert(expected.end(), kResetCommand.begin(), kResetCommand.end());
+  EXPECT_EQ(ReadBytes(console_, expected.size()), expected);
+
+  // Data from the host is forwarded again.
+  Bytes event = {0x04, 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00};
+  Write(console_, event);
+  EXPECT_EQ(ReadPacket(vhci_), event);
+  Stop();
+  EXPECT_EQ(forwarder_->counters().vhci_to_console.dropped_packets, 0);
+}
+
+}  // namespace
+}  // namespace cuttlefish
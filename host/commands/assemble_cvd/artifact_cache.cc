@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/assemble_cvd/artifact_cache.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr char kStampExtension[] = ".artifact_key";
+constexpr char kPartialExtension[] = ".partial";
+constexpr char kLockExtension[] = ".lock";
+constexpr size_t kReadChunkSize = 1 << 20;
+
+std::string EntryFile(const std::string& entry_dir, size_t index) {
+  return entry_dir + "/" + std::to_string(index);
+}
+
+// Size and modification time, to notice outputs changed by someone else.
+Result<std::string> OutputVersion(const std::string& path) {
+  struct stat st;
+  CF_EXPECT(stat(path.c_str(), &st) == 0,
+            "stat(\"" << path << "\") failed: " << strerror(errno));
+  return std::to_string(st.st_size) + " " + std::to_string(st.st_mtim.tv_sec) +
+         "." + std::to_string(st.st_mtim.tv_nsec);
+}
+
+// Eviction removes lock files, so a lock only excludes other assemblies while
+// its file is still the one at `path`.
+Result<SharedFD> LockEntry(const std::string& path, int operation) {
+  while (true) {
+    auto lock = SharedFD::Open(path, O_CREAT | O_RDWR, 0666);
+    CF_EXPECT(lock->IsOpen(),
+              "Could not open \"" << path << "\": " << lock->StrError());
+    CF_EXPECT(lock->Flock(operation));
+    struct stat locked;
+    CF_EXPECT(lock->Fstat(&locked) == 0,
+              "fstat(\"" << path << "\") failed: " << lock->StrError());
+    struct stat current;
+    if (stat(path.c_str(), &current) == 0 &&
+        current.st_dev == locked.st_dev && current.st_ino == locked.st_ino) {
+      return lock;
+    }
+  }
+}
+
+uint64_t DirectoryBytes(const std::string& path) {
+  uint64_t total = 0;
+  auto contents = DirectoryContents(path);
+  if (!contents.ok()) {
+    return 0;
+  }
+  for (const auto& name : *contents) {
+    struct stat st;
+    if (name != "." && name != ".." &&
+        stat((path + "/" + name).c_str(), &st) == 0) {
+      total += st.st_blocks * 512;
+    }
+  }
+  return total;
+}
+
+}  // namespace
+
+ArtifactKey::ArtifactKey(const std::string& kind) {
+  SHA256_Init(&context_);
+  AddString(kind);
+}
+
+void ArtifactKey::Update(const void* data, size_t size) {
+  SHA256_Update(&context_, data, size);
+}
+
+void ArtifactKey::AddString(const std::string& value) {
+  // Length prefixed so that consecutive values can't run into each other.
+  uint64_t size = value.size();
+  Update(&size, sizeof(size));
+  Update(value.data(), value.size());
+}
+
+Result<void> ArtifactKey::AddFile(const std::string& path) {
+  auto fd = SharedFD::Open(path, O_RDONLY);
+  CF_EXPECT(fd->IsOpen(), "Could not open \"" << path << "\": "
+                                              << fd->StrError());
+  AddString("file");
+  std::vector<char> buffer(kReadChunkSize);
+  uint64_t total = 0;
+  while (true) {
+    auto read = fd->Read(buffer.data(), buffer.size());
+    CF_EXPECT(read >= 0,
+              "Error reading \"" << path << "\": " << fd->StrError());
+    if (read == 0) {
+      break;
+    }
+    Update(buffer.data(), read);
+    total += read;
+  }
+  Update(&total, sizeof(total));
+  return {};
+}
+
+Result<void> ArtifactKey::AddFileIdentity(const std::string& path) {
+  AddString("identity " + AbsolutePath(path) + " " +
+            CF_EXPECT(OutputVersion(path)));
+  return {};
+}
+
+Result<void> ArtifactKey::AddTool(const std::string& path) {
+  if (!FileExists(path)) {
+    AddString("missing tool " + path);
+    return {};
+  }
+  CF_EXPECT(AddFileIdentity(path));
+  return {};
+}
+
+std::string ArtifactKey::Digest() const {
+  auto context = context_;
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &context);
+  std::stringstream hex;
+  for (auto byte : digest) {
+    hex << android::base::StringPrintf("%02x", byte);
+  }
+  return hex.str();
+}
+
+ArtifactCache::ArtifactCache(std::string directory, uint64_t max_bytes,
+                             bool allow_hard_links)
+    : directory_(std::move(directory)),
+      max_bytes_(max_bytes),
+      allow_hard_links_(allow_hard_links) {}
+
+Result<bool> ArtifactCache::Materialize(
+    const ArtifactKey& key, const std::vector<std::string>& outputs,
+    const std::function<Result<void>()>& build) {
+  CF_EXPECT(!outputs.empty(), "Nothing to cache");
+  if (directory_.empty()) {
+    CF_EXPECT(build());
+    return false;
+  }
+  CF_EXPECT(EnsureDirectoryExists(directory_));
+  const auto digest = key.Digest();
+  const auto entry_dir = directory_ + "/" + digest;
+
+  auto lock = CF_EXPECT(LockEntry(entry_dir + kLockExtension, LOCK_EX));
+
+  if (DirectoryExists(entry_dir)) {
+    // Mark as recently used.
+    utimensat(AT_FDCWD, entry_dir.c_str(), nullptr, 0);
+    if (!CF_EXPECT(OutputsCurrent(digest, outputs))) {
+      for (size_t i = 0; i < outputs.size(); i++) {
+        CF_EXPECT(Place(EntryFile(entry_dir, i), outputs[i]));
+      }
+      CF_EXPECT(WriteStamp(digest, outputs));
+    }
+    LOG(DEBUG) << "Using cached artifacts " << digest << " for "
+               << android::base::Join(outputs, ", ");
+    return true;
+  }
+
+  CF_EXPECT(build());
+
+  const auto partial_dir = entry_dir + kPartialExtension;
+  RecursivelyRemoveDirectory(partial_dir);
+  CF_EXPECT(EnsureDirectoryExists(partial_dir));
+  for (size_t i = 0; i < outputs.size(); i++) {
+    CF_EXPECT(FileExists(outputs[i]),
+              "Build did not produce \"" << outputs[i] << "\"");
+    CF_EXPECT(Place(outputs[i], EntryFile(partial_dir, i)));
+  }
+  CF_EXPECT(RenameFile(partial_dir, entry_dir));
+  CF_EXPECT(WriteStamp(digest, outputs));
+  Evict(entry_dir);
+  return false;
+}
+
+Result<void> ArtifactCache::Place(const std::string& from,
+                                  const std::string& to) const {
+  // Replace atomically, anything still holding the old file keeps it intact.
+  const auto partial = to + kPartialExtension;
+  RemoveFile(partial);
+  if (!allow_hard_links_ || link(from.c_str(), partial.c_str()) < 0) {
+    if (!CloneFile(from, partial).ok()) {
+      CF_EXPECT(Copy(from, partial),
+                "Could not copy \"" << from << "\" to \"" << partial << "\"");
+    }
+  }
+  CF_EXPECT(RenameFile(partial, to));
+  return {};
+}
+
+Result<bool> ArtifactCache::OutputsCurrent(
+    const std::string& digest, const std::vector<std::string>& outputs) const {
+  std::string stamp;
+  if (!android::base::ReadFileToString(outputs[0] + kStampExtension, &stamp)) {
+    return false;
+  }
+  std::string expected = digest + "\n";
+  for (const auto& output : outputs) {
+    struct stat st;
+    if (stat(output.c_str(), &st) != 0) {
+      return false;
+    }
+    // Left behind by an assembly that was allowed to share the cached copy,
+    // but this one may write to it.
+    if (!allow_hard_links_ && st.st_nlink > 1) {
+      return false;
+    }
+    expected += CF_EXPECT(OutputVersion(output)) + "\n";
+  }
+  return stamp == expected;
+}
+
+Result<void> ArtifactCache::WriteStamp(
+    const std::string& digest, const std::vector<std::string>& outputs) const {
+  std::string stamp = digest + "\n";
+  for (const auto& output : outputs) {
+    stamp += CF_EXPECT(OutputVersion(output)) + "\n";
+  }
+  const auto path = outputs[0] + kStampExtension;
+  CF_EXPECT(android::base::WriteStringToFile(stamp, path),
+            "Could not write \"" << path << "\"");
+  return {};
+}
+
+void ArtifactCache::Evict(const std::string& keep) const {
+  auto contents = DirectoryContents(directory_);
+  if (!contents.ok()) {
+    LOG(WARNING) << "Not trimming the artifact cache: "
+                 << contents.error().Message();
+    return;
+  }
+  struct Entry {
+    std::string path;
+    struct timespec last_used;
+    uint64_t bytes;
+  };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  for (const auto& name : *contents) {
+    auto path = directory_ + "/" + name;
+    if (android::base::EndsWith(name, kLockExtension)) {
+      RemoveOrphanLock(path);
+      continue;
+    }
+    struct stat st;
+    if (name == "." || name == ".." || !DirectoryExists(path) ||
+        android::base::EndsWith(name, kPartialExtension) ||
+        stat(path.c_str(), &st) != 0) {
+      continue;
+    }
+    entries.push_back(Entry{path, st.st_mtim, DirectoryBytes(path)});
+    total += entries.back().bytes;
+  }
+  std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+    return std::make_pair(a.last_used.tv_sec, a.last_used.tv_nsec) <
+           std::make_pair(b.last_used.tv_sec, b.last_used.tv_nsec);
+  });
+  for (const auto& entry : entries) {
+    if (total <= max_bytes_) {
+      break;
+    }
+    if (entry.path == keep) {
+      continue;
+    }
+    // Skip entries another assembly is using right now.
+    const auto lock_path = entry.path + kLockExtension;
+    auto lock = LockEntry(lock_path, LOCK_EX | LOCK_NB);
+    if (!lock.ok()) {
+      continue;
+    }
+    LOG(DEBUG) << "Evicting " << entry.path << " from the artifact cache";
+    if (RecursivelyRemoveDirectory(entry.path)) {
+      total -= entry.bytes;
+      RemoveFile(lock_path);
+    }
+  }
+}
+
+void ArtifactCache::RemoveOrphanLock(const std::string& lock_path) const {
+  const auto entry_dir =
+      lock_path.substr(0, lock_path.size() - strlen(kLockExtension));
+  if (DirectoryExists(entry_dir)) {
+    return;
+  }
+  // Held while an entry is being built, before its directory exists.
+  auto lock = LockEntry(lock_path, LOCK_EX | LOCK_NB);
+  if (lock.ok() && !DirectoryExists(entry_dir)) {
+    RemoveFile(lock_path);
+  }
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <openssl/sha.h>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+// Identifies a derived artifact by everything that went into building it.
+class ArtifactKey {
+ public:
+  // `kind` keeps keys for different artifacts apart even when their inputs
+  // are the same.
+  explicit ArtifactKey(const std::string& kind);
+
+  // Hashes the contents of an input file.
+  Result<void> AddFile(const std::string& path);
+  // Cheaper stand-in for inputs too large to hash on every run: the path,
+  // size and modification time.
+  Result<void> AddFileIdentity(const std::string& path);
+  // Identifies the version of a tool used in the build, if it exists.
+  Result<void> AddTool(const std::string& path);
+  void AddString(const std::string& value);
+
+  std::string Digest() const;
+
+ private:
+  void Update(const void* data, size_t size);
+
+  SHA256_CTX context_;
+};
+
+// Host wide store of derived images, so that assembling an instance with the
+// same inputs as an earlier assembly or another instance links the stored
+// images into place instead of building them again.
+//
+// Each key has its own lock file, so concurrent assemblies of the same
+// inputs build the artifacts once while the others wait and then reuse them.
+// Least recently used entries are evicted, along with their lock files, once
+// the cache grows past its size limit.
+class ArtifactCache {
+ public:
+  // An empty `directory` disables caching. Hard links are only used when
+  // nothing writes to the outputs in place, otherwise outputs are reflinked
+  // or copied.
+  ArtifactCache(std::string directory, uint64_t max_bytes,
+                bool allow_hard_links);
+
+  // Makes the files in `outputs` hold the artifacts for `key`, calling
+  // `build` to produce them there only when the cache doesn't have them.
+  // Returns whether the artifacts came from the cache. Outputs already
+  // holding the artifacts for `key` are left alone, so their modification
+  // times don't change.
+  Result<bool> Materialize(const ArtifactKey& key,
+                           const std::vector<std::string>& outputs,
+                           const std::function<Result<void>()>& build);
+
+ private:
+  Result<void> Place(const std::string& from, const std::string& to) const;
+  Result<bool> OutputsCurrent(const std::string& digest,
+                              const std::vector<std::string>& outputs) const;
+  Result<void> WriteStamp(const std::string& digest,
+                          const std::vector<std::string>& outputs) const;
+  void Evict(const std::string& keep) const;
+  void RemoveOrphanLock(const std::string& lock_path) const;
+
+  std::string directory_;
+  uint64_t max_bytes_;
+  bool allow_hard_links_;
+};
+
+// Returns the cache configured by the --artifact_cache_* flags. Caching is
+// off unless --artifact_cache_dir is given.
+ArtifactCache ArtifactCacheFromFlags();
+
+}  // namespace cuttlefish
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/assemble_cvd/artifact_cache.h"
+
+#include <gflags/gflags.h>
+
+DEFINE_string(artifact_cache_dir, "",
+              "Where to keep repacked boot, vendor_dlkm and super images for "
+              "reuse by later assemblies with the same inputs, e.g. "
+              "$TEMP/cuttlefish_artifact_cache. Empty disables the cache.");
+DEFINE_uint64(artifact_cache_size_mb, 20 * 1024,
+              "Size the artifact cache is trimmed down to after adding to it, "
+              "by removing the least recently used entries.");
+DECLARE_bool(use_overlay);
+
+namespace cuttlefish {
+
+ArtifactCache ArtifactCacheFromFlags() {
+  return ArtifactCache(FLAGS_artifact_cache_dir,
+                       FLAGS_artifact_cache_size_mb << 20, FLAGS_use_overlay);
+}
+
+}  // namespace cuttlefish
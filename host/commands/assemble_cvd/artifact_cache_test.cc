@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/files.h"
+#include "host/commands/assemble_cvd/artifact_cache.h"
+
+namespace cuttlefish {
+namespace {
+
+std::string KeyOf(const std::string& kind, const std::string& file) {
+  ArtifactKey key(kind);
+  EXPECT_TRUE(key.AddFile(file).ok());
+  return key.Digest();
+}
+
+}  // namespace
+
+TEST(ArtifactKey, DependsOnKindAndContents) {
+  TemporaryDir dir;
+  const std::string input = std::string(dir.path) + "/input";
+  ASSERT_TRUE(android::base::WriteStringToFile("one", input));
+  const auto digest = KeyOf("boot", input);
+  EXPECT_EQ(KeyOf("boot", input), digest);
+  EXPECT_NE(KeyOf("super", input), digest);
+
+  ASSERT_TRUE(android::base::WriteStringToFile("two", input));
+  EXPECT_NE(KeyOf("boot", input), digest);
+}
+
+TEST(ArtifactKey, StringsDoNotRunTogether) {
+  ArtifactKey first("kind");
+  first.AddString("ab");
+  first.AddString("c");
+  ArtifactKey second("kind");
+  second.AddString("a");
+  second.AddString("bc");
+  EXPECT_NE(first.Digest(), second.Digest());
+}
+
+TEST(ArtifactKey, MissingToolsAreNotAnError) {
+  ArtifactKey key("kind");
+  EXPECT_TRUE(key.AddTool("/nonexistent/tool").ok());
+  EXPECT_FALSE(key.AddFile("/nonexistent/file").ok());
+}
+
+TEST(ArtifactCache, BuildsOnceAndReuses) {
+  TemporaryDir dir;
+  const std::string cache_dir = std::string(dir.path) + "/cache";
+  ArtifactCache cache(cache_dir, 1 << 30, /* allow_hard_links */ false);
+  ArtifactKey key("test");
+  key.AddString("input");
+
+  int builds = 0;
+  auto build_into = [&builds](const std::string& output) {
+    return [&builds, output]() -> Result<void> {
+      builds++;
+      CF_EXPECT(android::base::WriteStringToFile("artifact", output));
+      return {};
+    };
+  };
+  const std::string first = std::string(dir.path) + "/first";
+  auto from_cache = cache.Materialize(key, {first}, build_into(first));
+  ASSERT_TRUE(from_cache.ok()) << from_cache.error().Message();
+  EXPECT_FALSE(*from_cache);
+
+  const std::string second = std::string(dir.path) + "/second";
+  from_cache = cache.Materialize(key, {second}, build_into(second));
+  ASSERT_TRUE(from_cache.ok()) << from_cache.error().Message();
+  EXPECT_TRUE(*from_cache);
+  EXPECT_EQ(builds, 1);
+  EXPECT_EQ(ReadFile(second), "artifact");
+}
+
+TEST(ArtifactCache, EmptyDirectoryDisablesCaching) {
+  TemporaryDir dir;
+  ArtifactCache cache("", 1 << 30, /* allow_hard_links */ false);
+  ArtifactKey key("test");
+  const std::string output = std::string(dir.path) + "/output";
+  int builds = 0;
+  for (int i = 0; i < 2; i++) {
+    auto from_cache =
+        cache.Materialize(key, {output}, [&]() -> Result<void> {
+          builds++;
+          CF_EXPECT(android::base::WriteStringToFile("artifact", output));
+          return {};
+        });
+    ASSERT_TRUE(from_cache.ok()) << from_cache.error().Message();
+    EXPECT_FALSE(*from_cache);
+  }
+  EXPECT_EQ(builds, 2);
+}
+
+TEST(ArtifactCache, EvictsEntriesAndTheirLocks) {
+  TemporaryDir dir;
+  const std::string cache_dir = std::string(dir.path) + "/cache";
+  // Nothing but the newest entry fits.
+  ArtifactCache cache(cache_dir, 0, /* allow_hard_links */ false);
+  ASSERT_TRUE(EnsureDirectoryExists(cache_dir).ok());
+  // Left behind by an assembly that failed to build its artifacts.
+  const std::string orphan_lock = cache_dir + "/orphan.lock";
+  ASSERT_TRUE(android::base::WriteStringToFile("", orphan_lock));
+
+  std::string digests[2];
+  for (int i = 0; i < 2; i++) {
+    ArtifactKey key("test");
+    key.AddString(std::to_string(i));
+    digests[i] = key.Digest();
+    const std::string output =
+        std::string(dir.path) + "/output" + std::to_string(i);
+    auto from_cache =
+        cache.Materialize(key, {output}, [&]() -> Result<void> {
+          CF_EXPECT(android::base::WriteStringToFile("artifact", output));
+          return {};
+        });
+    ASSERT_TRUE(from_cache.ok()) << from_cache.error().Message();
+  }
+  EXPECT_FALSE(DirectoryExists(cache_dir + "/" + digests[0]));
+  EXPECT_FALSE(FileExists(cache_dir + "/" + digests[0] + ".lock"));
+  EXPECT_TRUE(DirectoryExists(cache_dir + "/" + digests[1]));
+  EXPECT_FALSE(FileExists(orphan_lock));
+}
+
+}  // namespace cuttlefish
@@ -206,6 +206,8 @@ Result<const CuttlefishConfig*> InitFilesystemAndCreateConfig(
     int modem_simulator_count = 0;
 
     std::set<std::string> preserving;
+    // Metrics events that weren't uploaded yet don't depend on the disks.
+    preserving.insert("metrics_spool");
     bool creating_os_disk = false;
     // if any device needs to rebuild its composite disk,
     // then don't preserve any files and delete everything.
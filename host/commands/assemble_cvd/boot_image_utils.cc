@@ -24,17 +24,16 @@
 #include <regex>
 #include <sstream>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 
 #include "common/libs/utils/files.h"
 #include "common/libs/utils/result.h"
 #include "common/libs/utils/subprocess.h"
+#include "host/commands/assemble_cvd/ramdisk_pipeline.h"
 
 const char TMP_EXTENSION[] = ".tmp";
-const char CPIO_EXT[] = ".cpio";
-const char TMP_RD_DIR[] = "stripped_ramdisk_dir";
-const char STRIPPED_RD[] = "stripped_ramdisk";
 const char CONCATENATED_VENDOR_RAMDISK[] = "concatenated_vendor_ramdisk";
 namespace cuttlefish {
 namespace {
@@ -75,70 +74,76 @@ bool DeleteTmpFileIfNotChanged(const std::string& tmp_file, const std::string& c
 
 void RepackVendorRamdisk(const std::string& kernel_modules_ramdisk_path,
                          const std::string& original_ramdisk_path,
-                         const std::string& new_ramdisk_path,
-                         const std::string& build_dir) {
-  int success = 0;
-  const std::string ramdisk_stage_dir = build_dir + "/" + TMP_RD_DIR;
-  UnpackRamdisk(original_ramdisk_path, ramdisk_stage_dir);
-
-  success = execute({"rm", "-rf", ramdisk_stage_dir + "/lib/modules"});
-  CHECK(success == 0) << "Could not rmdir \"lib/modules\" in TMP_RD_DIR. "
-                      << "Exited with status " << success;
-
-  const std::string stripped_ramdisk_path = build_dir + "/" + STRIPPED_RD;
-  success = execute({"/bin/bash", "-c",
-                     HostBinaryPath("mkbootfs") + " " + ramdisk_stage_dir +
-                         " > " + stripped_ramdisk_path + CPIO_EXT});
-  CHECK(success == 0) << "Unable to run cd or cpio. Exited with status "
-                      << success;
-
-  success = execute({"/bin/bash", "-c", HostBinaryPath("lz4") +
-                     " -c -l -12 --favor-decSpeed " + stripped_ramdisk_path + CPIO_EXT + " > " +
-                     stripped_ramdisk_path});
-  CHECK(success == 0) << "Unable to run lz4. Exited with status " << success;
-
-  // Concatenates the stripped ramdisk and input ramdisk and places the result at new_ramdisk_path
-  std::ofstream final_rd(new_ramdisk_path, std::ios_base::binary | std::ios_base::trunc);
-  std::ifstream ramdisk_a(stripped_ramdisk_path, std::ios_base::binary);
-  std::ifstream ramdisk_b(kernel_modules_ramdisk_path, std::ios_base::binary);
-  final_rd << ramdisk_a.rdbuf() << ramdisk_b.rdbuf();
+                         const std::string& new_ramdisk_path) {
+  StageTimer timer("Vendor ramdisk repack");
+  auto original_ramdisk = ReadFile(original_ramdisk_path);
+  auto kernel_modules_ramdisk = ReadFile(kernel_modules_ramdisk_path);
+  timer.Stage("read");
+  auto cpio = Lz4LegacyDecompress(original_ramdisk);
+  CHECK(cpio.ok()) << "Unable to decompress \"" << original_ramdisk_path
+                   << "\": " << cpio.error().Message();
+  timer.Stage("lz4 decompress");
+  auto archive = CpioArchive::Parse(*cpio);
+  CHECK(archive.ok()) << "Unable to parse \"" << original_ramdisk_path
+                      << "\": " << archive.error().Message();
+  timer.Stage("cpio parse");
+  archive->RemoveTree("lib/modules");
+  auto stripped_cpio = archive->Serialize();
+  timer.Stage("cpio write");
+  auto stripped_ramdisk = Lz4LegacyCompress(stripped_cpio);
+  CHECK(stripped_ramdisk.ok()) << stripped_ramdisk.error().Message();
+  timer.Stage("lz4 compress");
+
+  // The kernel modules ramdisk goes after the stripped one, so its modules
+  // win when the kernel unpacks them.
+  CHECK(android::base::WriteStringToFile(
+      *stripped_ramdisk + kernel_modules_ramdisk, new_ramdisk_path))
+      << "Unable to write \"" << new_ramdisk_path << "\"";
+  timer.Stage("write");
 }
 
 }  // namespace
 
 void PackRamdisk(const std::string& ramdisk_stage_dir,
                  const std::string& output_ramdisk) {
-  int success = execute({"/bin/bash", "-c",
-                         HostBinaryPath("mkbootfs") + " " + ramdisk_stage_dir +
-                             " > " + output_ramdisk + CPIO_EXT});
-  CHECK(success == 0) << "Unable to run cd or cpio. Exited with status "
-                      << success;
-
-  success = execute({"/bin/bash", "-c",
-                     HostBinaryPath("lz4") + " -c -l -12 --favor-decSpeed " +
-                         output_ramdisk + CPIO_EXT + " > " + output_ramdisk});
-  CHECK(success == 0) << "Unable to run lz4. Exited with status " << success;
+  StageTimer timer("Ramdisk pack");
+  // mkbootfs applies the Android filesystem config to the staged files.
+  Command mkbootfs(HostBinaryPath("mkbootfs"));
+  mkbootfs.AddParameter(ramdisk_stage_dir);
+  std::string cpio;
+  std::string error;
+  int success =
+      RunWithManagedStdio(std::move(mkbootfs), nullptr, &cpio, &error);
+  CHECK(success == 0) << "Unable to run mkbootfs. Exited with status "
+                      << success << ": " << error;
+  timer.Stage("mkbootfs");
+
+  auto ramdisk = Lz4LegacyCompress(cpio);
+  CHECK(ramdisk.ok()) << ramdisk.error().Message();
+  timer.Stage("lz4 compress");
+  CHECK(android::base::WriteStringToFile(*ramdisk, output_ramdisk))
+      << "Unable to write \"" << output_ramdisk << "\"";
+  timer.Stage("write");
 }
 
 void UnpackRamdisk(const std::string& original_ramdisk_path,
                    const std::string& ramdisk_stage_dir) {
-  int success =
-      execute({"/bin/bash", "-c",
-               HostBinaryPath("lz4") + " -c -d -l " + original_ramdisk_path +
-                   " > " + original_ramdisk_path + CPIO_EXT});
-  CHECK(success == 0) << "Unable to run lz4. Exited with status " << success;
-  const auto ret = EnsureDirectoryExists(ramdisk_stage_dir);
-  CHECK(ret.ok()) << ret.error().Message();
-
-  success = execute(
-      {"/bin/bash", "-c",
-       "(cd " + ramdisk_stage_dir + " && while " + HostBinaryPath("toybox") +
-           " cpio -idu; do :; done) < " + original_ramdisk_path + CPIO_EXT});
-  CHECK(success == 0) << "Unable to run cd or cpio. Exited with status "
-                      << success;
+  StageTimer timer("Ramdisk unpack");
+  auto ramdisk = ReadFile(original_ramdisk_path);
+  timer.Stage("read");
+  auto cpio = Lz4LegacyDecompress(ramdisk);
+  CHECK(cpio.ok()) << "Unable to decompress \"" << original_ramdisk_path
+                   << "\": " << cpio.error().Message();
+  timer.Stage("lz4 decompress");
+  auto archive = CpioArchive::Parse(*cpio);
+  CHECK(archive.ok()) << "Unable to parse \"" << original_ramdisk_path
+                      << "\": " << archive.error().Message();
+  timer.Stage("cpio parse");
+  auto extracted = archive->ExtractTo(ramdisk_stage_dir);
+  CHECK(extracted.ok()) << extracted.error().Message();
+  timer.Stage("extract");
 }
 
-
 bool UnpackBootImage(const std::string& boot_image_path,
                      const std::string& unpack_dir) {
   auto unpack_path = HostBinaryPath("unpack_bootimg");
@@ -217,13 +222,27 @@ bool RepackBootImage(const std::string& new_kernel_path,
                      const std::string& boot_image_path,
                      const std::string& new_boot_image_path,
                      const std::string& build_dir) {
-  if (UnpackBootImage(boot_image_path, build_dir) == false) {
-    return false;
+  StageTimer timer("Boot image repack");
+  std::string kernel_cmdline;
+  auto contents = ParseBootImage(ReadFile(boot_image_path));
+  if (contents.ok()) {
+    kernel_cmdline = contents->cmdline;
+    if (!android::base::WriteStringToFile(contents->ramdisk,
+                                          build_dir + "/ramdisk")) {
+      PLOG(ERROR) << "Unable to write the ramdisk to " << build_dir;
+      return false;
+    }
+  } else {
+    LOG(DEBUG) << "Falling back to unpack_bootimg: "
+               << contents.error().Message();
+    if (UnpackBootImage(boot_image_path, build_dir) == false) {
+      return false;
+    }
+    std::string boot_params = ReadFile(build_dir + "/boot_params");
+    kernel_cmdline = ExtractValue(boot_params, "command line args: ");
   }
-
-  std::string boot_params = ReadFile(build_dir + "/boot_params");
-  auto kernel_cmdline = ExtractValue(boot_params, "command line args: ");
   LOG(DEBUG) << "Cmdline from boot image is " << kernel_cmdline;
+  timer.Stage("unpack");
 
   auto tmp_boot_image_path = new_boot_image_path + TMP_EXTENSION;
   auto repack_path = HostBinaryPath("mkbootimg");
@@ -243,6 +262,7 @@ bool RepackBootImage(const std::string& new_kernel_path,
     LOG(ERROR) << "Unable to run mkbootimg. Exited with status " << success;
     return false;
   }
+  timer.Stage("mkbootimg");
 
   auto avbtool_path = HostBinaryPath("avbtool");
   Command avb_cmd(avbtool_path);
@@ -258,6 +278,7 @@ bool RepackBootImage(const std::string& new_kernel_path,
     LOG(ERROR) << "Unable to run avbtool. Exited with status " << success;
     return false;
   }
+  timer.Stage("avbtool");
 
   return DeleteTmpFileIfNotChanged(tmp_boot_image_path, new_boot_image_path);
 }
@@ -278,7 +299,7 @@ bool RepackVendorBootImage(const std::string& new_ramdisk,
     if (!FileExists(ramdisk_path)) {
       RepackVendorRamdisk(new_ramdisk,
                           unpack_dir + "/" + CONCATENATED_VENDOR_RAMDISK,
-                          ramdisk_path, unpack_dir);
+                          ramdisk_path);
     }
   } else {
     ramdisk_path = unpack_dir + "/" + CONCATENATED_VENDOR_RAMDISK;
@@ -372,7 +393,7 @@ void RepackGem5BootImage(const std::string& initrd_path,
   if (FileExists(input_ramdisk_path) && !FileExists(new_ramdisk_path)) {
     RepackVendorRamdisk(input_ramdisk_path,
                         unpack_dir + "/" + CONCATENATED_VENDOR_RAMDISK,
-                        new_ramdisk_path, unpack_dir);
+                        new_ramdisk_path);
   }
   std::ifstream vendor_boot_ramdisk(FileExists(new_ramdisk_path) ? new_ramdisk_path : unpack_dir +
                                     "/concatenated_vendor_ramdisk",
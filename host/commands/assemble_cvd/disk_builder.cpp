@@ -73,15 +73,6 @@ DiskBuilder DiskBuilder::FooterPath(std::string footer_path) && {
   return *this;
 }
 
-DiskBuilder& DiskBuilder::CrosvmPath(std::string crosvm_path) & {
-  crosvm_path_ = std::move(crosvm_path);
-  return *this;
-}
-DiskBuilder DiskBuilder::CrosvmPath(std::string crosvm_path) && {
-  crosvm_path_ = std::move(crosvm_path);
-  return *this;
-}
-
 DiskBuilder& DiskBuilder::VmManager(std::string vm_manager) & {
   vm_manager_ = std::move(vm_manager);
   return *this;
@@ -212,8 +203,7 @@ Result<bool> DiskBuilder::BuildOverlayIfNecessary() {
     return false;
   }
 
-  CF_EXPECT(!crosvm_path_.empty(), "crosvm binary missing");
-  CreateQcowOverlay(crosvm_path_, composite_disk_path_, overlay_path_);
+  CF_EXPECT(CreateQcowOverlay(composite_disk_path_, overlay_path_));
 
   return true;
 }
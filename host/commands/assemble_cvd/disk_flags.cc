@@ -16,13 +16,16 @@
 
 #include "host/commands/assemble_cvd/disk_flags.h"
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parsebool.h>
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
 #include <fruit/fruit.h>
 #include <gflags/gflags.h>
+#include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <unistd.h>
 
 #include <fstream>
 
@@ -30,10 +33,12 @@
 #include "common/libs/utils/files.h"
 #include "common/libs/utils/size_utils.h"
 #include "common/libs/utils/subprocess.h"
+#include "host/commands/assemble_cvd/artifact_cache.h"
 #include "host/commands/assemble_cvd/boot_config.h"
 #include "host/commands/assemble_cvd/boot_image_utils.h"
 #include "host/commands/assemble_cvd/disk_builder.h"
 #include "host/commands/assemble_cvd/flags_defaults.h"
+#include "host/commands/assemble_cvd/parallel_setup.h"
 #include "host/commands/assemble_cvd/super_image_mixer.h"
 #include "host/commands/assemble_cvd/vendor_dlkm_utils.h"
 #include "host/libs/config/bootconfig_args.h"
@@ -109,6 +114,10 @@ DEFINE_string(
     blank_sdcard_image_mb, CF_DEFAULTS_BLANK_SDCARD_IMAGE_MB,
     "If enabled, the size of the blank sdcard image to generate, MB.");
 
+DEFINE_uint32(disk_setup_jobs, CF_DEFAULTS_DISK_SETUP_JOBS,
+              "How many instances to set up the disks of at once. 0 uses one "
+              "per CPU core.");
+
 DECLARE_string(ap_rootfs_image);
 DECLARE_string(bootloader);
 DECLARE_string(initramfs_path);
@@ -384,7 +393,6 @@ DiskBuilder OsCompositeDiskBuilder(const CuttlefishConfig& config,
   return DiskBuilder()
       .Partitions(GetOsCompositeDiskConfig(instance))
       .VmManager(config.vm_manager())
-      .CrosvmPath(instance.crosvm_binary())
       .ConfigPath(instance.PerInstancePath("os_composite_disk_config.txt"))
       .HeaderPath(instance.PerInstancePath("os_composite_gpt_header.img"))
       .FooterPath(instance.PerInstancePath("os_composite_gpt_footer.img"))
@@ -397,7 +405,6 @@ DiskBuilder ApCompositeDiskBuilder(const CuttlefishConfig& config,
   return DiskBuilder()
       .Partitions(GetApCompositeDiskConfig(config, instance))
       .VmManager(config.vm_manager())
-      .CrosvmPath(instance.crosvm_binary())
       .ConfigPath(instance.PerInstancePath("ap_composite_disk_config.txt"))
       .HeaderPath(instance.PerInstancePath("ap_composite_gpt_header.img"))
       .FooterPath(instance.PerInstancePath("ap_composite_gpt_footer.img"))
@@ -467,6 +474,42 @@ static uint64_t AvailableSpaceAtPath(const std::string& path) {
   return static_cast<uint64_t>(vfs.f_frsize) * vfs.f_bavail;
 }
 
+static std::string RepackedVendorDlkmPath(
+    const CuttlefishConfig::InstanceSpecific& instance) {
+  return instance.instance_dir() + "/superimg/vendor_dlkm_repacked.img";
+}
+
+// Digest of an image's contents, stored next to it along with the size and
+// modification time it was computed for, so each version of the image is
+// only read once no matter how many instances compare against it.
+static Result<std::string> ImageDigest(const std::string& path) {
+  struct stat st;
+  CF_EXPECT(stat(path.c_str(), &st) == 0,
+            "stat(\"" << path << "\") failed: " << strerror(errno));
+  const auto version = std::to_string(st.st_size) + " " +
+                       std::to_string(st.st_mtim.tv_sec) + "." +
+                       std::to_string(st.st_mtim.tv_nsec);
+  const auto digest_path = path + ".sha256";
+  std::string stored;
+  if (android::base::ReadFileToString(digest_path, &stored)) {
+    auto lines = android::base::Split(stored, "\n");
+    if (lines.size() == 2 && lines[0] == version) {
+      return lines[1];
+    }
+  }
+  ArtifactKey key("image");
+  CF_EXPECT(key.AddFile(path));
+  auto digest = key.Digest();
+  if (!android::base::WriteStringToFile(version + "\n" + digest,
+                                        digest_path)) {
+    PLOG(WARNING) << "Failed to write " << digest_path;
+  }
+  return digest;
+}
+
+// Writes the repacked images to the new_*_image() paths already in the
+// config. It runs while other instances are being set up, so it must not
+// change any flags.
 class KernelRamdiskRepacker : public SetupFeature {
  public:
   INJECT(
@@ -485,11 +528,39 @@ class KernelRamdiskRepacker : public SetupFeature {
   }
 
  protected:
-  bool RepackVendorDLKM(const std::string& superimg_build_dir,
-                        const std::string& vendor_dlkm_build_dir,
-                        const std::string& ramdisk_path) {
-    const auto new_vendor_dlkm_img =
-        superimg_build_dir + "/vendor_dlkm_repacked.img";
+  // Leaves the ramdisk without its modules at `ramdisk_path`, and the
+  // vendor_dlkm, super and vbmeta_vendor_dlkm images holding them.
+  Result<void> RepackVendorDLKM(const std::string& vendor_dlkm_build_dir,
+                                const std::string& ramdisk_path) {
+    ArtifactKey key("vendor_dlkm");
+    CF_EXPECT(key.AddFile(instance_.initramfs_path()));
+    CF_EXPECT(key.AddFileIdentity(instance_.super_image()));
+    for (const auto& tool : {"sefcontext_compile", "mkuserimg_mke2fs", "lpadd",
+                             "avbtool"}) {
+      CF_EXPECT(key.AddTool(HostBinaryPath(tool)));
+    }
+    CF_EXPECT(
+        key.AddTool(DefaultHostArtifactsPath("etc/cvd_avb_testkey.pem")));
+    const std::vector<std::string> outputs = {
+        ramdisk_path,
+        RepackedVendorDlkmPath(instance_),
+        instance_.new_super_image(),
+        instance_.new_vbmeta_vendor_dlkm_image(),
+    };
+    CF_EXPECT(ArtifactCacheFromFlags().Materialize(
+        key, outputs, [&, this]() -> Result<void> {
+          CF_EXPECT(Copy(instance_.initramfs_path(), ramdisk_path),
+                    "Failed to copy " << instance_.initramfs_path() << " to "
+                                      << ramdisk_path);
+          CF_EXPECT(BuildVendorDLKMImages(vendor_dlkm_build_dir, ramdisk_path),
+                    "Failed to repack the vendor_dlkm partition");
+          return {};
+        }));
+    return {};
+  }
+  bool BuildVendorDLKMImages(const std::string& vendor_dlkm_build_dir,
+                             const std::string& ramdisk_path) {
+    const auto new_vendor_dlkm_img = RepackedVendorDlkmPath(instance_);
     const auto tmp_vendor_dlkm_img = new_vendor_dlkm_img + ".tmp";
     if (!EnsureDirectoryExists(vendor_dlkm_build_dir).ok()) {
       LOG(ERROR) << "Failed to create directory " << vendor_dlkm_build_dir;
@@ -516,28 +587,105 @@ class KernelRamdiskRepacker : public SetupFeature {
       return false;
     }
     const auto new_super_img = instance_.new_super_image();
-    if (!Copy(instance_.super_image(), new_super_img)) {
-      PLOG(ERROR) << "Failed to copy super image " << instance_.super_image()
-                  << " to " << new_super_img;
-      return false;
-    }
-    if (!RepackSuperWithVendorDLKM(new_super_img, new_vendor_dlkm_img)) {
-      LOG(ERROR) << "Failed to repack super image with new vendor dlkm image.";
-      return false;
+    // The old file may be a link shared with another instance, never write
+    // through it.
+    RemoveFile(new_super_img);
+    if (!ShareRepackedSuperImage(new_vendor_dlkm_img, new_super_img)) {
+      if (!CopySuperImage(instance_.super_image(), new_super_img)) {
+        return false;
+      }
+      if (!RepackSuperWithVendorDLKM(new_super_img, new_vendor_dlkm_img)) {
+        LOG(ERROR)
+            << "Failed to repack super image with new vendor dlkm image.";
+        return false;
+      }
     }
     if (!RebuildVbmetaVendor(new_vendor_dlkm_img,
                              instance_.new_vbmeta_vendor_dlkm_image())) {
       LOG(ERROR) << "Failed to rebuild vbmeta vendor.";
       return false;
     }
-    SetCommandLineOptionWithMode("super_image", new_super_img.c_str(),
-                                 google::FlagSettingMode::SET_FLAGS_DEFAULT);
-    SetCommandLineOptionWithMode(
-        "vbmeta_vendor_dlkm_image",
-        instance_.new_vbmeta_vendor_dlkm_image().c_str(),
-        google::FlagSettingMode::SET_FLAGS_DEFAULT);
     return true;
   }
+  Result<void> RepackBootImageCached(const std::string& new_boot_image_path) {
+    ArtifactKey key("boot");
+    CF_EXPECT(key.AddFile(instance_.kernel_path()));
+    CF_EXPECT(key.AddFile(instance_.boot_image()));
+    CF_EXPECT(key.AddTool(HostBinaryPath("mkbootimg")));
+    CF_EXPECT(key.AddTool(HostBinaryPath("avbtool")));
+    CF_EXPECT(ArtifactCacheFromFlags().Materialize(
+        key, {new_boot_image_path}, [&, this]() -> Result<void> {
+          CF_EXPECT(RepackBootImage(instance_.kernel_path(),
+                                    instance_.boot_image(),
+                                    new_boot_image_path,
+                                    instance_.instance_dir()));
+          return {};
+        }));
+    return {};
+  }
+  // With overlays the VM never writes to the super image, so instances that
+  // repacked the same base super image with identical vendor_dlkm contents
+  // can all use the copy made by the first of them.
+  bool ShareRepackedSuperImage(const std::string& vendor_dlkm_img,
+                               const std::string& new_super_img) {
+    if (!FLAGS_use_overlay) {
+      return false;
+    }
+    const auto vendor_dlkm_size = FileSize(vendor_dlkm_img);
+    std::string vendor_dlkm_digest;
+    // Instances are assembled in order, only the earlier ones are done.
+    for (const auto& other : config_.Instances()) {
+      if (other.id() == instance_.id()) {
+        break;
+      }
+      const auto other_vendor_dlkm_img = RepackedVendorDlkmPath(other);
+      if (other.super_image() != instance_.super_image() ||
+          !FileExists(other.new_super_image()) ||
+          FileSize(other_vendor_dlkm_img) != vendor_dlkm_size) {
+        continue;
+      }
+      if (vendor_dlkm_digest.empty()) {
+        auto digest = ImageDigest(vendor_dlkm_img);
+        if (!digest.ok()) {
+          LOG(WARNING) << digest.error().Message();
+          return false;
+        }
+        vendor_dlkm_digest = *digest;
+      }
+      auto other_digest = ImageDigest(other_vendor_dlkm_img);
+      if (!other_digest.ok() || *other_digest != vendor_dlkm_digest) {
+        continue;
+      }
+      if (link(other.new_super_image().c_str(), new_super_img.c_str()) < 0) {
+        PLOG(WARNING) << "Failed to link " << other.new_super_image()
+                      << " to " << new_super_img;
+        return false;
+      }
+      LOG(DEBUG) << "Sharing the repacked super image of instance "
+                 << other.id();
+      return true;
+    }
+    return false;
+  }
+
+  // Prefers a reflink, after which only the blocks lpadd rewrites take up
+  // space of their own.
+  bool CopySuperImage(const std::string& super_img,
+                      const std::string& new_super_img) {
+    auto cloned = CloneFile(super_img, new_super_img);
+    if (cloned.ok()) {
+      return true;
+    }
+    LOG(DEBUG) << "Falling back to a full copy of the super image: "
+               << cloned.error().Message();
+    if (!Copy(super_img, new_super_img)) {
+      PLOG(ERROR) << "Failed to copy super image " << super_img << " to "
+                  << new_super_img;
+      return false;
+    }
+    return true;
+  }
+
   bool Setup() override {
     if (!FileHasContent(instance_.boot_image())) {
       LOG(ERROR) << "File not found: " << instance_.boot_image();
@@ -562,15 +710,12 @@ class KernelRamdiskRepacker : public SetupFeature {
     if (instance_.kernel_path().size() &&
         config_.vm_manager() != Gem5Manager::name()) {
       const std::string new_boot_image_path = instance_.new_boot_image();
-      bool success =
-          RepackBootImage(instance_.kernel_path(), instance_.boot_image(),
-                          new_boot_image_path, instance_.instance_dir());
-      if (!success) {
-        LOG(ERROR) << "Failed to regenerate the boot image with the new kernel";
+      auto repacked = RepackBootImageCached(new_boot_image_path);
+      if (!repacked.ok()) {
+        LOG(ERROR) << "Failed to regenerate the boot image with the new "
+                   << "kernel: " << repacked.error().Message();
         return false;
       }
-      SetCommandLineOptionWithMode("boot_image", new_boot_image_path.c_str(),
-                                   google::FlagSettingMode::SET_FLAGS_DEFAULT);
     }
 
     if (instance_.kernel_path().size() || instance_.initramfs_path().size()) {
@@ -581,14 +726,11 @@ class KernelRamdiskRepacker : public SetupFeature {
         const auto superimg_build_dir = instance_.instance_dir() + "/superimg";
         const auto ramdisk_repacked =
             instance_.instance_dir() + "/ramdisk_repacked";
-        if (!Copy(instance_.initramfs_path(), ramdisk_repacked)) {
-          LOG(ERROR) << "Failed to copy " << instance_.initramfs_path()
-                     << " to " << ramdisk_repacked;
-          return false;
-        }
         const auto vendor_dlkm_build_dir = superimg_build_dir + "/vendor_dlkm";
-        if (!RepackVendorDLKM(superimg_build_dir, vendor_dlkm_build_dir,
-                              ramdisk_repacked)) {
+        auto repacked = RepackVendorDLKM(vendor_dlkm_build_dir,
+                                         ramdisk_repacked);
+        if (!repacked.ok()) {
+          LOG(ERROR) << repacked.error().Message();
           return false;
         }
         bool success = RepackVendorBootImage(
@@ -611,9 +753,6 @@ class KernelRamdiskRepacker : public SetupFeature {
             return false;
           }
         }
-        SetCommandLineOptionWithMode(
-            "vendor_boot_image", new_vendor_boot_image_path.c_str(),
-            google::FlagSettingMode::SET_FLAGS_DEFAULT);
       }
     }
     return true;
@@ -1010,8 +1149,10 @@ class InitializeSdCard : public SetupFeature {
     if (FileExists(instance_.sdcard_path())) {
       return {};
     }
-    CF_EXPECT(CreateBlankImage(instance_.sdcard_path(),
-                               instance_.blank_sdcard_image_mb(), "sdcard"),
+    // The template is cloned again by powerwash.
+    CF_EXPECT(CreateBlankImageFromTemplate(
+                  instance_.sdcard_path(), instance_.blank_sdcard_image_mb(),
+                  "sdcard", instance_.instance_internal_dir()),
               "Failed to create \"" << instance_.sdcard_path() << "\"");
     return {};
   }
@@ -1076,7 +1217,6 @@ class InitializeInstanceCompositeDisk : public SetupFeature {
         DiskBuilder()
             .Partitions(persistent_composite_disk_config(instance_))
             .VmManager(config_.vm_manager())
-            .CrosvmPath(instance_.crosvm_binary())
             .ConfigPath(ipath("persistent_composite_disk_config.txt"))
             .HeaderPath(ipath("persistent_composite_gpt_header.img"))
             .FooterPath(ipath("persistent_composite_gpt_footer.img"))
@@ -1089,7 +1229,6 @@ class InitializeInstanceCompositeDisk : public SetupFeature {
         DiskBuilder()
             .Partitions(persistent_ap_composite_disk_config(instance_))
             .VmManager(config_.vm_manager())
-            .CrosvmPath(instance_.crosvm_binary())
             .ConfigPath(ipath("ap_persistent_composite_disk_config.txt"))
             .HeaderPath(ipath("ap_persistent_composite_gpt_header.img"))
             .FooterPath(ipath("ap_persistent_composite_gpt_footer.img"))
@@ -1464,9 +1603,18 @@ Result<void> DiskImageFlagsVectorization(CuttlefishConfig& config, const Fetcher
   return {};
 }
 
-Result<void> CreateDynamicDiskFiles(const FetcherConfig& fetcher_config,
-                                    const CuttlefishConfig& config) {
-  for (const auto& instance : config.Instances()) {
+static Result<void> CreateInstanceDiskFiles(
+    const FetcherConfig& fetcher_config, const CuttlefishConfig& config,
+    const CuttlefishConfig::InstanceSpecific& instance,
+    ParallelSetup::Job& job) {
+  auto step = [&job](const std::string& name,
+                     const std::function<Result<void>()>& setup) {
+    return job.Step(name, setup);
+  };
+  // These work on files shared between instances, like the unpacked vendor
+  // boot image in the assembly directory, and expect the earlier instances
+  // to be done with them.
+  CF_EXPECT(job.Serially([&]() -> Result<void> {
     // TODO(schuffelen): Unify this with the other injector created in
     // assemble_cvd.cpp
     fruit::Injector<> injector(DiskChangesComponent, &fetcher_config, &config,
@@ -1476,75 +1624,113 @@ Result<void> CreateDynamicDiskFiles(const FetcherConfig& fetcher_config,
     }
 
     const auto& features = injector.getMultibindings<SetupFeature>();
-    CF_EXPECT(SetupFeature::RunSetup(features));
-    fruit::Injector<> instance_injector(DiskChangesPerInstanceComponent,
-                                        &fetcher_config, &config, &instance);
-    for (auto& late_injected :
-         instance_injector.getMultibindings<LateInjected>()) {
-      CF_EXPECT(late_injected->LateInject(instance_injector));
-    }
-
-    const auto& instance_features =
-        instance_injector.getMultibindings<SetupFeature>();
-    CF_EXPECT(SetupFeature::RunSetup(instance_features),
-              "instance = \"" << instance.instance_name() << "\"");
-
-    // Check if filling in the sparse image would run out of disk space.
-    auto existing_sizes = SparseFileSizes(instance.data_image());
-    CF_EXPECT(existing_sizes.sparse_size > 0 || existing_sizes.disk_size > 0,
-              "Unable to determine size of \"" << instance.data_image()
-                                               << "\". Does this file exist?");
-    auto available_space = AvailableSpaceAtPath(instance.data_image());
-    if (available_space <
-        existing_sizes.sparse_size - existing_sizes.disk_size) {
-      // TODO(schuffelen): Duplicate this check in run_cvd when it can run on a
-      // separate machine
-      return CF_ERR("Not enough space remaining in fs containing \""
-                    << instance.data_image() << "\", wanted "
-                    << (existing_sizes.sparse_size - existing_sizes.disk_size)
-                    << ", got " << available_space);
-    } else {
-      LOG(DEBUG) << "Available space: " << available_space;
-      LOG(DEBUG) << "Sparse size of \"" << instance.data_image()
-                 << "\": " << existing_sizes.sparse_size;
-      LOG(DEBUG) << "Disk size of \"" << instance.data_image()
-                 << "\": " << existing_sizes.disk_size;
-    }
+    CF_EXPECT(SetupFeature::RunSetup(features, step));
+    return {};
+  }));
+  fruit::Injector<> instance_injector(DiskChangesPerInstanceComponent,
+                                      &fetcher_config, &config, &instance);
+  for (auto& late_injected :
+       instance_injector.getMultibindings<LateInjected>()) {
+    CF_EXPECT(late_injected->LateInject(instance_injector));
+  }
 
-    auto os_disk_builder = OsCompositeDiskBuilder(config, instance);
-    const auto os_built_composite = CF_EXPECT(os_disk_builder.BuildCompositeDiskIfNecessary());
+  const auto& instance_features =
+      instance_injector.getMultibindings<SetupFeature>();
+  CF_EXPECT(SetupFeature::RunSetup(instance_features, step),
+            "instance = \"" << instance.instance_name() << "\"");
+
+  // Check if filling in the sparse image would run out of disk space.
+  auto existing_sizes = SparseFileSizes(instance.data_image());
+  CF_EXPECT(existing_sizes.sparse_size > 0 || existing_sizes.disk_size > 0,
+            "Unable to determine size of \"" << instance.data_image()
+                                             << "\". Does this file exist?");
+  auto available_space = AvailableSpaceAtPath(instance.data_image());
+  if (available_space <
+      existing_sizes.sparse_size - existing_sizes.disk_size) {
+    // TODO(schuffelen): Duplicate this check in run_cvd when it can run on a
+    // separate machine
+    return CF_ERR("Not enough space remaining in fs containing \""
+                  << instance.data_image() << "\", wanted "
+                  << (existing_sizes.sparse_size - existing_sizes.disk_size)
+                  << ", got " << available_space);
+  } else {
+    LOG(DEBUG) << "Available space: " << available_space;
+    LOG(DEBUG) << "Sparse size of \"" << instance.data_image()
+               << "\": " << existing_sizes.sparse_size;
+    LOG(DEBUG) << "Disk size of \"" << instance.data_image()
+               << "\": " << existing_sizes.disk_size;
+  }
+
+  auto os_disk_builder = OsCompositeDiskBuilder(config, instance);
+  bool os_built_composite = false;
+  CF_EXPECT(job.Step("OsCompositeDisk", [&]() -> Result<void> {
+    os_built_composite =
+        CF_EXPECT(os_disk_builder.BuildCompositeDiskIfNecessary());
+    return {};
+  }));
 
-    auto ap_disk_builder = ApCompositeDiskBuilder(config, instance);
-    if (instance.ap_boot_flow() != APBootFlow::None) {
+  auto ap_disk_builder = ApCompositeDiskBuilder(config, instance);
+  if (instance.ap_boot_flow() != APBootFlow::None) {
+    CF_EXPECT(job.Step("ApCompositeDisk", [&]() -> Result<void> {
       CF_EXPECT(ap_disk_builder.BuildCompositeDiskIfNecessary());
-    }
+      return {};
+    }));
+  }
 
-    if (os_built_composite) {
-      if (FileExists(instance.access_kregistry_path())) {
-        CF_EXPECT(CreateBlankImage(instance.access_kregistry_path(), 2 /* mb */,
-                                   "none"),
-                  "Failed for \"" << instance.access_kregistry_path() << "\"");
-      }
-      if (FileExists(instance.hwcomposer_pmem_path())) {
-        CF_EXPECT(CreateBlankImage(instance.hwcomposer_pmem_path(), 2 /* mb */,
-                                   "none"),
-                  "Failed for \"" << instance.hwcomposer_pmem_path() << "\"");
-      }
-      if (FileExists(instance.pstore_path())) {
-        CF_EXPECT(CreateBlankImage(instance.pstore_path(), 2 /* mb */, "none"),
-                  "Failed for\"" << instance.pstore_path() << "\"");
-      }
+  if (os_built_composite) {
+    if (FileExists(instance.access_kregistry_path())) {
+      CF_EXPECT(CreateBlankImage(instance.access_kregistry_path(), 2 /* mb */,
+                                 "none"),
+                "Failed for \"" << instance.access_kregistry_path() << "\"");
     }
+    if (FileExists(instance.hwcomposer_pmem_path())) {
+      CF_EXPECT(CreateBlankImage(instance.hwcomposer_pmem_path(), 2 /* mb */,
+                                 "none"),
+                "Failed for \"" << instance.hwcomposer_pmem_path() << "\"");
+    }
+    if (FileExists(instance.pstore_path())) {
+      CF_EXPECT(CreateBlankImage(instance.pstore_path(), 2 /* mb */, "none"),
+                "Failed for\"" << instance.pstore_path() << "\"");
+    }
+  }
 
-    if (!instance.protected_vm()) {
+  if (!instance.protected_vm()) {
+    CF_EXPECT(job.Step("Overlays", [&]() -> Result<void> {
       os_disk_builder.OverlayPath(instance.PerInstancePath("overlay.img"));
       CF_EXPECT(os_disk_builder.BuildOverlayIfNecessary());
       if (instance.ap_boot_flow() != APBootFlow::None) {
         ap_disk_builder.OverlayPath(instance.PerInstancePath("ap_overlay.img"));
         CF_EXPECT(ap_disk_builder.BuildOverlayIfNecessary());
       }
-    }
+      return {};
+    }));
+  }
+  return {};
+}
+
+Result<void> CreateDynamicDiskFiles(const FetcherConfig& fetcher_config,
+                                    const CuttlefishConfig& config) {
+  const auto instances = config.Instances();
+  size_t jobs = FLAGS_disk_setup_jobs;
+  if (jobs == 0) {
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  ParallelSetup setup(jobs);
+  for (const auto& instance : instances) {
+    setup.Add(instance.instance_name(),
+              [&fetcher_config, &config, &instance](ParallelSetup::Job& job) {
+                return CreateInstanceDiskFiles(fetcher_config, config,
+                                               instance, job);
+              });
   }
+  auto start = std::chrono::steady_clock::now();
+  auto result = setup.Run();
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  LOG(DEBUG) << "Disk setup of " << instances.size() << " instance(s) with up "
+             << "to " << jobs << " at once took " << elapsed.count() << "ms\n"
+             << setup.TimingReport();
+  CF_EXPECT(std::move(result));
 
   for (auto instance : config.Instances()) {
     // Check that the files exist
@@ -303,6 +303,16 @@ DEFINE_string(report_anonymous_usage_stats,
               CF_DEFAULTS_REPORT_ANONYMOUS_USAGE_STATS,
               "Report anonymous usage "
               "statistics for metrics collection and analysis.");
+DEFINE_int32(log_rotate_size_mb, CF_DEFAULTS_LOG_ROTATE_SIZE_MB,
+             "Start a new kernel and logcat log file once the current one "
+             "reaches this size. 0 keeps a single, unbounded file.");
+DEFINE_int32(log_rotate_interval_s, CF_DEFAULTS_LOG_ROTATE_INTERVAL_S,
+             "Start a new kernel and logcat log file once the current one is "
+             "this old. 0 disables time based rotation.");
+DEFINE_int32(log_rotate_keep, CF_DEFAULTS_LOG_ROTATE_KEEP,
+             "Number of rotated kernel and logcat log files to keep.");
+DEFINE_bool(log_rotate_compress, CF_DEFAULTS_LOG_ROTATE_COMPRESS,
+            "Compress rotated kernel and logcat log files with zstd.");
 DEFINE_vec(ril_dns, CF_DEFAULTS_RIL_DNS,
               "DNS address of mobile network (RIL)");
 DEFINE_vec(kgdb, cuttlefish::BoolToString(CF_DEFAULTS_KGDB),
@@ -355,6 +365,10 @@ DEFINE_string(ap_kernel_image, CF_DEFAULTS_AP_KERNEL_IMAGE,
 DEFINE_vec(record_screen, cuttlefish::BoolToString(CF_DEFAULTS_RECORD_SCREEN),
            "Enable screen recording. "
            "Requires --start_webrtc");
+DEFINE_vec(frame_export, CF_DEFAULTS_FRAME_EXPORT,
+           "Share the latest display frames with local processes through "
+           "memory, as \"i420\" or \"rgba\". \"none\" disables it. "
+           "Requires --start_webrtc");
 
 DEFINE_vec(smt, cuttlefish::BoolToString(CF_DEFAULTS_SMT),
            "Enable simultaneous multithreading (SMT/HT)");
@@ -829,6 +843,16 @@ Result<CuttlefishConfig> InitializeCuttlefishConfiguration(
 
   tmp_config_obj.set_enable_metrics(FLAGS_report_anonymous_usage_stats);
 
+  CF_EXPECT(FLAGS_log_rotate_size_mb >= 0,
+            "--log_rotate_size_mb can't be negative");
+  CF_EXPECT(FLAGS_log_rotate_interval_s >= 0,
+            "--log_rotate_interval_s can't be negative");
+  CF_EXPECT(FLAGS_log_rotate_keep >= 0, "--log_rotate_keep can't be negative");
+  tmp_config_obj.set_log_rotate_size_mb(FLAGS_log_rotate_size_mb);
+  tmp_config_obj.set_log_rotate_interval_s(FLAGS_log_rotate_interval_s);
+  tmp_config_obj.set_log_rotate_keep(FLAGS_log_rotate_keep);
+  tmp_config_obj.set_log_rotate_compress(FLAGS_log_rotate_compress);
+
 #ifdef ENFORCE_MAC80211_HWSIM
   tmp_config_obj.set_virtio_mac80211_hwsim(true);
 #else
@@ -928,6 +952,8 @@ Result<CuttlefishConfig> InitializeCuttlefishConfiguration(
       CF_EXPECT(GET_FLAG_BOOL_VALUE(enable_bootanimation));
   std::vector<bool> record_screen_vec = CF_EXPECT(GET_FLAG_BOOL_VALUE(
       record_screen));
+  std::vector<std::string> frame_export_vec =
+      CF_EXPECT(GET_FLAG_STR_VALUE(frame_export));
   std::vector<std::string> gem5_debug_file_vec =
       CF_EXPECT(GET_FLAG_STR_VALUE(gem5_debug_file));
   std::vector<bool> protected_vm_vec = CF_EXPECT(GET_FLAG_BOOL_VALUE(
@@ -1046,6 +1072,11 @@ Result<CuttlefishConfig> InitializeCuttlefishConfiguration(
     instance.set_enable_gnss_grpc_proxy(start_gnss_proxy_vec[instance_index]);
     instance.set_enable_bootanimation(enable_bootanimation_vec[instance_index]);
     instance.set_record_screen(record_screen_vec[instance_index]);
+    const auto& frame_export = frame_export_vec[instance_index];
+    CF_EXPECT(frame_export == "none" || frame_export == "i420" ||
+                  frame_export == "rgba",
+              "Unknown --frame_export format \"" << frame_export << "\"");
+    instance.set_frame_export(frame_export);
     instance.set_gem5_debug_file(gem5_debug_file_vec[instance_index]);
     instance.set_protected_vm(protected_vm_vec[instance_index]);
     instance.set_mte(mte_vec[instance_index]);
@@ -98,6 +98,7 @@
 // Disk default parameters
 #define CF_DEFAULTS_BLANK_METADATA_IMAGE_MB "64"
 #define CF_DEFAULTS_BLANK_SDCARD_IMAGE_MB "2048"
+#define CF_DEFAULTS_DISK_SETUP_JOBS 0
 #define CF_DEFAULTS_BOOT_IMAGE CF_DEFAULTS_DYNAMIC_STRING
 #define CF_DEFAULTS_DATA_IMAGE CF_DEFAULTS_DYNAMIC_STRING
 #define CF_DEFAULTS_INIT_BOOT_IMAGE CF_DEFAULTS_DYNAMIC_STRING
@@ -125,6 +126,7 @@
 #define CF_DEFAULTS_HWCOMPOSER cuttlefish::kHwComposerAuto
 #define CF_DEFAULTS_GPU_MODE cuttlefish::kGpuModeAuto
 #define CF_DEFAULTS_RECORD_SCREEN false
+#define CF_DEFAULTS_FRAME_EXPORT "none"
 #define CF_DEFAULTS_GPU_CAPTURE_BINARY CF_DEFAULTS_DYNAMIC_STRING
 #define CF_DEFAULTS_ENABLE_GPU_UDMABUF false
 #define CF_DEFAULTS_DISPLAY0 CF_DEFAULTS_DYNAMIC_STRING
@@ -198,3 +200,9 @@
 // Metrics default parameters
 // TODO: Defined twice , please remove redundant definitions
 #define CF_DEFAULTS_REPORT_ANONYMOUS_USAGE_STATS CF_DEFAULTS_DYNAMIC_STRING
+
+// Log default parameters
+#define CF_DEFAULTS_LOG_ROTATE_SIZE_MB 0
+#define CF_DEFAULTS_LOG_ROTATE_INTERVAL_S 0
+#define CF_DEFAULTS_LOG_ROTATE_KEEP 4
+#define CF_DEFAULTS_LOG_ROTATE_COMPRESS false
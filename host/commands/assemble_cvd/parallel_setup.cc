@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/assemble_cvd/parallel_setup.h"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#include <android-base/logging.h>
+
+namespace cuttlefish {
+
+ParallelSetup::Job::Job(ParallelSetup& setup, size_t index, std::string name,
+                        std::function<Result<void>(Job&)> run)
+    : setup_(setup),
+      index_(index),
+      name_(std::move(name)),
+      run_(std::move(run)) {}
+
+Result<void> ParallelSetup::Job::Step(
+    const std::string& name, const std::function<Result<void>()>& step) {
+  CF_EXPECT(!setup_.cancelled_, "Cancelled after a failure in another job");
+  auto start = Clock::now();
+  auto result = step();
+  {
+    std::lock_guard lock(setup_.mutex_);
+    steps_.emplace_back(name, Clock::now() - start);
+  }
+  return result;
+}
+
+Result<void> ParallelSetup::Job::Serially(
+    const std::function<Result<void>()>& section) {
+  {
+    auto start = Clock::now();
+    std::unique_lock lock(setup_.mutex_);
+    setup_.serial_turn_.wait(lock, [this]() {
+      return setup_.cancelled_ || setup_.next_serial_ == index_;
+    });
+    steps_.emplace_back("waiting", Clock::now() - start);
+    CF_EXPECT(!setup_.cancelled_, "Cancelled after a failure in another job");
+  }
+  auto result = section();
+  setup_.FinishSerial(*this);
+  return result;
+}
+
+ParallelSetup::ParallelSetup(size_t max_jobs)
+    : max_jobs_(std::max<size_t>(max_jobs, 1)) {}
+
+void ParallelSetup::Add(std::string name,
+                        std::function<Result<void>(Job&)> run) {
+  jobs_.emplace_back(
+      new Job(*this, jobs_.size(), std::move(name), std::move(run)));
+}
+
+Result<void> ParallelSetup::Run() {
+  auto worker = [this]() {
+    while (!cancelled_) {
+      auto index = next_job_++;
+      if (index >= jobs_.size()) {
+        return;
+      }
+      RunJob(*jobs_[index]);
+    }
+  };
+  auto threads = std::min(max_jobs_, jobs_.size());
+  if (threads <= 1) {
+    worker();
+  } else {
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++) {
+      workers.emplace_back(worker);
+    }
+    for (auto& thread : workers) {
+      thread.join();
+    }
+  }
+  if (failure_) {
+    auto& [name, result] = *failure_;
+    CF_EXPECT(std::move(result), "Failed in \"" << name << "\"");
+  }
+  return {};
+}
+
+void ParallelSetup::RunJob(Job& job) {
+  auto start = Job::Clock::now();
+  auto result = job.run_(job);
+  {
+    std::lock_guard lock(mutex_);
+    job.total_ = Job::Clock::now() - start;
+    if (!result.ok() && !failure_) {
+      // Failures after this one are most likely just the cancellation.
+      failure_.emplace(job.name_, std::move(result));
+      cancelled_ = true;
+      serial_turn_.notify_all();
+    }
+  }
+  FinishSerial(job);
+}
+
+void ParallelSetup::FinishSerial(Job& job) {
+  std::lock_guard lock(mutex_);
+  job.serial_done_ = true;
+  while (next_serial_ < jobs_.size() && jobs_[next_serial_]->serial_done_) {
+    next_serial_++;
+  }
+  serial_turn_.notify_all();
+}
+
+std::string ParallelSetup::TimingReport() const {
+  auto millis = [](Job::Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  };
+  std::lock_guard lock(mutex_);
+  std::stringstream report;
+  for (const auto& job : jobs_) {
+    report << job->name_ << " took " << millis(job->total_) << "ms";
+    const char* separator = ": ";
+    for (const auto& [step, duration] : job->steps_) {
+      report << separator << step << " " << millis(duration) << "ms";
+      separator = ", ";
+    }
+    report << "\n";
+  }
+  return report.str();
+}
+
+}  // namespace cuttlefish
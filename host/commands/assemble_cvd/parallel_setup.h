@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+// Runs independent jobs, such as setting up the disks of different instances,
+// on a bounded number of threads.
+//
+// Jobs are made of named steps which are timed for a report. Once a step
+// fails no more jobs or steps are started, and the first failure is returned
+// after the steps already running finish.
+class ParallelSetup {
+ public:
+  class Job {
+   public:
+    // Runs and times one step. Fails without running it once another job
+    // failed. Matches SetupFeature::SetupRunner.
+    Result<void> Step(const std::string& name,
+                      const std::function<Result<void>()>& step);
+
+    // Runs `section`, which may contain steps, without overlapping the
+    // serial sections of other jobs and after those of the jobs added
+    // earlier. For work on state shared between jobs. Call at most once.
+    Result<void> Serially(const std::function<Result<void>()>& section);
+
+   private:
+    friend class ParallelSetup;
+    using Clock = std::chrono::steady_clock;
+
+    Job(ParallelSetup& setup, size_t index, std::string name,
+        std::function<Result<void>(Job&)> run);
+
+    ParallelSetup& setup_;
+    size_t index_;
+    std::string name_;
+    std::function<Result<void>(Job&)> run_;
+    // Guarded by setup_.mutex_.
+    bool serial_done_ = false;
+    std::vector<std::pair<std::string, Clock::duration>> steps_;
+    Clock::duration total_ = {};
+  };
+
+  // At most `max_jobs` jobs run at once, at least one.
+  explicit ParallelSetup(size_t max_jobs);
+
+  void Add(std::string name, std::function<Result<void>(Job&)> run);
+
+  // Runs all the jobs added, blocking until they are done.
+  Result<void> Run();
+
+  // One line per job with the time each of its steps took.
+  std::string TimingReport() const;
+
+ private:
+  void RunJob(Job& job);
+  void FinishSerial(Job& job);
+
+  size_t max_jobs_;
+  std::vector<std::unique_ptr<Job>> jobs_;
+  std::atomic<size_t> next_job_ = 0;
+  std::atomic<bool> cancelled_ = false;
+  mutable std::mutex mutex_;
+  std::condition_variable serial_turn_;
+  size_t next_serial_ = 0;
+  // The first failure, with the job it happened in.
+  std::optional<std::pair<std::string, Result<void>>> failure_;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,141 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "host/commands/assemble_cvd/parallel_setup.h"
+
+namespace cuttlefish {
+
+TEST(ParallelSetup, BoundsConcurrency) {
+  ParallelSetup setup(3);
+  std::atomic<int> running = 0;
+  std::atomic<int> most_running = 0;
+  for (int i = 0; i < 10; i++) {
+    setup.Add("job " + std::to_string(i),
+              [&](ParallelSetup::Job& job) -> Result<void> {
+                return job.Step("work", [&]() -> Result<void> {
+                  int now = ++running;
+                  int most = most_running;
+                  while (now > most &&
+                         !most_running.compare_exchange_weak(most, now)) {
+                  }
+                  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                  running--;
+                  return {};
+                });
+              });
+  }
+  auto result = setup.Run();
+  ASSERT_TRUE(result.ok()) << result.error().Message();
+  EXPECT_GT(most_running, 1);
+  EXPECT_LE(most_running, 3);
+
+  auto report = setup.TimingReport();
+  EXPECT_EQ(std::count(report.begin(), report.end(), '\n'), 10);
+  EXPECT_NE(report.find("job 9 took "), std::string::npos);
+  EXPECT_NE(report.find(": work "), std::string::npos);
+}
+
+TEST(ParallelSetup, StopsAfterFirstFailure) {
+  ParallelSetup setup(2);
+  std::atomic<int> started = 0;
+  std::atomic<bool> later_step_ran = false;
+  setup.Add("failing", [](ParallelSetup::Job& job) -> Result<void> {
+    return job.Step("fail", []() -> Result<void> {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      return CF_ERR("broken");
+    });
+  });
+  for (int i = 0; i < 10; i++) {
+    setup.Add("job " + std::to_string(i),
+              [&](ParallelSetup::Job& job) -> Result<void> {
+                started++;
+                CF_EXPECT(job.Step("first", []() -> Result<void> {
+                  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                  return {};
+                }));
+                return job.Step("second", [&]() -> Result<void> {
+                  later_step_ran = true;
+                  return {};
+                });
+              });
+  }
+  auto result = setup.Run();
+  ASSERT_FALSE(result.ok());
+  EXPECT_NE(result.error().Message().find("broken"), std::string::npos);
+  EXPECT_LE(started, 1);
+  EXPECT_FALSE(later_step_ran);
+}
+
+TEST(ParallelSetup, SerialSectionsRunInOrder) {
+  ParallelSetup setup(4);
+  std::mutex mutex;
+  std::vector<int> order;
+  bool overlapped = false;
+  bool in_section = false;
+  for (int i = 0; i < 8; i++) {
+    setup.Add("job " + std::to_string(i),
+              [&, i](ParallelSetup::Job& job) -> Result<void> {
+                // Later jobs tend to get here first.
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(2 * (8 - i)));
+                return job.Serially([&, i]() -> Result<void> {
+                  {
+                    std::lock_guard lock(mutex);
+                    overlapped |= in_section;
+                    in_section = true;
+                    order.push_back(i);
+                  }
+                  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                  std::lock_guard lock(mutex);
+                  in_section = false;
+                  return {};
+                });
+              });
+  }
+  auto result = setup.Run();
+  ASSERT_TRUE(result.ok()) << result.error().Message();
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7}));
+  EXPECT_FALSE(overlapped);
+}
+
+TEST(ParallelSetup, SerialSectionsSkipJobsWithout) {
+  ParallelSetup setup(2);
+  std::atomic<bool> ran = false;
+  setup.Add("no section", [](ParallelSetup::Job&) -> Result<void> {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return {};
+  });
+  setup.Add("section", [&](ParallelSetup::Job& job) -> Result<void> {
+    return job.Serially([&]() -> Result<void> {
+      ran = true;
+      return {};
+    });
+  });
+  auto result = setup.Run();
+  ASSERT_TRUE(result.ok()) << result.error().Message();
+  EXPECT_TRUE(ran);
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/assemble_cvd/ramdisk_pipeline.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <bootimg.h>
+#include <lz4.h>
+#define LZ4_HC_STATIC_LINKING_ONLY
+#include <lz4hc.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr uint32_t kLz4LegacyMagic = 0x184C2102;
+constexpr size_t kLz4LegacyBlockSize = 8 << 20;
+constexpr uint32_t kLz4LegacyMaxCompressedBlock =
+    LZ4_COMPRESSBOUND(kLz4LegacyBlockSize);
+constexpr int kLz4CompressionLevel = 12;
+
+constexpr std::string_view kCpioMagic = "070701";
+constexpr size_t kCpioHeaderSize = 110;
+constexpr std::string_view kCpioTrailer = "TRAILER!!!";
+constexpr uint32_t kFirstInode = 300000;
+
+constexpr size_t kBootImagePageSize = 4096;
+
+uint32_t ReadLe32(const char* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return le32toh(value);
+}
+
+void WriteLe32(char* data, uint32_t value) {
+  value = htole32(value);
+  memcpy(data, &value, sizeof(value));
+}
+
+void AppendLe32(std::string& out, uint32_t value) {
+  out.resize(out.size() + sizeof(value));
+  WriteLe32(out.data() + out.size() - sizeof(value), value);
+}
+
+size_t Align(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+Result<uint32_t> ParseHex(std::string_view field) {
+  uint32_t value = 0;
+  for (char c : field) {
+    int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return CF_ERR("Invalid hex field in cpio header: " << field);
+    }
+    value = (value << 4) | digit;
+  }
+  return value;
+}
+
+std::string_view NormalizedPath(std::string_view name) {
+  while (name.substr(0, 2) == "./") {
+    name.remove_prefix(2);
+  }
+  return name;
+}
+
+// Whether the path stays inside the directory it is relative to, i.e. it
+// isn't absolute and has no ".." components. Names like "a..b" are fine.
+bool StaysInside(std::string_view path) {
+  if (path.empty() || path.front() == '/') {
+    return false;
+  }
+  while (!path.empty()) {
+    auto end = std::min(path.find('/'), path.size());
+    if (path.substr(0, end) == "..") {
+      return false;
+    }
+    path.remove_prefix(std::min(end + 1, path.size()));
+  }
+  return true;
+}
+
+}  // namespace
+
+Result<std::string> Lz4LegacyDecompress(std::string_view compressed) {
+  std::string out;
+  size_t pos = 0;
+  while (pos < compressed.size()) {
+    // Ramdisks may be padded after the last stream.
+    if (std::all_of(compressed.begin() + pos, compressed.end(),
+                    [](char c) { return c == '\0'; })) {
+      break;
+    }
+    CF_EXPECT(compressed.size() - pos >= 4, "Truncated lz4 stream");
+    CF_EXPECT(ReadLe32(compressed.data() + pos) == kLz4LegacyMagic,
+              "Not an lz4 legacy stream at offset " << pos);
+    pos += 4;
+    while (compressed.size() - pos >= 4) {
+      auto block_size = ReadLe32(compressed.data() + pos);
+      if (block_size == kLz4LegacyMagic) {
+        break;
+      }
+      if (block_size == 0 && std::all_of(compressed.begin() + pos,
+                                         compressed.end(),
+                                         [](char c) { return c == '\0'; })) {
+        break;
+      }
+      CF_EXPECT(block_size <= kLz4LegacyMaxCompressedBlock,
+                "Invalid lz4 block size " << block_size << " at " << pos);
+      pos += 4;
+      CF_EXPECT(compressed.size() - pos >= block_size, "Truncated lz4 block");
+      auto old_size = out.size();
+      out.resize(old_size + kLz4LegacyBlockSize);
+      int decompressed =
+          LZ4_decompress_safe(compressed.data() + pos, out.data() + old_size,
+                              block_size, kLz4LegacyBlockSize);
+      CF_EXPECT(decompressed >= 0, "Corrupt lz4 block at " << pos);
+      out.resize(old_size + decompressed);
+      pos += block_size;
+    }
+    if (compressed.size() - pos < 4) {
+      break;
+    }
+  }
+  return out;
+}
+
+Result<std::string> Lz4LegacyCompress(std::string_view data) {
+  std::vector<char> state(LZ4_sizeofStateHC());
+  auto stream = LZ4_initStreamHC(state.data(), state.size());
+  CF_EXPECT(stream != nullptr, "Could not initialize lz4 state");
+  LZ4_favorDecompressionSpeed(stream, 1);
+
+  std::string out;
+  AppendLe32(out, kLz4LegacyMagic);
+  for (size_t pos = 0; pos < data.size(); pos += kLz4LegacyBlockSize) {
+    int block = std::min(kLz4LegacyBlockSize, data.size() - pos);
+    int bound = LZ4_compressBound(block);
+    auto block_start = out.size() + 4;
+    AppendLe32(out, 0);
+    out.resize(block_start + bound);
+    int compressed = LZ4_compress_HC_extStateHC_fastReset(
+        state.data(), data.data() + pos, out.data() + block_start, block, bound,
+        kLz4CompressionLevel);
+    CF_EXPECT(compressed > 0, "lz4 compression failed");
+    out.resize(block_start + compressed);
+    WriteLe32(out.data() + block_start - 4, compressed);
+  }
+  return out;
+}
+
+Result<CpioArchive> CpioArchive::Parse(std::string_view data) {
+  CpioArchive archive;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    // Archives are often padded out to a block size before the next one.
+    if (data[pos] == '\0') {
+      pos++;
+      continue;
+    }
+    CF_EXPECT(data.size() - pos >= kCpioHeaderSize, "Truncated cpio header");
+    auto header = data.substr(pos, kCpioHeaderSize);
+    CF_EXPECT(header.substr(0, kCpioMagic.size()) == kCpioMagic,
+              "Unsupported cpio format at offset " << pos);
+    auto field = [&header](int index) {
+      return ParseHex(header.substr(kCpioMagic.size() + index * 8, 8));
+    };
+    Entry entry;
+    entry.mode = CF_EXPECT(field(1));
+    entry.uid = CF_EXPECT(field(2));
+    entry.gid = CF_EXPECT(field(3));
+    entry.mtime = CF_EXPECT(field(5));
+    uint32_t file_size = CF_EXPECT(field(6));
+    entry.rdev_major = CF_EXPECT(field(9));
+    entry.rdev_minor = CF_EXPECT(field(10));
+    uint32_t name_size = CF_EXPECT(field(11));
+
+    CF_EXPECT(name_size > 0, "Empty cpio entry name");
+    size_t name_start = pos + kCpioHeaderSize;
+    CF_EXPECT(data.size() - name_start >= name_size, "Truncated cpio name");
+    // The name size includes the terminating null byte.
+    entry.name = data.substr(name_start, name_size - 1);
+    size_t data_start = Align(name_start + name_size, 4);
+    CF_EXPECT(data_start <= data.size() &&
+                  data.size() - data_start >= file_size,
+              "Truncated cpio entry \"" << entry.name << "\"");
+    entry.data = data.substr(data_start, file_size);
+    pos = Align(data_start + file_size, 4);
+
+    if (entry.name == kCpioTrailer) {
+      continue;
+    }
+    archive.Add(std::move(entry));
+  }
+  return archive;
+}
+
+void CpioArchive::Add(Entry entry) {
+  std::string key(NormalizedPath(entry.name));
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    entries_[it->second] = std::move(entry);
+    return;
+  }
+  index_.emplace(std::move(key), entries_.size());
+  entries_.emplace_back(std::move(entry));
+}
+
+size_t CpioArchive::RemoveTree(const std::string& path) {
+  std::string prefix(NormalizedPath(path));
+  auto in_tree = [&prefix](const Entry& entry) {
+    auto name = NormalizedPath(entry.name);
+    return name == prefix || (name.size() > prefix.size() &&
+                              name.substr(0, prefix.size()) == prefix &&
+                              name[prefix.size()] == '/');
+  };
+  auto removed_begin =
+      std::remove_if(entries_.begin(), entries_.end(), in_tree);
+  size_t removed = entries_.end() - removed_begin;
+  entries_.erase(removed_begin, entries_.end());
+  index_.clear();
+  for (size_t i = 0; i < entries_.size(); i++) {
+    index_.emplace(NormalizedPath(entries_[i].name), i);
+  }
+  return removed;
+}
+
+std::string CpioArchive::Serialize() const {
+  size_t total = 0;
+  for (const auto& entry : entries_) {
+    total += kCpioHeaderSize + entry.name.size() + entry.data.size() + 8;
+  }
+  std::string out;
+  out.reserve(total + kCpioHeaderSize + kCpioTrailer.size() + 8);
+
+  uint32_t inode = kFirstInode;
+  auto append = [&out, &inode](const Entry& entry) {
+    // Same layout as mkbootfs: no hard links and no device of origin.
+    out += android::base::StringPrintf(
+        "%s%08x%08x%08x%08x%08x%08x%08zx%08x%08x%08x%08x%08zx%08x",
+        kCpioMagic.data(), inode++, entry.mode, entry.uid, entry.gid, 1,
+        entry.mtime, entry.data.size(), 0, 0, entry.rdev_major,
+        entry.rdev_minor, entry.name.size() + 1, 0);
+    out += entry.name;
+    out.push_back('\0');
+    out.resize(Align(out.size(), 4), '\0');
+    out += entry.data;
+    out.resize(Align(out.size(), 4), '\0');
+  };
+  for (const auto& entry : entries_) {
+    append(entry);
+  }
+  append(Entry{.name = std::string(kCpioTrailer)});
+  return out;
+}
+
+Result<void> CpioArchive::ExtractTo(const std::string& directory) const {
+  CF_EXPECT(EnsureDirectoryExists(directory));
+  // Directory permissions are applied last in case they aren't writable.
+  std::vector<std::pair<std::string, mode_t>> directory_modes;
+  for (const auto& entry : entries_) {
+    auto name = NormalizedPath(entry.name);
+    if (name.empty() || name == ".") {
+      continue;
+    }
+    CF_EXPECT(StaysInside(name),
+              "Refusing to extract \"" << entry.name << "\"");
+    auto path = directory + "/" + std::string(name);
+    auto parent = cpp_dirname(path);
+    if (!DirectoryExists(parent)) {
+      CF_EXPECT(EnsureDirectoryExists(parent));
+    }
+    mode_t permissions = entry.mode & 07777;
+    switch (entry.mode & S_IFMT) {
+      case S_IFDIR:
+        CF_EXPECT(mkdir(path.c_str(), 0700) == 0 || errno == EEXIST,
+                  "mkdir(\"" << path << "\") failed: " << strerror(errno));
+        directory_modes.emplace_back(path, permissions);
+        break;
+      case S_IFREG: {
+        unlink(path.c_str());
+        auto fd = SharedFD::Open(path, O_CREAT | O_TRUNC | O_WRONLY,
+                                 permissions | S_IWUSR);
+        CF_EXPECT(fd->IsOpen(),
+                  "Could not open \"" << path << "\": " << fd->StrError());
+        auto written = WriteAll(fd, entry.data);
+        CF_EXPECT(written == static_cast<ssize_t>(entry.data.size()),
+                  "Error writing \"" << path << "\": " << fd->StrError());
+        CF_EXPECT(fd->Chmod(permissions),
+                  "chmod(\"" << path << "\") failed: " << fd->StrError());
+        break;
+      }
+      case S_IFLNK:
+        unlink(path.c_str());
+        CF_EXPECT(symlink(entry.data.c_str(), path.c_str()) == 0,
+                  "symlink(\"" << path << "\") failed: " << strerror(errno));
+        break;
+      default:
+        LOG(DEBUG) << "Skipping special file \"" << entry.name << "\"";
+        break;
+    }
+  }
+  for (const auto& [path, mode] : directory_modes) {
+    CF_EXPECT(chmod(path.c_str(), mode) == 0,
+              "chmod(\"" << path << "\") failed: " << strerror(errno));
+  }
+  return {};
+}
+
+Result<BootImageContents> ParseBootImage(std::string_view image) {
+  CF_EXPECT(image.size() >= sizeof(boot_img_hdr_v3), "Boot image too small");
+  CF_EXPECT(memcmp(image.data(), BOOT_MAGIC, BOOT_MAGIC_SIZE) == 0,
+            "Not a boot image");
+  boot_img_hdr_v3 header;
+  memcpy(&header, image.data(), sizeof(header));
+  CF_EXPECT(header.header_version == 3 || header.header_version == 4,
+            "Unsupported boot image header version "
+                << header.header_version);
+
+  size_t kernel_offset = kBootImagePageSize;
+  size_t ramdisk_offset =
+      kernel_offset + Align(header.kernel_size, kBootImagePageSize);
+  CF_EXPECT(ramdisk_offset <= image.size() &&
+                image.size() - ramdisk_offset >= header.ramdisk_size,
+            "Boot image is truncated");
+
+  BootImageContents contents;
+  contents.header_version = header.header_version;
+  contents.ramdisk = image.substr(ramdisk_offset, header.ramdisk_size);
+  auto cmdline = reinterpret_cast<const char*>(header.cmdline);
+  contents.cmdline =
+      std::string(cmdline, strnlen(cmdline, sizeof(header.cmdline)));
+  return contents;
+}
+
+StageTimer::StageTimer(std::string name)
+    : name_(std::move(name)),
+      start_(Clock::now()),
+      stage_start_(start_) {}
+
+StageTimer::~StageTimer() {
+  auto millis = [](Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  };
+  std::stringstream summary;
+  summary << name_ << " took " << millis(Clock::now() - start_) << "ms";
+  const char* separator = ": ";
+  for (const auto& [stage, duration] : stages_) {
+    summary << separator << stage << " " << millis(duration) << "ms";
+    separator = ", ";
+  }
+  LOG(DEBUG) << summary.str();
+}
+
+void StageTimer::Stage(std::string stage) {
+  auto now = Clock::now();
+  stages_.emplace_back(std::move(stage), now - stage_start_);
+  stage_start_ = now;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common/libs/utils/result.h"
+
+// In memory versions of the tools used to take ramdisks and boot images apart
+// and put them back together, so a repack reads each input once and writes
+// its output once instead of going through a chain of subprocesses and
+// intermediate files.
+
+namespace cuttlefish {
+
+// Decompresses the lz4 legacy format produced by `lz4 -l`, as used by kernel
+// and vendor ramdisks. Concatenated streams are decompressed back to back.
+Result<std::string> Lz4LegacyDecompress(std::string_view compressed);
+// Equivalent to `lz4 -l -12 --favor-decSpeed`.
+Result<std::string> Lz4LegacyCompress(std::string_view data);
+
+// A newc format cpio archive, as produced by mkbootfs.
+class CpioArchive {
+ public:
+  struct Entry {
+    std::string name;
+    uint32_t mode = 0;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    uint32_t mtime = 0;
+    uint32_t rdev_major = 0;
+    uint32_t rdev_minor = 0;
+    // File contents, or the target of a symlink.
+    std::string data;
+  };
+
+  // Parses one or more concatenated archives. Like `cpio -u`, an entry
+  // replaces any earlier entry with the same path.
+  static Result<CpioArchive> Parse(std::string_view data);
+
+  const std::vector<Entry>& Entries() const { return entries_; }
+  void Add(Entry entry);
+  // Removes `path` and everything under it. Returns the number of entries
+  // removed.
+  size_t RemoveTree(const std::string& path);
+  std::string Serialize() const;
+  // Recreates the archive's files, directories and symlinks under
+  // `directory`. Device nodes need root and are skipped; ownership is not
+  // restored.
+  Result<void> ExtractTo(const std::string& directory) const;
+
+ private:
+  std::vector<Entry> entries_;
+  std::map<std::string, size_t> index_;
+};
+
+// The sections of a v3 or v4 boot image needed to repack it.
+struct BootImageContents {
+  uint32_t header_version;
+  std::string ramdisk;
+  std::string cmdline;
+};
+Result<BootImageContents> ParseBootImage(std::string_view image);
+
+// Collects how long each step of a multi step operation takes, and logs them
+// all on one line when done.
+class StageTimer {
+ public:
+  explicit StageTimer(std::string name);
+  ~StageTimer();
+
+  // Ends the stage that was running since the previous call.
+  void Stage(std::string stage);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  std::string name_;
+  Clock::time_point start_;
+  Clock::time_point stage_start_;
+  std::vector<std::pair<std::string, Clock::duration>> stages_;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,207 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <bootimg.h>
+#include <gtest/gtest.h>
+
+#include "host/commands/assemble_cvd/ramdisk_pipeline.h"
+
+namespace cuttlefish {
+namespace {
+
+std::string Pattern(size_t size) {
+  std::string data;
+  data.reserve(size);
+  for (size_t i = 0; data.size() < size; i++) {
+    data += "line " + std::to_string(i % 1000) + "\n";
+  }
+  data.resize(size);
+  return data;
+}
+
+CpioArchive::Entry File(const std::string& name, const std::string& data) {
+  return CpioArchive::Entry{.name = name, .mode = S_IFREG | 0644, .data = data};
+}
+
+CpioArchive::Entry Directory(const std::string& name) {
+  return CpioArchive::Entry{.name = name, .mode = S_IFDIR | 0755};
+}
+
+}  // namespace
+
+TEST(RamdiskPipeline, Lz4RoundTripsAcrossBlocks) {
+  // Larger than one 8MiB legacy block.
+  auto data = Pattern(9 << 20);
+  auto compressed = Lz4LegacyCompress(data);
+  ASSERT_TRUE(compressed.ok()) << compressed.error().Message();
+  EXPECT_LT(compressed->size(), data.size());
+  auto decompressed = Lz4LegacyDecompress(*compressed);
+  ASSERT_TRUE(decompressed.ok()) << decompressed.error().Message();
+  EXPECT_EQ(*decompressed, data);
+}
+
+TEST(RamdiskPipeline, Lz4DecompressesConcatenatedStreams) {
+  auto first = Lz4LegacyCompress("first ");
+  auto second = Lz4LegacyCompress("second");
+  ASSERT_TRUE(first.ok() && second.ok());
+  auto decompressed =
+      Lz4LegacyDecompress(*first + *second + std::string(16, '\0'));
+  ASSERT_TRUE(decompressed.ok()) << decompressed.error().Message();
+  EXPECT_EQ(*decompressed, "first second");
+}
+
+TEST(RamdiskPipeline, Lz4RejectsOtherFormats) {
+  EXPECT_FALSE(Lz4LegacyDecompress("070701not lz4").ok());
+}
+
+TEST(RamdiskPipeline, CpioRoundTrips) {
+  CpioArchive archive;
+  archive.Add(Directory("lib"));
+  archive.Add(File("lib/a.ko", "module a"));
+  archive.Add(CpioArchive::Entry{
+      .name = "init", .mode = S_IFLNK | 0777, .data = "/system/bin/init"});
+
+  auto parsed = CpioArchive::Parse(archive.Serialize());
+  ASSERT_TRUE(parsed.ok()) << parsed.error().Message();
+  ASSERT_EQ(parsed->Entries().size(), 3);
+  EXPECT_EQ(parsed->Entries()[1].name, "lib/a.ko");
+  EXPECT_EQ(parsed->Entries()[1].mode, S_IFREG | 0644);
+  EXPECT_EQ(parsed->Entries()[1].data, "module a");
+  EXPECT_EQ(parsed->Entries()[2].data, "/system/bin/init");
+  EXPECT_EQ(parsed->Serialize(), archive.Serialize());
+}
+
+TEST(RamdiskPipeline, CpioLaterArchivesReplaceEntries) {
+  CpioArchive first;
+  first.Add(File("a", "old"));
+  first.Add(File("b", "b"));
+  CpioArchive second;
+  second.Add(File("./a", "new"));
+
+  auto merged = CpioArchive::Parse(first.Serialize() + std::string(512, '\0') +
+                                   second.Serialize());
+  ASSERT_TRUE(merged.ok()) << merged.error().Message();
+  ASSERT_EQ(merged->Entries().size(), 2);
+  EXPECT_EQ(merged->Entries()[0].data, "new");
+  EXPECT_EQ(merged->Entries()[1].data, "b");
+}
+
+TEST(RamdiskPipeline, CpioRemovesTrees) {
+  CpioArchive archive;
+  archive.Add(Directory("lib"));
+  archive.Add(Directory("lib/modules"));
+  archive.Add(File("lib/modules/a.ko", "a"));
+  archive.Add(File("lib/modules_extra", "keep"));
+  archive.Add(File("init", "init"));
+
+  EXPECT_EQ(archive.RemoveTree("lib/modules"), 2);
+  ASSERT_EQ(archive.Entries().size(), 3);
+  EXPECT_EQ(archive.Entries()[0].name, "lib");
+  EXPECT_EQ(archive.Entries()[1].name, "lib/modules_extra");
+  EXPECT_EQ(archive.Entries()[2].name, "init");
+  // Lookups still work after removal.
+  archive.Add(File("init", "new init"));
+  EXPECT_EQ(archive.Entries().size(), 3);
+  EXPECT_EQ(archive.Entries()[2].data, "new init");
+}
+
+TEST(RamdiskPipeline, CpioExtracts) {
+  char tmp_dir[] = "/tmp/ramdisk_pipeline_testXXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  std::string dir = tmp_dir;
+
+  CpioArchive archive;
+  archive.Add(Directory("etc"));
+  archive.Add(File("etc/modules.load", "a.ko\n"));
+  archive.Add(CpioArchive::Entry{
+      .name = "link", .mode = S_IFLNK | 0777, .data = "etc/modules.load"});
+  auto extracted = archive.ExtractTo(dir);
+  ASSERT_TRUE(extracted.ok()) << extracted.error().Message();
+
+  std::ifstream file(dir + "/link");
+  std::stringstream contents;
+  contents << file.rdbuf();
+  EXPECT_EQ(contents.str(), "a.ko\n");
+  struct stat st;
+  ASSERT_EQ(stat((dir + "/etc").c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & 07777, 0755);
+
+  unlink((dir + "/link").c_str());
+  unlink((dir + "/etc/modules.load").c_str());
+  rmdir((dir + "/etc").c_str());
+  rmdir(dir.c_str());
+}
+
+TEST(RamdiskPipeline, CpioExtractsOnlyInsideTheDirectory) {
+  char tmp_dir[] = "/tmp/ramdisk_pipeline_testXXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  std::string dir = tmp_dir;
+
+  for (const auto& name :
+       {"../escape", "etc/../../escape", "etc/..", "..", "/escape"}) {
+    CpioArchive escaping;
+    escaping.Add(File(name, "x"));
+    EXPECT_FALSE(escaping.ExtractTo(dir).ok()) << name;
+  }
+
+  // Dots are fine within a name.
+  CpioArchive dotted;
+  dotted.Add(File("a..b", "1"));
+  dotted.Add(File("..c", "2"));
+  dotted.Add(File("d..", "3"));
+  auto extracted = dotted.ExtractTo(dir);
+  ASSERT_TRUE(extracted.ok()) << extracted.error().Message();
+  for (const auto& name : {"a..b", "..c", "d.."}) {
+    struct stat st;
+    EXPECT_EQ(stat((dir + "/" + name).c_str(), &st), 0) << name;
+    unlink((dir + "/" + name).c_str());
+  }
+  rmdir(dir.c_str());
+}
+
+TEST(RamdiskPipeline, ParsesBootImage) {
+  boot_img_hdr_v3 header = {};
+  memcpy(header.magic, BOOT_MAGIC, BOOT_MAGIC_SIZE);
+  header.kernel_size = 5000;
+  header.ramdisk_size = 6;
+  header.header_version = 4;
+  strcpy(reinterpret_cast<char*>(header.cmdline), "console=ttyS0");
+
+  std::string image(4096 * 4, '\0');
+  memcpy(image.data(), &header, sizeof(header));
+  // The header takes one page and the kernel two.
+  memcpy(image.data() + 4096 * 3, "ramdsk", 6);
+
+  auto contents = ParseBootImage(image);
+  ASSERT_TRUE(contents.ok()) << contents.error().Message();
+  EXPECT_EQ(contents->header_version, 4);
+  EXPECT_EQ(contents->ramdisk, "ramdsk");
+  EXPECT_EQ(contents->cmdline, "console=ttyS0");
+
+  header.header_version = 2;
+  memcpy(image.data(), &header, sizeof(header));
+  EXPECT_FALSE(ParseBootImage(image).ok());
+}
+
+}  // namespace cuttlefish
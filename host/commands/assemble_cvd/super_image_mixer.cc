@@ -30,6 +30,7 @@
 #include "common/libs/utils/archive.h"
 #include "common/libs/utils/files.h"
 #include "common/libs/utils/subprocess.h"
+#include "host/commands/assemble_cvd/artifact_cache.h"
 #include "host/commands/assemble_cvd/misc_info.h"
 #include "host/libs/config/cuttlefish_config.h"
 #include "host/libs/config/fetcher_config.h"
@@ -272,10 +273,26 @@ class SuperImageRebuilderImpl : public SuperImageRebuilder {
  private:
   std::unordered_set<SetupFeature*> Dependencies() const override { return {}; }
   Result<void> ResultSetup() override {
-    if (SuperImageNeedsRebuilding(fetcher_config_)) {
-      CF_EXPECT(RebuildSuperImage(fetcher_config_, config_,
-                                  instance_.new_super_image()));
+    if (!SuperImageNeedsRebuilding(fetcher_config_)) {
+      return {};
     }
+    // Mixing is slow, and the inputs are the same for every instance and
+    // usually for every assembly from the same fetched builds.
+    ArtifactKey key("mixed_super");
+    for (auto source : {FileSource::DEFAULT_BUILD, FileSource::SYSTEM_BUILD}) {
+      auto target_zip = TargetFilesZip(fetcher_config_, source);
+      CF_EXPECT(target_zip != "", "Unable to find target zip file.");
+      CF_EXPECT(key.AddFileIdentity(target_zip));
+    }
+    CF_EXPECT(key.AddTool(
+        DefaultHostArtifactsPath("otatools/bin/build_super_image")));
+    CF_EXPECT(key.AddTool(HostBinaryPath("build_super_image")));
+    CF_EXPECT(ArtifactCacheFromFlags().Materialize(
+        key, {instance_.new_super_image()}, [this]() -> Result<void> {
+          CF_EXPECT(RebuildSuperImage(fetcher_config_, config_,
+                                      instance_.new_super_image()));
+          return {};
+        }));
     return {};
   }
 
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/console_forwarder/console_ring_buffer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+
+namespace cuttlefish {
+
+ConsoleRingBuffer::ConsoleRingBuffer(size_t capacity, Overflow overflow)
+    : buffer_(capacity), overflow_(overflow) {
+  CHECK(capacity > 0) << "Ring buffer capacity must be positive";
+}
+
+void ConsoleRingBuffer::Push(const char* data, size_t size) {
+  const uint64_t capacity = buffer_.size();
+  std::unique_lock lock(mutex_);
+  if (overflow_ == Overflow::kBlock) {
+    while (size > 0) {
+      space_available_.wait(lock, [this]() { return FreeSpaceLocked() > 0; });
+      auto copied = CopyInLocked(data, size);
+      data += copied;
+      size -= copied;
+    }
+    return;
+  }
+  if (size > capacity) {
+    // Only the newest bytes could survive anyway.
+    dropped_ += size - capacity;
+    data += size - capacity;
+    size = capacity;
+  }
+  if (head_ + size > tail_ + capacity) {
+    uint64_t overflow = head_ + size - (tail_ + capacity);
+    if (peeked_) {
+      // Remember how much of the run being written was given up on, in case
+      // the write succeeds after all.
+      uint64_t peeked_end = peeked_start_ + peeked_size_;
+      if (tail_ < peeked_end) {
+        peeked_dropped_ += std::min(tail_ + overflow, peeked_end) - tail_;
+      }
+    }
+    tail_ += overflow;
+    dropped_ += overflow;
+  }
+  dropped_ += size - CopyInLocked(data, size);
+}
+
+size_t ConsoleRingBuffer::FreeSpace() const {
+  std::lock_guard lock(mutex_);
+  return FreeSpaceLocked();
+}
+
+size_t ConsoleRingBuffer::FreeSpaceLocked() const {
+  // Bytes under an ongoing write may leave the queue but can't be reused yet.
+  uint64_t limit = (peeked_ ? peeked_start_ : tail_) + buffer_.size();
+  return limit - head_;
+}
+
+size_t ConsoleRingBuffer::CopyInLocked(const char* data, size_t size) {
+  const uint64_t capacity = buffer_.size();
+  size = std::min(size, FreeSpaceLocked());
+  if (size == 0) {
+    return 0;
+  }
+  size_t offset = head_ % capacity;
+  size_t first = std::min<size_t>(size, capacity - offset);
+  memcpy(buffer_.data() + offset, data, first);
+  memcpy(buffer_.data(), data + first, size - first);
+  head_ += size;
+  data_available_.notify_one();
+  return size;
+}
+
+ConsoleRingBuffer::Run ConsoleRingBuffer::Peek() {
+  const uint64_t capacity = buffer_.size();
+  std::unique_lock lock(mutex_);
+  data_available_.wait(lock, [this]() { return head_ > tail_; });
+  size_t offset = tail_ % capacity;
+  size_t size = std::min<uint64_t>(head_ - tail_, capacity - offset);
+  peeked_ = true;
+  peeked_start_ = tail_;
+  peeked_size_ = size;
+  peeked_dropped_ = 0;
+  return Run{buffer_.data() + offset, size};
+}
+
+void ConsoleRingBuffer::Release(size_t size) {
+  std::lock_guard lock(mutex_);
+  peeked_ = false;
+  // The producer may have moved past the run while it was being written.
+  dropped_ -= std::min<uint64_t>(peeked_dropped_, size);
+  tail_ = std::max(tail_, peeked_start_ + size);
+  space_available_.notify_one();
+}
+
+void ConsoleRingBuffer::Clear() {
+  std::lock_guard lock(mutex_);
+  tail_ = head_;
+  space_available_.notify_one();
+}
+
+uint64_t ConsoleRingBuffer::DroppedBytes() const {
+  std::lock_guard lock(mutex_);
+  return dropped_;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cuttlefish {
+
+// Fixed size byte queue between one producer and one consumer that may be
+// arbitrarily slow.
+//
+// With Overflow::kDropOldest the producer never blocks: when it runs out of
+// room it discards the oldest unconsumed bytes. The consumer writes straight
+// out of the buffer: the run returned by Peek() is never overwritten before
+// Release() is called, so while a write is in progress the producer may have
+// to discard the newest bytes instead. Either way the discarded bytes are
+// added to DroppedBytes().
+//
+// With Overflow::kBlock nothing is dropped, the producer waits for the
+// consumer to make room instead.
+class ConsoleRingBuffer {
+ public:
+  struct Run {
+    const char* data;
+    size_t size;
+  };
+
+  enum class Overflow { kDropOldest, kBlock };
+
+  explicit ConsoleRingBuffer(size_t capacity,
+                             Overflow overflow = Overflow::kDropOldest);
+
+  void Push(const char* data, size_t size);
+  // Bytes that can be pushed without dropping or blocking.
+  size_t FreeSpace() const;
+  // Blocks until there is data and returns the oldest contiguous run of it.
+  Run Peek();
+  // Marks `size` bytes of the last Peek() run as consumed.
+  void Release(size_t size);
+  // Discards all queued data without counting it as dropped.
+  void Clear();
+
+  uint64_t DroppedBytes() const;
+
+ private:
+  // Copies as much of `data` as fits without touching queued bytes, returns
+  // how much that was.
+  size_t CopyInLocked(const char* data, size_t size);
+  size_t FreeSpaceLocked() const;
+
+  std::vector<char> buffer_;
+  const Overflow overflow_;
+  mutable std::mutex mutex_;
+  std::condition_variable data_available_;
+  std::condition_variable space_available_;
+  // Positions are byte counts since creation, reduced modulo the capacity to
+  // index into buffer_.
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+  bool peeked_ = false;
+  uint64_t peeked_start_ = 0;
+  uint64_t peeked_size_ = 0;
+  // Bytes at the start of the peeked run that were counted as dropped.
+  uint64_t peeked_dropped_ = 0;
+  uint64_t dropped_ = 0;
+};
+
+}  // namespace cuttlefish
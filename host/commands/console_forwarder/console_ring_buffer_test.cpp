@@ -0,0 +1,145 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "host/commands/console_forwarder/console_ring_buffer.h"
+
+namespace cuttlefish {
+namespace {
+
+std::string Drain(ConsoleRingBuffer& buffer, size_t size) {
+  std::string out;
+  while (out.size() < size) {
+    auto run = buffer.Peek();
+    out.append(run.data, run.size);
+    buffer.Release(run.size);
+  }
+  return out;
+}
+
+void Push(ConsoleRingBuffer& buffer, const std::string& data) {
+  buffer.Push(data.data(), data.size());
+}
+
+}  // namespace
+
+TEST(ConsoleRingBuffer, WrapsAround) {
+  ConsoleRingBuffer buffer(8);
+  Push(buffer, "abcdef");
+  EXPECT_EQ(Drain(buffer, 6), "abcdef");
+  Push(buffer, "ghijkl");
+  EXPECT_EQ(Drain(buffer, 6), "ghijkl");
+  EXPECT_EQ(buffer.DroppedBytes(), 0);
+}
+
+TEST(ConsoleRingBuffer, DropsOldest) {
+  ConsoleRingBuffer buffer(8);
+  Push(buffer, "abcdef");
+  Push(buffer, "ghijkl");
+  EXPECT_EQ(Drain(buffer, 8), "efghijkl");
+  EXPECT_EQ(buffer.DroppedBytes(), 4);
+}
+
+TEST(ConsoleRingBuffer, KeepsNewestOfOversizedPush) {
+  ConsoleRingBuffer buffer(4);
+  Push(buffer, "abcdefgh");
+  EXPECT_EQ(Drain(buffer, 4), "efgh");
+  EXPECT_EQ(buffer.DroppedBytes(), 4);
+}
+
+TEST(ConsoleRingBuffer, DoesNotOverwritePeekedRun) {
+  ConsoleRingBuffer buffer(8);
+  Push(buffer, "abcd");
+  auto run = buffer.Peek();
+  ASSERT_EQ(std::string(run.data, run.size), "abcd");
+  // Only the four free bytes can be used while "abcd" is being written.
+  Push(buffer, "efghijkl");
+  EXPECT_EQ(std::string(run.data, run.size), "abcd");
+  buffer.Release(run.size);
+  EXPECT_EQ(Drain(buffer, 4), "efgh");
+  EXPECT_EQ(buffer.DroppedBytes(), 4);
+}
+
+TEST(ConsoleRingBuffer, PeekedRunCanFallBehind) {
+  ConsoleRingBuffer buffer(8);
+  Push(buffer, "abcdef");
+  buffer.Peek();
+  // The producer moves past "ab" while it is being written.
+  Push(buffer, "gh");
+  Push(buffer, "ij");
+  buffer.Release(2);
+  EXPECT_EQ(Drain(buffer, 6), "cdefgh");
+  // Only "ij" was lost, "ab" made it out.
+  EXPECT_EQ(buffer.DroppedBytes(), 2);
+}
+
+TEST(ConsoleRingBuffer, ClearWhilePeeked) {
+  ConsoleRingBuffer buffer(8);
+  Push(buffer, "abcd");
+  buffer.Peek();
+  buffer.Clear();
+  buffer.Release(4);
+  Push(buffer, "ef");
+  EXPECT_EQ(Drain(buffer, 2), "ef");
+  EXPECT_EQ(buffer.DroppedBytes(), 0);
+}
+
+TEST(ConsoleRingBuffer, ClearDoesNotCountAsDropped) {
+  ConsoleRingBuffer buffer(8);
+  Push(buffer, "abcd");
+  buffer.Clear();
+  Push(buffer, "ef");
+  EXPECT_EQ(Drain(buffer, 2), "ef");
+  EXPECT_EQ(buffer.DroppedBytes(), 0);
+}
+
+TEST(ConsoleRingBuffer, ReportsFreeSpace) {
+  ConsoleRingBuffer buffer(8);
+  Push(buffer, "abcdef");
+  EXPECT_EQ(buffer.FreeSpace(), 2);
+  buffer.Peek();
+  buffer.Release(2);
+  EXPECT_EQ(buffer.FreeSpace(), 4);
+}
+
+TEST(ConsoleRingBuffer, BlockingBufferWaitsForRoom) {
+  ConsoleRingBuffer buffer(4, ConsoleRingBuffer::Overflow::kBlock);
+  std::thread producer([&buffer]() { Push(buffer, "abcdefghij"); });
+  EXPECT_EQ(Drain(buffer, 10), "abcdefghij");
+  producer.join();
+  EXPECT_EQ(buffer.DroppedBytes(), 0);
+}
+
+TEST(ConsoleRingBuffer, BlockingBufferKeepsPeekedRun) {
+  ConsoleRingBuffer buffer(4, ConsoleRingBuffer::Overflow::kBlock);
+  Push(buffer, "ab");
+  auto run = buffer.Peek();
+  std::thread producer([&buffer]() { Push(buffer, "cdef"); });
+  // Only two bytes fit while "ab" is being written.
+  while (buffer.FreeSpace() > 0) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(std::string(run.data, run.size), "ab");
+  buffer.Release(run.size);
+  producer.join();
+  EXPECT_EQ(Drain(buffer, 4), "cdef");
+  EXPECT_EQ(buffer.DroppedBytes(), 0);
+}
+
+}  // namespace cuttlefish
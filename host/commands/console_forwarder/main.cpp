@@ -14,20 +14,25 @@
  * limitations under the License.
  */
 
+#include <poll.h>
 #include <termios.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
 
-#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
 #include <thread>
-#include <vector>
+#include <utility>
 
 #include <gflags/gflags.h>
 #include <android-base/logging.h>
 
 #include <common/libs/fs/shared_fd.h>
 #include <common/libs/fs/shared_select.h>
+#include <host/commands/console_forwarder/console_ring_buffer.h>
 #include <host/libs/config/cuttlefish_config.h>
 #include <host/libs/config/logging.h>
 
@@ -39,6 +44,94 @@ DEFINE_int32(console_out_fd,
              "File descriptor for the console's output channel");
 
 namespace cuttlefish {
+namespace {
+
+constexpr size_t kReadSize = 4096;
+constexpr size_t kLogBufferSize = 1024 * 1024;
+constexpr size_t kClientBufferSize = 64 * 1024;
+constexpr size_t kConsoleInBufferSize = 64 * 1024;
+constexpr int kWritableTimeoutMs = 100;
+// How often the client is checked for again while console input is full.
+constexpr int kConsoleInFullRetryMs = 10;
+constexpr auto kDropReportInterval = std::chrono::seconds(10);
+
+// A file descriptor the console forwards data to, with the bytes still
+// waiting to be written to it.
+class Destination {
+ public:
+  Destination(std::string name, SharedFD fd, size_t capacity,
+              ConsoleRingBuffer::Overflow overflow)
+      : name_(std::move(name)),
+        buffer_(capacity, overflow),
+        fd_(std::move(fd)) {}
+
+  void Push(const char* data, size_t size) { buffer_.Push(data, size); }
+  size_t FreeSpace() const { return buffer_.FreeSpace(); }
+
+  // Points the destination at a new file descriptor, discarding whatever was
+  // queued for the old one.
+  void Reset(SharedFD fd) {
+    std::lock_guard lock(fd_mutex_);
+    fd_ = std::move(fd);
+    buffer_.Clear();
+  }
+
+  void StartWriter() {
+    writer_ = std::thread([this]() { WriteLoop(); });
+  }
+
+ private:
+  SharedFD Fd() {
+    std::lock_guard lock(fd_mutex_);
+    return fd_;
+  }
+
+  [[noreturn]] void WriteLoop() {
+    uint64_t reported_drops = 0;
+    auto last_report = std::chrono::steady_clock::now() - kDropReportInterval;
+    while (true) {
+      auto run = buffer_.Peek();
+      auto fd = Fd();
+      auto bytes_written = fd->Write(run.data, run.size);
+      if (bytes_written < 0) {
+        auto error = fd->GetErrno();
+        if (error == EAGAIN) {
+          // Nothing is reading the PTY. Give the run back so newer console
+          // output can replace it while waiting.
+          buffer_.Release(0);
+          PollSharedFd writable = {.fd = fd, .events = POLLOUT};
+          SharedFD::Poll(&writable, 1, kWritableTimeoutMs);
+          continue;
+        }
+        // Error handling is done on the reading thread (a failed client is
+        // disconnected, a serial console failure aborts the process).
+        LOG(ERROR) << "Error writing to " << name_ << ": " << fd->StrError();
+        buffer_.Release(run.size);
+      } else {
+        buffer_.Release(bytes_written);
+      }
+
+      auto dropped = buffer_.DroppedBytes();
+      auto now = std::chrono::steady_clock::now();
+      if (dropped != reported_drops &&
+          now - last_report >= kDropReportInterval) {
+        LOG(WARNING) << "Dropped " << dropped - reported_drops
+                     << " bytes of console data for " << name_ << " ("
+                     << dropped << " in total), it can't keep up";
+        reported_drops = dropped;
+        last_report = now;
+      }
+    }
+  }
+
+  std::string name_;
+  ConsoleRingBuffer buffer_;
+  std::mutex fd_mutex_;
+  SharedFD fd_;
+  std::thread writer_;
+};
+
+}  // namespace
 
 // Handles forwarding the serial console to a pseudo-terminal (PTY)
 // It receives a couple of fds for the console (could be the same fd twice if,
@@ -46,22 +139,35 @@ namespace cuttlefish {
 // Data available in the console's output needs to be read immediately to avoid
 // the having the VMM blocked on writes to the pipe. To achieve this one thread
 // takes care of (and only of) all read calls (from console output and from the
-// socket client), using select(2) to ensure it never blocks. Writes are handled
-// in a different thread, the two threads communicate through a buffer queue
-// protected by a mutex.
+// socket client), using select(2) to ensure it never blocks. Each destination
+// has its own fixed size ring buffer and writer thread, so a stalled reader
+// doesn't hold back the others or grow memory. The console log, the kernel
+// log and the client lose their oldest data when they fall behind, with the
+// dropped bytes counted and logged. The kernel log is parsed for boot events,
+// but blocking on it would stall the VMM's serial output, so it only gets a
+// larger buffer than the client. The console input carries keystrokes and can't lose
+// data, so the client isn't read while the console input buffer is full.
 class ConsoleForwarder {
  public:
   ConsoleForwarder(std::string console_path, SharedFD console_in,
                    SharedFD console_out, SharedFD console_log,
                    SharedFD kernel_log)
       : console_path_(console_path),
-        console_in_(console_in),
         console_out_(console_out),
-        console_log_(console_log),
-        kernel_log_(kernel_log) {}
+        console_in_("console input", console_in, kConsoleInBufferSize,
+                    ConsoleRingBuffer::Overflow::kBlock),
+        console_log_("console log", console_log, kLogBufferSize,
+                     ConsoleRingBuffer::Overflow::kDropOldest),
+        kernel_log_("kernel log", kernel_log, kLogBufferSize,
+                    ConsoleRingBuffer::Overflow::kDropOldest),
+        client_("console client", SharedFD(), kClientBufferSize,
+                ConsoleRingBuffer::Overflow::kDropOldest) {}
   [[noreturn]] void StartServer() {
-    // Create a new thread to handle writes to the console
-    writer_thread_ = std::thread([this]() { WriteLoop(); });
+    // Create a thread for each destination to handle writes to it
+    console_in_.StartWriter();
+    console_log_.StartWriter();
+    kernel_log_.StartWriter();
+    client_.StartWriter();
     // Use the calling thread (likely the process' main thread) to handle
     // reading the console's output and input from the client.
     ReadLoop();
@@ -105,84 +211,41 @@ class ConsoleForwarder {
     return pty_shared_fd;
   }
 
-  void EnqueueWrite(std::shared_ptr<std::vector<char>> buf_ptr, SharedFD fd) {
-    std::lock_guard<std::mutex> lock(write_queue_mutex_);
-    write_queue_.emplace_back(fd, buf_ptr);
-    condvar_.notify_one();
-  }
-
-  [[noreturn]] void WriteLoop() {
-    while (true) {
-      while (!write_queue_.empty()) {
-        std::shared_ptr<std::vector<char>> buf_ptr;
-        SharedFD fd;
-        {
-          std::lock_guard<std::mutex> lock(write_queue_mutex_);
-          auto& front = write_queue_.front();
-          buf_ptr = front.second;
-          fd = front.first;
-          write_queue_.pop_front();
-        }
-        // Write all bytes to the file descriptor. Writes may block, so the
-        // mutex lock should NOT be held while writing to avoid blocking the
-        // other thread.
-        ssize_t bytes_written = 0;
-        ssize_t bytes_to_write = buf_ptr->size();
-        while (bytes_to_write > 0) {
-          bytes_written =
-              fd->Write(buf_ptr->data() + bytes_written, bytes_to_write);
-          if (bytes_written < 0) {
-            // It is expected for writes to the PTY to fail if nothing is connected
-            if(fd->GetErrno() != EAGAIN) {
-              LOG(ERROR) << "Error writing to fd: " << fd->StrError();
-            }
-
-            // Don't try to write from this buffer anymore, error handling will
-            // be done on the reading thread (failed client will be
-            // disconnected, on serial console failure this process will abort).
-            break;
-          }
-          bytes_to_write -= bytes_written;
-        }
-      }
-      {
-        std::unique_lock<std::mutex> lock(write_queue_mutex_);
-        // Check again before sleeping, state may have changed
-        if (write_queue_.empty()) {
-          condvar_.wait(lock);
-        }
-      }
-    }
-  }
-
   [[noreturn]] void ReadLoop() {
     SharedFD client_fd;
+    char buf[kReadSize];
     while (true) {
       if (!client_fd->IsOpen()) {
         client_fd = OpenPTY();
+        client_.Reset(client_fd);
       }
 
       SharedFDSet read_set;
       read_set.Set(console_out_);
-      read_set.Set(client_fd);
+      // Only read as much input as can be queued without blocking, the rest
+      // waits in the PTY.
+      auto console_in_space = std::min(console_in_.FreeSpace(), sizeof(buf));
+      struct timeval retry = {.tv_sec = 0,
+                              .tv_usec = kConsoleInFullRetryMs * 1000};
+      if (console_in_space > 0) {
+        read_set.Set(client_fd);
+      }
 
-      Select(&read_set, nullptr, nullptr, nullptr);
+      Select(&read_set, nullptr, nullptr,
+             console_in_space > 0 ? nullptr : &retry);
       if (read_set.IsSet(console_out_)) {
-        std::shared_ptr<std::vector<char>> buf_ptr = std::make_shared<std::vector<char>>(4096);
-        auto bytes_read = console_out_->Read(buf_ptr->data(), buf_ptr->size());
+        auto bytes_read = console_out_->Read(buf, sizeof(buf));
         // This is likely unrecoverable, so exit here
         CHECK(bytes_read > 0) << "Error reading from console output: "
                               << console_out_->StrError();
-        buf_ptr->resize(bytes_read);
-        EnqueueWrite(buf_ptr, console_log_);
+        console_log_.Push(buf, bytes_read);
         if (client_fd->IsOpen()) {
-          EnqueueWrite(buf_ptr, client_fd);
+          client_.Push(buf, bytes_read);
         }
-        EnqueueWrite(buf_ptr, kernel_log_);
+        kernel_log_.Push(buf, bytes_read);
       }
       if (read_set.IsSet(client_fd)) {
-        std::shared_ptr<std::vector<char>> buf_ptr = std::make_shared<std::vector<char>>(4096);
-        auto bytes_read = client_fd->Read(buf_ptr->data(), buf_ptr->size());
+        auto bytes_read = client_fd->Read(buf, console_in_space);
         if (bytes_read <= 0) {
           // If this happens, it's usually because the PTY controller went away
           // e.g. the user closed minicom, or killed screen, or closed kgdb. In
@@ -191,23 +254,18 @@ class ConsoleForwarder {
                      << client_fd->StrError();
           client_fd->Close();
         } else {
-          buf_ptr->resize(bytes_read);
-          EnqueueWrite(buf_ptr, console_in_);
+          console_in_.Push(buf, bytes_read);
         }
       }
     }
   }
 
   std::string console_path_;
-  SharedFD console_in_;
   SharedFD console_out_;
-  SharedFD console_log_;
-  SharedFD kernel_log_;
-  std::thread writer_thread_;
-  std::mutex write_queue_mutex_;
-  std::condition_variable condvar_;
-  std::deque<std::pair<SharedFD, std::shared_ptr<std::vector<char>>>>
-      write_queue_;
+  Destination console_in_;
+  Destination console_log_;
+  Destination kernel_log_;
+  Destination client_;
 };
 
 int ConsoleForwarderMain(int argc, char** argv) {
@@ -18,9 +18,11 @@
 
 #include <signal.h>
 
+#include <future>
 #include <map>
 #include <mutex>
 #include <sstream>
+#include <vector>
 
 #include <android-base/file.h>
 #include <fruit/fruit.h>
@@ -43,6 +45,10 @@
 namespace cuttlefish {
 namespace {
 
+// Each status command runs the status binary of a group, possibly once per
+// instance.
+constexpr size_t kMaxConcurrentStatusCommands = 4;
+
 // Returns true only if command terminated normally, and returns 0
 Result<void> RunCommand(Command&& command) {
   auto subprocess = std::move(command.Start());
@@ -225,8 +231,8 @@ static Result<ExecCommandResult> ExecCommand(Command&& command) {
 }
 
 Result<InstanceManager::StatusCommandOutput>
-InstanceManager::IssueStatusCommand(const selector::LocalInstanceGroup& group,
-                                    const SharedFD& err) {
+InstanceManager::IssueStatusCommand(
+    const selector::LocalInstanceGroup& group) {
   std::string not_supported_version_msg = " does not comply with cvd fleet.\n";
   const auto host_android_out = group.HostArtifactsPath();
   auto status_bin = CF_EXPECT(host_tool_target_manager_.ExecBaseName({
@@ -240,8 +246,8 @@ InstanceManager::IssueStatusCommand(const selector::LocalInstanceGroup& group,
   if (command_result.ok()) {
     StatusCommandOutput output;
     if (command_result->stdout_buf.empty()) {
-      WriteAll(err, ConcatToString(group.GroupName(), "-*",
-                                   not_supported_version_msg));
+      output.stderr_msg = ConcatToString(group.GroupName(), "-*",
+                                         not_supported_version_msg);
       Json::Reader().parse("{}", output.stdout_json);
       return output;
     }
@@ -260,8 +266,8 @@ InstanceManager::IssueStatusCommand(const selector::LocalInstanceGroup& group,
     auto second_command_result =
         CF_EXPECT(ExecCommand(std::move(without_args)));
     if (second_command_result.stdout_buf.empty()) {
-      WriteAll(err,
-               instance_ref.Get().DeviceName() + not_supported_version_msg);
+      output.stderr_msg +=
+          instance_ref.Get().DeviceName() + not_supported_version_msg;
       second_command_result.stdout_buf.append("{}");
     }
     output.stdout_json[index] =
@@ -281,9 +287,29 @@ Result<cvd::Status> InstanceManager::CvdFleetImpl(const uid_t uid,
   WriteAll(out, _GroupDeviceInfoStart);
   auto&& instance_groups = instance_db.InstanceGroups();
 
+  // A few groups are queried at a time. Their output is written in order by
+  // this thread only, so the messages of different groups don't interleave.
+  std::vector<std::future<Result<StatusCommandOutput>>> results;
+  results.reserve(instance_groups.size());
+  auto start_next = [this, &instance_groups, &results]() {
+    if (results.size() == instance_groups.size()) {
+      return;
+    }
+    const auto& group = *instance_groups[results.size()];
+    results.emplace_back(std::async(std::launch::async, [this, &group]() {
+      return IssueStatusCommand(group);
+    }));
+  };
   for (const auto& group : instance_groups) {
     CF_EXPECT(group != nullptr);
-    auto result = IssueStatusCommand(*group, err);
+  }
+  for (size_t i = 0; i < kMaxConcurrentStatusCommands; i++) {
+    start_next();
+  }
+  auto results_it = results.begin();
+  for (const auto& group : instance_groups) {
+    auto result = (results_it++)->get();
+    start_next();
     if (!result.ok()) {
       WriteAll(err, "      (unknown instance status error)");
     } else {
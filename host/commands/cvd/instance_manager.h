@@ -119,7 +119,7 @@ class InstanceManager {
     Json::Value stdout_json;
   };
   Result<StatusCommandOutput> IssueStatusCommand(
-      const selector::LocalInstanceGroup& group, const SharedFD& err);
+      const selector::LocalInstanceGroup& group);
   Result<void> IssueStopCommand(const SharedFD& out, const SharedFD& err,
                                 const std::string& config_file_path,
                                 const selector::LocalInstanceGroup& group);
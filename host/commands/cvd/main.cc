@@ -15,6 +15,7 @@
  */
 
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <iterator>
 #include <optional>
@@ -84,6 +85,7 @@ struct RunServerParam {
    *
    */
   SharedFD carryover_stderr_fd;
+  ServerRequestLimits request_limits;
 };
 Result<void> RunServer(const RunServerParam& fds) {
   if (!fds.internal_server_fd->IsOpen()) {
@@ -108,7 +110,8 @@ Result<void> RunServer(const RunServerParam& fds) {
                            .carryover_client_fd = fds.carryover_client_fd,
                            .memory_carryover_fd = fds.memory_carryover_fd,
                            .server_logger = std::move(server_logger),
-                           .scoped_logger = std::move(scoped_logger)}));
+                           .scoped_logger = std::move(scoped_logger),
+                           .request_limits = fds.request_limits}));
   return {};
 }
 
@@ -117,6 +120,7 @@ struct ParseResult {
   SharedFD carryover_client_fd;
   std::optional<SharedFD> memory_carryover_fd;
   SharedFD carryover_stderr_fd;
+  ServerRequestLimits request_limits;
 };
 
 Result<ParseResult> ParseIfServer(std::vector<std::string>& all_args) {
@@ -132,7 +136,21 @@ Result<ParseResult> ParseIfServer(std::vector<std::string>& all_args) {
   SharedFD memory_carryover_fd;
   flags.emplace_back(
       SharedFDFlag("INTERNAL_memory_carryover_fd", memory_carryover_fd));
+  ServerRequestLimits defaults;
+  std::int32_t request_workers = defaults.workers;
+  flags.emplace_back(GflagsCompatFlag("request_workers", request_workers));
+  std::int32_t max_concurrent_fetches = defaults.concurrent_fetches;
+  flags.emplace_back(
+      GflagsCompatFlag("max_concurrent_fetches", max_concurrent_fetches));
+  std::int32_t max_concurrent_starts = defaults.concurrent_starts;
+  flags.emplace_back(
+      GflagsCompatFlag("max_concurrent_starts", max_concurrent_starts));
   CF_EXPECT(ParseFlags(flags, all_args));
+  CF_EXPECT(request_workers > 0, "--request_workers must be positive");
+  CF_EXPECT(max_concurrent_fetches > 0,
+            "--max_concurrent_fetches must be positive");
+  CF_EXPECT(max_concurrent_starts > 0,
+            "--max_concurrent_starts must be positive");
   std::optional<SharedFD> memory_carryover_fd_opt;
   if (memory_carryover_fd->IsOpen()) {
     memory_carryover_fd_opt = std::move(memory_carryover_fd);
@@ -142,6 +160,12 @@ Result<ParseResult> ParseIfServer(std::vector<std::string>& all_args) {
       .carryover_client_fd = carryover_client_fd,
       .memory_carryover_fd = memory_carryover_fd_opt,
       .carryover_stderr_fd = carryover_stderr_fd,
+      .request_limits =
+          {
+              .workers = static_cast<size_t>(request_workers),
+              .concurrent_fetches = static_cast<size_t>(max_concurrent_fetches),
+              .concurrent_starts = static_cast<size_t>(max_concurrent_starts),
+          },
   };
   return {result};
 }
@@ -247,7 +271,8 @@ Result<void> CvdMain(int argc, char** argv, char** envp) {
     return RunServer({.internal_server_fd = parsed_fds.internal_server_fd,
                       .carryover_client_fd = parsed_fds.carryover_client_fd,
                       .memory_carryover_fd = parsed_fds.memory_carryover_fd,
-                      .carryover_stderr_fd = parsed_fds.carryover_stderr_fd});
+                      .carryover_stderr_fd = parsed_fds.carryover_stderr_fd,
+                      .request_limits = parsed_fds.request_limits});
   }
 
   CF_EXPECT_EQ(android::base::Basename(all_args[0]), "cvd");
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/cvd/request_executor.h"
+
+#include <utility>
+
+#include <android-base/logging.h>
+
+namespace cuttlefish {
+namespace {
+
+thread_local bool is_worker_thread = false;
+
+}  // namespace
+
+RequestExecutor::RequestExecutor(size_t num_workers,
+                                 std::map<std::string, size_t> class_limits)
+    : class_limits_(std::move(class_limits)) {
+  for (size_t i = 0; i < num_workers; i++) {
+    workers_.emplace_back([this]() { WorkerLoop(); });
+  }
+}
+
+RequestExecutor::~RequestExecutor() {
+  Stop();
+  Join();
+}
+
+RequestExecutor::Submitted RequestExecutor::Submit(
+    const std::string& request_class, Task task) {
+  std::lock_guard lock(mutex_);
+  if (stopped_) {
+    return {.id = 0, .queue_depth = 0};
+  }
+  Request request{
+      .id = next_id_++,
+      .request_class = request_class,
+      .task = std::move(task),
+  };
+  Submitted submitted{.id = request.id, .queue_depth = 0};
+  // Requests still in the queue may not have been picked up by a worker yet,
+  // they are counted as if they were running already.
+  size_t of_class = 0;
+  for (const auto& queued : queue_) {
+    of_class += queued.request_class == request_class ? 1 : 0;
+  }
+  if (running_ + queue_.size() >= workers_.size() ||
+      !CanRun(request, of_class)) {
+    submitted.queue_depth = queue_.size() + 1;
+  }
+  queue_.emplace_back(std::move(request));
+  queue_cv_.notify_one();
+  return submitted;
+}
+
+bool RequestExecutor::Cancel(uint64_t id) {
+  std::lock_guard lock(mutex_);
+  for (auto it = queue_.begin(); it != queue_.end(); it++) {
+    if (it->id == id) {
+      queue_.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+void RequestExecutor::Stop() {
+  std::unique_lock lock(mutex_);
+  stopped_ = true;
+  if (!queue_.empty()) {
+    LOG(DEBUG) << "Dropping " << queue_.size() << " queued requests";
+    queue_.clear();
+  }
+  queue_cv_.notify_all();
+  size_t own = is_worker_thread ? 1 : 0;
+  idle_cv_.wait(lock, [this, own]() { return running_ == own; });
+}
+
+void RequestExecutor::Join() {
+  for (auto& worker : workers_) {
+    if (worker.joinable() && worker.get_id() != std::this_thread::get_id()) {
+      worker.join();
+    }
+  }
+}
+
+bool RequestExecutor::CanRun(const Request& request, size_t ahead) const {
+  auto limit = class_limits_.find(request.request_class);
+  if (limit == class_limits_.end()) {
+    return true;
+  }
+  auto running = running_per_class_.find(request.request_class);
+  if (running != running_per_class_.end()) {
+    ahead += running->second;
+  }
+  return ahead < limit->second;
+}
+
+void RequestExecutor::WorkerLoop() {
+  is_worker_thread = true;
+  std::unique_lock lock(mutex_);
+  while (true) {
+    auto next = queue_.end();
+    queue_cv_.wait(lock, [this, &next]() {
+      for (next = queue_.begin(); next != queue_.end(); next++) {
+        if (CanRun(*next)) {
+          break;
+        }
+      }
+      return stopped_ || next != queue_.end();
+    });
+    if (stopped_) {
+      return;
+    }
+    auto request = std::move(*next);
+    queue_.erase(next);
+    running_++;
+    running_per_class_[request.request_class]++;
+
+    lock.unlock();
+    request.task();
+    lock.lock();
+
+    running_--;
+    running_per_class_[request.request_class]--;
+    // A finished request may let a queued one of its class start.
+    queue_cv_.notify_all();
+    idle_cv_.notify_all();
+  }
+}
+
+}  // namespace cuttlefish
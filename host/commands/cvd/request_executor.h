@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cuttlefish {
+
+/*
+ * Runs server requests on a fixed number of worker threads.
+ *
+ * Requests are grouped into classes, and a class may have a limit on how
+ * many of its requests run at once, e.g. to keep a few fetches from taking
+ * all the workers. A queued request runs as soon as a worker is free and its
+ * class is under its limit, even when older requests of another class are
+ * still waiting, so cheap commands aren't stuck behind heavy ones.
+ */
+class RequestExecutor {
+ public:
+  using Task = std::function<void()>;
+
+  RequestExecutor(size_t num_workers,
+                  std::map<std::string, size_t> class_limits);
+  ~RequestExecutor();
+
+  struct Submitted {
+    // Zero when the executor was stopped and the task was dropped.
+    uint64_t id;
+    // The position of the request in the queue, zero when it can start
+    // right away. Requests that are about to start count as queued.
+    size_t queue_depth;
+  };
+  Submitted Submit(const std::string& request_class, Task task);
+  // Removes a request that didn't start yet, returns whether it was removed.
+  bool Cancel(uint64_t id);
+
+  // Drops the queued requests and waits for the running ones to finish,
+  // except the one on the calling thread if it is a worker.
+  void Stop();
+  // Waits for the workers to exit, after Stop().
+  void Join();
+
+ private:
+  struct Request {
+    uint64_t id;
+    std::string request_class;
+    Task task;
+  };
+
+  void WorkerLoop();
+  // Whether the limit of the request's class allows it to run with `ahead`
+  // more requests of its class started first. Called with mutex_ held.
+  bool CanRun(const Request& request, size_t ahead = 0) const;
+
+  const std::map<std::string, size_t> class_limits_;
+  std::mutex mutex_;
+  std::condition_variable queue_cv_;
+  std::condition_variable idle_cv_;
+  bool stopped_ = false;
+  uint64_t next_id_ = 1;
+  std::list<Request> queue_;
+  std::map<std::string, size_t> running_per_class_;
+  size_t running_ = 0;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace cuttlefish
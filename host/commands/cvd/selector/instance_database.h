@@ -18,6 +18,7 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "common/libs/utils/result.h"
@@ -144,7 +145,24 @@ class InstanceDatabase {
 
   Result<void> LoadGroupFromJson(const Json::Value& group_json);
 
+  void IndexInstance(const LocalInstance& instance);
+  void RemoveFromIndexes(const LocalInstanceGroup& group);
+
   std::vector<std::unique_ptr<LocalInstanceGroup>> local_instance_groups_;
+  /*
+   * Indexes of local_instance_groups_ so that the lookups don't visit every
+   * group, updated whenever a group or an instance is added or removed.
+   *
+   * A group is indexed by its home directory both as given and resolved by
+   * realpath.
+   */
+  Map<std::string, LocalInstanceGroup*> groups_by_home_;
+  Map<std::string, LocalInstanceGroup*> groups_by_name_;
+  Map<unsigned, const LocalInstance*> instances_by_id_;
+  // Per-instance names are only unique within a group.
+  Map<std::string, Set<const LocalInstance*>> instances_by_name_;
+  // The last serialization of each group, dropped when the group changes.
+  mutable Map<const LocalInstanceGroup*, Json::Value> serialized_groups_;
   Map<FieldName, ConstGroupHandler> group_handlers_;
   Map<FieldName, ConstInstanceHandler> instance_handlers_;
 
@@ -44,7 +44,43 @@ InstanceDatabase::FindIterator(const LocalInstanceGroup& group) {
   return local_instance_groups_.end();
 }
 
-void InstanceDatabase::Clear() { local_instance_groups_.clear(); }
+void InstanceDatabase::Clear() {
+  local_instance_groups_.clear();
+  groups_by_home_.clear();
+  groups_by_name_.clear();
+  instances_by_id_.clear();
+  instances_by_name_.clear();
+  serialized_groups_.clear();
+}
+
+void InstanceDatabase::IndexInstance(const LocalInstance& instance) {
+  instances_by_id_[instance.InstanceId()] = std::addressof(instance);
+  instances_by_name_[instance.PerInstanceName()].insert(
+      std::addressof(instance));
+}
+
+void InstanceDatabase::RemoveFromIndexes(const LocalInstanceGroup& group) {
+  for (auto itr = groups_by_home_.begin(); itr != groups_by_home_.end();) {
+    if (itr->second == std::addressof(group)) {
+      itr = groups_by_home_.erase(itr);
+    } else {
+      itr++;
+    }
+  }
+  groups_by_name_.erase(group.GroupName());
+  for (const auto& instance : group.Instances()) {
+    instances_by_id_.erase(instance->InstanceId());
+    auto by_name = instances_by_name_.find(instance->PerInstanceName());
+    if (by_name == instances_by_name_.end()) {
+      continue;
+    }
+    by_name->second.erase(instance.get());
+    if (by_name->second.empty()) {
+      instances_by_name_.erase(by_name);
+    }
+  }
+  serialized_groups_.erase(std::addressof(group));
+}
 
 Result<ConstRef<LocalInstanceGroup>> InstanceDatabase::AddInstanceGroup(
     const AddInstanceGroupParam& param) {
@@ -73,6 +109,12 @@ Result<ConstRef<LocalInstanceGroup>> InstanceDatabase::AddInstanceGroup(
   CF_EXPECT(new_group != nullptr);
   local_instance_groups_.emplace_back(new_group);
   const auto raw_ptr = local_instance_groups_.back().get();
+  groups_by_name_[raw_ptr->GroupName()] = raw_ptr;
+  groups_by_home_[raw_ptr->HomeDir()] = raw_ptr;
+  std::string home_realpath;
+  if (android::base::Realpath(raw_ptr->HomeDir(), &home_realpath)) {
+    groups_by_home_[home_realpath] = raw_ptr;
+  }
   ConstRef<LocalInstanceGroup> const_ref = *raw_ptr;
   return {const_ref};
 }
@@ -85,22 +127,20 @@ Result<void> InstanceDatabase::AddInstance(const std::string& group_name,
 
   CF_EXPECT(IsValidInstanceName(instance_name),
             "instance_name " << instance_name << " is invalid.");
-  auto itr = FindIterator(group);
-  CF_EXPECT(
-      itr != local_instance_groups_.end() && *itr != nullptr,
-      "Adding instances to non-existing group " + group.InternalGroupName());
-
-  auto instances =
-      CF_EXPECT(FindInstances({kInstanceIdField, std::to_string(id)}));
-  if (instances.size() != 0) {
+  if (Contains(instances_by_id_, id)) {
     return CF_ERR("instance id " << id << " is taken");
   }
 
-  auto instances_by_name = CF_EXPECT((*itr)->FindByInstanceName(instance_name));
+  auto instances_by_name = CF_EXPECT(group.FindByInstanceName(instance_name));
   if (!instances_by_name.empty()) {
     return CF_ERR("instance name " << instance_name << " is taken");
   }
-  return (*itr)->AddInstance(id, instance_name);
+  CF_EXPECT(group.AddInstance(id, instance_name));
+  auto added = CF_EXPECT(group.FindById(id));
+  CF_EXPECT_EQ(added.size(), 1);
+  IndexInstance(added.cbegin()->Get());
+  serialized_groups_.erase(group_ptr);
+  return {};
 }
 
 Result<void> InstanceDatabase::AddInstances(
@@ -116,21 +156,16 @@ Result<void> InstanceDatabase::SetBuildId(const std::string& group_name,
   auto* group_ptr = CF_EXPECT(FindMutableGroup(group_name));
   auto& group = *group_ptr;
   group.SetBuildId(build_id);
+  serialized_groups_.erase(group_ptr);
   return {};
 }
 
 Result<LocalInstanceGroup*> InstanceDatabase::FindMutableGroup(
     const std::string& group_name) {
-  LocalInstanceGroup* group_ptr = nullptr;
-  for (auto& group_uniq_ptr : local_instance_groups_) {
-    if (group_uniq_ptr && group_uniq_ptr->GroupName() == group_name) {
-      group_ptr = group_uniq_ptr.get();
-      break;
-    }
-  }
-  CF_EXPECT(group_ptr != nullptr,
+  auto itr = groups_by_name_.find(group_name);
+  CF_EXPECT(itr != groups_by_name_.end(),
             "Instance Group named as " << group_name << " is not found.");
-  return group_ptr;
+  return itr->second;
 }
 
 bool InstanceDatabase::RemoveInstanceGroup(const std::string& group_name) {
@@ -148,63 +183,51 @@ bool InstanceDatabase::RemoveInstanceGroup(const LocalInstanceGroup& group) {
   if (itr == local_instance_groups_.end() || !(*itr)) {
     return false;
   }
+  RemoveFromIndexes(group);
   local_instance_groups_.erase(itr);
   return true;
 }
 
 Result<Set<ConstRef<LocalInstanceGroup>>> InstanceDatabase::FindGroupsByHome(
     const std::string& home) const {
-  auto subset = CollectToSet<LocalInstanceGroup>(
-      local_instance_groups_,
-      [&home](const std::unique_ptr<LocalInstanceGroup>& group) {
-        if (!group) {
-          return false;
-        }
-        if (group->HomeDir() == home) {
-          return true;
-        }
-        if (group->HomeDir().empty() || home.empty()) {
-          return false;
-        }
-        // The two paths must be an absolute path.
-        // this is guaranteed by the CreationAnalyzer
-        std::string home_realpath;
-        std::string group_home_realpath;
-        if (!android::base::Realpath(home, std::addressof(home_realpath))) {
-          return false;
-        }
-        if (!android::base::Realpath(group->HomeDir(),
-                                     std::addressof(group_home_realpath))) {
-          return false;
-        }
-        return home_realpath == group_home_realpath;
-      });
-  return AtMostOne(subset, GenerateTooManyInstancesErrorMsg(1, kHomeField));
+  Set<ConstRef<LocalInstanceGroup>> subset;
+  auto itr = groups_by_home_.find(home);
+  if (itr == groups_by_home_.end()) {
+    // The path must be an absolute path.
+    // this is guaranteed by the CreationAnalyzer
+    std::string home_realpath;
+    if (!android::base::Realpath(home, std::addressof(home_realpath))) {
+      return subset;
+    }
+    itr = groups_by_home_.find(home_realpath);
+  }
+  if (itr != groups_by_home_.end()) {
+    subset.insert(Cref(*itr->second));
+  }
+  return subset;
 }
 
 Result<Set<ConstRef<LocalInstanceGroup>>>
 InstanceDatabase::FindGroupsByGroupName(const std::string& group_name) const {
-  auto subset = CollectToSet<LocalInstanceGroup>(
-      local_instance_groups_,
-      [&group_name](const std::unique_ptr<LocalInstanceGroup>& group) {
-        return (group && group->GroupName() == group_name);
-      });
-  return AtMostOne(subset,
-                   GenerateTooManyInstancesErrorMsg(1, kGroupNameField));
+  Set<ConstRef<LocalInstanceGroup>> subset;
+  auto itr = groups_by_name_.find(group_name);
+  if (itr != groups_by_name_.end()) {
+    subset.insert(Cref(*itr->second));
+  }
+  return subset;
 }
 
 Result<Set<ConstRef<LocalInstanceGroup>>>
 InstanceDatabase::FindGroupsByInstanceName(
     const std::string& instance_name) const {
-  auto subset = CollectToSet<LocalInstanceGroup>(
-      local_instance_groups_,
-      [&instance_name](const std::unique_ptr<LocalInstanceGroup>& group) {
-        if (!group) {
-          return false;
-        }
-        auto instance_set_result = group->FindByInstanceName(instance_name);
-        return instance_set_result.ok() && (instance_set_result->size() == 1);
-      });
+  Set<ConstRef<LocalInstanceGroup>> subset;
+  auto itr = instances_by_name_.find(instance_name);
+  if (itr == instances_by_name_.end()) {
+    return subset;
+  }
+  for (const auto* instance : itr->second) {
+    subset.insert(Cref(instance->ParentGroup()));
+  }
   return subset;
 }
 
@@ -214,46 +237,38 @@ Result<Set<ConstRef<LocalInstance>>> InstanceDatabase::FindInstancesById(
   if (!android::base::ParseInt(id, &parsed_int)) {
     return CF_ERR(id << " cannot be converted to an integer");
   }
-  auto collector =
-      [parsed_int](const std::unique_ptr<LocalInstanceGroup>& group)
-      -> Result<Set<ConstRef<LocalInstance>>> {
-    CF_EXPECT(group != nullptr);
-    return group->FindById(parsed_int);
-  };
-  auto subset = CollectAllElements<LocalInstance, LocalInstanceGroup>(
-      collector, local_instance_groups_);
-  CF_EXPECT(subset.ok());
-  return AtMostOne(*subset,
-                   GenerateTooManyInstancesErrorMsg(1, kInstanceIdField));
+  Set<ConstRef<LocalInstance>> subset;
+  if (parsed_int < 0) {
+    return subset;
+  }
+  auto itr = instances_by_id_.find(parsed_int);
+  if (itr != instances_by_id_.end()) {
+    subset.insert(Cref(*itr->second));
+  }
+  return subset;
 }
 
 Result<Set<ConstRef<LocalInstance>>>
 InstanceDatabase::FindInstancesByInstanceName(
     const Value& instance_specific_name) const {
-  auto collector = [&instance_specific_name](
-                       const std::unique_ptr<LocalInstanceGroup>& group)
-      -> Result<Set<ConstRef<LocalInstance>>> {
-    CF_EXPECT(group != nullptr);
-    return (group->FindByInstanceName(instance_specific_name));
-  };
-  return CollectAllElements<LocalInstance, LocalInstanceGroup>(
-      collector, local_instance_groups_);
+  Set<ConstRef<LocalInstance>> subset;
+  auto itr = instances_by_name_.find(instance_specific_name);
+  if (itr == instances_by_name_.end()) {
+    return subset;
+  }
+  for (const auto* instance : itr->second) {
+    subset.insert(Cref(*instance));
+  }
+  return subset;
 }
 
 Result<Set<ConstRef<LocalInstance>>> InstanceDatabase::FindInstancesByGroupName(
     const Value& group_name) const {
-  auto collector =
-      [&group_name](const std::unique_ptr<LocalInstanceGroup>& group)
-      -> Result<Set<ConstRef<LocalInstance>>> {
-    CF_EXPECT(group != nullptr);
-    if (group->GroupName() != group_name) {
-      Set<ConstRef<LocalInstance>> empty_set;
-      return empty_set;
-    }
-    return (group->FindAllInstances());
-  };
-  return CollectAllElements<LocalInstance, LocalInstanceGroup>(
-      collector, local_instance_groups_);
+  auto itr = groups_by_name_.find(group_name);
+  if (itr == groups_by_name_.end()) {
+    return Set<ConstRef<LocalInstance>>{};
+  }
+  return itr->second->FindAllInstances();
 }
 
 Json::Value InstanceDatabase::Serialize() const {
@@ -261,7 +276,15 @@ Json::Value InstanceDatabase::Serialize() const {
   int i = 0;
   Json::Value group_array;
   for (const auto& local_instance_group : local_instance_groups_) {
-    group_array[i] = local_instance_group->Serialize();
+    // Only the groups that changed since the last call are serialized again.
+    auto cached = serialized_groups_.find(local_instance_group.get());
+    if (cached == serialized_groups_.end()) {
+      cached = serialized_groups_
+                   .emplace(local_instance_group.get(),
+                            local_instance_group->Serialize())
+                   .first;
+    }
+    group_array[i] = cached->second;
     ++i;
   }
   instance_db_json[kJsonGroups] = group_array;
@@ -67,20 +67,60 @@
 
 namespace cuttlefish {
 
-static constexpr int kNumThreads = 10;
+static constexpr int kNumThreads = 4;
+
+// The class a request counts against in the executor's concurrency limits.
+static std::string RequestClass(const cvd::Request& request) {
+  if (request.contents_case() != cvd::Request::ContentsCase::kCommandRequest) {
+    return "";
+  }
+  const auto& args = request.command_request().args();
+  if (args.empty()) {
+    return "";
+  }
+  auto command = cpp_basename(args[0]);
+  int next = 1;
+  if (command == "cvd") {
+    command = args.size() > 1 ? args[1] : "";
+    next = 2;
+  }
+  if (command == "fetch" || command == "fetch_cvd") {
+    return "fetch";
+  }
+  if (command == "start" || command == "launch_cvd") {
+    return "start";
+  }
+  if (command == "acloud") {
+    // Only acloud create launches devices, list, delete and the rest are
+    // quick.
+    std::string subcommand;
+    for (; next < args.size(); next++) {
+      if (!android::base::StartsWith(args[next], "-")) {
+        subcommand = args[next];
+        break;
+      }
+    }
+    return subcommand == "create" ? "start" : "acloud " + subcommand;
+  }
+  return command;
+}
 
 CvdServer::CvdServer(BuildApi& build_api, EpollPool& epoll_pool,
                      InstanceManager& instance_manager,
                      HostToolTargetManager& host_tool_target_manager,
-                     ServerLogger& server_logger)
+                     ServerLogger& server_logger,
+                     ServerRequestLimits& request_limits)
     : build_api_(build_api),
       epoll_pool_(epoll_pool),
       instance_manager_(instance_manager),
       host_tool_target_manager_(host_tool_target_manager),
       server_logger_(server_logger),
       running_(true),
+      request_limits_(request_limits),
+      executor_(request_limits.workers,
+                {{"fetch", request_limits.concurrent_fetches},
+                 {"start", request_limits.concurrent_starts}}),
       optout_(false) {
-  std::scoped_lock lock(threads_mutex_);
   for (auto i = 0; i < kNumThreads; i++) {
     threads_.emplace_back([this]() {
       while (running_) {
@@ -98,6 +138,7 @@ CvdServer::CvdServer(BuildApi& build_api, EpollPool& epoll_pool,
 
 CvdServer::~CvdServer() {
   running_ = false;
+  executor_.Stop();
   auto wakeup = BestEffortWakeup();
   CHECK(wakeup.ok()) << wakeup.error().Trace();
   Join();
@@ -163,22 +204,18 @@ void CvdServer::Stop() {
     }
     {
       std::lock_guard lock(request->mutex);
+      // Requests that didn't get to their handler yet see this and fail.
+      request->interrupted = true;
       if (request->handler == nullptr) {
         continue;
       }
       request->handler->Interrupt();
     }
-    auto wakeup = BestEffortWakeup();
-    CHECK(wakeup.ok()) << wakeup.error().Trace();
-    std::scoped_lock lock(threads_mutex_);
-    for (auto& thread : threads_) {
-      auto current_thread = thread.get_id() == std::this_thread::get_id();
-      auto matching_thread = thread.get_id() == request->thread_id;
-      if (!current_thread && matching_thread && thread.joinable()) {
-        thread.join();
-      }
-    }
   }
+  // Waits for the interrupted requests to return.
+  executor_.Stop();
+  auto wakeup = BestEffortWakeup();
+  CHECK(wakeup.ok()) << wakeup.error().Trace();
 }
 
 void CvdServer::Join() {
@@ -187,6 +224,7 @@ void CvdServer::Join() {
       thread.join();
     }
   }
+  executor_.Join();
 }
 
 Result<void> CvdServer::Exec(const ExecParam& exec_param) {
@@ -207,6 +245,11 @@ Result<void> CvdServer::Exec(const ExecParam& exec_param) {
       "-INTERNAL_carryover_client_fd=" + std::to_string(client_dup.get()),
       "-INTERNAL_carryover_stderr_fd=" +
           std::to_string(client_stderr_dup.get()),
+      "-request_workers=" + std::to_string(request_limits_.workers),
+      "-max_concurrent_fetches=" +
+          std::to_string(request_limits_.concurrent_fetches),
+      "-max_concurrent_starts=" +
+          std::to_string(request_limits_.concurrent_starts),
   };
 
   int in_memory_dup = -1;
@@ -326,24 +369,90 @@ Result<void> CvdServer::HandleMessage(EpollEvent event) {
     return {};
   }
 
-  auto logger = server_logger_.LogThreadToFd(request->Err());
-  auto response = HandleRequest(*request, event.fd);
+  // Even if the interrupt callback outlives the request handler, it'll only
+  // hold on to this struct which will be cleaned out when the request handler
+  // exits.
+  auto shared = std::make_shared<OngoingRequest>();
+  // Registered before it is queued, so that Stop() reaches the request
+  // wherever it is between the queue and its handler.
+  {
+    std::lock_guard lock(ongoing_requests_mutex_);
+    CF_EXPECT(running_, "The server is stopping");
+    ongoing_requests_.insert(shared);
+  }
+  ScopeGuard unregister([this, shared] { RemoveOngoingRequest(shared); });
+  auto interrupt_cb = [this, shared,
+                       err = request->Err()](EpollEvent ev) -> Result<void> {
+    auto logger = server_logger_.LogThreadToFd(err);
+    std::lock_guard lock(shared->mutex);
+    if (executor_.Cancel(shared->queued_id)) {
+      // The client went away before the request started.
+      RemoveOngoingRequest(shared);
+      CF_EXPECT(epoll_pool_.Remove(ev.fd));
+      return {};
+    }
+    shared->interrupted = true;
+    if (shared->handler != nullptr) {
+      CF_EXPECT(shared->handler->Interrupt());
+    }
+    return {};
+  };
+  CF_EXPECT(epoll_pool_.Register(event.fd, EPOLLHUP, interrupt_cb));
+
+  // Held until queued_id is set, the interrupt callback needs it.
+  std::unique_lock shared_lock(shared->mutex);
+  auto task = [this, request = *request, client = event.fd, shared]() {
+    ScopeGuard unregister([this, shared] { RemoveOngoingRequest(shared); });
+    auto result = RunRequest(request, client, shared);
+    if (!result.ok()) {
+      LOG(ERROR) << "Failed to run request:\n" << result.error().Message();
+      LOG(DEBUG) << "Failed to run request:\n" << result.error().Trace();
+      epoll_pool_.Remove(client);
+    }
+  };
+  auto submitted = executor_.Submit(RequestClass(request->Message()), task);
+  CF_EXPECT(submitted.id != 0, "The server is stopping");
+  shared->queued_id = submitted.id;
+  shared_lock.unlock();
+  unregister.Cancel();
+
+  if (submitted.queue_depth > 0) {
+    auto position = std::to_string(submitted.queue_depth);
+    LOG(INFO) << "Request queued at position " << position;
+    WriteAll(request->Err(),
+             "cvd_server is busy, request queued at position " + position +
+                 "\n");
+  }
+
+  abandon_client.Cancel();
+  return {};
+}
+
+void CvdServer::RemoveOngoingRequest(
+    const std::shared_ptr<OngoingRequest>& request) {
+  std::lock_guard lock(ongoing_requests_mutex_);
+  ongoing_requests_.erase(request);
+}
+
+Result<void> CvdServer::RunRequest(RequestWithStdio request, SharedFD client,
+                                   std::shared_ptr<OngoingRequest> shared) {
+  auto logger = server_logger_.LogThreadToFd(request.Err());
+  auto response = HandleRequest(request, shared);
+  CF_EXPECT(epoll_pool_.Remove(client));  // Delete interrupt handler
   if (!response.ok()) {
     cvd::Response failure_message;
     failure_message.mutable_status()->set_code(cvd::Status::INTERNAL);
     failure_message.mutable_status()->set_message(response.error().Trace());
-    CF_EXPECT(SendResponse(event.fd, failure_message));
+    CF_EXPECT(SendResponse(client, failure_message));
     return {};  // Error already sent to the client, don't repeat on the server
   }
-  CF_EXPECT(SendResponse(event.fd, *response));
+  CF_EXPECT(SendResponse(client, *response));
 
-  auto self_cb = [this, err = request->Err()](EpollEvent ev) -> Result<void> {
+  auto self_cb = [this](EpollEvent ev) -> Result<void> {
     CF_EXPECT(HandleMessage(ev));
     return {};
   };
-  CF_EXPECT(epoll_pool_.Register(event.fd, EPOLLIN, self_cb));
-
-  abandon_client.Cancel();
+  CF_EXPECT(epoll_pool_.Register(client, EPOLLIN, self_cb));
   return {};
 }
 
@@ -410,8 +519,8 @@ static Result<void> VerifyUser(const RequestWithStdio& request) {
   return {};
 }
 
-Result<cvd::Response> CvdServer::HandleRequest(RequestWithStdio orig_request,
-                                               SharedFD client) {
+Result<cvd::Response> CvdServer::HandleRequest(
+    RequestWithStdio orig_request, std::shared_ptr<OngoingRequest> shared) {
   CF_EXPECT(VerifyUser(orig_request));
   auto request = CF_EXPECT(ConvertDirPathToAbsolute(orig_request));
   fruit::Injector<> injector(RequestComponent, this);
@@ -422,43 +531,18 @@ Result<cvd::Response> CvdServer::HandleRequest(RequestWithStdio orig_request,
 
   auto possible_handlers = injector.getMultibindings<CvdServerHandler>();
 
-  // Even if the interrupt callback outlives the request handler, it'll only
-  // hold on to this struct which will be cleaned out when the request handler
-  // exits.
-  auto shared = std::make_shared<OngoingRequest>();
-  shared->handler = CF_EXPECT(RequestHandler(request, possible_handlers));
-  shared->thread_id = std::this_thread::get_id();
-
   {
-    std::lock_guard lock(ongoing_requests_mutex_);
-    if (running_) {
-      ongoing_requests_.insert(shared);
-    } else {
-      // We're executing concurrently with a Stop() call.
-      return {};
-    }
-  }
-  ScopeGuard remove_ongoing_request([this, shared] {
-    std::lock_guard lock(ongoing_requests_mutex_);
-    ongoing_requests_.erase(shared);
-  });
-
-  auto interrupt_cb = [this, shared,
-                       err = request.Err()](EpollEvent) -> Result<void> {
-    auto logger = server_logger_.LogThreadToFd(err);
     std::lock_guard lock(shared->mutex);
-    CF_EXPECT(shared->handler != nullptr);
-    CF_EXPECT(shared->handler->Interrupt());
-    return {};
-  };
-  CF_EXPECT(epoll_pool_.Register(client, EPOLLHUP, interrupt_cb));
+    CF_EXPECT(!shared->interrupted,
+              "The client went away or the server is stopping");
+    shared->handler = CF_EXPECT(RequestHandler(request, possible_handlers));
+  }
 
   auto response = CF_EXPECT(shared->handler->Handle(request));
   {
     std::lock_guard lock(shared->mutex);
     shared->handler = nullptr;
   }
-  CF_EXPECT(epoll_pool_.Remove(client));  // Delete interrupt handler
 
   return response;
 }
@@ -470,10 +554,12 @@ Result<void> CvdServer::InstanceDbFromJson(const std::string& json_string) {
   return {};
 }
 
-static fruit::Component<> ServerComponent(ServerLogger* server_logger) {
+static fruit::Component<> ServerComponent(
+    ServerLogger* server_logger, ServerRequestLimits* request_limits) {
   return fruit::createComponent()
       .addMultibinding<CvdServer, CvdServer>()
       .bindInstance(*server_logger)
+      .bindInstance(*request_limits)
       .install(BuildApiModule)
       .install(EpollLoopComponent)
       .install(HostToolTargetManagerComponent)
@@ -491,7 +577,8 @@ Result<int> CvdServerMain(ServerMainParam&& fds) {
   CF_EXPECT(server_fd->IsOpen(), "Did not receive a valid cvd_server fd");
 
   std::unique_ptr<ServerLogger> server_logger = std::move(fds.server_logger);
-  fruit::Injector<> injector(ServerComponent, server_logger.get());
+  fruit::Injector<> injector(ServerComponent, server_logger.get(),
+                             &fds.request_limits);
 
   for (auto& late_injected : injector.getMultibindings<LateInjected>()) {
     CF_EXPECT(late_injected->LateInject(injector));
@@ -18,9 +18,13 @@
 
 #include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
 #include <shared_mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <fruit/fruit.h>
@@ -34,6 +38,7 @@
 #include "host/commands/cvd/epoll_loop.h"
 #include "host/commands/cvd/instance_manager.h"
 #include "host/commands/cvd/logger.h"
+#include "host/commands/cvd/request_executor.h"
 // including "server_command/subcmd.h" causes cyclic dependency
 #include "host/commands/cvd/server_command/host_tool_target_manager.h"
 #include "host/commands/cvd/server_command/server_handler.h"
@@ -42,6 +47,15 @@
 
 namespace cuttlefish {
 
+// How many requests the server runs at once, set with the --request_workers,
+// --max_concurrent_fetches and --max_concurrent_starts server flags.
+struct ServerRequestLimits {
+  // Requests like start and fetch keep a worker for minutes.
+  size_t workers = 16;
+  size_t concurrent_fetches = 2;
+  size_t concurrent_starts = 8;
+};
+
 struct ServerMainParam {
   SharedFD internal_server_fd;
   SharedFD carryover_client_fd;
@@ -53,6 +67,7 @@ struct ServerMainParam {
    * The scoped_logger should expire just after AcceptCarryoverClient()
    */
   std::unique_ptr<ServerLogger::ScopedLogger> scoped_logger;
+  ServerRequestLimits request_limits;
 };
 Result<int> CvdServerMain(ServerMainParam&& fds);
 
@@ -63,7 +78,8 @@ class CvdServer {
 
  public:
   INJECT(CvdServer(BuildApi&, EpollPool&, InstanceManager&,
-                   HostToolTargetManager&, ServerLogger&));
+                   HostToolTargetManager&, ServerLogger&,
+                   ServerRequestLimits&));
   ~CvdServer();
 
   Result<void> StartServer(SharedFD server);
@@ -85,9 +101,12 @@ class CvdServer {
 
  private:
   struct OngoingRequest {
-    CvdServerHandler* handler;
+    CvdServerHandler* handler = nullptr;
     std::mutex mutex;
-    std::thread::id thread_id;
+    // Set while the request waits in the executor queue.
+    uint64_t queued_id = 0;
+    // The client went away or the server is stopping.
+    bool interrupted = false;
   };
 
   /* this has to be static due to the way fruit includes components */
@@ -95,7 +114,11 @@ class CvdServer {
 
   Result<void> AcceptClient(EpollEvent);
   Result<void> HandleMessage(EpollEvent);
-  Result<cvd::Response> HandleRequest(RequestWithStdio, SharedFD client);
+  Result<void> RunRequest(RequestWithStdio, SharedFD client,
+                          std::shared_ptr<OngoingRequest>);
+  Result<cvd::Response> HandleRequest(RequestWithStdio,
+                                      std::shared_ptr<OngoingRequest>);
+  void RemoveOngoingRequest(const std::shared_ptr<OngoingRequest>&);
   Result<void> BestEffortWakeup();
 
   SharedFD server_fd_;
@@ -105,12 +128,15 @@ class CvdServer {
   HostToolTargetManager& host_tool_target_manager_;
   ServerLogger& server_logger_;
   std::atomic_bool running_ = true;
+  // Carried over to the new server on Exec.
+  const ServerRequestLimits request_limits_;
 
   std::mutex ongoing_requests_mutex_;
   std::set<std::shared_ptr<OngoingRequest>> ongoing_requests_;
-  // TODO(schuffelen): Move this thread pool to another class.
-  std::mutex threads_mutex_;
+  // Only wait for clients and read their requests, which run on the
+  // executor.
   std::vector<std::thread> threads_;
+  RequestExecutor executor_;
 
   // translator optout
   std::atomic<bool> optout_;
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/cvd/server_command/log_tailer.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+// Besides growing, an unlink shows up as a change of the link count. The
+// file isn't deleted while it's open here.
+constexpr uint32_t kFileEvents =
+    IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+constexpr uint32_t kDirEvents = IN_CREATE | IN_MOVED_TO | IN_DELETE |
+                                IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF;
+
+// The directory closest to `path` that exists, starting from its parent.
+Result<std::string> ClosestExistingDirectory(const std::string& path) {
+  auto dir = cpp_dirname(path);
+  while (!DirectoryExists(dir)) {
+    auto parent = cpp_dirname(dir);
+    CF_EXPECT(parent != dir, "No directory of \"" << path << "\" exists");
+    dir = std::move(parent);
+  }
+  return dir;
+}
+
+}  // namespace
+
+Result<std::unique_ptr<LogTailer>> LogTailer::Create(const std::string& path) {
+  int inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  CF_EXPECT(inotify_fd >= 0, "inotify_init1 failed: " << strerror(errno));
+  int interrupt_fd = eventfd(0, EFD_CLOEXEC);
+  if (interrupt_fd < 0) {
+    auto error = errno;
+    close(inotify_fd);
+    return CF_ERR("eventfd failed: " << strerror(error));
+  }
+  return std::unique_ptr<LogTailer>(
+      new LogTailer(path, inotify_fd, interrupt_fd));
+}
+
+LogTailer::LogTailer(std::string path, int inotify_fd, int interrupt_fd)
+    : path_(std::move(path)),
+      inotify_fd_(inotify_fd),
+      interrupt_fd_(interrupt_fd) {}
+
+LogTailer::~LogTailer() {
+  close(inotify_fd_);
+  close(interrupt_fd_);
+}
+
+Result<std::vector<std::string>> LogTailer::NextLines() {
+  while (true) {
+    if (!file_->IsOpen()) {
+      CF_EXPECT(OpenOrWatchForFile());
+    }
+    if (file_->IsOpen()) {
+      // Checked before reading, so whatever was written to the old file
+      // before it was replaced is still read.
+      auto replaced = CF_EXPECT(FileWasReplaced());
+      auto lines = CF_EXPECT(ReadLines());
+      if (!lines.empty()) {
+        return lines;
+      }
+      if (replaced) {
+        // A line the old file didn't finish never will be.
+        file_ = SharedFD();
+        partial_line_.clear();
+        continue;
+      }
+    }
+    CF_EXPECT(WaitForChanges());
+  }
+}
+
+void LogTailer::Interrupt() { eventfd_write(interrupt_fd_, 1); }
+
+Result<void> LogTailer::OpenOrWatchForFile() {
+  // Wait for the next missing directory or the file itself to be created,
+  // checking again after the watch is in place so nothing created in the
+  // meantime goes unnoticed. Once the file exists this is its directory,
+  // where the file being deleted, renamed or replaced shows up.
+  while (true) {
+    auto dir = CF_EXPECT(ClosestExistingDirectory(path_));
+    CF_EXPECT(Watch(dir_watch_, dir, kDirEvents));
+    if (CF_EXPECT(ClosestExistingDirectory(path_)) == dir) {
+      break;
+    }
+  }
+  file_ = SharedFD::Open(path_, O_RDONLY | O_CLOEXEC);
+  if (file_->IsOpen()) {
+    return Watch(file_watch_, path_, kFileEvents);
+  }
+  CF_EXPECT(file_->GetErrno() == ENOENT,
+            "Failed to open \"" << path_ << "\": " << file_->StrError());
+  if (file_watch_ >= 0) {
+    inotify_rm_watch(inotify_fd_, file_watch_);
+    file_watch_ = -1;
+  }
+  return {};
+}
+
+Result<void> LogTailer::Watch(int& watch, const std::string& path,
+                              uint32_t mask) {
+  // Watches on the same inode share a descriptor, so the old one must go
+  // before the new one is added. It is already gone if its inode was
+  // deleted, which makes this fail harmlessly.
+  if (watch >= 0) {
+    inotify_rm_watch(inotify_fd_, watch);
+  }
+  watch = inotify_add_watch(inotify_fd_, path.c_str(), mask);
+  CF_EXPECT(watch >= 0, "Failed to watch \"" << path << "\": "
+                                             << strerror(errno));
+  return {};
+}
+
+// Whether the path no longer leads to the open file.
+Result<bool> LogTailer::FileWasReplaced() {
+  struct stat open_stat;
+  CF_EXPECT(file_->Fstat(&open_stat) == 0,
+            "Failed to stat \"" << path_ << "\": " << file_->StrError());
+  struct stat path_stat;
+  if (stat(path_.c_str(), &path_stat) < 0) {
+    CF_EXPECT(errno == ENOENT || errno == ENOTDIR,
+              "Failed to stat \"" << path_ << "\": " << strerror(errno));
+    return true;
+  }
+  return open_stat.st_dev != path_stat.st_dev ||
+         open_stat.st_ino != path_stat.st_ino;
+}
+
+Result<std::vector<std::string>> LogTailer::ReadLines() {
+  char buffer[4096];
+  ssize_t read_size;
+  while ((read_size = file_->Read(buffer, sizeof(buffer))) > 0) {
+    partial_line_.append(buffer, read_size);
+  }
+  CF_EXPECT(read_size == 0,
+            "Failed to read \"" << path_ << "\": " << file_->StrError());
+  std::vector<std::string> lines;
+  size_t start = 0;
+  for (auto end = partial_line_.find('\n', start); end != std::string::npos;
+       end = partial_line_.find('\n', start)) {
+    lines.emplace_back(partial_line_, start, end - start);
+    start = end + 1;
+  }
+  partial_line_.erase(0, start);
+  return lines;
+}
+
+Result<void> LogTailer::WaitForChanges() {
+  struct pollfd fds[] = {
+      {.fd = inotify_fd_, .events = POLLIN, .revents = 0},
+      {.fd = interrupt_fd_, .events = POLLIN, .revents = 0},
+  };
+  CF_EXPECT(TEMP_FAILURE_RETRY(poll(fds, 2, -1)) >= 0,
+            "poll failed: " << strerror(errno));
+  CF_EXPECT(!(fds[1].revents & POLLIN), "Interrupted");
+  // What changed doesn't matter, the caller checks the file again.
+  char events[4096];
+  while (read(inotify_fd_, events, sizeof(events)) > 0) {
+  }
+  return {};
+}
+
+}  // namespace cuttlefish
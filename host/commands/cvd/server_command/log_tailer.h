@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+/*
+ * Follows a log file as it is written, like `tail -F` from its first line.
+ *
+ * The file and its directories don't need to exist yet. inotify reports when
+ * they are created and when the file grows, so lines are returned as soon as
+ * they are written, and nothing is read twice. When the path is deleted,
+ * renamed or replaced, e.g. by log rotation or by the cleanup of a previous
+ * run, the rest of the old file is read and then the new one is followed.
+ */
+class LogTailer {
+ public:
+  static Result<std::unique_ptr<LogTailer>> Create(const std::string& path);
+  ~LogTailer();
+
+  // Blocks until there are new complete lines and returns them, without
+  // their line breaks.
+  Result<std::vector<std::string>> NextLines();
+
+  // Makes NextLines fail from now on, including a call that is blocked.
+  // Can be called from any thread.
+  void Interrupt();
+
+ private:
+  LogTailer(std::string path, int inotify_fd, int interrupt_fd);
+
+  Result<void> OpenOrWatchForFile();
+  Result<void> Watch(int& watch, const std::string& path, uint32_t mask);
+  Result<bool> FileWasReplaced();
+  Result<std::vector<std::string>> ReadLines();
+  Result<void> WaitForChanges();
+
+  const std::string path_;
+  const int inotify_fd_;
+  const int interrupt_fd_;
+  // The open file, or nothing while it doesn't exist.
+  int file_watch_ = -1;
+  // The parent directory of the open file, or the closest existing
+  // directory while it doesn't exist.
+  int dir_watch_ = -1;
+  SharedFD file_;
+  std::string partial_line_;
+};
+
+}  // namespace cuttlefish
@@ -18,17 +18,18 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cstdint>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
 #include <map>
 #include <mutex>
-#include <regex>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
@@ -44,6 +45,7 @@
 #include "host/commands/cvd/common_utils.h"
 #include "host/commands/cvd/selector/selector_constants.h"
 #include "host/commands/cvd/server_command/generic.h"
+#include "host/commands/cvd/server_command/log_tailer.h"
 #include "host/commands/cvd/server_command/server_handler.h"
 #include "host/commands/cvd/server_command/start_impl.h"
 #include "host/commands/cvd/server_command/subprocess_waiter.h"
@@ -118,7 +120,7 @@ class CvdStartCommandHandler : public CvdServerHandler {
 
   Result<void> HandleNoDaemonWorker(
       const selector::GroupCreationInfo& group_creation_info,
-      std::atomic<bool>* interrupted, const uid_t uid);
+      LogTailer& kernel_log, const uid_t uid);
 
   Result<cvd::Response> HandleNoDaemon(
       const std::optional<selector::GroupCreationInfo>& group_creation_info,
@@ -685,72 +687,69 @@ Result<cvd::Response> CvdStartCommandHandler::Handle(
                    : HandleNoDaemon(group_creation_info, uid);
 }
 
+namespace {
+
+// Finds the build fingerprint in a "[  12.345678] GUEST_BUILD_FINGERPRINT:"
+// kernel log line.
+std::optional<std::string> GuestBuildFingerprint(const std::string& line) {
+  static constexpr std::string_view kMarker = "GUEST_BUILD_FINGERPRINT:";
+  auto marker_pos = line.find(kMarker);
+  if (marker_pos == std::string::npos) {
+    return std::nullopt;
+  }
+  auto prefix = android::base::Trim(line.substr(0, marker_pos));
+  auto open_pos = prefix.rfind('[');
+  if (prefix.empty() || prefix.back() != ']' || open_pos == std::string::npos) {
+    return std::nullopt;
+  }
+  auto timestamp = android::base::Trim(
+      prefix.substr(open_pos + 1, prefix.size() - open_pos - 2));
+  auto dot_pos = timestamp.find('.');
+  auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+  if (dot_pos == std::string::npos || dot_pos + 1 == timestamp.size() ||
+      !std::all_of(timestamp.begin(), timestamp.begin() + dot_pos, is_digit) ||
+      !std::all_of(timestamp.begin() + dot_pos + 1, timestamp.end(),
+                   is_digit)) {
+    return std::nullopt;
+  }
+  return line.substr(marker_pos + kMarker.size());
+}
+
+}  // namespace
+
 Result<void> CvdStartCommandHandler::HandleNoDaemonWorker(
     const selector::GroupCreationInfo& group_creation_info,
-    std::atomic<bool>* interrupted, const uid_t uid) {
-  const std::string home_dir = group_creation_info.home;
+    LogTailer& kernel_log, const uid_t uid) {
   const std::string group_name = group_creation_info.group_name;
-  std::string kernel_log_path =
-      ConcatToString(home_dir, "/cuttlefish_runtime/kernel.log");
-  std::regex finger_pattern(
-      "\\[\\s*[0-9]*\\.[0-9]+\\]\\s*GUEST_BUILD_FINGERPRINT:");
-  std::regex boot_pattern("VIRTUAL_DEVICE_BOOT_COMPLETED");
-  std::streampos last_pos;
-  bool first_iteration = true;
-  while (*interrupted == false) {
-    if (!FileExists(kernel_log_path)) {
-      LOG(ERROR) << kernel_log_path << " does not yet exist, so wait for 5s";
-      using namespace std::chrono_literals;
-      std::this_thread::sleep_for(5s);
-      continue;
-    }
-    std::ifstream kernel_log_file(kernel_log_path);
-    CF_EXPECT(kernel_log_file.is_open(),
-              "The kernel log file exists but it cannot be open.");
-    if (!first_iteration) {
-      kernel_log_file.seekg(last_pos);
-    } else {
-      first_iteration = false;
-      last_pos = kernel_log_file.tellg();
-    }
-    for (std::string line; std::getline(kernel_log_file, line);) {
-      last_pos = kernel_log_file.tellg();
-      // if the line broke before a newline, this will end up reading the
-      // previous line one more time but only with '\n'. That's okay
-      last_pos -= line.size();
-      if (last_pos != std::ios_base::beg) {
-        last_pos -= std::string("\n").size();
-      }
-      std::smatch matched;
-      if (std::regex_search(line, matched, finger_pattern)) {
-        std::string build_id = matched.suffix().str();
-        CF_EXPECT(instance_manager_.SetBuildId(uid, group_name, build_id));
+  while (true) {
+    auto lines = CF_EXPECT(kernel_log.NextLines(),
+                           "Cvd start kernel monitor interrupted.");
+    for (const auto& line : lines) {
+      if (auto build_id = GuestBuildFingerprint(line)) {
+        CF_EXPECT(instance_manager_.SetBuildId(uid, group_name, *build_id));
         continue;
       }
-      if (std::regex_search(line, matched, boot_pattern)) {
+      if (line.find("VIRTUAL_DEVICE_BOOT_COMPLETED") != std::string::npos) {
         return {};
       }
     }
-    using namespace std::chrono_literals;
-    std::this_thread::sleep_for(2s);
   }
-  return CF_ERR("Cvd start kernel monitor interrupted.");
 }
 
 Result<cvd::Response> CvdStartCommandHandler::HandleNoDaemon(
     const std::optional<selector::GroupCreationInfo>& group_creation_info,
     const uid_t uid) {
-  std::atomic<bool> interrupted;
   std::atomic<bool> worker_success;
-  interrupted = false;
   worker_success = false;
   const auto* group_info = std::addressof(*group_creation_info);
-  auto* interrupted_ptr = std::addressof(interrupted);
+  auto kernel_log = CF_EXPECT(LogTailer::Create(
+      ConcatToString(group_info->home, "/cuttlefish_runtime/kernel.log")));
+  auto* kernel_log_ptr = kernel_log.get();
   auto* worker_success_ptr = std::addressof(worker_success);
   std::thread worker = std::thread(
-      [this, group_info, interrupted_ptr, worker_success_ptr, uid]() {
+      [this, group_info, kernel_log_ptr, worker_success_ptr, uid]() {
         LOG(ERROR) << "worker thread started.";
-        auto result = HandleNoDaemonWorker(*group_info, interrupted_ptr, uid);
+        auto result = HandleNoDaemonWorker(*group_info, *kernel_log_ptr, uid);
         *worker_success_ptr = result.ok();
         if (*worker_success_ptr == false) {
           LOG(ERROR) << result.error().Trace();
@@ -760,8 +759,9 @@ Result<cvd::Response> CvdStartCommandHandler::HandleNoDaemon(
   if (infop.si_code != CLD_EXITED || infop.si_status != EXIT_SUCCESS) {
     // perhaps failed in launch
     instance_manager_.RemoveInstanceGroup(uid, group_creation_info->home);
-    interrupted = true;
   }
+  // Nothing writes to the kernel log once the device is gone.
+  kernel_log->Interrupt();
   worker.join();
   auto final_response = ResponseFromSiginfo(infop);
   if (!final_response.has_status() ||
@@ -216,6 +216,30 @@ TEST_F(CvdInstanceDatabaseTest, RemoveGroup) {
   ASSERT_FALSE(db.RemoveInstanceGroup(*eng_group));
 }
 
+TEST_F(CvdInstanceDatabaseTest, RemoveGroupReleasesIdsAndNames) {
+  if (!SetUpOk() || !AddGroups({"meow"})) {
+    GTEST_SKIP() << Error().msg;
+  }
+  auto& db = GetDb();
+  if (!db.AddInstance("meow", 1, "tv").ok()) {
+    GTEST_SKIP() << "Failed to add instance 1 to meow";
+  }
+
+  ASSERT_TRUE(db.RemoveInstanceGroup("meow"));
+  auto by_id = db.FindInstances({kInstanceIdField, "1"});
+  auto by_name = db.FindInstances({kInstanceNameField, "tv"});
+  auto by_home = db.FindGroups({kHomeField, Workspace() + "/" + "meow"});
+  ASSERT_TRUE(by_id.ok());
+  ASSERT_TRUE(by_name.ok());
+  ASSERT_TRUE(by_home.ok());
+  ASSERT_TRUE(by_id->empty());
+  ASSERT_TRUE(by_name->empty());
+  ASSERT_TRUE(by_home->empty());
+
+  ASSERT_TRUE(AddGroups({"meow"}));
+  ASSERT_TRUE(db.AddInstance("meow", 1, "tv").ok());
+}
+
 TEST_F(CvdInstanceDatabaseTest, AddInstances) {
   if (!SetUpOk() || !AddGroups({"yah_ong"})) {
     GTEST_SKIP() << Error().msg;
@@ -0,0 +1,151 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/cvd/server_command/log_tailer.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+using ::testing::ElementsAre;
+
+class LogTailerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto tailer = LogTailer::Create(path_);
+    ASSERT_TRUE(tailer.ok()) << tailer.error().Trace();
+    tailer_ = std::move(*tailer);
+  }
+
+  // Runs NextLines in the background, so the test can change the file while
+  // the tailer waits.
+  std::future<Result<std::vector<std::string>>> NextLinesAsync() {
+    return std::async(std::launch::async,
+                      [this]() { return tailer_->NextLines(); });
+  }
+
+  // Fails rather than hang if the tailer misses the change.
+  std::vector<std::string> Get(
+      std::future<Result<std::vector<std::string>>>& lines) {
+    if (lines.wait_for(std::chrono::seconds(10)) !=
+        std::future_status::ready) {
+      tailer_->Interrupt();
+      ADD_FAILURE() << "No lines after 10 seconds";
+    }
+    auto result = lines.get();
+    EXPECT_TRUE(result.ok()) << result.error().Trace();
+    return result.ok() ? *result : std::vector<std::string>{};
+  }
+
+  std::vector<std::string> Next() {
+    auto lines = NextLinesAsync();
+    return Get(lines);
+  }
+
+  static void Append(const std::string& path, const std::string& data) {
+    auto file = fopen(path.c_str(), "a");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+  }
+
+  TemporaryDir dir_;
+  std::string path_ = std::string(dir_.path) + "/logs/kernel.log";
+  std::unique_ptr<LogTailer> tailer_;
+};
+
+TEST_F(LogTailerTest, WaitsForTheFileAndItsDirectory) {
+  auto lines = NextLinesAsync();
+  ASSERT_EQ(mkdir((std::string(dir_.path) + "/logs").c_str(), 0700), 0);
+  Append(path_, "first\nsecond\n");
+  EXPECT_THAT(Get(lines), ElementsAre("first", "second"));
+}
+
+TEST_F(LogTailerTest, ReturnsLinesOnceComplete) {
+  ASSERT_EQ(mkdir((std::string(dir_.path) + "/logs").c_str(), 0700), 0);
+  Append(path_, "one\ntw");
+  EXPECT_THAT(Next(), ElementsAre("one"));
+  auto lines = NextLinesAsync();
+  Append(path_, "o\nthr");
+  EXPECT_THAT(Get(lines), ElementsAre("two"));
+}
+
+TEST_F(LogTailerTest, FollowsTheNewFileAfterRotation) {
+  ASSERT_EQ(mkdir((std::string(dir_.path) + "/logs").c_str(), 0700), 0);
+  Append(path_, "before\n");
+  EXPECT_THAT(Next(), ElementsAre("before"));
+
+  auto lines = NextLinesAsync();
+  ASSERT_EQ(rename(path_.c_str(), (path_ + ".1").c_str()), 0);
+  // Written to the old file by a writer that hasn't reopened yet.
+  Append(path_ + ".1", "late\n");
+  Append(path_, "after\n");
+  auto first = Get(lines);
+  std::vector<std::string> all(first.begin(), first.end());
+  if (all.size() < 2) {
+    auto second = Next();
+    all.insert(all.end(), second.begin(), second.end());
+  }
+  EXPECT_THAT(all, ElementsAre("late", "after"));
+}
+
+TEST_F(LogTailerTest, LeavesAStaleFileThatIsDeleted) {
+  // E.g. the log of a previous run, until the launcher cleans it up.
+  ASSERT_EQ(mkdir((std::string(dir_.path) + "/logs").c_str(), 0700), 0);
+  Append(path_, "stale\n");
+  EXPECT_THAT(Next(), ElementsAre("stale"));
+
+  auto lines = NextLinesAsync();
+  ASSERT_EQ(unlink(path_.c_str()), 0);
+  Append(path_, "fresh\n");
+  EXPECT_THAT(Get(lines), ElementsAre("fresh"));
+}
+
+TEST_F(LogTailerTest, FollowsTheFileWhenItsDirectoryIsRecreated) {
+  auto logs = std::string(dir_.path) + "/logs";
+  ASSERT_EQ(mkdir(logs.c_str(), 0700), 0);
+  Append(path_, "stale\n");
+  EXPECT_THAT(Next(), ElementsAre("stale"));
+
+  auto lines = NextLinesAsync();
+  ASSERT_EQ(unlink(path_.c_str()), 0);
+  ASSERT_EQ(rmdir(logs.c_str()), 0);
+  ASSERT_EQ(mkdir(logs.c_str(), 0700), 0);
+  Append(path_, "fresh\n");
+  EXPECT_THAT(Get(lines), ElementsAre("fresh"));
+}
+
+TEST_F(LogTailerTest, InterruptStopsAWait) {
+  auto lines = NextLinesAsync();
+  tailer_->Interrupt();
+  ASSERT_EQ(lines.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_FALSE(lines.get().ok());
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -0,0 +1,79 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/scope_guard.h"
+#include "host/commands/cvd/request_executor.h"
+
+namespace cuttlefish {
+
+TEST(RequestExecutorTest, RunsTasks) {
+  RequestExecutor executor(2, {});
+  std::promise<void> done;
+  auto submitted = executor.Submit("", [&done]() { done.set_value(); });
+
+  ASSERT_NE(submitted.id, 0);
+  ASSERT_EQ(submitted.queue_depth, 0);
+  ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+}
+
+TEST(RequestExecutorTest, LimitedClassDoesNotBlockOthers) {
+  RequestExecutor executor(4, {{"fetch", 1}});
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  // The executor waits for the blocked task when destroyed, even after a
+  // failed assertion.
+  ScopeGuard release_on_exit([&release]() { release.set_value(); });
+  std::promise<void> cheap_done;
+
+  executor.Submit("fetch", [released]() { released.wait(); });
+  auto second_fetch = executor.Submit("fetch", []() {});
+  auto cheap = executor.Submit("status", [&cheap_done]() {
+    cheap_done.set_value();
+  });
+
+  ASSERT_GT(second_fetch.queue_depth, 0);
+  ASSERT_EQ(cheap.queue_depth, 0);
+  ASSERT_EQ(cheap_done.get_future().wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+}
+
+TEST(RequestExecutorTest, CancelsQueuedTasks) {
+  RequestExecutor executor(1, {});
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  ScopeGuard release_on_exit([&release]() { release.set_value(); });
+  bool ran = false;
+
+  executor.Submit("", [released]() { released.wait(); });
+  auto queued = executor.Submit("", [&ran]() { ran = true; });
+
+  ASSERT_GT(queued.queue_depth, 0);
+  ASSERT_TRUE(executor.Cancel(queued.id));
+  ASSERT_FALSE(executor.Cancel(queued.id));
+  release_on_exit.Cancel();
+  release.set_value();
+  executor.Stop();
+  ASSERT_FALSE(ran);
+}
+
+}  // namespace cuttlefish
@@ -26,6 +26,11 @@
 
 DEFINE_int32(instance_num, 1, "Which instance to read the configs from");
 DEFINE_double(delay, 1.0, "delay interval between different coordinates");
+DEFINE_double(speed, 1.0, "playback speed, 2 plays the route twice as fast");
+DEFINE_bool(use_timestamps, false,
+            "wait for the recorded time between locations instead of delay");
+DEFINE_double(interpolation_interval, 0,
+              "interval between positions interpolated between locations");
 
 DEFINE_string(format, "", "supported file format, either kml or gpx");
 DEFINE_string(file_path, "", "path to input file location {Kml or gpx} format");
@@ -48,6 +53,17 @@ arguments:
   --delay=[delay_value]
     delay between different gps locations ( double , default value is 1.0 second)
 
+  --speed=[speed_value]
+    playback speed ( double , default value is 1.0)
+
+  --use_timestamps=[true|false]
+    wait for the time recorded between locations that have one instead of
+    the delay ( default value is false)
+
+  --interpolation_interval=[interval_value]
+    report positions interpolated between locations at this interval
+    ( double , default value is 0 seconds, no interpolation)
+
   --instance_num=[integer_value]
     running instance number , starts from 1 ( integer , default value is 1)
 
@@ -61,6 +77,8 @@ examples:
 
     cvd_import_locations --format="gpx" --file_path="input.gpx" --delay=.5 --instance_num=2
 
+    cvd_import_locations --format="gpx" --file_path="input.gpx" --use_timestamps --speed=4 --interpolation_interval=.2
+
 )"""";
 namespace cuttlefish {
 namespace {
@@ -88,34 +106,45 @@ int ImportLocationsCvdMain(int argc, char** argv) {
   GnssClient gpsclient(
       grpc::CreateChannel(socket_name, grpc::InsecureChannelCredentials()));
 
-  GpsFixArray coordinates;
-  std::string error;
-  bool isOk = false;
+  gnss_grpc_proxy::GpsPlaybackOptions options;
+  options.set_delay(int(1000 * FLAGS_delay));
+  options.set_use_timestamps(FLAGS_use_timestamps);
+  options.set_speed(FLAGS_speed);
+  options.set_interpolation_interval(int(1000 * FLAGS_interpolation_interval));
 
   LOG(INFO) << "Server port: " << server_port << " socket: " << socket_name
             << std::endl;
+
+  // The locations are sent while the file is parsed, the proxy starts playing
+  // them back right away.
+  auto stream = gpsclient.StreamGpsLocations(options);
+  size_t count = 0;
+  GpsFixCallback send = [&stream, &count](const GpsFix& fix) {
+    count++;
+    return stream->Write(fix);
+  };
+  std::string error;
+  bool isOk = false;
   if (FLAGS_format == "gpx" || FLAGS_format == "GPX") {
-    isOk =
-        GpxParser::parseFile(FLAGS_file_path.c_str(), &coordinates, &error);
+    isOk = GpxParser::parseFileStreaming(FLAGS_file_path.c_str(), send,
+                                         &error);
   } else if (FLAGS_format == "kml" || FLAGS_format == "KML") {
-    isOk =
-        KmlParser::parseFile(FLAGS_file_path.c_str(), &coordinates, &error);
+    isOk = KmlParser::parseFileStreaming(FLAGS_file_path.c_str(), send,
+                                         &error);
   }
 
-  LOG(INFO) << "Number of parsed points: " << coordinates.size() << std::endl;
+  LOG(INFO) << "Number of parsed points: " << count << std::endl;
 
+  auto status = stream->Finish();
   if (!isOk) {
     LOG(ERROR) << " Parsing Error: " << error << std::endl;
     return 1;
   }
-
-  int delay = (int)(1000 * FLAGS_delay);
-  auto status = gpsclient.SendGpsLocations(delay,coordinates);
-  CHECK(status.ok()) << "Failed to send gps location data \n";
   if (!status.ok()) {
+    LOG(ERROR) << "Failed to send gps location data: "
+               << status.error().Message();
     return 1;
   }
-  std::this_thread::sleep_for(std::chrono::milliseconds(delay));
   return 0;
 }
 
@@ -16,6 +16,7 @@
 
 #include <android-base/file.h>
 #include <gtest/gtest.h>
+#include <cstring>
 #include <fstream>
 #include "host/libs/location/GpsFix.h"
 #include "host/libs/location/GpxParser.h"
@@ -378,4 +379,58 @@ TEST(GpxParser, ParseValidDocumentString) {
   EXPECT_EQ("Trkpt 2-2", locations[7].name);
 }
 
+TEST(GpxParser, ParseStreamingStopsWhenCallbackFails) {
+  std::string error;
+  std::vector<std::string> names;
+
+  bool isOk = GpxParser::parseStringStreaming(
+      kValidDocumentText, strlen(kValidDocumentText),
+      [&names](const GpsFix& fix) {
+        names.push_back(fix.name);
+        return names.size() < 3;
+      },
+      &error);
+  EXPECT_FALSE(isOk);
+  EXPECT_FALSE(error.empty());
+  ASSERT_EQ(3U, names.size());
+  EXPECT_EQ("Wpt 1", names[0]);
+  EXPECT_EQ("Wpt 2", names[1]);
+  EXPECT_EQ("Rtept 1", names[2]);
+}
+
+char kFractionalTimesText[] =
+    "<?xml version=\"1.0\"?>"
+    "<gpx>"
+    "<trk>"
+    "<trkseg>"
+    "<trkpt lon=\"0\" lat=\"0\">"
+    "<time>2023-04-01T10:00:00.5Z</time>"
+    "</trkpt>"
+    "<trkpt lon=\"0\" lat=\"0\">"
+    "<time>2023-04-01T10:00:00.25Z</time>"
+    "</trkpt>"
+    "<trkpt lon=\"0\" lat=\"0\">"
+    "<time>2023-04-01T10:00:01.123456Z</time>"
+    "</trkpt>"
+    "<trkpt lon=\"0\" lat=\"0\">"
+    "<time>2023-04-01T10:00:00Z</time>"
+    "</trkpt>"
+    "</trkseg>"
+    "</trk>"
+    "</gpx>";
+TEST(GpxParser, ParseFractionalSeconds) {
+  std::string error;
+  GpsFixArray locations;
+  EXPECT_TRUE(ParseGpxString(&locations, kFractionalTimesText, &error));
+  ASSERT_EQ(4U, locations.size());
+  // Sorted by time, to the millisecond.
+  EXPECT_EQ(0, locations[0].time_ms);
+  EXPECT_EQ(250, locations[1].time_ms);
+  EXPECT_EQ(500, locations[2].time_ms);
+  EXPECT_EQ(123, locations[3].time_ms);
+  EXPECT_EQ(locations[0].time, locations[1].time);
+  EXPECT_EQ(locations[0].time, locations[2].time);
+  EXPECT_EQ(locations[0].time + 1, locations[3].time);
+}
+
 }  // namespace cuttlefish
\ No newline at end of file
@@ -658,4 +658,77 @@ TEST(KmlParser, ParsePlacemarkNullNameNoCrashString) {
   EXPECT_STREQ("", locations.front().description.c_str());
 }
 
+TEST(KmlParser, ParseStreamingPassesFixesInOrder) {
+  GpsFixArray locations;
+  std::string error;
+  ASSERT_TRUE(ParseKmlString(&locations, kMultipleLocationsText, &error));
+
+  GpsFixArray streamed;
+  EXPECT_TRUE(KmlParser::parseStringStreaming(
+      kMultipleLocationsText, strlen(kMultipleLocationsText),
+      [&streamed](const GpsFix& fix) {
+        streamed.push_back(fix);
+        return true;
+      },
+      &error));
+  EXPECT_EQ("", error);
+  ASSERT_EQ(locations.size(), streamed.size());
+  for (unsigned i = 0; i < locations.size(); ++i) {
+    EXPECT_EQ(locations[i].name, streamed[i].name);
+    EXPECT_EQ(locations[i].description, streamed[i].description);
+    EXPECT_FLOAT_EQ(locations[i].longitude, streamed[i].longitude);
+    EXPECT_FLOAT_EQ(locations[i].latitude, streamed[i].latitude);
+    EXPECT_FLOAT_EQ(locations[i].elevation, streamed[i].elevation);
+  }
+}
+
+TEST(KmlParser, ParseStreamingStopsWhenCallbackFails) {
+  std::string error;
+  int calls = 0;
+  EXPECT_FALSE(KmlParser::parseStringStreaming(
+      kMultipleLocationsText, strlen(kMultipleLocationsText),
+      [&calls](const GpsFix&) { return ++calls < 2; }, &error));
+  EXPECT_FALSE(error.empty());
+  EXPECT_EQ(2, calls);
+}
+
+// The file is read in 64KB chunks, the coordinates span several of them.
+TEST(KmlParser, ParseFileStreamingLongPath) {
+  constexpr int kPoints = 10000;
+  std::string text =
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+      "<kml xmlns=\"http://earth.google.com/kml/2.x\">"
+      "<Placemark>"
+      "<name>Long path</name>"
+      "<LineString>"
+      "<coordinates>";
+  for (int i = 0; i < kPoints; ++i) {
+    text += std::to_string(i % 180) + ".25," + std::to_string(i % 90) +
+            ".5," + std::to_string(i) + "\n";
+  }
+  text += "</coordinates></LineString></Placemark></kml>";
+  ASSERT_GT(text.size(), 2U * 64 * 1024);
+
+  TemporaryDir myDir;
+  std::string path = std::string(myDir.path) + "/long.kml";
+  ASSERT_TRUE(android::base::WriteStringToFile(text, path));
+
+  int count = 0;
+  std::string error;
+  EXPECT_TRUE(KmlParser::parseFileStreaming(
+      path.c_str(),
+      [&count](const GpsFix& fix) {
+        // Only the first point carries the name of the Placemark.
+        EXPECT_EQ(count == 0 ? "Long path" : "", fix.name);
+        EXPECT_FLOAT_EQ(count % 180 + 0.25, fix.longitude);
+        EXPECT_FLOAT_EQ(count % 90 + 0.5, fix.latitude);
+        EXPECT_FLOAT_EQ(count, fix.elevation);
+        ++count;
+        return true;
+      },
+      &error))
+      << error;
+  EXPECT_EQ(kPoints, count);
+}
+
 }  // namespace cuttlefish
\ No newline at end of file
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "host/libs/location/XmlStreamParser.h"
+
+namespace cuttlefish {
+namespace {
+
+// parseFile reads the document in chunks of this size.
+constexpr size_t kChunkSize = 64 * 1024;
+
+// Records the elements and text it is passed.
+class RecordingParser : public XmlStreamParser {
+ public:
+  RecordingParser() : XmlStreamParser("Test") {}
+
+  std::vector<std::string> items;
+  std::string text;
+
+ protected:
+  void startElement(const char* name, const char*, int attributeCount,
+                    const xmlChar** attributes) override {
+    current_ = name;
+    if (current_ == "item") {
+      std::string value;
+      EXPECT_TRUE(getAttribute(attributeCount, attributes, "id", &value));
+      items.push_back(value);
+    }
+  }
+  void endElement(const char*, const char*) override { current_.clear(); }
+  void characters(const char* chars, int len) override {
+    if (current_ == "text") {
+      text.append(chars, len);
+    }
+  }
+
+ private:
+  std::string current_;
+};
+
+std::string WriteTempFile(const TemporaryDir& dir, const std::string& text) {
+  std::string path = std::string(dir.path) + "/test.xml";
+  EXPECT_TRUE(android::base::WriteStringToFile(text, path));
+  return path;
+}
+
+TEST(XmlStreamParser, ParseFileSplitsTextAcrossChunks) {
+  std::string expected;
+  for (size_t i = 0; expected.size() < 3 * kChunkSize; ++i) {
+    expected += "line " + std::to_string(i) + "\n";
+  }
+  std::string document = "<?xml version=\"1.0\"?><doc><text>" + expected +
+                         "</text></doc>";
+
+  TemporaryDir dir;
+  RecordingParser parser;
+  std::string error;
+  ASSERT_TRUE(parser.parseFile(WriteTempFile(dir, document).c_str(), &error))
+      << error;
+  EXPECT_EQ(expected, parser.text);
+}
+
+TEST(XmlStreamParser, ParseFileSplitsElementsAcrossChunks) {
+  std::string document = "<?xml version=\"1.0\"?><doc>";
+  std::vector<std::string> expected;
+  // Every chunk boundary falls inside an element: a few bytes before each
+  // one an element starts whose tag is longer than that.
+  for (size_t boundary = kChunkSize; boundary <= 4 * kChunkSize;
+       boundary += kChunkSize) {
+    document.append(boundary - 5 - document.size(), ' ');
+    auto id = "boundary-" + std::to_string(boundary);
+    document += "<item id=\"" + id + "\"/>";
+    expected.push_back(id);
+    for (int i = 0; i < 100; ++i) {
+      id = std::to_string(boundary) + "-" + std::to_string(i);
+      document += "<item id=\"" + id + "\"/>";
+      expected.push_back(id);
+    }
+  }
+  document += "</doc>";
+
+  TemporaryDir dir;
+  RecordingParser parser;
+  std::string error;
+  ASSERT_TRUE(parser.parseFile(WriteTempFile(dir, document).c_str(), &error))
+      << error;
+  EXPECT_EQ(expected, parser.items);
+}
+
+TEST(XmlStreamParser, ParseFileFailsOnTruncatedDocument) {
+  std::string document = "<?xml version=\"1.0\"?><doc><text>";
+  document.append(2 * kChunkSize, 'x');
+
+  TemporaryDir dir;
+  RecordingParser parser;
+  std::string error;
+  EXPECT_FALSE(parser.parseFile(WriteTempFile(dir, document).c_str(), &error));
+  EXPECT_EQ("Test document not parsed successfully.", error);
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -49,13 +49,17 @@
 #include <common/libs/fs/shared_select.h>
 #include <host/libs/config/cuttlefish_config.h>
 #include <host/libs/config/logging.h>
-#include <queue>
+
+#include "host/commands/gnss_grpc_proxy/location_playback.h"
 
 using gnss_grpc_proxy::GnssGrpcProxy;
+using gnss_grpc_proxy::GpsCoordinates;
+using gnss_grpc_proxy::GpsPlaybackOptions;
 using gnss_grpc_proxy::SendGpsReply;
 using gnss_grpc_proxy::SendGpsRequest;
 using gnss_grpc_proxy::SendGpsCoordinatesReply;
 using gnss_grpc_proxy::SendGpsCoordinatesRequest;
+using gnss_grpc_proxy::StreamGpsLocationsRequest;
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
@@ -111,10 +115,10 @@ class GnssGrpcProxyServiceImpl final : public GnssGrpcProxy::Service {
        : gnss_in_(gnss_in),
          gnss_out_(gnss_out),
          fixed_location_in_(fixed_location_in),
-         fixed_location_out_(fixed_location_out) {
-          //Set the default GPS delay to 1 second
-          fixed_locations_delay_=1000;
-         }
+         fixed_location_out_(fixed_location_out),
+         playback_([this](const GpsCoordinates& location) {
+           SetFixedLocation(location);
+         }) {}
 
 
    Status SendGps(ServerContext* context, const SendGpsRequest* request,
@@ -126,7 +130,7 @@ class GnssGrpcProxyServiceImpl final : public GnssGrpcProxy::Service {
    }
 
 
-  std::string ConvertCoordinate(gnss_grpc_proxy::GpsCoordinates coordinate){
+  std::string ConvertCoordinate(const GpsCoordinates& coordinate){
     std::string latitude = std::to_string(coordinate.latitude());
     std::string longitude = std::to_string(coordinate.longitude());
     std::string elevation = std::to_string(coordinate.elevation());
@@ -138,17 +142,35 @@ class GnssGrpcProxyServiceImpl final : public GnssGrpcProxy::Service {
                         const SendGpsCoordinatesRequest* request,
                         SendGpsCoordinatesReply* reply) override {
      reply->set_status(SendGpsCoordinatesReply::OK);//update protobuf reply
-     {
-       std::lock_guard<std::mutex> lock(fixed_locations_queue_mutex_);
-       // Reset local buffers
-       fixed_locations_queue_ = {};
-       // Make a local copy of the input buffers
-       for (auto loc : request->coordinates()) {
-         fixed_locations_queue_.push(ConvertCoordinate(loc));
+     GpsPlaybackOptions options;
+     options.set_delay(request->delay());
+     playback_.Replace(options, request->coordinates());
+     return Status::OK;
+   }
+
+   Status StreamGpsLocations(
+       ServerContext* context,
+       grpc::ServerReader<StreamGpsLocationsRequest>* reader,
+       SendGpsCoordinatesReply* reply) override {
+     StreamGpsLocationsRequest request;
+     bool first = true;
+     uint64_t playback = 0;
+     while (reader->Read(&request)) {
+       if (first) {
+         playback = playback_.Begin(request.options());
+         first = false;
+       }
+       for (const auto& loc : request.coordinates()) {
+         // Not reading from the stream while the queue is full slows the
+         // client down through gRPC's flow control.
+         if (!playback_.Add(playback, loc)) {
+           reply->set_status(SendGpsCoordinatesReply::ABORTED);
+           return Status(grpc::StatusCode::ABORTED,
+                         "Replaced by another playback");
+         }
        }
-       fixed_locations_delay_ = request->delay();
      }
-
+     reply->set_status(SendGpsCoordinatesReply::OK);
      return Status::OK;
    }
 
@@ -185,8 +207,7 @@ class GnssGrpcProxyServiceImpl final : public GnssGrpcProxy::Service {
     void StartServer() {
       // Create a new thread to handle writes to the gnss and to the any client
       // connected to the socket.
-      fixed_location_write_thread_ =
-          std::thread([this]() { WriteFixedLocationFromQueue(); });
+      fixed_location_write_thread_ = std::thread([this]() { playback_.Run(); });
       measurement_read_thread_ =
           std::thread([this]() { ReadMeasurementLoop(); });
       fixed_location_read_thread_ =
@@ -353,20 +374,10 @@ class GnssGrpcProxyServiceImpl final : public GnssGrpcProxy::Service {
      }
    }
 
-   [[noreturn]] void WriteFixedLocationFromQueue() {
-      while (true) {
-         if (!fixed_locations_queue_.empty()) {
-         std::string dataPoint = fixed_locations_queue_.front();
-         std::string line = GenerateGpsLine(dataPoint);
-         std::lock_guard<std::mutex> lock(cached_fixed_location_mutex);
-         cached_fixed_location = line;
-         {
-           std::lock_guard<std::mutex> lock(fixed_locations_queue_mutex_);
-           fixed_locations_queue_.pop();
-         }
-       }
-       std::this_thread::sleep_for(std::chrono::milliseconds(fixed_locations_delay_));
-     }
+   void SetFixedLocation(const GpsCoordinates& location) {
+     std::string line = GenerateGpsLine(ConvertCoordinate(location));
+     std::lock_guard<std::mutex> lock(cached_fixed_location_mutex);
+     cached_fixed_location = line;
    }
 
     std::string getTimeNanosFromLine(const std::string& line) {
@@ -398,9 +409,7 @@ class GnssGrpcProxyServiceImpl final : public GnssGrpcProxy::Service {
     std::string previous_cached_gnss_raw;
     std::mutex cached_gnss_raw_mutex;
 
-    std::queue<std::string> fixed_locations_queue_;
-    std::mutex fixed_locations_queue_mutex_;
-    int fixed_locations_delay_;
+    cuttlefish::LocationPlayback playback_;
 };
 
 void RunServer() {
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/gnss_grpc_proxy/location_playback.h"
+
+#include <algorithm>
+#include <utility>
+
+using gnss_grpc_proxy::GpsCoordinates;
+using gnss_grpc_proxy::GpsPlaybackOptions;
+
+namespace cuttlefish {
+
+LocationPlayback::LocationPlayback(Sink sink) : sink_(std::move(sink)) {
+  // Set the default GPS delay to 1 second
+  options_.set_delay(1000);
+}
+
+void LocationPlayback::Replace(
+    const GpsPlaybackOptions& options,
+    const google::protobuf::RepeatedPtrField<GpsCoordinates>& locations) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    queue_.assign(locations.begin(), locations.end());
+    options_ = options;
+    generation_++;
+  }
+  cv_.notify_all();
+}
+
+uint64_t LocationPlayback::Begin(const GpsPlaybackOptions& options) {
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    queue_.clear();
+    options_ = options;
+    generation = ++generation_;
+  }
+  cv_.notify_all();
+  return generation;
+}
+
+bool LocationPlayback::Add(uint64_t playback, const GpsCoordinates& location) {
+  {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock, [this, playback]() {
+      return queue_.size() < kMaxQueuedLocations || generation_ != playback;
+    });
+    if (generation_ != playback) {
+      return false;
+    }
+    queue_.push_back(location);
+  }
+  cv_.notify_all();
+  return true;
+}
+
+void LocationPlayback::Run() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (true) {
+    cv_.wait(lock, [this]() { return stopped_ || !queue_.empty(); });
+    if (stopped_) {
+      return;
+    }
+    auto generation = generation_;
+    auto location = queue_.front();
+    queue_.pop_front();
+    cv_.notify_all();
+    sink_(location);
+
+    // A new playback interrupts the wait for the next location.
+    auto interrupted = [this, generation]() {
+      return stopped_ || generation_ != generation;
+    };
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + Delay(location);
+    std::chrono::milliseconds interval(options_.interpolation_interval());
+    if (interval.count() > 0) {
+      for (auto next = start + interval; next < deadline; next += interval) {
+        if (cv_.wait_until(lock, next, interrupted)) {
+          break;
+        }
+        if (!queue_.empty()) {
+          float fraction = float((next - start).count()) /
+                           float((deadline - start).count());
+          sink_(Interpolate(location, queue_.front(), fraction));
+        }
+      }
+    }
+    cv_.wait_until(lock, deadline, interrupted);
+  }
+}
+
+void LocationPlayback::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+}
+
+// Called with mtx_ held.
+std::chrono::milliseconds LocationPlayback::Delay(
+    const GpsCoordinates& location) {
+  int64_t delay = options_.delay();
+  if (options_.use_timestamps() && location.timestamp_ms() != 0 &&
+      !queue_.empty() && queue_.front().timestamp_ms() != 0) {
+    delay = std::max<int64_t>(
+        queue_.front().timestamp_ms() - location.timestamp_ms(), 0);
+  }
+  float speed = options_.speed() > 0 ? options_.speed() : 1;
+  return std::chrono::milliseconds(int64_t(delay / speed));
+}
+
+GpsCoordinates LocationPlayback::Interpolate(const GpsCoordinates& from,
+                                             const GpsCoordinates& to,
+                                             float fraction) {
+  auto between = [fraction](float a, float b) {
+    return a + (b - a) * fraction;
+  };
+  // Takes the short way across the antimeridian.
+  float to_longitude = to.longitude();
+  if (to_longitude - from.longitude() > 180) {
+    to_longitude -= 360;
+  } else if (to_longitude - from.longitude() < -180) {
+    to_longitude += 360;
+  }
+  float longitude = between(from.longitude(), to_longitude);
+  if (longitude > 180) {
+    longitude -= 360;
+  } else if (longitude < -180) {
+    longitude += 360;
+  }
+  GpsCoordinates result;
+  result.set_latitude(between(from.latitude(), to.latitude()));
+  result.set_longitude(longitude);
+  result.set_elevation(between(from.elevation(), to.elevation()));
+  return result;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#include "gnss_grpc_proxy.pb.h"
+
+namespace cuttlefish {
+
+// Plays back a route: each location is reported and stays current for the
+// delay the playback options give it, optionally with interpolated locations
+// reported in between. A new playback replaces the current one right away.
+class LocationPlayback {
+ public:
+  // Locations streamed ahead of the playback are held back once this many
+  // are queued, so that the memory used doesn't depend on the length of the
+  // route.
+  static constexpr size_t kMaxQueuedLocations = 4096;
+
+  // Receives every location as it becomes current.
+  using Sink = std::function<void(const gnss_grpc_proxy::GpsCoordinates&)>;
+
+  explicit LocationPlayback(Sink sink);
+
+  // Replaces the current playback with all of |locations|.
+  void Replace(
+      const gnss_grpc_proxy::GpsPlaybackOptions& options,
+      const google::protobuf::RepeatedPtrField<gnss_grpc_proxy::GpsCoordinates>&
+          locations);
+  // Replaces the current playback with one whose locations are passed to Add
+  // as they arrive. Returns the playback to pass to Add.
+  uint64_t Begin(const gnss_grpc_proxy::GpsPlaybackOptions& options);
+  // Waits while the queue is full. Returns false, without adding |location|,
+  // once |playback| was replaced.
+  bool Add(uint64_t playback, const gnss_grpc_proxy::GpsCoordinates& location);
+
+  // Reports the queued locations until Stop is called.
+  void Run();
+  void Stop();
+
+  // The point |fraction| of the way from |from| to |to|.
+  static gnss_grpc_proxy::GpsCoordinates Interpolate(
+      const gnss_grpc_proxy::GpsCoordinates& from,
+      const gnss_grpc_proxy::GpsCoordinates& to, float fraction);
+
+ private:
+  std::chrono::milliseconds Delay(
+      const gnss_grpc_proxy::GpsCoordinates& location);
+
+  Sink sink_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<gnss_grpc_proxy::GpsCoordinates> queue_;
+  gnss_grpc_proxy::GpsPlaybackOptions options_;
+  // Incremented when a new playback replaces the queued locations
+  uint64_t generation_ = 0;
+  bool stopped_ = false;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/gnss_grpc_proxy/location_playback.h"
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using gnss_grpc_proxy::GpsCoordinates;
+using gnss_grpc_proxy::GpsPlaybackOptions;
+using gnss_grpc_proxy::SendGpsCoordinatesRequest;
+
+namespace cuttlefish {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+GpsCoordinates Location(float latitude, int64_t timestamp_ms = 0) {
+  GpsCoordinates location;
+  location.set_latitude(latitude);
+  location.set_longitude(latitude * 2);
+  location.set_elevation(latitude * 3);
+  location.set_timestamp_ms(timestamp_ms);
+  return location;
+}
+
+class LocationPlaybackTest : public ::testing::Test {
+ protected:
+  struct Reported {
+    Clock::time_point time;
+    GpsCoordinates location;
+  };
+
+  void TearDown() override {
+    playback_.Stop();
+    if (runner_.joinable()) {
+      runner_.join();
+    }
+  }
+
+  void Play(const GpsPlaybackOptions& options,
+            const std::vector<GpsCoordinates>& locations) {
+    SendGpsCoordinatesRequest request;
+    for (const auto& location : locations) {
+      *request.add_coordinates() = location;
+    }
+    playback_.Replace(options, request.coordinates());
+    if (!runner_.joinable()) {
+      runner_ = std::thread([this]() { playback_.Run(); });
+    }
+  }
+
+  // The first |count| locations reported, fails after a few seconds.
+  std::vector<Reported> WaitFor(size_t count) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    EXPECT_TRUE(cv_.wait_for(lock, std::chrono::seconds(10), [this, count]() {
+      return reported_.size() >= count;
+    })) << "Only " << reported_.size() << " of " << count << " reported";
+    return reported_;
+  }
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<Reported> reported_;
+  LocationPlayback playback_{[this](const GpsCoordinates& location) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    reported_.push_back({Clock::now(), location});
+    cv_.notify_all();
+  }};
+  std::thread runner_;
+};
+
+TEST_F(LocationPlaybackTest, ReportsEachLocationAfterTheDelay) {
+  GpsPlaybackOptions options;
+  options.set_delay(50);
+  Play(options, {Location(1), Location(2), Location(3)});
+
+  auto reported = WaitFor(3);
+  ASSERT_EQ(reported.size(), 3);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_FLOAT_EQ(reported[i].location.latitude(), i + 1);
+  }
+  EXPECT_GE(reported[1].time - reported[0].time,
+            std::chrono::milliseconds(50));
+  EXPECT_GE(reported[2].time - reported[1].time,
+            std::chrono::milliseconds(50));
+}
+
+TEST_F(LocationPlaybackTest, InterpolatesBetweenLocations) {
+  GpsPlaybackOptions options;
+  options.set_delay(200);
+  options.set_interpolation_interval(50);
+  Play(options, {Location(0), Location(8)});
+
+  auto reported = WaitFor(5);
+  ASSERT_EQ(reported.size(), 5);
+  // At a quarter, half and three quarters of the delay.
+  std::vector<float> latitudes = {0, 2, 4, 6, 8};
+  for (int i = 0; i < 5; i++) {
+    EXPECT_FLOAT_EQ(reported[i].location.latitude(), latitudes[i]);
+    EXPECT_FLOAT_EQ(reported[i].location.longitude(), latitudes[i] * 2);
+    EXPECT_FLOAT_EQ(reported[i].location.elevation(), latitudes[i] * 3);
+  }
+}
+
+TEST_F(LocationPlaybackTest, FollowsTimestampsAtTheGivenSpeed) {
+  GpsPlaybackOptions options;
+  // Only used without timestamps.
+  options.set_delay(10000);
+  options.set_use_timestamps(true);
+  options.set_speed(2);
+  Play(options, {Location(1, 1000), Location(2, 1400)});
+
+  auto reported = WaitFor(2);
+  ASSERT_EQ(reported.size(), 2);
+  auto gap = reported[1].time - reported[0].time;
+  EXPECT_GE(gap, std::chrono::milliseconds(200));
+  EXPECT_LT(gap, std::chrono::milliseconds(5000));
+}
+
+TEST_F(LocationPlaybackTest, NewPlaybackAbortsAWaitingStream) {
+  GpsPlaybackOptions options;
+  auto first = playback_.Begin(options);
+  // Nothing plays yet, so the queue fills up.
+  for (size_t i = 0; i < LocationPlayback::kMaxQueuedLocations; i++) {
+    ASSERT_TRUE(playback_.Add(first, Location(1)));
+  }
+  auto blocked = std::async(std::launch::async, [this, first]() {
+    return playback_.Add(first, Location(1));
+  });
+  EXPECT_EQ(blocked.wait_for(std::chrono::milliseconds(100)),
+            std::future_status::timeout);
+
+  options.set_delay(10);
+  Play(options, {Location(5)});
+  ASSERT_EQ(blocked.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_FALSE(blocked.get());
+  // The locations of the replaced playback were dropped.
+  auto reported = WaitFor(1);
+  ASSERT_EQ(reported.size(), 1);
+  EXPECT_FLOAT_EQ(reported[0].location.latitude(), 5);
+}
+
+TEST(LocationPlaybackInterpolate, TakesTheShortWayAcrossTheAntimeridian) {
+  GpsCoordinates from, to;
+  from.set_longitude(170);
+  to.set_longitude(-170);
+  EXPECT_FLOAT_EQ(LocationPlayback::Interpolate(from, to, 0.25).longitude(),
+                  175);
+  EXPECT_FLOAT_EQ(
+      std::abs(LocationPlayback::Interpolate(from, to, 0.5).longitude()), 180);
+  EXPECT_FLOAT_EQ(LocationPlayback::Interpolate(from, to, 0.75).longitude(),
+                  -175);
+  EXPECT_FLOAT_EQ(LocationPlayback::Interpolate(to, from, 0.75).longitude(),
+                  175);
+}
+
+}  // namespace
+}  // namespace cuttlefish
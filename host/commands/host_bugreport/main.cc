@@ -14,69 +14,148 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <limits>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/strings.h>
 #include <gflags/gflags.h>
 
 #include "common/libs/fs/shared_fd.h"
 #include "common/libs/fs/shared_select.h"
 #include "common/libs/utils/files.h"
+#include "host/commands/host_bugreport/parallel_zip_writer.h"
 #include "host/libs/config/cuttlefish_config.h"
 #include "ziparchive/zip_writer.h"
 
 DEFINE_string(output, "host_bugreport.zip", "Where to write the output");
+DEFINE_uint32(jobs, 1,
+              "How many files to compress at the same time, 0 for one per "
+              "core. Entries are still written in order.");
+DEFINE_uint64(max_log_size_mb, 0,
+              "Only include this much of each log, 0 for no limit.");
+DEFINE_bool(log_tail, true,
+            "Keep the end of logs over --max_log_size_mb, rather than the "
+            "start.");
 
 namespace cuttlefish {
 namespace {
 
-void SaveFile(ZipWriter& writer, const std::string& zip_path,
-              const std::string& file_path) {
-  writer.StartEntry(zip_path, ZipWriter::kCompress | ZipWriter::kAlign32);
-  std::fstream file(file_path, std::fstream::in | std::fstream::binary);
+// Deflating these again would cost time and save next to nothing.
+bool IsCompressed(const std::string& path) {
+  for (const auto& extension :
+       {".webm", ".zst", ".gz", ".xz", ".lz4", ".zip"}) {
+    if (android::base::EndsWith(path, extension)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ZipEntry MakeEntry(const std::string& zip_path, const std::string& file_path,
+                   bool is_log) {
+  ZipEntry entry{zip_path, file_path};
+  entry.compress = !IsCompressed(file_path);
+  off_t max_size = FLAGS_max_log_size_mb << 20;
+  if (is_log && max_size > 0) {
+    entry.length = max_size;
+    if (FLAGS_log_tail) {
+      entry.offset = std::max<off_t>(FileSize(file_path) - max_size, 0);
+    }
+  }
+  return entry;
+}
+
+// The segments log_sink rotated out of the log at `path`, <path>.<n> and
+// <path>.<n>.zst, from the newest to the oldest. Returns their file names.
+std::vector<std::string> RotatedSegments(const std::string& path) {
+  auto prefix = android::base::Basename(path) + ".";
+  auto contents = DirectoryContents(android::base::Dirname(path));
+  if (!contents.ok()) {
+    return {};
+  }
+  std::vector<std::pair<int, std::string>> segments;
+  for (const auto& file : *contents) {
+    if (!android::base::StartsWith(file, prefix)) {
+      continue;
+    }
+    auto index = file.substr(prefix.size());
+    if (android::base::EndsWith(index, ".zst")) {
+      index.resize(index.size() - strlen(".zst"));
+    }
+    int number;
+    if (android::base::ParseInt(index, &number, 1)) {
+      segments.emplace_back(number, file);
+    }
+  }
+  std::sort(segments.begin(), segments.end());
+  std::vector<std::string> files;
+  for (auto& [number, file] : segments) {
+    files.push_back(std::move(file));
+  }
+  return files;
+}
+
+void SaveFile(ZipWriter& writer, const ZipEntry& entry) {
+  auto flags = entry.compress ? ZipWriter::kCompress | ZipWriter::kAlign32
+                              : ZipWriter::kAlign32;
+  writer.StartEntry(entry.zip_path, flags);
+  std::fstream file(entry.file_path, std::fstream::in | std::fstream::binary);
+  file.seekg(entry.offset);
+  auto left = entry.length.value_or(std::numeric_limits<off_t>::max());
   do {
     char data[1024 * 10];
-    file.read(data, sizeof(data));
+    file.read(data, std::min<off_t>(sizeof(data), left));
     writer.WriteBytes(data, file.gcount());
-  } while (file);
+    left -= file.gcount();
+  } while (file && left > 0);
   writer.FinishEntry();
   if (file.bad()) {
-    LOG(ERROR) << "Error in logging " << file_path << " to " << zip_path;
+    LOG(ERROR) << "Error in logging " << entry.file_path << " to "
+               << entry.zip_path;
   }
 }
 
-Result<void> CvdHostBugreportMain(int argc, char** argv) {
-  ::android::base::InitLogging(argv, android::base::StderrLogger);
-  google::ParseCommandLineFlags(&argc, &argv, true);
-
-  auto config = CuttlefishConfig::Get();
-  CHECK(config) << "Unable to find the config";
-
-  auto out_path = FLAGS_output.c_str();
-  std::unique_ptr<FILE, decltype(&fclose)> out(fopen(out_path, "wbe"), &fclose);
-  ZipWriter writer(out.get());
-
-  auto save = [&writer, config](const std::string& path) {
-    SaveFile(writer, "cuttlefish_assembly/" + path, config->AssemblyPath(path));
+Result<std::vector<ZipEntry>> BugreportEntries(
+    const CuttlefishConfig& config) {
+  std::vector<ZipEntry> entries;
+  auto save = [&entries, &config](const std::string& path, bool is_log) {
+    entries.push_back(MakeEntry("cuttlefish_assembly/" + path,
+                                config.AssemblyPath(path), is_log));
   };
-  save("assemble_cvd.log");
-  save("cuttlefish_config.json");
+  save("assemble_cvd.log", true);
+  save("cuttlefish_config.json", false);
 
-  for (const auto& instance : config->Instances()) {
-    auto save = [&writer, instance](const std::string& path) {
+  for (const auto& instance : config.Instances()) {
+    auto save = [&entries, instance](const std::string& path, bool is_log) {
       const auto& zip_name = instance.instance_name() + "/" + path;
       const auto& file_name = instance.PerInstancePath(path.c_str());
-      SaveFile(writer, zip_name, file_name);
+      entries.push_back(MakeEntry(zip_name, file_name, is_log));
     };
-    save("cuttlefish_config.json");
-    save("disk_config.txt");
-    save("kernel.log");
-    save("launcher.log");
-    save("logcat");
-    save("metrics.log");
+    auto save_log = [&save, instance](const std::string& path) {
+      save(path, true);
+      for (const auto& segment :
+           RotatedSegments(instance.PerInstancePath(path.c_str()))) {
+        // A compressed segment can't be cut to --max_log_size_mb.
+        save(segment, !android::base::EndsWith(segment, ".zst"));
+      }
+    };
+    save("cuttlefish_config.json", false);
+    save("disk_config.txt", false);
+    save_log("kernel.log");
+    save_log("launcher.log");
+    save_log("logcat");
+    save_log("metrics.log");
     auto tombstones =
         CF_EXPECT(DirectoryContents(instance.PerInstancePath("tombstones")),
                   "Cannot read from tombstones directory.");
@@ -84,7 +163,7 @@ Result<void> CvdHostBugreportMain(int argc, char** argv) {
       if (tombstone == "." || tombstone == "..") {
         continue;
       }
-      save("tombstones/" + tombstone);
+      save("tombstones/" + tombstone, false);
     }
     auto recordings =
         CF_EXPECT(DirectoryContents(instance.PerInstancePath("recording")),
@@ -93,11 +172,41 @@ Result<void> CvdHostBugreportMain(int argc, char** argv) {
       if (recording == "." || recording == "..") {
         continue;
       }
-      save("recording/" + recording);
+      save("recording/" + recording, false);
     }
   }
+  return entries;
+}
 
-  writer.Finish();
+Result<void> CvdHostBugreportMain(int argc, char** argv) {
+  ::android::base::InitLogging(argv, android::base::StderrLogger);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  auto config = CuttlefishConfig::Get();
+  CHECK(config) << "Unable to find the config";
+
+  auto entries = CF_EXPECT(BugreportEntries(*config));
+
+  size_t jobs = FLAGS_jobs;
+  if (jobs == 0) {
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  if (jobs > 1) {
+    auto out = SharedFD::Open(FLAGS_output,
+                              O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    CF_EXPECT(out->IsOpen(), "Unable to open \"" << FLAGS_output
+                                                  << "\": " << out->StrError());
+    CF_EXPECT(WriteZipInParallel(out, entries, jobs));
+  } else {
+    auto out_path = FLAGS_output.c_str();
+    std::unique_ptr<FILE, decltype(&fclose)> out(fopen(out_path, "wbe"),
+                                                 &fclose);
+    ZipWriter writer(out.get());
+    for (const auto& entry : entries) {
+      SaveFile(writer, entry);
+    }
+    writer.Finish();
+  }
 
   LOG(INFO) << "Saved to \"" << FLAGS_output << "\"";
 
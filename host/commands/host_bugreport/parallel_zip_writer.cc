@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/host_bugreport/parallel_zip_writer.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <android-base/logging.h>
+
+#include "common/libs/fs/shared_buf.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr size_t kChunkSize = 64 * 1024;
+constexpr uint16_t kStored = 0;
+constexpr uint16_t kDeflated = 8;
+constexpr uint16_t kZipVersion = 20;
+
+// An entry ready to be written. Deflated data is kept in memory, stored data
+// is copied from the file again when it is written.
+struct PreparedEntry {
+  uint16_t method = kStored;
+  uint32_t crc = 0;
+  uint64_t size = 0;
+  std::string deflated;
+};
+
+void Put16(std::string& out, uint16_t value) {
+  out.push_back(value & 0xff);
+  out.push_back(value >> 8);
+}
+
+void Put32(std::string& out, uint32_t value) {
+  Put16(out, value & 0xffff);
+  Put16(out, value >> 16);
+}
+
+class FileRange {
+ public:
+  explicit FileRange(const ZipEntry& entry)
+      : fd_(SharedFD::Open(entry.file_path, O_RDONLY | O_CLOEXEC)),
+        left_(entry.length.value_or(std::numeric_limits<off_t>::max())) {
+    if (fd_->IsOpen() && entry.offset > 0 &&
+        fd_->LSeek(entry.offset, SEEK_SET) < 0) {
+      fd_ = SharedFD();
+    }
+  }
+
+  bool IsOpen() const { return fd_->IsOpen(); }
+  std::string StrError() const { return fd_->StrError(); }
+
+  // Returns the number of bytes read, 0 at the end of the range.
+  ssize_t Read(char* buf, size_t size) {
+    auto wanted = std::min<off_t>(size, left_);
+    if (wanted == 0) {
+      return 0;
+    }
+    auto read = fd_->Read(buf, wanted);
+    if (read > 0) {
+      left_ -= read;
+    }
+    return read;
+  }
+
+ private:
+  SharedFD fd_;
+  off_t left_;
+};
+
+Result<PreparedEntry> Prepare(const ZipEntry& entry) {
+  PreparedEntry prepared;
+  FileRange file(entry);
+  if (!file.IsOpen()) {
+    LOG(ERROR) << "Error in logging " << entry.file_path << " to "
+               << entry.zip_path << ": " << file.StrError();
+    return prepared;
+  }
+
+  z_stream stream{};
+  if (entry.compress) {
+    CF_EXPECT(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                           -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+  }
+  auto cleanup = [&stream, &entry]() {
+    if (entry.compress) {
+      deflateEnd(&stream);
+    }
+  };
+
+  prepared.crc = crc32(0, nullptr, 0);
+  std::vector<char> in(kChunkSize);
+  std::vector<char> out(kChunkSize);
+  ssize_t read;
+  do {
+    read = file.Read(in.data(), in.size());
+    if (read < 0) {
+      // Keep what was read so far, the same as ZipWriter would.
+      LOG(ERROR) << "Error in logging " << entry.file_path << " to "
+                 << entry.zip_path << ": " << file.StrError();
+      read = 0;
+    }
+    prepared.crc = crc32(prepared.crc, reinterpret_cast<Bytef*>(in.data()),
+                         read);
+    prepared.size += read;
+    if (!entry.compress) {
+      continue;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(in.data());
+    stream.avail_in = read;
+    int status;
+    do {
+      stream.next_out = reinterpret_cast<Bytef*>(out.data());
+      stream.avail_out = out.size();
+      status = deflate(&stream, read == 0 ? Z_FINISH : Z_NO_FLUSH);
+      if (status == Z_STREAM_ERROR) {
+        cleanup();
+        return CF_ERR("Failed to compress " << entry.file_path);
+      }
+      prepared.deflated.append(out.data(), out.size() - stream.avail_out);
+    } while (stream.avail_out == 0);
+  } while (read > 0);
+  cleanup();
+
+  if (entry.compress && prepared.deflated.size() < prepared.size) {
+    prepared.method = kDeflated;
+  } else {
+    prepared.deflated.clear();
+  }
+  return prepared;
+}
+
+class ArchiveWriter {
+ public:
+  explicit ArchiveWriter(SharedFD out) : out_(std::move(out)) {
+    auto now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    dos_time_ = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec >> 1);
+    dos_date_ = ((std::max(tm.tm_year, 80) - 80) << 9) |
+                ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+  }
+
+  Result<void> Add(const ZipEntry& entry, const PreparedEntry& prepared) {
+    uint64_t stored_size = prepared.method == kDeflated
+                               ? prepared.deflated.size()
+                               : prepared.size;
+    CF_EXPECT(offset_ + stored_size < std::numeric_limits<uint32_t>::max(),
+              "The archive would need zip64, which isn't supported");
+    CF_EXPECT(entry.zip_path.size() < std::numeric_limits<uint16_t>::max());
+
+    uint32_t header_offset = offset_;
+    std::string header;
+    Put32(header, 0x04034b50);
+    PutCommon(header, entry, prepared, stored_size);
+    Put16(header, 0);  // extra field length
+    header += entry.zip_path;
+    CF_EXPECT(Write(header.data(), header.size()));
+
+    if (prepared.method == kDeflated) {
+      CF_EXPECT(Write(prepared.deflated.data(), prepared.deflated.size()));
+    } else {
+      CF_EXPECT(CopyStored(entry, prepared.size));
+    }
+
+    Put32(central_directory_, 0x02014b50);
+    Put16(central_directory_, (3 << 8) | kZipVersion);  // made by unix
+    PutCommon(central_directory_, entry, prepared, stored_size);
+    Put16(central_directory_, 0);  // extra field length
+    Put16(central_directory_, 0);  // comment length
+    Put16(central_directory_, 0);  // disk number
+    Put16(central_directory_, 0);  // internal attributes
+    Put32(central_directory_, (S_IFREG | 0644) << 16);
+    Put32(central_directory_, header_offset);
+    central_directory_ += entry.zip_path;
+    entries_++;
+    return {};
+  }
+
+  Result<void> Finish() {
+    CF_EXPECT(entries_ < std::numeric_limits<uint16_t>::max(),
+              "Too many entries without zip64");
+    std::string end;
+    Put32(end, 0x06054b50);
+    Put16(end, 0);  // disk number
+    Put16(end, 0);  // disk with the central directory
+    Put16(end, entries_);
+    Put16(end, entries_);
+    Put32(end, central_directory_.size());
+    Put32(end, offset_);
+    Put16(end, 0);  // comment length
+    CF_EXPECT(Write(central_directory_.data(), central_directory_.size()));
+    CF_EXPECT(Write(end.data(), end.size()));
+    return {};
+  }
+
+ private:
+  // The fields shared by the local and central headers, up to the name length.
+  void PutCommon(std::string& out, const ZipEntry& entry,
+                 const PreparedEntry& prepared, uint64_t stored_size) {
+    Put16(out, kZipVersion);
+    Put16(out, 0);  // flags
+    Put16(out, prepared.method);
+    Put16(out, dos_time_);
+    Put16(out, dos_date_);
+    Put32(out, prepared.crc);
+    Put32(out, stored_size);
+    Put32(out, prepared.size);
+    Put16(out, entry.zip_path.size());
+  }
+
+  Result<void> Write(const char* data, size_t size) {
+    CF_EXPECT(WriteAll(out_, data, size) == size,
+              "Failed to write the archive: " << out_->StrError());
+    offset_ += size;
+    return {};
+  }
+
+  // Copies exactly the bytes the checksum was computed over, in case the file
+  // grew since.
+  Result<void> CopyStored(const ZipEntry& entry, uint64_t size) {
+    if (size == 0) {
+      return {};
+    }
+    FileRange file(entry);
+    CF_EXPECT(file.IsOpen(), "Failed to reopen " << entry.file_path);
+    std::vector<char> buf(kChunkSize);
+    while (size > 0) {
+      auto read = file.Read(buf.data(), std::min<uint64_t>(buf.size(), size));
+      CF_EXPECT(read > 0, "Failed to read " << entry.file_path << " again: "
+                                            << file.StrError());
+      CF_EXPECT(Write(buf.data(), read));
+      size -= read;
+    }
+    return {};
+  }
+
+  SharedFD out_;
+  uint16_t dos_time_;
+  uint16_t dos_date_;
+  uint64_t offset_ = 0;
+  uint32_t entries_ = 0;
+  std::string central_directory_;
+};
+
+}  // namespace
+
+Result<void> WriteZipInParallel(SharedFD out,
+                                const std::vector<ZipEntry>& entries,
+                                size_t jobs) {
+  jobs = std::max<size_t>(jobs, 1);
+  // Limits how many compressed entries can wait in memory to be written.
+  const size_t window = 2 * jobs;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<std::optional<Result<PreparedEntry>>> prepared(entries.size());
+  size_t next = 0;
+  size_t written = 0;
+  bool stopping = false;
+
+  auto worker = [&]() {
+    std::unique_lock lock(mutex);
+    while (true) {
+      changed.wait(lock, [&]() {
+        return stopping || next >= entries.size() || next < written + window;
+      });
+      if (stopping || next >= entries.size()) {
+        return;
+      }
+      auto index = next++;
+      lock.unlock();
+      auto result = Prepare(entries[index]);
+      lock.lock();
+      prepared[index] = std::move(result);
+      changed.notify_all();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < std::min(jobs, entries.size()); i++) {
+    workers.emplace_back(worker);
+  }
+
+  auto write = [&]() -> Result<void> {
+    ArchiveWriter archive(out);
+    for (size_t i = 0; i < entries.size(); i++) {
+      std::optional<Result<PreparedEntry>> result;
+      {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [&]() { return prepared[i].has_value(); });
+        result = std::move(prepared[i]);
+        prepared[i].reset();
+      }
+      auto entry = CF_EXPECT(std::move(*result));
+      CF_EXPECT(archive.Add(entries[i], entry));
+      std::lock_guard lock(mutex);
+      written++;
+      changed.notify_all();
+    }
+    CF_EXPECT(archive.Finish());
+    return {};
+  };
+  auto result = write();
+
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+    changed.notify_all();
+  }
+  for (auto& thread : workers) {
+    thread.join();
+  }
+  return result;
+}
+
+}  // namespace cuttlefish
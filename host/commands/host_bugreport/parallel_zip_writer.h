@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+struct ZipEntry {
+  std::string zip_path;
+  std::string file_path;
+  // The part of the file to include, by default all of it.
+  off_t offset = 0;
+  std::optional<off_t> length;
+  // Whether to deflate the data or store it as is.
+  bool compress = true;
+};
+
+/* Writes a zip archive of `entries` to `out`, in order.
+ *
+ * Up to `jobs` entries are read and compressed at the same time, and written
+ * out as soon as the entries before them are. Files which can't be read are
+ * logged and included as empty entries, like ZipWriter would.
+ *
+ * ZipWriter can only compress the entry it is writing, which is why this
+ * writes the archive format itself. Like ZipWriter, it doesn't support zip64,
+ * so the archive must stay under 4GiB.
+ */
+Result<void> WriteZipInParallel(SharedFD out,
+                                const std::vector<ZipEntry>& entries,
+                                size_t jobs);
+
+}  // namespace cuttlefish
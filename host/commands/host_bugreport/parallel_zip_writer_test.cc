@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/host_bugreport/parallel_zip_writer.h"
+
+#include <fcntl.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <ziparchive/zip_archive.h>
+
+#include "common/libs/fs/shared_fd.h"
+
+namespace cuttlefish {
+namespace {
+
+class ParallelZipWriterTest : public ::testing::TestWithParam<size_t> {
+ protected:
+  std::string Path(const std::string& name) {
+    return std::string(dir_.path) + "/" + name;
+  }
+
+  std::string WriteFile(const std::string& name, const std::string& data) {
+    auto path = Path(name);
+    EXPECT_TRUE(android::base::WriteStringToFile(data, path));
+    return path;
+  }
+
+  // Writes the archive and reads every entry back with libziparchive, keyed by
+  // name. Also checks that the entries are laid out in the requested order.
+  std::map<std::string, std::string> WriteAndRead(
+      const std::vector<ZipEntry>& entries) {
+    auto archive_path = Path("out.zip");
+    auto out = SharedFD::Open(archive_path,
+                              O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    EXPECT_TRUE(out->IsOpen()) << out->StrError();
+    auto result = WriteZipInParallel(out, entries, GetParam());
+    EXPECT_TRUE(result.ok()) << result.error().Message();
+    out->Close();
+
+    std::map<std::string, std::string> contents;
+    ZipArchiveHandle handle;
+    auto error = OpenArchive(archive_path.c_str(), &handle);
+    EXPECT_EQ(error, 0) << ErrorCodeString(error);
+    if (error != 0) {
+      CloseArchive(handle);
+      return contents;
+    }
+    off64_t previous_offset = -1;
+    for (const auto& entry : entries) {
+      ZipEntry64 zip_entry;
+      error = FindEntry(handle, entry.zip_path, &zip_entry);
+      EXPECT_EQ(error, 0) << entry.zip_path << ": " << ErrorCodeString(error);
+      if (error != 0) {
+        continue;
+      }
+      EXPECT_GT(zip_entry.offset, previous_offset) << entry.zip_path;
+      previous_offset = zip_entry.offset;
+      if (!entry.compress) {
+        EXPECT_EQ(zip_entry.method, kCompressStored) << entry.zip_path;
+      }
+      std::string data(zip_entry.uncompressed_length, '\0');
+      error = ExtractToMemory(handle, &zip_entry,
+                              reinterpret_cast<uint8_t*>(data.data()),
+                              data.size());
+      EXPECT_EQ(error, 0) << entry.zip_path << ": " << ErrorCodeString(error);
+      contents[entry.zip_path] = data;
+      methods_[entry.zip_path] = zip_entry.method;
+    }
+    CloseArchive(handle);
+    return contents;
+  }
+
+  TemporaryDir dir_;
+  std::map<std::string, uint16_t> methods_;
+};
+
+std::string RandomBytes(size_t size) {
+  std::mt19937 generator(size);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::string data(size, '\0');
+  for (auto& c : data) {
+    c = byte(generator);
+  }
+  return data;
+}
+
+TEST_P(ParallelZipWriterTest, ReadsBackWithZipArchive) {
+  // Larger than the chunks the writer reads and deflates in.
+  std::string text;
+  while (text.size() < 300 * 1024) {
+    text += "[    1.234567] virtio_net virtio1 eth0: renamed from eth1\n";
+  }
+  auto random = RandomBytes(150 * 1024);
+
+  std::vector<ZipEntry> entries = {
+      {"logs/kernel.log", WriteFile("kernel.log", text)},
+      {"random.bin", WriteFile("random.bin", random)},
+      {"empty", WriteFile("empty", "")},
+      {"recording/video.webm", WriteFile("video.webm", random)},
+  };
+  entries.back().compress = false;
+  auto contents = WriteAndRead(entries);
+
+  ASSERT_EQ(contents.size(), entries.size());
+  EXPECT_EQ(contents["logs/kernel.log"], text);
+  EXPECT_EQ(methods_["logs/kernel.log"], kCompressDeflated);
+  // Random data doesn't deflate, it's stored instead.
+  EXPECT_EQ(contents["random.bin"], random);
+  EXPECT_EQ(methods_["random.bin"], kCompressStored);
+  EXPECT_EQ(contents["empty"], "");
+  EXPECT_EQ(contents["recording/video.webm"], random);
+}
+
+TEST_P(ParallelZipWriterTest, ReadsBackRanges) {
+  std::string log;
+  for (int i = 0; log.size() < 200 * 1024; i++) {
+    log += "line " + std::to_string(i) + "\n";
+  }
+  auto path = WriteFile("launcher.log", log);
+  ZipEntry head{"head", path};
+  head.length = 1000;
+  ZipEntry tail{"tail", path};
+  tail.offset = log.size() - 100 * 1024;
+  tail.length = 100 * 1024;
+  ZipEntry past_end{"past_end", path};
+  past_end.offset = log.size() - 10;
+  past_end.length = 1000;
+
+  auto contents = WriteAndRead({head, tail, past_end});
+
+  EXPECT_EQ(contents["head"], log.substr(0, 1000));
+  EXPECT_EQ(contents["tail"], log.substr(log.size() - 100 * 1024));
+  EXPECT_EQ(contents["past_end"], log.substr(log.size() - 10));
+}
+
+TEST_P(ParallelZipWriterTest, MissingFilesAreEmptyEntries) {
+  auto contents = WriteAndRead({
+      {"before", WriteFile("before", "before")},
+      {"missing", Path("does_not_exist")},
+      {"after", WriteFile("after", "after")},
+  });
+
+  ASSERT_EQ(contents.size(), 3);
+  EXPECT_EQ(contents["before"], "before");
+  EXPECT_EQ(contents["missing"], "");
+  EXPECT_EQ(contents["after"], "after");
+}
+
+TEST_P(ParallelZipWriterTest, ManyEntriesStayInOrder) {
+  // More entries than the writer lets wait in memory.
+  std::vector<ZipEntry> entries;
+  for (int i = 0; i < 100; i++) {
+    auto name = "tombstones/tombstone_" + std::to_string(i);
+    entries.push_back({name, WriteFile("tombstone_" + std::to_string(i),
+                                       std::string(i * 97, 'a' + i % 26))});
+  }
+  auto contents = WriteAndRead(entries);
+
+  ASSERT_EQ(contents.size(), entries.size());
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(contents["tombstones/tombstone_" + std::to_string(i)],
+              std::string(i * 97, 'a' + i % 26));
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Jobs, ParallelZipWriterTest,
+                         ::testing::Values(1, 4, 16));
+
+}  // namespace
+}  // namespace cuttlefish
@@ -16,6 +16,8 @@
 
 #include "host/commands/kernel_log_monitor/kernel_log_server.h"
 
+#include <algorithm>
+#include <iterator>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -24,6 +26,7 @@
 #include <android-base/strings.h>
 #include <netinet/in.h>
 #include "common/libs/fs/shared_select.h"
+#include "host/commands/kernel_log_monitor/multi_pattern_matcher.h"
 #include "host/libs/config/cuttlefish_config.h"
 
 namespace {
@@ -31,6 +34,9 @@ namespace {
 using cuttlefish::SharedFD;
 using monitor::Event;
 
+// Large enough to drain the console pipe in one read during boot bursts.
+constexpr size_t kReadBufferSize = 64 * 1024;
+
 constexpr struct {
   std::string_view match;   // Substring to match in the kernel logs
   std::string_view prefix;  // Prefix value to output, describing the entry
@@ -65,6 +71,25 @@ constexpr struct {
      monitor::Event::DisplayPowerModeChanged, kKeyValuePair},
 };
 
+constexpr size_t kNumInformationalPatterns =
+    std::size(kInformationalPatterns);
+
+// All patterns searched for in each line, informational ones first, then the
+// stages, each in table order.
+const monitor::MultiPatternMatcher& Matcher() {
+  static const auto* matcher = []() {
+    std::vector<std::string_view> patterns;
+    for (const auto& [match, prefix] : kInformationalPatterns) {
+      patterns.push_back(match);
+    }
+    for (const auto& [stage, event, format] : kStageTable) {
+      patterns.push_back(stage);
+    }
+    return new monitor::MultiPatternMatcher(patterns);
+  }();
+  return *matcher;
+}
+
 void ProcessSubscriptions(
     Json::Value message,
     std::vector<monitor::EventCallback>* subscribers) {
@@ -89,10 +114,18 @@ void ProcessSubscriptions(
 
 namespace monitor {
 KernelLogServer::KernelLogServer(cuttlefish::SharedFD pipe_fd,
-                                 const std::string& log_name)
+                                 const std::string& log_name,
+                                 cuttlefish::LogSinkOptions log_options)
     : pipe_fd_(pipe_fd),
-      log_fd_(cuttlefish::SharedFD::Open(log_name.c_str(),
-                                         O_CREAT | O_RDWR | O_APPEND, 0666)) {}
+      read_buffer_(kReadBufferSize),
+      first_match_(Matcher().NumPatterns(), std::string::npos) {
+  auto log_sink = cuttlefish::LogSink::Create(log_name, std::move(log_options));
+  if (log_sink.ok()) {
+    log_sink_ = std::move(*log_sink);
+  } else {
+    LOG(ERROR) << "Could not open kernel log: " << log_sink.error().Message();
+  }
+}
 
 void KernelLogServer::BeforeSelect(cuttlefish::SharedFDSet* fd_read) const {
   fd_read->Set(pipe_fd_);
@@ -109,69 +142,95 @@ void KernelLogServer::SubscribeToEvents(monitor::EventCallback callback) {
 }
 
 bool KernelLogServer::HandleIncomingMessage() {
-  const size_t buf_len = 256;
-  char buf[buf_len];
-  ssize_t ret = pipe_fd_->Read(buf, buf_len);
+  ssize_t ret = pipe_fd_->Read(read_buffer_.data(), read_buffer_.size());
   if (ret < 0) {
     LOG(ERROR) << "Could not read kernel logs: " << pipe_fd_->StrError();
     return false;
   }
   if (ret == 0) return false;
   // Write the log to a file
-  if (log_fd_->Write(buf, ret) < 0) {
-    LOG(ERROR) << "Could not write kernel log to file: " << log_fd_->StrError();
+  if (!log_sink_) {
+    LOG(ERROR) << "Could not write kernel log to file: not open";
+    return false;
+  }
+  auto written = log_sink_->Write(read_buffer_.data(), ret);
+  if (!written.ok()) {
+    LOG(ERROR) << "Could not write kernel log to file: "
+               << written.error().Message();
     return false;
   }
 
   // Detect VIRTUAL_DEVICE_BOOT_*
-  for (ssize_t i=0; i<ret; i++) {
+  const auto& matcher = Matcher();
+  const char* buf = read_buffer_.data();
+  ssize_t line_start = 0;
+  for (ssize_t i = 0; i < ret; i++) {
     if ('\n' == buf[i]) {
-      for (auto& [match, prefix] : kInformationalPatterns) {
-        auto pos = line_.find(match);
-        if (std::string::npos != pos) {
-          LOG(INFO) << prefix << line_.substr(pos + match.size());
-        }
-      }
-      for (const auto& [stage, event, format] : kStageTable) {
-        auto pos = line_.find(stage);
-        if (std::string::npos != pos) {
-          // Log the stage
-          LOG(INFO) << stage;
-
-          Json::Value message;
-          message["event"] = event;
-          Json::Value metadata;
-
-          if (format == kKeyValuePair) {
-            // Expect space-separated key=value pairs in the log message.
-            const auto& fields =
-                android::base::Split(line_.substr(pos + stage.size()), " ");
-            for (std::string field : fields) {
-              field = android::base::Trim(field);
-              if (field.empty()) {
-                // Expected; android::base::Split() always returns at least
-                // one (possibly empty) string.
-                LOG(DEBUG) << "Empty field for line: " << line_;
-                continue;
-              }
-              const auto& keyvalue = android::base::Split(field, "=");
-              if (keyvalue.size() != 2) {
-                LOG(WARNING) << "Field is not in key=value format: " << field;
-                continue;
-              }
-              metadata[keyvalue[0]] = keyvalue[1];
-            }
-          }
-          message["metadata"] = metadata;
-          ProcessSubscriptions(message, &subscribers_);
-        }
+      line_.append(buf + line_start, i - line_start);
+      ProcessLine();
+      line_start = i + 1;
+      match_state_ = MultiPatternMatcher::kStartState;
+      continue;
+    }
+    match_state_ = matcher.Next(match_state_, buf[i]);
+    for (auto pattern : matcher.Matches(match_state_)) {
+      if (first_match_[pattern] == std::string::npos) {
+        auto end_in_line = line_.size() + (i - line_start) + 1;
+        first_match_[pattern] = end_in_line - matcher.PatternSize(pattern);
+        matched_patterns_.push_back(pattern);
       }
-      line_.clear();
     }
-    line_.append(1, buf[i]);
   }
+  line_.append(buf + line_start, ret - line_start);
 
   return true;
 }
 
+void KernelLogServer::ProcessLine() {
+  // Report in table order, regardless of where in the line each pattern was.
+  std::sort(matched_patterns_.begin(), matched_patterns_.end());
+  for (auto pattern : matched_patterns_) {
+    auto pos = first_match_[pattern];
+    first_match_[pattern] = std::string::npos;
+    if (pattern < kNumInformationalPatterns) {
+      const auto& [match, prefix] = kInformationalPatterns[pattern];
+      LOG(INFO) << prefix << line_.substr(pos + match.size());
+      continue;
+    }
+    const auto& [stage, event, format] =
+        kStageTable[pattern - kNumInformationalPatterns];
+    // Log the stage
+    LOG(INFO) << stage;
+
+    Json::Value message;
+    message["event"] = event;
+    Json::Value metadata;
+
+    if (format == kKeyValuePair) {
+      // Expect space-separated key=value pairs in the log message.
+      const auto& fields =
+          android::base::Split(line_.substr(pos + stage.size()), " ");
+      for (std::string field : fields) {
+        field = android::base::Trim(field);
+        if (field.empty()) {
+          // Expected; android::base::Split() always returns at least
+          // one (possibly empty) string.
+          LOG(DEBUG) << "Empty field for line: " << line_;
+          continue;
+        }
+        const auto& keyvalue = android::base::Split(field, "=");
+        if (keyvalue.size() != 2) {
+          LOG(WARNING) << "Field is not in key=value format: " << field;
+          continue;
+        }
+        metadata[keyvalue[0]] = keyvalue[1];
+      }
+    }
+    message["metadata"] = metadata;
+    ProcessSubscriptions(message, &subscribers_);
+  }
+  matched_patterns_.clear();
+  line_.clear();
+}
+
 }  // namespace monitor
@@ -18,6 +18,7 @@
 #include <stdint.h>
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,6 +26,8 @@
 
 #include "common/libs/fs/shared_fd.h"
 #include "common/libs/fs/shared_select.h"
+#include "host/commands/kernel_log_monitor/multi_pattern_matcher.h"
+#include "host/libs/log_sink/log_sink.h"
 
 namespace monitor {
 
@@ -56,7 +59,8 @@ using EventCallback = std::function<SubscriptionAction(Json::Value)>;
 // Only accept one connection.
 class KernelLogServer {
  public:
-  KernelLogServer(cuttlefish::SharedFD pipe_fd, const std::string& log_name);
+  KernelLogServer(cuttlefish::SharedFD pipe_fd, const std::string& log_name,
+                  cuttlefish::LogSinkOptions log_options = {});
 
   ~KernelLogServer() = default;
 
@@ -74,10 +78,17 @@ class KernelLogServer {
   // Respond to message from remote client.
   // Returns false, if client disconnected.
   bool HandleIncomingMessage();
+  // Reports the patterns found in line_ and starts a new line.
+  void ProcessLine();
 
   cuttlefish::SharedFD pipe_fd_;
-  cuttlefish::SharedFD log_fd_;
+  std::unique_ptr<cuttlefish::LogSink> log_sink_;
+  std::vector<char> read_buffer_;
   std::string line_;
+  MultiPatternMatcher::State match_state_ = MultiPatternMatcher::kStartState;
+  // Position of the first match of each pattern in line_, or npos.
+  std::vector<size_t> first_match_;
+  std::vector<size_t> matched_patterns_;
   std::vector<EventCallback> subscribers_;
 
   KernelLogServer(const KernelLogServer&) = delete;
@@ -17,7 +17,9 @@
 #include <signal.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -29,6 +31,7 @@
 #include <common/libs/fs/shared_select.h>
 #include <host/libs/config/cuttlefish_config.h>
 #include <host/libs/config/logging.h>
+#include <host/libs/log_sink/log_sink_flags.h>
 #include "host/commands/kernel_log_monitor/kernel_log_server.h"
 #include "host/commands/kernel_log_monitor/utils.h"
 
@@ -94,8 +97,17 @@ int main(int argc, char** argv) {
     return 2;
   }
 
+  // The boot events are reported as soon as they are read, kernel.log must not
+  // lag behind them. Each pipe read is still a single write.
+  auto log_options = cuttlefish::LogSinkOptionsFromFlags();
+  if (!log_options.ok()) {
+    LOG(ERROR) << log_options.error().Message();
+    return 1;
+  }
+  log_options->flush_interval = std::chrono::milliseconds(0);
   monitor::KernelLogServer klog{pipe,
-                                instance.PerInstanceLogPath("kernel.log")};
+                                instance.PerInstanceLogPath("kernel.log"),
+                                std::move(*log_options)};
 
   for (auto subscriber_fd: subscriber_fds) {
     if (subscriber_fd->IsOpen()) {
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/kernel_log_monitor/multi_pattern_matcher.h"
+
+#include <deque>
+#include <limits>
+
+#include <android-base/logging.h>
+
+namespace monitor {
+namespace {
+
+constexpr MultiPatternMatcher::State kNoState =
+    std::numeric_limits<MultiPatternMatcher::State>::max();
+
+}  // namespace
+
+MultiPatternMatcher::MultiPatternMatcher(
+    const std::vector<std::string_view>& patterns) {
+  // Class 0 is every byte that appears in no pattern.
+  for (const auto& pattern : patterns) {
+    CHECK(!pattern.empty()) << "Empty patterns match everywhere";
+    for (unsigned char c : pattern) {
+      if (byte_classes_[c] == 0) {
+        byte_classes_[c] = num_classes_++;
+      }
+    }
+    pattern_sizes_.push_back(pattern.size());
+  }
+  CHECK(num_classes_ <= std::numeric_limits<uint8_t>::max() + 1);
+
+  // Build the trie, leaving missing edges unset.
+  transitions_.assign(num_classes_, kNoState);
+  matches_.emplace_back();
+  for (size_t i = 0; i < patterns.size(); i++) {
+    State state = kStartState;
+    for (unsigned char c : patterns[i]) {
+      auto& next = transitions_[state * num_classes_ + byte_classes_[c]];
+      if (next == kNoState) {
+        next = matches_.size();
+        transitions_.resize(transitions_.size() + num_classes_, kNoState);
+        matches_.emplace_back();
+      }
+      state = transitions_[state * num_classes_ + byte_classes_[c]];
+    }
+    matches_[state].push_back(i);
+  }
+
+  // Breadth first, point missing edges at the longest proper suffix's edge
+  // and inherit that suffix's matches. This turns the trie into a DFA.
+  std::vector<State> fail(matches_.size(), kStartState);
+  std::deque<State> pending;
+  for (size_t cls = 0; cls < num_classes_; cls++) {
+    auto& next = transitions_[cls];
+    if (next == kNoState) {
+      next = kStartState;
+    } else {
+      pending.push_back(next);
+    }
+  }
+  while (!pending.empty()) {
+    State state = pending.front();
+    pending.pop_front();
+    const auto& inherited = matches_[fail[state]];
+    matches_[state].insert(matches_[state].end(), inherited.begin(),
+                           inherited.end());
+    for (size_t cls = 0; cls < num_classes_; cls++) {
+      auto& next = transitions_[state * num_classes_ + cls];
+      auto fallback = transitions_[fail[state] * num_classes_ + cls];
+      if (next == kNoState) {
+        next = fallback;
+      } else {
+        fail[next] = fallback;
+        pending.push_back(next);
+      }
+    }
+  }
+}
+
+}  // namespace monitor
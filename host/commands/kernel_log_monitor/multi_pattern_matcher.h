@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <string_view>
+#include <vector>
+
+namespace monitor {
+
+// Aho-Corasick automaton that finds all occurrences of a fixed set of
+// substrings in a single pass over the input, one table lookup per byte.
+//
+// Bytes that don't appear in any pattern share a single input class, which
+// keeps the transition table small enough to stay in cache.
+class MultiPatternMatcher {
+ public:
+  using State = uint32_t;
+  static constexpr State kStartState = 0;
+
+  explicit MultiPatternMatcher(const std::vector<std::string_view>& patterns);
+
+  State Next(State state, unsigned char c) const {
+    return transitions_[state * num_classes_ + byte_classes_[c]];
+  }
+
+  // Indices of the patterns ending at the last byte consumed to reach `state`.
+  const std::vector<size_t>& Matches(State state) const {
+    return matches_[state];
+  }
+
+  size_t PatternSize(size_t pattern) const { return pattern_sizes_[pattern]; }
+  size_t NumPatterns() const { return pattern_sizes_.size(); }
+
+ private:
+  std::array<uint8_t, 256> byte_classes_{};
+  size_t num_classes_ = 1;
+  std::vector<State> transitions_;
+  std::vector<std::vector<size_t>> matches_;
+  std::vector<size_t> pattern_sizes_;
+};
+
+}  // namespace monitor
@@ -0,0 +1,121 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/kernel_log_monitor/multi_pattern_matcher.h"
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace monitor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::UnorderedElementsAre;
+
+// (pattern index, offset of the first byte of the match)
+using Match = std::pair<size_t, size_t>;
+
+// Feeds `chunks` one after the other, carrying the state across them the way
+// the kernel log server does across reads.
+std::vector<Match> FindAll(const MultiPatternMatcher& matcher,
+                           const std::vector<std::string_view>& chunks) {
+  std::vector<Match> found;
+  auto state = MultiPatternMatcher::kStartState;
+  size_t offset = 0;
+  for (auto chunk : chunks) {
+    for (unsigned char c : chunk) {
+      state = matcher.Next(state, c);
+      offset++;
+      for (auto pattern : matcher.Matches(state)) {
+        found.emplace_back(pattern, offset - matcher.PatternSize(pattern));
+      }
+    }
+  }
+  return found;
+}
+
+TEST(MultiPatternMatcherTest, FindsEveryOccurrence) {
+  MultiPatternMatcher matcher({"boot", "init"});
+  EXPECT_THAT(FindAll(matcher, {"init: boot, reboot, init"}),
+              ElementsAre(Match(1, 0), Match(0, 6), Match(0, 14),
+                          Match(1, 20)));
+}
+
+TEST(MultiPatternMatcherTest, NoMatches) {
+  MultiPatternMatcher matcher({"VIRTUAL_DEVICE_BOOT_COMPLETED"});
+  EXPECT_THAT(FindAll(matcher, {"VIRTUAL_DEVICE_BOOT_STARTED"}),
+              ElementsAre());
+}
+
+TEST(MultiPatternMatcherTest, OverlappingPatterns) {
+  MultiPatternMatcher matcher({"abab", "bab", "ba"});
+  EXPECT_THAT(FindAll(matcher, {"ababab"}),
+              UnorderedElementsAre(Match(0, 0), Match(2, 1), Match(1, 1),
+                                   Match(0, 2), Match(2, 3), Match(1, 3)));
+}
+
+TEST(MultiPatternMatcherTest, SelfOverlappingPattern) {
+  MultiPatternMatcher matcher({"aa"});
+  EXPECT_THAT(FindAll(matcher, {"aaaa"}),
+              ElementsAre(Match(0, 0), Match(0, 1), Match(0, 2)));
+}
+
+TEST(MultiPatternMatcherTest, PatternIsSuffixOfAnother) {
+  MultiPatternMatcher matcher({"BOOT_COMPLETED", "COMPLETED"});
+  // Both end at the same byte, the shorter one is inherited through the
+  // failure link of the longer one.
+  EXPECT_THAT(FindAll(matcher, {"x BOOT_COMPLETED"}),
+              UnorderedElementsAre(Match(0, 2), Match(1, 7)));
+  EXPECT_THAT(FindAll(matcher, {"x COMPLETED"}), ElementsAre(Match(1, 2)));
+}
+
+TEST(MultiPatternMatcherTest, PatternIsPrefixOfAnother) {
+  MultiPatternMatcher matcher({"DISPLAY_POWER_MODE", "DISPLAY"});
+  EXPECT_THAT(FindAll(matcher, {"DISPLAY_POWER_MODE_CHANGED"}),
+              ElementsAre(Match(1, 0), Match(0, 0)));
+}
+
+TEST(MultiPatternMatcherTest, MatchesSpanReadBoundaries) {
+  const std::string input = "xx VIRTUAL_DEVICE_BOOT_COMPLETED yy BOOT";
+  MultiPatternMatcher matcher({"VIRTUAL_DEVICE_BOOT_COMPLETED", "BOOT"});
+  auto whole = FindAll(matcher, {input});
+  ASSERT_THAT(whole, ElementsAre(Match(1, 18), Match(0, 3), Match(1, 36)));
+  // Every way of splitting the input in two or three reads finds the same.
+  std::string_view view = input;
+  for (size_t i = 0; i <= input.size(); i++) {
+    EXPECT_EQ(FindAll(matcher, {view.substr(0, i), view.substr(i)}), whole)
+        << "split at " << i;
+    for (size_t j = i; j <= input.size(); j += 7) {
+      EXPECT_EQ(FindAll(matcher, {view.substr(0, i), view.substr(i, j - i),
+                                  view.substr(j)}),
+                whole)
+          << "split at " << i << " and " << j;
+    }
+  }
+}
+
+TEST(MultiPatternMatcherTest, BytesOutsidePatternsResetTheMatch) {
+  MultiPatternMatcher matcher({"abc"});
+  EXPECT_THAT(FindAll(matcher, {"ab", "\xff", "c abc"}),
+              ElementsAre(Match(0, 5)));
+}
+
+}  // namespace
+}  // namespace monitor
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a captured boot console log through KernelLogServer and reports the
+// scanning throughput and the delay between a chunk reaching the pipe and the
+// events it contains reaching subscribers.
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <gflags/gflags.h>
+#include <json/json.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/fs/shared_select.h"
+#include "host/commands/kernel_log_monitor/kernel_log_server.h"
+
+DEFINE_string(console_log, "", "Captured boot console log to replay");
+DEFINE_int32(chunk_size, 4096, "Bytes written to the console pipe at a time");
+DEFINE_int32(iterations, 10, "Number of times to replay the log");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int ReplayBenchmarkMain(int argc, char** argv) {
+  ::android::base::InitLogging(argv, android::base::StderrLogger);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  // KernelLogServer logs every stage it sees, keep that out of the timing.
+  android::base::SetMinimumLogSeverity(android::base::WARNING);
+
+  std::string log;
+  CHECK(android::base::ReadFileToString(FLAGS_console_log, &log))
+      << "Could not read \"" << FLAGS_console_log << "\"";
+  CHECK(FLAGS_chunk_size > 0 && FLAGS_chunk_size <= 64 * 1024)
+      << "Chunks must fit in a single read of the server";
+
+  cuttlefish::SharedFD read_end;
+  cuttlefish::SharedFD write_end;
+  CHECK(cuttlefish::SharedFD::Pipe(&read_end, &write_end));
+  CHECK(write_end->Fcntl(F_SETPIPE_SZ, FLAGS_chunk_size) >= 0)
+      << write_end->StrError();
+
+  monitor::KernelLogServer server(read_end, "/dev/null");
+  Clock::time_point chunk_written;
+  std::vector<Clock::duration> latencies;
+  server.SubscribeToEvents([&](Json::Value) {
+    latencies.push_back(Clock::now() - chunk_written);
+    return monitor::SubscriptionAction::ContinueSubscription;
+  });
+
+  Clock::duration processing{};
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    for (size_t offset = 0; offset < log.size(); offset += FLAGS_chunk_size) {
+      auto size = std::min<size_t>(FLAGS_chunk_size, log.size() - offset);
+      CHECK(cuttlefish::WriteAll(write_end, log.data() + offset, size) == size)
+          << write_end->StrError();
+      chunk_written = Clock::now();
+      cuttlefish::SharedFDSet fd_read;
+      fd_read.Set(read_end);
+      server.AfterSelect(fd_read);
+      processing += Clock::now() - chunk_written;
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(processing).count();
+  double megabytes = double(log.size()) * FLAGS_iterations / (1024 * 1024);
+  std::cout << "Scanned " << megabytes << " MB in " << seconds << " s: "
+            << megabytes / seconds << " MB/s\n";
+  if (latencies.empty()) {
+    std::cout << "No events found in the log\n";
+    return 0;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto micros = [](Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  };
+  std::cout << latencies.size() << " events, latency p50 "
+            << micros(latencies[latencies.size() / 2]) << " us, p99 "
+            << micros(latencies[latencies.size() * 99 / 100]) << " us, max "
+            << micros(latencies.back()) << " us\n";
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) { return ReplayBenchmarkMain(argc, argv); }
@@ -0,0 +1,207 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/log_tee/log_line_parser.h"
+
+#include <cctype>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <android-base/strings.h>
+
+namespace cuttlefish {
+namespace {
+
+using android::base::LogSeverity;
+
+std::optional<LogSeverity> CrosvmSeverity(std::string_view level) {
+  if (level == "ERROR") {
+    return android::base::ERROR;
+  } else if (level == "WARN" || level == "WARNING") {
+    return android::base::WARNING;
+  } else if (level == "INFO") {
+    // crosvm is chatty at INFO, keep it out of the console by default.
+    return android::base::DEBUG;
+  } else if (level == "DEBUG" || level == "TRACE" || level == "VERBOSE") {
+    return android::base::VERBOSE;
+  }
+  return {};
+}
+
+std::string_view ConsumeToken(std::string_view* text, char delimiter) {
+  auto end = text->find(delimiter);
+  auto token = text->substr(0, end);
+  text->remove_prefix(end == std::string_view::npos ? text->size() : end + 1);
+  return token;
+}
+
+bool IsDigits(std::string_view text) {
+  if (text.empty()) {
+    return false;
+  }
+  for (char c : text) {
+    if (!std::isdigit(static_cast<unsigned char>(c))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// "[2023-03-14T17:21:04.123456789Z ERROR devices::virtio] message" or
+// "[ERROR:devices/src/virtio/block.rs:123] message"
+std::optional<ParsedLogLine> ParseCrosvm(std::string_view line) {
+  auto header = line;
+  if (!android::base::ConsumePrefix(&header, "[")) {
+    return {};
+  }
+  header = header.substr(0, header.find(']'));
+  auto old_style = header;
+  if (auto severity = CrosvmSeverity(ConsumeToken(&old_style, ':'))) {
+    return ParsedLogLine{*severity, {}, line};
+  }
+  auto timestamp = ConsumeToken(&header, ' ');
+  auto severity = CrosvmSeverity(ConsumeToken(&header, ' '));
+  if (!severity || timestamp.empty() ||
+      !std::isdigit(static_cast<unsigned char>(timestamp[0]))) {
+    return {};
+  }
+  return ParsedLogLine{*severity, timestamp, line};
+}
+
+// "qemu-system-x86_64: warning: message", optionally preceded by a timestamp
+// when started with "-msg timestamp=on".
+std::optional<ParsedLogLine> ParseQemu(std::string_view line) {
+  std::string_view timestamp;
+  if (!line.empty() && std::isdigit(static_cast<unsigned char>(line[0]))) {
+    auto rest = line;
+    timestamp = ConsumeToken(&rest, ' ');
+    line = rest;
+  }
+  if (!android::base::StartsWith(line, "qemu-system-")) {
+    return {};
+  }
+  auto colon = line.find(": ");
+  if (colon == std::string_view::npos) {
+    return {};
+  }
+  auto body = line.substr(colon + 2);
+  LogSeverity severity = android::base::ERROR;  // error_report has no prefix
+  if (android::base::StartsWith(body, "warning: ")) {
+    severity = android::base::WARNING;
+  } else if (android::base::StartsWith(body, "info: ")) {
+    severity = android::base::INFO;
+  }
+  return ParsedLogLine{severity, timestamp, line};
+}
+
+// "tag E 03-14 17:21:04  1234  1235 file.cpp:12] message", as written by
+// StderrOutputGenerator and android::base::StderrLogger.
+std::optional<ParsedLogLine> ParseAndroidBase(std::string_view line) {
+  static constexpr std::string_view kSeverities = "VDIWEF";
+  auto rest = line;
+  auto tag = ConsumeToken(&rest, ' ');
+  auto level = ConsumeToken(&rest, ' ');
+  if (tag.empty() || level.size() != 1 ||
+      kSeverities.find(level[0]) == std::string_view::npos) {
+    return {};
+  }
+  // "MM-DD HH:MM:SS"
+  static constexpr size_t kTimestampSize = 14;
+  if (rest.size() < kTimestampSize || rest[2] != '-' || rest[8] != ':') {
+    return {};
+  }
+  auto timestamp = rest.substr(0, kTimestampSize);
+  rest.remove_prefix(kTimestampSize);
+  // pid and tid are right aligned in 5 character columns.
+  for (int i = 0; i < 2; i++) {
+    while (!rest.empty() && rest[0] == ' ') {
+      rest.remove_prefix(1);
+    }
+    if (!IsDigits(ConsumeToken(&rest, ' '))) {
+      return {};
+    }
+  }
+  // 'F' maps to FATAL_WITHOUT_ABORT, another process failing shouldn't abort
+  // this one.
+  LogSeverity severity = static_cast<LogSeverity>(kSeverities.find(level[0]));
+  return ParsedLogLine{severity, timestamp, rest};
+}
+
+}  // namespace
+
+ParsedLogLine ParseLogLine(std::string_view line) {
+  while (!line.empty() && std::isspace(static_cast<unsigned char>(line[0]))) {
+    line.remove_prefix(1);
+  }
+  while (!line.empty() &&
+         std::isspace(static_cast<unsigned char>(line.back()))) {
+    line.remove_suffix(1);
+  }
+  for (auto parser : {ParseCrosvm, ParseQemu, ParseAndroidBase}) {
+    if (auto parsed = parser(line)) {
+      return *parsed;
+    }
+  }
+  return ParsedLogLine{android::base::DEBUG, {}, line};
+}
+
+std::string ForwardedMessage(const ParsedLogLine& parsed) {
+  const auto& [severity, timestamp, message] = parsed;
+  bool in_message = timestamp.data() >= message.data() &&
+                    timestamp.data() < message.data() + message.size();
+  if (timestamp.empty() || in_message) {
+    return std::string(message);
+  }
+  std::string forwarded;
+  forwarded.reserve(timestamp.size() + message.size() + 3);
+  forwarded.append("[").append(timestamp).append("] ").append(message);
+  return forwarded;
+}
+
+const std::vector<std::string_view>& LineFramer::Append(std::string_view data) {
+  buffer_.erase(0, consumed_);
+  consumed_ = 0;
+  lines_.clear();
+  buffer_.append(data);
+  while (true) {
+    auto newline = buffer_.find('\n', consumed_);
+    if (newline == std::string::npos) {
+      if (buffer_.size() - consumed_ < kMaxLineLength) {
+        break;
+      }
+      lines_.push_back(
+          std::string_view(buffer_).substr(consumed_, kMaxLineLength));
+      consumed_ += kMaxLineLength;
+      continue;
+    }
+    lines_.push_back(
+        std::string_view(buffer_).substr(consumed_, newline - consumed_));
+    consumed_ = newline + 1;
+  }
+  return lines_;
+}
+
+const std::vector<std::string_view>& LineFramer::Flush() {
+  buffer_.erase(0, consumed_);
+  consumed_ = buffer_.size();
+  lines_.clear();
+  if (!buffer_.empty()) {
+    lines_.push_back(buffer_);
+  }
+  return lines_;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,65 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <android-base/logging.h>
+
+namespace cuttlefish {
+
+struct ParsedLogLine {
+  android::base::LogSeverity severity;
+  // Timestamp written by the source, empty if it didn't write one.
+  std::string_view timestamp;
+  // What to log. Headers that the launcher log would repeat are removed.
+  std::string_view message;
+};
+
+// Understands the headers written by crosvm ("[<timestamp> ERROR target] ..."
+// and the older "[ERROR:file.rs:12] ..."), QEMU ("[<timestamp> ]qemu-system-x:
+// warning: ...") and android::base loggers ("tag E 03-14 17:21:04 pid tid
+// file:line] ..."). Anything else is reported as DEBUG.
+ParsedLogLine ParseLogLine(std::string_view line);
+
+// The text to forward for `parsed`. The launcher log stamps lines with the time
+// they are forwarded at, so the source's own timestamp is put back in front of
+// the message when it was removed along with the header.
+std::string ForwardedMessage(const ParsedLogLine& parsed);
+
+// Splits a byte stream into lines, regardless of how reads line up with them.
+class LineFramer {
+ public:
+  // Lines longer than this are cut, so a source that never writes a newline
+  // can't grow the buffer forever.
+  static constexpr size_t kMaxLineLength = 64 * 1024;
+
+  // Returns the lines completed by `data`, without their newlines. They stay
+  // valid until the next call to Append or Flush.
+  const std::vector<std::string_view>& Append(std::string_view data);
+  // Returns the last, partial line if there is one.
+  const std::vector<std::string_view>& Flush();
+
+ private:
+  std::string buffer_;
+  // Bytes at the start of buffer_ already returned as lines.
+  size_t consumed_ = 0;
+  std::vector<std::string_view> lines_;
+};
+
+}  // namespace cuttlefish
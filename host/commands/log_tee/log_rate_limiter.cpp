@@ -0,0 +1,65 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/log_tee/log_rate_limiter.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace cuttlefish {
+
+LogRateLimiter::LogRateLimiter(double lines_per_second, double burst)
+    : lines_per_second_(lines_per_second),
+      burst_(std::max(burst, 1.0)),
+      tokens_(burst_),
+      last_refill_(Clock::now()) {}
+
+bool LogRateLimiter::Admit(android::base::LogSeverity severity,
+                           Clock::time_point now) {
+  if (lines_per_second_ <= 0) {
+    return true;
+  }
+  std::chrono::duration<double> elapsed = now - last_refill_;
+  if (elapsed.count() > 0) {
+    tokens_ = std::min(burst_, tokens_ + elapsed.count() * lines_per_second_);
+    last_refill_ = now;
+  }
+  if (tokens_ >= 1) {
+    tokens_ -= 1;
+    return true;
+  }
+  if (severity >= android::base::WARNING) {
+    return true;
+  }
+  suppressed_++;
+  worst_suppressed_ = std::max(worst_suppressed_, severity);
+  return false;
+}
+
+std::optional<std::string> LogRateLimiter::TakeSuppressedSummary() {
+  if (suppressed_ == 0) {
+    return {};
+  }
+  static constexpr const char* kSeverityNames[] = {
+      "VERBOSE", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL", "FATAL"};
+  std::stringstream summary;
+  summary << suppressed_ << " lines suppressed by rate limiting, up to "
+          << kSeverityNames[worst_suppressed_] << " severity";
+  suppressed_ = 0;
+  worst_suppressed_ = android::base::VERBOSE;
+  return summary.str();
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,53 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#include <android-base/logging.h>
+
+namespace cuttlefish {
+
+// Token bucket admitting `lines_per_second` lines on average, in bursts of up
+// to `burst` lines. Lines turned away are counted so they can be summarized.
+// A rate of zero or less admits everything. Warnings and errors are always
+// admitted, a flood of debug output must not hide them; they still use up
+// tokens when there are any.
+class LogRateLimiter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  LogRateLimiter(double lines_per_second, double burst);
+
+  bool Admit(android::base::LogSeverity severity, Clock::time_point now);
+
+  // Describes the lines turned away since the last call, if any were.
+  std::optional<std::string> TakeSuppressedSummary();
+  bool HasSuppressed() const { return suppressed_ > 0; }
+
+ private:
+  double lines_per_second_;
+  double burst_;
+  double tokens_;
+  Clock::time_point last_refill_;
+  size_t suppressed_ = 0;
+  android::base::LogSeverity worst_suppressed_ = android::base::VERBOSE;
+};
+
+}  // namespace cuttlefish
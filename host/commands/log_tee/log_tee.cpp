@@ -16,16 +16,52 @@
 #include <signal.h>
 #include <sys/signalfd.h>
 
+#include <string_view>
+
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 #include <gflags/gflags.h>
 
 #include "common/libs/fs/shared_fd.h"
 #include "common/libs/utils/tee_logging.h"
+#include "host/commands/log_tee/log_line_parser.h"
+#include "host/commands/log_tee/log_rate_limiter.h"
 #include "host/libs/config/cuttlefish_config.h"
 
 DEFINE_string(process_name, "", "The process to credit log messages to");
 DEFINE_int32(log_fd_in, -1, "The file descriptor to read logs from.");
+DEFINE_double(max_lines_per_second, 200,
+              "Average number of lines per second forwarded from the process. "
+              "Excess lines below WARNING are dropped and summarized. 0 "
+              "disables the limit.");
+DEFINE_double(max_lines_burst, 2000,
+              "Number of lines the process may write in a burst before the "
+              "rate limit applies.");
+
+namespace {
+
+constexpr int kSummaryIntervalMs = 1000;
+
+void ReportSuppressed(cuttlefish::LogRateLimiter& limiter) {
+  if (auto summary = limiter.TakeSuppressedSummary()) {
+    LOG(WARNING) << *summary;
+  }
+}
+
+void ForwardLine(std::string_view line, cuttlefish::LogRateLimiter& limiter) {
+  auto parsed = cuttlefish::ParseLogLine(line);
+  if (parsed.message.empty()) {
+    return;
+  }
+  if (!limiter.Admit(parsed.severity,
+                     cuttlefish::LogRateLimiter::Clock::now())) {
+    return;
+  }
+  ReportSuppressed(limiter);
+  LOG(parsed.severity) << cuttlefish::ForwardedMessage(parsed);
+}
+
+}  // namespace
 
 int main(int argc, char** argv) {
   ::android::base::InitLogging(argv, android::base::StderrLogger);
@@ -81,6 +117,9 @@ int main(int argc, char** argv) {
 
   LOG(DEBUG) << "Starting to read from process " << FLAGS_process_name;
 
+  cuttlefish::LineFramer framer;
+  cuttlefish::LogRateLimiter limiter(FLAGS_max_lines_per_second,
+                                     FLAGS_max_lines_burst);
   char buf[1 << 16];
   ssize_t chars_read = 0;
   for (;;) {
@@ -92,8 +131,16 @@ int main(int argc, char** argv) {
     // This could be simpler if all the writers would close their FDs when they
     // are finished. Then, we could just read until EOF. However that would
     // require more work elsewhere in cuttlefish.
-    CHECK(cuttlefish::SharedFD::Poll(poll_fds, /*timeout=*/-1) >= 0)
-        << "poll failed: " << strerror(errno);
+    //
+    // Wake up periodically while lines are being dropped, so the summary
+    // shows up even if the process goes quiet.
+    int timeout = limiter.HasSuppressed() ? kSummaryIntervalMs : -1;
+    int poll_ret = cuttlefish::SharedFD::Poll(poll_fds, timeout);
+    CHECK(poll_ret >= 0) << "poll failed: " << strerror(errno);
+    if (poll_ret == 0) {
+      ReportSuppressed(limiter);
+      continue;
+    }
     if (poll_fds[0].revents) {
       chars_read = log_fd->Read(buf, sizeof(buf));
       if (chars_read < 0) {
@@ -104,25 +151,8 @@ int main(int argc, char** argv) {
       if (chars_read == 0) {
         break;
       }
-      auto trimmed = android::base::Trim(std::string_view(buf, chars_read));
-      // Newlines inside `trimmed` are handled by the android logging code.
-      // These checks attempt to determine the log severity coming from crosvm.
-      // There is no guarantee of success all the time since log line boundaries
-      // could be out sync with the reads, but that's ok.
-      //
-      // TODO(b/270424669): These checks are wrong, the format is
-      // "[<timestamp> ERROR". Maybe just stop bothering and send
-      // everything to LOG(DEBUG).
-      if (android::base::StartsWith(trimmed, "[INFO")) {
-        LOG(DEBUG) << trimmed;
-      } else if (android::base::StartsWith(trimmed, "[ERROR")) {
-        LOG(ERROR) << trimmed;
-      } else if (android::base::StartsWith(trimmed, "[WARNING")) {
-        LOG(WARNING) << trimmed;
-      } else if (android::base::StartsWith(trimmed, "[VERBOSE")) {
-        LOG(VERBOSE) << trimmed;
-      } else {
-        LOG(DEBUG) << trimmed;
+      for (auto line : framer.Append(std::string_view(buf, chars_read))) {
+        ForwardLine(line, limiter);
       }
 
       // Go back to polling immediately to see if there is more data, don't
@@ -140,5 +170,10 @@ int main(int argc, char** argv) {
     }
   }
 
+  for (auto line : framer.Flush()) {
+    ForwardLine(line, limiter);
+  }
+  ReportSuppressed(limiter);
+
   LOG(DEBUG) << "Finished reading from process " << FLAGS_process_name;
 }
@@ -0,0 +1,142 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "host/commands/log_tee/log_line_parser.h"
+#include "host/commands/log_tee/log_rate_limiter.h"
+
+namespace cuttlefish {
+
+TEST(LogTee, ParsesCrosvmLines) {
+  auto parsed = ParseLogLine(
+      "[2023-03-14T17:21:04.123456789+00:00 ERROR devices::virtio] oops\n");
+  EXPECT_EQ(parsed.severity, android::base::ERROR);
+  EXPECT_EQ(parsed.timestamp, "2023-03-14T17:21:04.123456789+00:00");
+  EXPECT_EQ(parsed.message,
+            "[2023-03-14T17:21:04.123456789+00:00 ERROR devices::virtio] oops");
+
+  EXPECT_EQ(ParseLogLine("[2023-03-14T17:21:04Z WARN crosvm] hm").severity,
+            android::base::WARNING);
+  EXPECT_EQ(ParseLogLine("[INFO:src/main.rs:12] hi").severity,
+            android::base::DEBUG);
+}
+
+TEST(LogTee, ParsesQemuLines) {
+  auto parsed = ParseLogLine("qemu-system-x86_64: warning: host lacks kvm");
+  EXPECT_EQ(parsed.severity, android::base::WARNING);
+  EXPECT_EQ(parsed.timestamp, "");
+
+  parsed = ParseLogLine(
+      "2023-03-14T17:21:04.123456Z qemu-system-aarch64: bad option");
+  EXPECT_EQ(parsed.severity, android::base::ERROR);
+  EXPECT_EQ(parsed.timestamp, "2023-03-14T17:21:04.123456Z");
+}
+
+TEST(LogTee, ParsesAndroidBaseLines) {
+  auto parsed = ParseLogLine(
+      "rootcanal W 03-14 17:21:04  1234  1235 model.cc:42] slow link");
+  EXPECT_EQ(parsed.severity, android::base::WARNING);
+  EXPECT_EQ(parsed.timestamp, "03-14 17:21:04");
+  EXPECT_EQ(parsed.message, "model.cc:42] slow link");
+
+  EXPECT_EQ(ParseLogLine("netsim F 03-14 17:21:04 1 2 x.cc:1] dead").severity,
+            android::base::FATAL_WITHOUT_ABORT);
+}
+
+TEST(LogTee, KeepsSourceTimestamps) {
+  // Still part of the message.
+  EXPECT_EQ(ForwardedMessage(ParseLogLine("[2023-03-14T17:21:04Z WARN x] hm")),
+            "[2023-03-14T17:21:04Z WARN x] hm");
+  // Removed along with the header.
+  EXPECT_EQ(ForwardedMessage(ParseLogLine(
+                "rootcanal W 03-14 17:21:04  1234  1235 model.cc:42] slow")),
+            "[03-14 17:21:04] model.cc:42] slow");
+  EXPECT_EQ(ForwardedMessage(ParseLogLine(
+                "2023-03-14T17:21:04.123456Z qemu-system-aarch64: bad option")),
+            "[2023-03-14T17:21:04.123456Z] qemu-system-aarch64: bad option");
+  EXPECT_EQ(ForwardedMessage(ParseLogLine("no timestamp")), "no timestamp");
+}
+
+TEST(LogTee, UnknownLinesAreDebug) {
+  auto parsed = ParseLogLine("  just some text  ");
+  EXPECT_EQ(parsed.severity, android::base::DEBUG);
+  EXPECT_EQ(parsed.message, "just some text");
+}
+
+TEST(LogTee, FramesLinesAcrossReads) {
+  LineFramer framer;
+  EXPECT_TRUE(framer.Append("first li").empty());
+  auto lines = framer.Append("ne\nsecond\nthi");
+  ASSERT_EQ(lines.size(), 2);
+  EXPECT_EQ(lines[0], "first line");
+  EXPECT_EQ(lines[1], "second");
+  lines = framer.Flush();
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(lines[0], "thi");
+}
+
+TEST(LogTee, CutsOverlongLines) {
+  LineFramer framer;
+  auto lines = framer.Append(std::string(LineFramer::kMaxLineLength + 1, 'a'));
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(lines[0].size(), LineFramer::kMaxLineLength);
+}
+
+TEST(LogTee, RateLimiterSummarizesDroppedLines) {
+  LogRateLimiter limiter(/* lines_per_second */ 1, /* burst */ 2);
+  auto now = LogRateLimiter::Clock::now() + std::chrono::hours(1);
+  EXPECT_TRUE(limiter.Admit(android::base::INFO, now));
+  EXPECT_TRUE(limiter.Admit(android::base::INFO, now));
+  EXPECT_FALSE(limiter.Admit(android::base::DEBUG, now));
+  EXPECT_FALSE(limiter.Admit(android::base::INFO, now));
+  EXPECT_TRUE(limiter.HasSuppressed());
+
+  auto summary = limiter.TakeSuppressedSummary();
+  ASSERT_TRUE(summary);
+  EXPECT_EQ(*summary,
+            "2 lines suppressed by rate limiting, up to INFO severity");
+  EXPECT_FALSE(limiter.TakeSuppressedSummary());
+
+  EXPECT_TRUE(limiter.Admit(android::base::INFO, now + std::chrono::seconds(1)));
+}
+
+TEST(LogTee, RateLimiterAlwaysAdmitsWarnings) {
+  LogRateLimiter limiter(/* lines_per_second */ 1, /* burst */ 1);
+  auto now = LogRateLimiter::Clock::now() + std::chrono::hours(1);
+  EXPECT_TRUE(limiter.Admit(android::base::DEBUG, now));
+  EXPECT_FALSE(limiter.Admit(android::base::DEBUG, now));
+  EXPECT_TRUE(limiter.Admit(android::base::WARNING, now));
+  EXPECT_TRUE(limiter.Admit(android::base::ERROR, now));
+  EXPECT_FALSE(limiter.Admit(android::base::INFO, now));
+
+  auto summary = limiter.TakeSuppressedSummary();
+  ASSERT_TRUE(summary);
+  EXPECT_EQ(*summary,
+            "2 lines suppressed by rate limiting, up to INFO severity");
+}
+
+TEST(LogTee, ZeroRateDisablesLimit) {
+  LogRateLimiter limiter(0, 0);
+  auto now = LogRateLimiter::Clock::now();
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(limiter.Admit(android::base::INFO, now));
+  }
+}
+
+}  // namespace cuttlefish
@@ -16,6 +16,8 @@
 
 #include <signal.h>
 
+#include <vector>
+
 #include <gflags/gflags.h>
 #include <android-base/logging.h>
 
@@ -23,6 +25,8 @@
 #include "common/libs/fs/shared_fd.h"
 #include "host/libs/config/cuttlefish_config.h"
 #include "host/libs/config/logging.h"
+#include "host/libs/log_sink/log_sink.h"
+#include "host/libs/log_sink/log_sink_flags.h"
 
 DEFINE_int32(log_pipe_fd, -1,
              "A file descriptor representing a (UNIX) socket from which to "
@@ -59,25 +63,27 @@ int main(int argc, char** argv) {
     return 2;
   }
 
+  auto log_options = cuttlefish::LogSinkOptionsFromFlags();
+  CHECK(log_options.ok()) << log_options.error().Message();
   auto path = instance.logcat_path();
-  auto logcat_file =
-      cuttlefish::SharedFD::Open(path.c_str(), O_CREAT | O_APPEND | O_WRONLY, 0666);
+  auto logcat_sink = cuttlefish::LogSink::Create(path, *log_options);
+  CHECK(logcat_sink.ok()) << logcat_sink.error().Message();
 
   // Server loop
+  std::vector<char> buff(64 * 1024);
   while (true) {
-    char buff[1024];
-    auto read = pipe->Read(buff, sizeof(buff));
+    auto read = pipe->Read(buff.data(), buff.size());
     if (read < 0) {
       LOG(ERROR) << "Could not read logcat: " << pipe->StrError();
       break;
     }
-    auto written = cuttlefish::WriteAll(logcat_file, buff, read);
-    CHECK(written == read)
-        << "Error writing to log file: " << logcat_file->StrError()
-        << ". This is unrecoverable.";
+    auto written = (*logcat_sink)->Write(buff.data(), read);
+    CHECK(written.ok()) << "Error writing to log file: "
+                        << written.error().Message()
+                        << ". This is unrecoverable.";
   }
 
-  logcat_file->Close();
+  logcat_sink->reset();
   pipe->Close();
   return 0;
 }
@@ -17,7 +17,9 @@
 #include <android-base/strings.h>
 #include <fruit/fruit.h>
 #include <gflags/gflags.h>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "common/libs/utils/flag_parser.h"
 #include "common/libs/utils/tee_logging.h"
@@ -83,69 +85,45 @@ void buildCFMetricsEvent(uint64_t now_ms,
   metrics_timestamp->set_nanos(now_ns);
 }
 
-std::unique_ptr<LogRequest> buildLogRequest(
-    uint64_t now_ms, cuttlefish::CuttlefishLogEvent* cfEvent) {
-  // "log_request" is the top level LogRequest
-  auto log_request = std::make_unique<LogRequest>();
-  log_request->set_request_time_ms(now_ms);
-  log_request->set_log_source(kLogSourceId);
-  log_request->set_log_source_name(kLogSourceStr);
-  ClientInfo* client_info = log_request->mutable_client_info();
-  client_info->set_client_type(kCppClientType);
+std::optional<LogEvent> Clearcut::BuildEvent(
+    cuttlefish::CuttlefishLogEvent::DeviceType device_type,
+    cuttlefish::MetricsEvent::EventType event_type) {
+  uint64_t now_ms = metrics::epochTimeMs();
+
+  auto cfEvent = buildCFLogEvent(now_ms, device_type);
+  buildCFMetricsEvent(now_ms, cfEvent.get(), event_type);
 
   // "cfLogStr" is CuttlefishLogEvent serialized
   std::string cfLogStr;
   if (!cfEvent->SerializeToString(&cfLogStr)) {
     LOG(ERROR) << "SerializeToString failed for event";
-    return nullptr;
+    return std::nullopt;
   }
-  LogEvent* logEvent = log_request->add_log_event();
-  logEvent->set_event_time_ms(now_ms);
-  logEvent->set_source_extension(cfLogStr);
-  return log_request;
+  LogEvent logEvent;
+  logEvent.set_event_time_ms(now_ms);
+  logEvent.set_source_extension(cfLogStr);
+  return logEvent;
 }
 
-int Clearcut::SendEvent(cuttlefish::CuttlefishLogEvent::DeviceType device_type,
-                        cuttlefish::MetricsEvent::EventType event_type) {
-  uint64_t now_ms = metrics::epochTimeMs();
-
-  auto cfEvent = buildCFLogEvent(now_ms, device_type);
-  buildCFMetricsEvent(now_ms, cfEvent.get(), event_type);
-  auto logRequest = buildLogRequest(now_ms, cfEvent.get());
-  if (!logRequest) {
-    LOG(ERROR) << "failed to build LogRequest";
-    return kMetricsError;
+std::optional<std::string> Clearcut::BuildRequest(
+    const std::vector<LogEvent>& events) {
+  // "log_request" is the top level LogRequest
+  LogRequest log_request;
+  log_request.set_request_time_ms(metrics::epochTimeMs());
+  log_request.set_log_source(kLogSourceId);
+  log_request.set_log_source_name(kLogSourceStr);
+  ClientInfo* client_info = log_request.mutable_client_info();
+  client_info->set_client_type(kCppClientType);
+  for (const auto& event : events) {
+    *log_request.add_log_event() = event;
   }
 
   std::string logRequestStr;
-  if (!logRequest->SerializeToString(&logRequestStr)) {
+  if (!log_request.SerializeToString(&logRequestStr)) {
     LOG(ERROR) << "SerializeToString failed for log_request";
-    return kMetricsError;
+    return std::nullopt;
   }
-  return metrics::postReq(logRequestStr, metrics::kProd);
-}
-
-int Clearcut::SendVMStart(cuttlefish::CuttlefishLogEvent::DeviceType device) {
-  return SendEvent(
-      device, cuttlefish::MetricsEvent::CUTTLEFISH_EVENT_TYPE_VM_INSTANTIATION);
-}
-
-int Clearcut::SendVMStop(cuttlefish::CuttlefishLogEvent::DeviceType device) {
-  return SendEvent(device,
-                   cuttlefish::MetricsEvent::CUTTLEFISH_EVENT_TYPE_VM_STOP);
-}
-
-int Clearcut::SendDeviceBoot(
-    cuttlefish::CuttlefishLogEvent::DeviceType device) {
-  return SendEvent(device,
-                   cuttlefish::MetricsEvent::CUTTLEFISH_EVENT_TYPE_DEVICE_BOOT);
-}
-
-int Clearcut::SendLockScreen(
-    cuttlefish::CuttlefishLogEvent::DeviceType device) {
-  return SendEvent(
-      device,
-      cuttlefish::MetricsEvent::CUTTLEFISH_EVENT_TYPE_LOCK_SCREEN_AVAILABLE);
+  return logRequestStr;
 }
 
 }  // namespace cuttlefish
@@ -15,25 +15,25 @@
  */
 #pragma once
 
+#include <optional>
+#include <string>
+#include <vector>
+
 #include "host/commands/metrics/proto/cf_metrics_proto.h"
 
 namespace cuttlefish {
 
 class Clearcut {
- private:
-  static int SendEvent(cuttlefish::CuttlefishLogEvent::DeviceType device_type,
-                       cuttlefish::MetricsEvent::EventType event_type);
-
  public:
   Clearcut();
   ~Clearcut();
-  static int SendVMStart(
-      cuttlefish::CuttlefishLogEvent::DeviceType device_type);
-  static int SendVMStop(cuttlefish::CuttlefishLogEvent::DeviceType device_type);
-  static int SendDeviceBoot(
-      cuttlefish::CuttlefishLogEvent::DeviceType device_type);
-  static int SendLockScreen(
-      cuttlefish::CuttlefishLogEvent::DeviceType device_type);
+  // Builds the LogEvent of one metrics event happening now.
+  static std::optional<LogEvent> BuildEvent(
+      cuttlefish::CuttlefishLogEvent::DeviceType device_type,
+      cuttlefish::MetricsEvent::EventType event_type);
+  // Serializes a single LogRequest that carries all the events.
+  static std::optional<std::string> BuildRequest(
+      const std::vector<LogEvent>& events);
 };
 
 }  // namespace cuttlefish
@@ -64,19 +64,33 @@ void MetricsHostReceiver::ServerLoop() {
     std::string text(msg.mesg_text);
     LOG(INFO) << "Metrics host received: " << text;
     auto hostDev = cuttlefish::CuttlefishLogEvent::CUTTLEFISH_DEVICE_TYPE_HOST;
+    cuttlefish::MetricsEvent::EventType event_type;
     if (text == "VMStart") {
-      rc = Clearcut::SendVMStart(hostDev);
+      event_type =
+          cuttlefish::MetricsEvent::CUTTLEFISH_EVENT_TYPE_VM_INSTANTIATION;
     } else if (text == "VMStop") {
-      rc = Clearcut::SendVMStop(hostDev);
+      event_type = cuttlefish::MetricsEvent::CUTTLEFISH_EVENT_TYPE_VM_STOP;
     } else if (text == "DeviceBoot") {
-      rc = Clearcut::SendDeviceBoot(hostDev);
+      event_type = cuttlefish::MetricsEvent::CUTTLEFISH_EVENT_TYPE_DEVICE_BOOT;
     } else if (text == "LockScreen") {
-      rc = Clearcut::SendLockScreen(hostDev);
+      event_type = cuttlefish::MetricsEvent::
+          CUTTLEFISH_EVENT_TYPE_LOCK_SCREEN_AVAILABLE;
+    } else {
+      LOG(ERROR) << "Unknown metrics message: " << text;
+      continue;
     }
-    if (rc != MetricsExitCodes::kSuccess) {
-      LOG(ERROR) << "Message failed to send to ClearCut: " << text;
+    // Spooled and sent later in a batch, so the queue is drained as fast as
+    // messages arrive.
+    auto event = Clearcut::BuildEvent(hostDev, event_type);
+    if (!event) {
+      LOG(ERROR) << "Failed to build metrics event: " << text;
+      continue;
+    }
+    auto enqueued = uploader_->Enqueue(*event);
+    if (!enqueued.ok()) {
+      LOG(ERROR) << "Failed to spool metrics event " << text << ": "
+                 << enqueued.error().Message();
     }
-    sleep(1);
   }
 }
 
@@ -87,6 +101,15 @@ bool MetricsHostReceiver::Initialize() {
     LOG(ERROR) << "init: metrics not enabled";
     return false;
   }
+  uploader_ = std::make_unique<MetricsUploader>(
+      config_.ForDefaultInstance().PerInstanceInternalPath("metrics_spool"),
+      metrics::kProd);
+  auto started = uploader_->Start();
+  if (!started.ok()) {
+    LOG(ERROR) << "init: failed to start the metrics uploader: "
+               << started.error().Message();
+    return false;
+  }
   thread_ = std::thread(&MetricsHostReceiver::ServerLoop, this);
   return true;
 }
@@ -15,7 +15,9 @@
  */
 #pragma once
 
+#include <memory>
 #include <thread>
+#include "host/commands/metrics/uploader.h"
 #include "host/libs/config/cuttlefish_config.h"
 
 namespace cuttlefish {
@@ -23,6 +25,7 @@ namespace cuttlefish {
 class MetricsHostReceiver {
  private:
   const CuttlefishConfig& config_;
+  std::unique_ptr<MetricsUploader> uploader_;
   std::thread thread_;
   void ServerLoop();
 
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "host/commands/metrics/uploader.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <utility>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/files.h"
+#include "host/commands/metrics/events.h"
+#include "host/commands/metrics/metrics_defs.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr std::chrono::milliseconds kMinRetryDelay(5000);
+constexpr std::chrono::milliseconds kMaxRetryDelay(300000);
+// Bounds the disk used while Clearcut is unreachable.
+constexpr size_t kMaxSpooledEvents = 1000;
+constexpr size_t kMaxEventsPerRequest = 100;
+static_assert(kMaxSpooledEvents > kMaxEventsPerRequest);
+constexpr char kEventSuffix[] = ".event";
+
+}  // namespace
+
+MetricsUploader::MetricsUploader(std::string spool_dir,
+                                 metrics::ClearcutServer server,
+                                 std::chrono::milliseconds batch_interval)
+    : spool_dir_(std::move(spool_dir)),
+      server_(server),
+      batch_interval_(batch_interval),
+      retry_delay_(kMinRetryDelay) {}
+
+MetricsUploader::~MetricsUploader() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+  }
+  cv_.notify_one();
+  upload_thread_.join();
+}
+
+Result<void> MetricsUploader::Start() {
+  CF_EXPECT(EnsureDirectoryExists(spool_dir_));
+  auto entries = CF_EXPECT(DirectoryContents(spool_dir_));
+  // The names sort in the order the events were spooled.
+  std::sort(entries.begin(), entries.end());
+  std::lock_guard<std::mutex> lock(mtx_);
+  for (const auto& entry : entries) {
+    if (android::base::EndsWith(entry, kEventSuffix)) {
+      spooled_.emplace_back(spool_dir_ + "/" + entry);
+    } else if (android::base::EndsWith(entry, ".tmp")) {
+      // Left behind when the process died in the middle of a write.
+      RemoveFile(spool_dir_ + "/" + entry);
+    }
+  }
+  if (!spooled_.empty()) {
+    LOG(INFO) << "Found " << spooled_.size() << " metrics events to upload";
+  }
+  while (spooled_.size() > kMaxSpooledEvents) {
+    DropOldestEvent();
+  }
+  running_ = true;
+  upload_thread_ = std::thread(&MetricsUploader::UploadLoop, this);
+  return {};
+}
+
+Result<void> MetricsUploader::Enqueue(const LogEvent& event) {
+  std::string serialized;
+  CF_EXPECT(event.SerializeToString(&serialized),
+            "Failed to serialize the metrics event");
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  std::stringstream name;
+  name << spool_dir_ << "/" << std::setfill('0') << std::setw(13)
+       << metrics::epochTimeMs() << "_" << std::setw(6) << event_sequence_++;
+  auto path = name.str() + kEventSuffix;
+  auto tmp_path = path + ".tmp";
+  auto fd = SharedFD::Open(tmp_path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  CF_EXPECT(fd->IsOpen(),
+            "Failed to open \"" << tmp_path << "\": " << fd->StrError());
+  CF_EXPECT(WriteAll(fd, serialized) == (ssize_t)serialized.size(),
+            "Failed to write \"" << tmp_path << "\": " << fd->StrError());
+  fd->Close();
+  CF_EXPECT(RenameFile(tmp_path, path));
+
+  counters_.events_queued++;
+  if (spooled_.empty()) {
+    // Gives the events that follow a chance to join the batch.
+    next_upload_ = std::max(next_upload_, Clock::now() + batch_interval_);
+  }
+  spooled_.emplace_back(std::move(path));
+  while (spooled_.size() > kMaxSpooledEvents) {
+    DropOldestEvent();
+  }
+  cv_.notify_one();
+  return {};
+}
+
+MetricsUploader::Counters MetricsUploader::GetCounters() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto counters = counters_;
+  counters.events_spooled = spooled_.size();
+  return counters;
+}
+
+void MetricsUploader::UploadLoop() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (running_) {
+    if (spooled_.empty()) {
+      cv_.wait(lock, [this]() { return !running_ || !spooled_.empty(); });
+      continue;
+    }
+    if (cv_.wait_until(lock, next_upload_, [this]() { return !running_; })) {
+      break;
+    }
+    std::vector<std::string> batch(
+        spooled_.begin(),
+        spooled_.begin() + std::min(spooled_.size(), kMaxEventsPerRequest));
+    uploading_ = batch.size();
+    // Enqueue must not wait for the network.
+    lock.unlock();
+    auto uploaded = UploadEvents(batch);
+    lock.lock();
+    uploading_ = 0;
+    if (uploaded.ok()) {
+      spooled_.erase(spooled_.begin(), spooled_.begin() + batch.size());
+      counters_.events_uploaded += *uploaded;
+      counters_.events_dropped += batch.size() - *uploaded;
+      retry_delay_ = kMinRetryDelay;
+      next_upload_ = Clock::now();
+    } else {
+      counters_.upload_failures++;
+      auto delay = NextRetryDelay();
+      LOG(WARNING) << "Failed to upload metrics, retrying in "
+                   << delay.count() << "ms: " << uploaded.error().Message();
+      next_upload_ = Clock::now() + delay;
+    }
+    LOG(INFO) << "Metrics uploader: queued " << counters_.events_queued
+              << ", uploaded " << counters_.events_uploaded << ", dropped "
+              << counters_.events_dropped << ", failures "
+              << counters_.upload_failures << ", spooled " << spooled_.size();
+  }
+}
+
+// Returns how many of the events could be read and were posted, the files
+// of all of them are removed.
+Result<size_t> MetricsUploader::UploadEvents(
+    const std::vector<std::string>& paths) {
+  std::vector<LogEvent> events;
+  for (const auto& path : paths) {
+    auto serialized = ReadFile(path);
+    LogEvent event;
+    if (serialized.empty() || !event.ParseFromString(serialized)) {
+      LOG(ERROR) << "Discarding unreadable metrics event \"" << path << "\"";
+      continue;
+    }
+    events.emplace_back(std::move(event));
+  }
+  if (!events.empty()) {
+    auto request = Clearcut::BuildRequest(events);
+    CF_EXPECT(request.has_value(), "Failed to build the log request");
+    CF_EXPECT(metrics::postReq(*request, server_) == kSuccess,
+              "Failed to post the request");
+  }
+  for (const auto& path : paths) {
+    RemoveFile(path);
+  }
+  return events.size();
+}
+
+// Called with mtx_ held. Skips the events being uploaded, the limit is far
+// above the size of a batch.
+void MetricsUploader::DropOldestEvent() {
+  auto oldest = spooled_.begin() + uploading_;
+  LOG(WARNING) << "Too many metrics events waiting, dropping \"" << *oldest
+               << "\"";
+  RemoveFile(*oldest);
+  spooled_.erase(oldest);
+  counters_.events_dropped++;
+}
+
+// Somewhere between half and all of the delay, which doubles every time.
+std::chrono::milliseconds MetricsUploader::NextRetryDelay() {
+  static std::default_random_engine random{std::random_device{}()};
+  std::uniform_int_distribution<int64_t> jitter(retry_delay_.count() / 2,
+                                                retry_delay_.count());
+  auto delay = std::chrono::milliseconds(jitter(random));
+  retry_delay_ = std::min(retry_delay_ * 2, kMaxRetryDelay);
+  return delay;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/libs/utils/result.h"
+#include "host/commands/metrics/proto/cf_metrics_proto.h"
+#include "host/commands/metrics/utils.h"
+
+namespace cuttlefish {
+
+/*
+ * Uploads metrics events to Clearcut from a thread of its own, batching the
+ * events that arrive close together into one request.
+ *
+ * Each event is written to the spool directory when it is enqueued and
+ * removed after its upload succeeds, so it survives failed uploads, which
+ * are retried with a growing delay, and the process stopping at any time.
+ * When the backlog grows past its limit the oldest events are dropped.
+ */
+class MetricsUploader {
+ public:
+  // How long the first event of a batch waits for others to join it.
+  static constexpr std::chrono::milliseconds kBatchInterval{10000};
+
+  struct Counters {
+    uint64_t events_queued = 0;
+    uint64_t events_uploaded = 0;
+    // Because the backlog grew too long or the event couldn't be read back.
+    uint64_t events_dropped = 0;
+    uint64_t upload_failures = 0;
+    // Events currently waiting in the spool directory.
+    uint64_t events_spooled = 0;
+  };
+
+  MetricsUploader(std::string spool_dir, metrics::ClearcutServer server,
+                  std::chrono::milliseconds batch_interval = kBatchInterval);
+  ~MetricsUploader();
+
+  // Picks up the events spooled by earlier runs and starts uploading.
+  Result<void> Start();
+  // Returns once the event is in the spool directory.
+  Result<void> Enqueue(const LogEvent& event);
+  Counters GetCounters();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void UploadLoop();
+  Result<size_t> UploadEvents(const std::vector<std::string>& paths);
+  void DropOldestEvent();
+  std::chrono::milliseconds NextRetryDelay();
+
+  const std::string spool_dir_;
+  const metrics::ClearcutServer server_;
+  const std::chrono::milliseconds batch_interval_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool running_ = false;
+  Counters counters_;
+  // Spooled event files, oldest first.
+  std::deque<std::string> spooled_;
+  // How many of the first spooled events are being uploaded, these are left
+  // alone when dropping events.
+  size_t uploading_ = 0;
+  uint64_t event_sequence_ = 0;
+  // When the spooled events are uploaded next, right away for the events of
+  // earlier runs.
+  Clock::time_point next_upload_;
+  std::chrono::milliseconds retry_delay_;
+  std::thread upload_thread_;
+};
+
+}  // namespace cuttlefish
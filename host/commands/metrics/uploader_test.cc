@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "host/commands/metrics/uploader.h"
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/scope_guard.h"
+
+namespace cuttlefish {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::SizeIs;
+
+// Stands in for Clearcut at the address metrics::kLocal posts to.
+class LocalClearcut {
+ public:
+  static constexpr int kPort = 27910;
+
+  ~LocalClearcut() {
+    if (thread_.joinable()) {
+      Release();
+      stopped_ = true;
+      server_->Shutdown(SHUT_RDWR);
+      thread_.join();
+    }
+  }
+
+  bool Start() {
+    server_ = SharedFD::SocketLocalServer(kPort, SOCK_STREAM);
+    if (!server_->IsOpen()) {
+      return false;
+    }
+    thread_ = std::thread([this]() { Serve(); });
+    return true;
+  }
+
+  // The HTTP status of the responses from now on.
+  void SetStatus(int status) { status_ = status; }
+
+  // Keeps the uploads that arrive from now on waiting for their response,
+  // until they are released one at a time or all together.
+  void Hold() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    held_ = true;
+  }
+  void ReleaseOne() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    releases_++;
+    cv_.notify_all();
+  }
+  void Release() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    held_ = false;
+    cv_.notify_all();
+  }
+
+  // The next request posted to /log, if any comes within a few seconds.
+  std::optional<LogRequest> NextRequest() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (!cv_.wait_for(lock, std::chrono::seconds(10),
+                      [this]() { return !requests_.empty(); })) {
+      return std::nullopt;
+    }
+    auto request = std::move(requests_.front());
+    requests_.pop_front();
+    return request;
+  }
+
+ private:
+  void Serve() {
+    while (!stopped_) {
+      auto client = SharedFD::Accept(*server_);
+      if (!client->IsOpen()) {
+        continue;
+      }
+      std::string headers;
+      while (headers.find("\r\n\r\n") == std::string::npos) {
+        char c;
+        if (client->Read(&c, 1) != 1) {
+          break;
+        }
+        headers += c;
+      }
+      size_t length = 0;
+      for (const auto& line : android::base::Split(headers, "\r\n")) {
+        auto field = android::base::Split(line, ":");
+        if (field.size() == 2 &&
+            android::base::EqualsIgnoreCase(field[0], "content-length")) {
+          length = std::stoul(android::base::Trim(field[1]));
+        }
+        if (android::base::EqualsIgnoreCase(line, "Expect: 100-continue")) {
+          WriteAll(client, std::string("HTTP/1.1 100 Continue\r\n\r\n"));
+        }
+      }
+      std::string body(length, '\0');
+      if (ReadExact(client, &body) != (ssize_t)length) {
+        continue;
+      }
+      LogRequest request;
+      std::unique_lock<std::mutex> lock(mtx_);
+      if (android::base::StartsWith(headers, "POST /log ") &&
+          request.ParseFromString(body)) {
+        requests_.emplace_back(std::move(request));
+        cv_.notify_all();
+      }
+      cv_.wait(lock, [this]() { return !held_ || releases_ > 0; });
+      if (held_) {
+        releases_--;
+      }
+      lock.unlock();
+      WriteAll(client, "HTTP/1.1 " + std::to_string(status_) +
+                           " Status\r\nContent-Length: 0\r\n"
+                           "Connection: close\r\n\r\n");
+    }
+  }
+
+  SharedFD server_;
+  std::thread thread_;
+  std::atomic<bool> stopped_ = false;
+  std::atomic<int> status_ = 200;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<LogRequest> requests_;
+  bool held_ = false;
+  int releases_ = 0;
+};
+
+LogEvent Event(int64_t time_ms) {
+  LogEvent event;
+  event.set_event_time_ms(time_ms);
+  return event;
+}
+
+std::vector<int64_t> EventTimes(const LogRequest& request) {
+  std::vector<int64_t> times;
+  for (const auto& event : request.log_event()) {
+    times.push_back(event.event_time_ms());
+  }
+  return times;
+}
+
+class MetricsUploaderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    if (!clearcut_.Start()) {
+      GTEST_SKIP() << "Port " << LocalClearcut::kPort << " is in use";
+    }
+  }
+
+  std::unique_ptr<MetricsUploader> Uploader(
+      std::chrono::milliseconds batch_interval) {
+    return std::make_unique<MetricsUploader>(spool_dir_, metrics::kLocal,
+                                             batch_interval);
+  }
+
+  std::vector<std::string> Spooled() {
+    auto entries = DirectoryContents(spool_dir_);
+    EXPECT_TRUE(entries.ok()) << entries.error().Message();
+    std::vector<std::string> spooled;
+    for (const auto& entry : entries.ok() ? *entries : spooled) {
+      if (android::base::EndsWith(entry, ".event")) {
+        spooled.push_back(entry);
+      }
+    }
+    return spooled;
+  }
+
+  // Until the uploader removed the files of the uploaded events.
+  void WaitForEmptySpool() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!Spooled().empty() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  LocalClearcut clearcut_;
+  TemporaryDir dir_;
+  std::string spool_dir_ = std::string(dir_.path) + "/metrics_spool";
+};
+
+TEST_F(MetricsUploaderTest, PostsEventsThatArriveTogetherInOneRequest) {
+  auto uploader = Uploader(std::chrono::milliseconds(500));
+  auto started = uploader->Start();
+  ASSERT_TRUE(started.ok()) << started.error().Message();
+  for (int64_t time : {1, 2, 3}) {
+    auto enqueued = uploader->Enqueue(Event(time));
+    ASSERT_TRUE(enqueued.ok()) << enqueued.error().Message();
+  }
+
+  auto request = clearcut_.NextRequest();
+  ASSERT_TRUE(request.has_value());
+  EXPECT_THAT(EventTimes(*request), ElementsAre(1, 2, 3));
+  WaitForEmptySpool();
+  EXPECT_THAT(Spooled(), IsEmpty());
+}
+
+TEST_F(MetricsUploaderTest, EventsAreSpooledBeforeEnqueueReturns) {
+  {
+    auto uploader = Uploader(std::chrono::hours(1));
+    auto started = uploader->Start();
+    ASSERT_TRUE(started.ok()) << started.error().Message();
+    ASSERT_TRUE(uploader->Enqueue(Event(1)).ok());
+    ASSERT_TRUE(uploader->Enqueue(Event(2)).ok());
+    EXPECT_THAT(Spooled(), SizeIs(2));
+  }
+  // As if the process stopped, the next one uploads them right away.
+  auto uploader = Uploader(std::chrono::hours(1));
+  auto started = uploader->Start();
+  ASSERT_TRUE(started.ok()) << started.error().Message();
+  auto request = clearcut_.NextRequest();
+  ASSERT_TRUE(request.has_value());
+  EXPECT_THAT(EventTimes(*request), ElementsAre(1, 2));
+  WaitForEmptySpool();
+  EXPECT_THAT(Spooled(), IsEmpty());
+}
+
+TEST_F(MetricsUploaderTest, KeepsEventsWhoseUploadFailed) {
+  clearcut_.SetStatus(500);
+  {
+    auto uploader = Uploader(std::chrono::milliseconds(0));
+    auto started = uploader->Start();
+    ASSERT_TRUE(started.ok()) << started.error().Message();
+    ASSERT_TRUE(uploader->Enqueue(Event(1)).ok());
+    ASSERT_TRUE(clearcut_.NextRequest().has_value());
+  }
+  EXPECT_THAT(Spooled(), SizeIs(1));
+
+  clearcut_.SetStatus(200);
+  auto uploader = Uploader(std::chrono::milliseconds(0));
+  auto started = uploader->Start();
+  ASSERT_TRUE(started.ok()) << started.error().Message();
+  auto request = clearcut_.NextRequest();
+  ASSERT_TRUE(request.has_value());
+  EXPECT_THAT(EventTimes(*request), ElementsAre(1));
+}
+
+TEST_F(MetricsUploaderTest, CountsEventsDroppedDuringAnUpload) {
+  clearcut_.Hold();
+  auto uploader = Uploader(std::chrono::milliseconds(0));
+  // Before the uploader waits for its upload to finish.
+  ScopeGuard release([this]() { clearcut_.Release(); });
+  auto started = uploader->Start();
+  ASSERT_TRUE(started.ok()) << started.error().Message();
+  ASSERT_TRUE(uploader->Enqueue(Event(0)).ok());
+  ASSERT_TRUE(clearcut_.NextRequest().has_value());
+
+  // Goes over the limit of 1000 spooled events while the first one is being
+  // uploaded, which drops the oldest of the others instead.
+  for (int64_t time = 1; time <= 1000; time++) {
+    ASSERT_TRUE(uploader->Enqueue(Event(time)).ok());
+  }
+  auto counters = uploader->GetCounters();
+  EXPECT_EQ(counters.events_queued, 1001);
+  EXPECT_EQ(counters.events_dropped, 1);
+  EXPECT_EQ(counters.events_spooled, 1000);
+
+  clearcut_.ReleaseOne();
+  // The next batch is held, the counters don't change meanwhile.
+  auto request = clearcut_.NextRequest();
+  ASSERT_TRUE(request.has_value());
+  EXPECT_THAT(EventTimes(*request), SizeIs(100));
+  EXPECT_EQ(EventTimes(*request).front(), 2);
+
+  counters = uploader->GetCounters();
+  EXPECT_EQ(counters.events_uploaded, 1);
+  EXPECT_EQ(counters.events_dropped, 1);
+  EXPECT_EQ(counters.events_spooled, 999);
+  EXPECT_THAT(Spooled(), SizeIs(999));
+}
+
+}  // namespace
+}  // namespace cuttlefish
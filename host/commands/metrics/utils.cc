@@ -235,10 +235,16 @@ MetricsExitCodes postReq(std::string output, metrics::ClearcutServer server) {
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &curl_out_writer);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(curl, CURLOPT_CURLU, url);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, output.c_str());
+    // Failed posts are retried later, they must not hold up the uploader.
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+    // The serialized protos may contain null bytes.
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)output.size());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, output.data());
     CURLcode rc = curl_easy_perform(curl);
     long http_code = 0;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_easy_cleanup(curl);
     if (http_code == 200 && rc != CURLE_ABORTED_BY_CALLBACK) {
       LOG(INFO) << "Metrics posted to ClearCut";
     } else {
@@ -248,9 +254,11 @@ MetricsExitCodes postReq(std::string output, metrics::ClearcutServer server) {
         LOG(ERROR) << "curl error code: " << rc << " | "
                    << curl_easy_strerror(rc);
       }
+      // Failed uploads are retried, the handles must not leak.
+      curl_url_cleanup(url);
+      curl_global_cleanup();
       return cuttlefish::kMetricsError;
     }
-    curl_easy_cleanup(curl);
   }
   curl_url_cleanup(url);
   curl_global_cleanup();
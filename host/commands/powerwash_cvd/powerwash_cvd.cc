@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 
@@ -48,6 +49,12 @@ Result<void> PowerwashCvdMain() {
       GetLauncherMonitor(*config, FLAGS_instance_num, FLAGS_wait_for_launcher));
 
   LOG(INFO) << "Requesting powerwash";
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed_ms = [&start]() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
   CF_EXPECT(WriteLauncherAction(monitor_socket, LauncherAction::kPowerwash));
   CF_EXPECT(WaitForRead(monitor_socket, FLAGS_wait_for_launcher));
   LauncherResponse powerwash_response =
@@ -57,7 +64,8 @@ Result<void> PowerwashCvdMain() {
       "Received `" << static_cast<char>(powerwash_response)
                    << "` response from launcher monitor for powerwash request");
 
-  LOG(INFO) << "Waiting for device to boot up again";
+  LOG(INFO) << "Host files reset after " << elapsed_ms()
+            << "ms, waiting for device to boot up again";
   CF_EXPECT(WaitForRead(monitor_socket, FLAGS_boot_timeout));
   RunnerExitCodes boot_exit_code = CF_EXPECT(ReadExitCode(monitor_socket));
   CF_EXPECT(boot_exit_code != RunnerExitCodes::kVirtualDeviceBootFailed,
@@ -65,7 +73,7 @@ Result<void> PowerwashCvdMain() {
   CF_EXPECT(boot_exit_code == RunnerExitCodes::kSuccess,
             "Unknown response" << static_cast<int>(boot_exit_code));
 
-  LOG(INFO) << "Powerwash successful";
+  LOG(INFO) << "Powerwash successful after " << elapsed_ms() << "ms";
   return {};
 }
 
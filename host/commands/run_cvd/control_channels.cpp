@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/commands/run_cvd/control_channels.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/utils/files.h"
+#include "host/libs/command_util/launcher_control.h"
+
+namespace cuttlefish {
+namespace {
+
+// Keeps a misbehaving client from making run_cvd busy.
+constexpr std::chrono::milliseconds kMinCountersInterval(100);
+
+std::string ReadProcFile(pid_t pid, const std::string& name) {
+  std::string contents;
+  auto path = "/proc/" + std::to_string(pid) + "/" + name;
+  auto fd = SharedFD::Open(path, O_RDONLY | O_CLOEXEC);
+  if (!fd->IsOpen() || ReadAll(fd, &contents) < 0) {
+    return "";
+  }
+  return contents;
+}
+
+// Reads /proc/<pid>/stat, returns std::nullopt if the process is gone or is
+// not a child of `parent`.
+std::optional<launcher::ProcessStatus> ChildProcessStatus(pid_t pid,
+                                                          pid_t parent) {
+  auto stat = ReadProcFile(pid, "stat");
+  // The name in parentheses may contain spaces and parentheses itself.
+  auto name_start = stat.find('(');
+  auto name_end = stat.rfind(')');
+  if (name_start == std::string::npos || name_end == std::string::npos ||
+      name_end + 2 > stat.size()) {
+    return std::nullopt;
+  }
+  // fields[0] is field 3 of proc(5), the state.
+  auto fields = android::base::Split(stat.substr(name_end + 2), " ");
+  pid_t ppid;
+  uint64_t utime, stime, rss_pages;
+  if (fields.size() < 22 || !android::base::ParseInt(fields[1], &ppid) ||
+      ppid != parent || !android::base::ParseUint(fields[11], &utime) ||
+      !android::base::ParseUint(fields[12], &stime) ||
+      !android::base::ParseUint(fields[21], &rss_pages)) {
+    return std::nullopt;
+  }
+  static const uint64_t ticks_per_second = sysconf(_SC_CLK_TCK);
+  static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+  launcher::ProcessStatus status;
+  status.set_pid(pid);
+  // The stat name is truncated to 15 characters, the command line isn't.
+  auto cmdline = ReadProcFile(pid, "cmdline");
+  auto argv0 = cmdline.substr(0, cmdline.find('\0'));
+  if (!argv0.empty()) {
+    status.set_name(cpp_basename(argv0));
+  } else {
+    status.set_name(stat.substr(name_start + 1, name_end - name_start - 1));
+  }
+  status.set_state(fields[0]);
+  status.set_cpu_time_ms((utime + stime) * 1000 / ticks_per_second);
+  status.set_rss_bytes(rss_pages * page_size);
+  return status;
+}
+
+std::vector<launcher::ProcessStatus> ChildProcesses(pid_t parent) {
+  std::vector<launcher::ProcessStatus> children;
+  if (parent < 0) {
+    return children;
+  }
+  auto entries = DirectoryContents("/proc");
+  if (!entries.ok()) {
+    LOG(ERROR) << "Failed to list processes: " << entries.error().Message();
+    return children;
+  }
+  for (const auto& entry : *entries) {
+    pid_t pid;
+    if (!android::base::ParseInt(entry, &pid)) {
+      continue;
+    }
+    if (auto status = ChildProcessStatus(pid, parent)) {
+      children.emplace_back(std::move(*status));
+    }
+  }
+  std::sort(children.begin(), children.end(),
+            [](const auto& a, const auto& b) { return a.pid() < b.pid(); });
+  return children;
+}
+
+}  // namespace
+
+LauncherControlChannels::LauncherControlChannels(
+    const CuttlefishConfig::InstanceSpecific& instance,
+    const ProcessMonitor& process_monitor)
+    : instance_(instance),
+      process_monitor_(process_monitor),
+      start_(Clock::now()) {}
+
+void LauncherControlChannels::Add(SharedFD channel) {
+  auto flags = channel->Fcntl(F_GETFL, 0);
+  if (flags < 0 || channel->Fcntl(F_SETFL, flags | O_NONBLOCK) < 0) {
+    LOG(ERROR) << "Failed to make control channel non blocking: "
+               << channel->StrError();
+    return;
+  }
+  channels_.push_back(Channel{.fd = std::move(channel)});
+}
+
+void LauncherControlChannels::AddToSet(SharedFDSet& read_set) const {
+  for (const auto& channel : channels_) {
+    read_set.Set(channel.fd);
+  }
+}
+
+std::optional<std::chrono::milliseconds>
+LauncherControlChannels::TimeUntilCounters() const {
+  if (subscriptions_.empty()) {
+    return std::nullopt;
+  }
+  auto next = std::min_element(
+      subscriptions_.begin(), subscriptions_.end(),
+      [](const auto& a, const auto& b) { return a.next < b.next; });
+  auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+      next->next - Clock::now());
+  return std::max(remaining, std::chrono::milliseconds(0));
+}
+
+void LauncherControlChannels::Service(const SharedFDSet& read_set) {
+  // Collected first, channels may be dropped along the way.
+  std::vector<SharedFD> readable;
+  for (const auto& channel : channels_) {
+    if (read_set.IsSet(channel.fd)) {
+      readable.push_back(channel.fd);
+    }
+  }
+  for (const auto& fd : readable) {
+    auto channel = std::find_if(
+        channels_.begin(), channels_.end(),
+        [&fd](const Channel& channel) { return channel.fd == fd; });
+    if (channel == channels_.end()) {
+      continue;
+    }
+    auto read = channel->received.ReadAvailable(fd);
+    if (!read.ok()) {
+      LOG(DEBUG) << "Dropping control channel: " << read.error().Message();
+      Drop(fd);
+      continue;
+    }
+    while (true) {
+      launcher::ControlRequest request;
+      auto next = channel->received.Next(request);
+      if (!next.ok()) {
+        LOG(ERROR) << "Dropping control channel: " << next.error().Message();
+        Drop(fd);
+        break;
+      }
+      if (!*next) {
+        break;
+      }
+      auto handled = HandleRequest(fd, request);
+      if (!handled.ok()) {
+        LOG(ERROR) << "Failed to answer control request: "
+                   << handled.error().Message();
+        Drop(fd);
+        break;
+      }
+    }
+  }
+
+  // Every subscriber that is due gets the same counters.
+  std::optional<launcher::ControlResponse> response;
+  auto now = Clock::now();
+  for (const auto& subscription : std::vector(subscriptions_)) {
+    if (subscription.next > now || !IsOpen(subscription.channel)) {
+      continue;
+    }
+    if (!response) {
+      response.emplace();
+      *response->mutable_counters() = CurrentCounters();
+    }
+    response->set_id(subscription.request_id);
+    auto written = WriteControlMessage(subscription.channel, *response);
+    if (!written.ok()) {
+      LOG(ERROR) << "Failed to send counters: " << written.error().Message();
+      Drop(subscription.channel);
+      continue;
+    }
+    for (auto& stored : subscriptions_) {
+      if (stored.channel == subscription.channel &&
+          stored.request_id == subscription.request_id) {
+        // Skips the ticks that were missed rather than catching up.
+        while (stored.next <= now) {
+          stored.next += stored.interval;
+        }
+      }
+    }
+  }
+}
+
+Result<void> LauncherControlChannels::HandleRequest(
+    const SharedFD& channel, const launcher::ControlRequest& request) {
+  launcher::ControlResponse response;
+  response.set_id(request.id());
+  switch (request.contents_case()) {
+    case launcher::ControlRequest::kStatus:
+      *response.mutable_status() = Status(request.status().processes());
+      break;
+    case launcher::ControlRequest::kCounters: {
+      auto interval = std::max(
+          std::chrono::milliseconds(request.counters().interval_ms()),
+          kMinCountersInterval);
+      subscriptions_.push_back(CountersSubscription{
+          .channel = channel,
+          .request_id = request.id(),
+          .interval = interval,
+          .next = Clock::now(),
+      });
+      // The first counters go out with the next call to Service.
+      return {};
+    }
+    case launcher::ControlRequest::kCancel: {
+      auto cancelled = request.cancel().request_id();
+      subscriptions_.erase(
+          std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                         [&channel, cancelled](const auto& subscription) {
+                           return subscription.channel == channel &&
+                                  subscription.request_id == cancelled;
+                         }),
+          subscriptions_.end());
+      break;
+    }
+    default:
+      response.set_error("Unknown control request");
+  }
+  CF_EXPECT(WriteControlMessage(channel, response));
+  return {};
+}
+
+launcher::InstanceStatus LauncherControlChannels::Status(
+    bool processes) const {
+  launcher::InstanceStatus status;
+  status.set_instance_name(instance_.instance_name());
+  status.set_uptime_ms(std::chrono::duration_cast<std::chrono::milliseconds>(
+                           Clock::now() - start_)
+                           .count());
+  if (processes) {
+    for (auto& process : ChildProcesses(process_monitor_.monitor_pid())) {
+      *status.add_processes() = std::move(process);
+    }
+  }
+  return status;
+}
+
+launcher::Counters LauncherControlChannels::CurrentCounters() const {
+  launcher::Counters counters;
+  counters.set_timestamp_ms(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  for (const auto& process : ChildProcesses(process_monitor_.monitor_pid())) {
+    counters.set_process_count(counters.process_count() + 1);
+    counters.set_cpu_time_ms(counters.cpu_time_ms() + process.cpu_time_ms());
+    counters.set_rss_bytes(counters.rss_bytes() + process.rss_bytes());
+  }
+  return counters;
+}
+
+bool LauncherControlChannels::IsOpen(const SharedFD& channel) const {
+  return std::any_of(channels_.begin(), channels_.end(),
+                     [&channel](const Channel& open) {
+                       return open.fd == channel;
+                     });
+}
+
+void LauncherControlChannels::Drop(const SharedFD& channel) {
+  channels_.erase(std::remove_if(channels_.begin(), channels_.end(),
+                                 [&channel](const Channel& open) {
+                                   return open.fd == channel;
+                                 }),
+                  channels_.end());
+  subscriptions_.erase(
+      std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                     [&channel](const auto& subscription) {
+                       return subscription.channel == channel;
+                     }),
+      subscriptions_.end());
+}
+
+}  // namespace cuttlefish
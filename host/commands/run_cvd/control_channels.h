@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/fs/shared_select.h"
+#include "common/libs/utils/result.h"
+#include "host/commands/run_cvd/process_monitor.h"
+#include "host/libs/command_util/launcher_control.h"
+#include "host/libs/config/cuttlefish_config.h"
+#include "launcher_control.pb.h"
+
+namespace cuttlefish {
+
+// The server side of the launcher control channels, see
+// launcher_control.proto. Meant to be driven by the select loop that accepts
+// the connections. Channels are non blocking, a client that sends part of a
+// message or doesn't read its responses can't hold up the loop.
+class LauncherControlChannels {
+ public:
+  LauncherControlChannels(const CuttlefishConfig::InstanceSpecific& instance,
+                          const ProcessMonitor& process_monitor);
+
+  void Add(SharedFD channel);
+  void AddToSet(SharedFDSet& read_set) const;
+  // How long the select loop may wait before counters are due, std::nullopt
+  // if it doesn't need to wake up for them.
+  std::optional<std::chrono::milliseconds> TimeUntilCounters() const;
+  // Reads what the channels in `read_set` sent, answers the requests that
+  // are complete and sends the counters that are due. Channels that fail,
+  // were closed or would block a write are dropped.
+  void Service(const SharedFDSet& read_set);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Channel {
+    SharedFD fd;
+    ControlMessageBuffer received;
+  };
+
+  struct CountersSubscription {
+    SharedFD channel;
+    uint64_t request_id;
+    std::chrono::milliseconds interval;
+    Clock::time_point next;
+  };
+
+  Result<void> HandleRequest(const SharedFD& channel,
+                             const launcher::ControlRequest& request);
+  launcher::InstanceStatus Status(bool processes) const;
+  launcher::Counters CurrentCounters() const;
+  bool IsOpen(const SharedFD& channel) const;
+  void Drop(const SharedFD& channel);
+
+  const CuttlefishConfig::InstanceSpecific& instance_;
+  const ProcessMonitor& process_monitor_;
+  const Clock::time_point start_;
+  std::vector<Channel> channels_;
+  std::vector<CountersSubscription> subscriptions_;
+};
+
+}  // namespace cuttlefish
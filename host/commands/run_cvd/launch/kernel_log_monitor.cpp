@@ -36,8 +36,9 @@ class KernelLogMonitor : public CommandSource,
                          public DiagnosticInformation,
                          public LateInjected {
  public:
-  INJECT(KernelLogMonitor(const CuttlefishConfig::InstanceSpecific& instance))
-      : instance_(instance) {}
+  INJECT(KernelLogMonitor(const CuttlefishConfig& config,
+                          const CuttlefishConfig::InstanceSpecific& instance))
+      : config_(config), instance_(instance) {}
 
   // DiagnosticInformation
   std::vector<std::string> Diagnostics() const override {
@@ -54,6 +55,12 @@ class KernelLogMonitor : public CommandSource,
   Result<std::vector<MonitorCommand>> Commands() override {
     Command command(KernelLogMonitorBinary());
     command.AddParameter("-log_pipe_fd=", fifo_);
+    command.AddParameter("-log_rotate_size_mb=", config_.log_rotate_size_mb());
+    command.AddParameter("-log_rotate_interval_s=",
+                         config_.log_rotate_interval_s());
+    command.AddParameter("-log_rotate_keep=", config_.log_rotate_keep());
+    command.AddParameter("-log_rotate_compress=",
+                         config_.log_rotate_compress());
 
     if (!event_pipe_write_ends_.empty()) {
       command.AddParameter("-subscriber_fds=");
@@ -111,6 +118,7 @@ class KernelLogMonitor : public CommandSource,
   }
 
   int number_of_event_pipes_ = 0;
+  const CuttlefishConfig& config_;
   const CuttlefishConfig::InstanceSpecific& instance_;
   SharedFD fifo_;
   std::vector<SharedFD> event_pipe_write_ends_;
@@ -119,7 +127,8 @@ class KernelLogMonitor : public CommandSource,
 
 }  // namespace
 
-fruit::Component<fruit::Required<const CuttlefishConfig::InstanceSpecific>,
+fruit::Component<fruit::Required<const CuttlefishConfig,
+                                 const CuttlefishConfig::InstanceSpecific>,
                  KernelLogPipeProvider>
 KernelLogMonitorComponent() {
   return fruit::createComponent()
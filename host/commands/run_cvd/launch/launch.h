@@ -41,11 +41,13 @@ fruit::Component<fruit::Required<const CuttlefishConfig,
                                  const CuttlefishConfig::InstanceSpecific>>
 BluetoothConnectorComponent();
 
-fruit::Component<fruit::Required<const CuttlefishConfig::InstanceSpecific>,
+fruit::Component<fruit::Required<const CuttlefishConfig,
+                                 const CuttlefishConfig::InstanceSpecific>,
                  KernelLogPipeProvider>
 KernelLogMonitorComponent();
 
-fruit::Component<fruit::Required<const CuttlefishConfig::InstanceSpecific>>
+fruit::Component<fruit::Required<const CuttlefishConfig,
+                                 const CuttlefishConfig::InstanceSpecific>>
 LogcatReceiverComponent();
 
 fruit::Component<fruit::Required<const CuttlefishConfig::InstanceSpecific>>
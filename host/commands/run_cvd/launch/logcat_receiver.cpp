@@ -32,8 +32,9 @@ namespace {
 
 class LogcatReceiver : public CommandSource, public DiagnosticInformation {
  public:
-  INJECT(LogcatReceiver(const CuttlefishConfig::InstanceSpecific& instance))
-      : instance_(instance) {}
+  INJECT(LogcatReceiver(const CuttlefishConfig& config,
+                        const CuttlefishConfig::InstanceSpecific& instance))
+      : config_(config), instance_(instance) {}
   // DiagnosticInformation
   std::vector<std::string> Diagnostics() const override {
     return {"Logcat output: " + instance_.logcat_path()};
@@ -43,6 +44,12 @@ class LogcatReceiver : public CommandSource, public DiagnosticInformation {
   Result<std::vector<MonitorCommand>> Commands() override {
     Command command(LogcatReceiverBinary());
     command.AddParameter("-log_pipe_fd=", pipe_);
+    command.AddParameter("-log_rotate_size_mb=", config_.log_rotate_size_mb());
+    command.AddParameter("-log_rotate_interval_s=",
+                         config_.log_rotate_interval_s());
+    command.AddParameter("-log_rotate_keep=", config_.log_rotate_keep());
+    command.AddParameter("-log_rotate_compress=",
+                         config_.log_rotate_compress());
     std::vector<MonitorCommand> commands;
     commands.emplace_back(std::move(command));
     return commands;
@@ -69,13 +76,15 @@ class LogcatReceiver : public CommandSource, public DiagnosticInformation {
     return {};
   }
 
+  const CuttlefishConfig& config_;
   const CuttlefishConfig::InstanceSpecific& instance_;
   SharedFD pipe_;
 };
 
 }  // namespace
 
-fruit::Component<fruit::Required<const CuttlefishConfig::InstanceSpecific>>
+fruit::Component<fruit::Required<const CuttlefishConfig,
+                                 const CuttlefishConfig::InstanceSpecific>>
 LogcatReceiverComponent() {
   return fruit::createComponent()
       .addMultibinding<CommandSource, LogcatReceiver>()
@@ -73,6 +73,9 @@ class ProcessMonitor {
   Result<void> StartAndMonitorProcesses();
   // Stops all monitored subprocesses.
   Result<void> StopMonitoredProcesses();
+  // The process that the monitored subprocesses are children of, -1 when
+  // they are not running.
+  pid_t monitor_pid() const { return monitor_; }
 
  private:
   Result<void> MonitorRoutine();
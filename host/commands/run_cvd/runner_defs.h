@@ -53,6 +53,8 @@ enum class LauncherAction : char {
   kRestart = 'R',
   kStatus = 'I',
   kStop = 'X',
+  // Switches the connection to the protocol of launcher_control.proto.
+  kControlChannel = 'C',
 };
 
 // Responses from the launcher server
@@ -19,43 +19,33 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <fruit/fruit.h>
 #include <gflags/gflags.h>
 
 #include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_select.h"
 #include "common/libs/utils/files.h"
 #include "common/libs/utils/subprocess.h"
+#include "host/commands/run_cvd/control_channels.h"
 #include "host/commands/run_cvd/runner_defs.h"
 #include "host/libs/config/command_source.h"
 #include "host/libs/config/cuttlefish_config.h"
 #include "host/libs/config/data_image.h"
 #include "host/libs/config/feature.h"
 #include "host/libs/config/inject.h"
+#include "host/libs/image_aggregator/image_aggregator.h"
 
 namespace cuttlefish {
 
 namespace {
 
-bool CreateQcowOverlay(const std::string& crosvm_path,
-                       const std::string& backing_file,
-                       const std::string& output_overlay_path) {
-  Command crosvm_qcow2_cmd(crosvm_path);
-  crosvm_qcow2_cmd.AddParameter("create_qcow2");
-  crosvm_qcow2_cmd.AddParameter("--backing-file");
-  crosvm_qcow2_cmd.AddParameter(backing_file);
-  crosvm_qcow2_cmd.AddParameter(output_overlay_path);
-  int success = crosvm_qcow2_cmd.Start().Wait();
-  if (success != 0) {
-    LOG(ERROR) << "Unable to run crosvm create_qcow2. Exited with status "
-               << success;
-    return false;
-  }
-  return true;
-}
-
 class ServerLoopImpl : public ServerLoop,
                        public SetupFeature,
                        public LateInjected {
@@ -87,98 +77,52 @@ class ServerLoopImpl : public ServerLoop,
 
     CF_EXPECT(process_monitor.StartAndMonitorProcesses());
 
+    LauncherControlChannels control_channels(instance_, process_monitor);
+    // Connections that send single byte actions.
+    std::vector<SharedFD> clients;
     while (true) {
-      // TODO: use select to handle simultaneous connections.
-      auto client = SharedFD::Accept(*server_);
-      LauncherAction action;
-      while (client->IsOpen() && client->Read(&action, sizeof(action)) > 0) {
-        switch (action) {
-          case LauncherAction::kStop: {
-            auto stop = process_monitor.StopMonitoredProcesses();
-            if (stop.ok()) {
-              auto response = LauncherResponse::kSuccess;
-              client->Write(&response, sizeof(response));
-              std::exit(0);
-            } else {
-              LOG(ERROR) << "Failed to stop subprocesses:\n"
-                         << stop.error().Message();
-              LOG(DEBUG) << "Failed to stop subprocesses:\n"
-                         << stop.error().Trace();
-              auto response = LauncherResponse::kError;
-              client->Write(&response, sizeof(response));
-            }
-            break;
-          }
-          case LauncherAction::kStatus: {
-            // TODO(schuffelen): Return more information on a side channel
-            auto response = LauncherResponse::kSuccess;
-            client->Write(&response, sizeof(response));
-            break;
-          }
-          case LauncherAction::kPowerwash: {
-            LOG(INFO) << "Received a Powerwash request from the monitor socket";
-            const auto& disks = instance_.virtual_disk_paths();
-            auto overlay = instance_.PerInstancePath("overlay.img");
-            if (std::find(disks.begin(), disks.end(), overlay) == disks.end()) {
-              LOG(ERROR) << "Powerwash unsupported with --use_overlay=false";
-              auto response = LauncherResponse::kError;
-              client->Write(&response, sizeof(response));
-              break;
-            }
-
-            auto stop = process_monitor.StopMonitoredProcesses();
-            if (!stop.ok()) {
-              LOG(ERROR) << "Stopping processes failed:\n"
-                         << stop.error().Message();
-              LOG(DEBUG) << "Stopping processes failed:\n"
-                         << stop.error().Trace();
-              auto response = LauncherResponse::kError;
-              client->Write(&response, sizeof(response));
-              break;
-            }
-            if (!PowerwashFiles()) {
-              LOG(ERROR) << "Powerwashing files failed.";
-              auto response = LauncherResponse::kError;
-              client->Write(&response, sizeof(response));
-              break;
-            }
-            auto response = LauncherResponse::kSuccess;
-            client->Write(&response, sizeof(response));
-
-            RestartRunCvd(client->UNMANAGED_Dup());
-            // RestartRunCvd should not return, so something went wrong.
-            response = LauncherResponse::kError;
-            client->Write(&response, sizeof(response));
-            LOG(FATAL) << "run_cvd in a bad state";
-            break;
-          }
-          case LauncherAction::kRestart: {
-            auto stop = process_monitor.StopMonitoredProcesses();
-            if (!stop.ok()) {
-              LOG(ERROR) << "Stopping processes failed:\n"
-                         << stop.error().Message();
-              LOG(DEBUG) << "Stopping processes failed:\n"
-                         << stop.error().Trace();
-              auto response = LauncherResponse::kError;
-              client->Write(&response, sizeof(response));
-              break;
-            }
-            DeleteFifos();
-
-            auto response = LauncherResponse::kSuccess;
-            client->Write(&response, sizeof(response));
-            RestartRunCvd(client->UNMANAGED_Dup());
-            // RestartRunCvd should not return, so something went wrong.
-            response = LauncherResponse::kError;
-            client->Write(&response, sizeof(response));
-            LOG(FATAL) << "run_cvd in a bad state";
-            break;
-          }
-          default:
-            LOG(ERROR) << "Unrecognized launcher action: "
-                       << static_cast<char>(action);
-            auto response = LauncherResponse::kError;
-            client->Write(&response, sizeof(response));
+      SharedFDSet read_set;
+      read_set.Set(server_);
+      for (const auto& client : clients) {
+        read_set.Set(client);
+      }
+      control_channels.AddToSet(read_set);
+      struct timeval timeout;
+      struct timeval* timeout_ptr = nullptr;
+      if (auto wait = control_channels.TimeUntilCounters()) {
+        timeout.tv_sec = wait->count() / 1000;
+        timeout.tv_usec = (wait->count() % 1000) * 1000;
+        timeout_ptr = &timeout;
+      }
+      CF_EXPECT(Select(&read_set, nullptr, nullptr, timeout_ptr) >= 0,
+                "Error on select call: " << strerror(errno));
+
+      control_channels.Service(read_set);
+      std::vector<SharedFD> open_clients;
+      for (const auto& client : clients) {
+        if (!read_set.IsSet(client)) {
+          open_clients.push_back(client);
+          continue;
+        }
+        LauncherAction action;
+        if (client->Read(&action, sizeof(action)) <= 0) {
+          continue;
+        }
+        if (action == LauncherAction::kControlChannel) {
+          control_channels.Add(client);
+          continue;
+        }
+        HandleAction(action, client, process_monitor);
+        open_clients.push_back(client);
+      }
+      clients = std::move(open_clients);
+      if (read_set.IsSet(server_)) {
+        auto client = SharedFD::Accept(*server_);
+        if (client->IsOpen()) {
+          clients.push_back(client);
+        } else {
+          LOG(ERROR) << "Failed to accept launcher client: "
+                     << client->StrError();
         }
       }
     }
@@ -202,6 +146,104 @@ class ServerLoopImpl : public ServerLoop,
     return true;
   }
 
+  void HandleAction(LauncherAction action, const SharedFD& client,
+                    ProcessMonitor& process_monitor) {
+    switch (action) {
+      case LauncherAction::kStop: {
+        auto stop = process_monitor.StopMonitoredProcesses();
+        if (stop.ok()) {
+          auto response = LauncherResponse::kSuccess;
+          client->Write(&response, sizeof(response));
+          std::exit(0);
+        } else {
+          LOG(ERROR) << "Failed to stop subprocesses:\n"
+                     << stop.error().Message();
+          LOG(DEBUG) << "Failed to stop subprocesses:\n"
+                     << stop.error().Trace();
+          auto response = LauncherResponse::kError;
+          client->Write(&response, sizeof(response));
+        }
+        break;
+      }
+      case LauncherAction::kStatus: {
+        // TODO(schuffelen): Return more information on a side channel
+        auto response = LauncherResponse::kSuccess;
+        client->Write(&response, sizeof(response));
+        break;
+      }
+      case LauncherAction::kPowerwash: {
+        LOG(INFO) << "Received a Powerwash request from the monitor socket";
+        auto powerwash_start = std::chrono::steady_clock::now();
+        const auto& disks = instance_.virtual_disk_paths();
+        auto overlay = instance_.PerInstancePath("overlay.img");
+        if (std::find(disks.begin(), disks.end(), overlay) == disks.end()) {
+          LOG(ERROR) << "Powerwash unsupported with --use_overlay=false";
+          auto response = LauncherResponse::kError;
+          client->Write(&response, sizeof(response));
+          break;
+        }
+
+        auto stop = process_monitor.StopMonitoredProcesses();
+        if (!stop.ok()) {
+          LOG(ERROR) << "Stopping processes failed:\n"
+                     << stop.error().Message();
+          LOG(DEBUG) << "Stopping processes failed:\n"
+                     << stop.error().Trace();
+          auto response = LauncherResponse::kError;
+          client->Write(&response, sizeof(response));
+          break;
+        }
+        if (!PowerwashFiles()) {
+          LOG(ERROR) << "Powerwashing files failed.";
+          auto response = LauncherResponse::kError;
+          client->Write(&response, sizeof(response));
+          break;
+        }
+        LOG(INFO) << "Stopped the device and reset its files in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - powerwash_start)
+                         .count()
+                  << "ms";
+        auto response = LauncherResponse::kSuccess;
+        client->Write(&response, sizeof(response));
+
+        RestartRunCvd(client->UNMANAGED_Dup());
+        // RestartRunCvd should not return, so something went wrong.
+        response = LauncherResponse::kError;
+        client->Write(&response, sizeof(response));
+        LOG(FATAL) << "run_cvd in a bad state";
+        break;
+      }
+      case LauncherAction::kRestart: {
+        auto stop = process_monitor.StopMonitoredProcesses();
+        if (!stop.ok()) {
+          LOG(ERROR) << "Stopping processes failed:\n"
+                     << stop.error().Message();
+          LOG(DEBUG) << "Stopping processes failed:\n"
+                     << stop.error().Trace();
+          auto response = LauncherResponse::kError;
+          client->Write(&response, sizeof(response));
+          break;
+        }
+        DeleteFifos();
+
+        auto response = LauncherResponse::kSuccess;
+        client->Write(&response, sizeof(response));
+        RestartRunCvd(client->UNMANAGED_Dup());
+        // RestartRunCvd should not return, so something went wrong.
+        response = LauncherResponse::kError;
+        client->Write(&response, sizeof(response));
+        LOG(FATAL) << "run_cvd in a bad state";
+        break;
+      }
+      default:
+        LOG(ERROR) << "Unrecognized launcher action: "
+                   << static_cast<char>(action);
+        auto response = LauncherResponse::kError;
+        client->Write(&response, sizeof(response));
+    }
+  }
+
   void DeleteFifos() {
     // TODO(schuffelen): Create these FIFOs in assemble_cvd instead of run_cvd.
     std::vector<std::string> pipes = {
@@ -256,7 +298,14 @@ class ServerLoopImpl : public ServerLoop,
     // round up
     auto sdcard_mb_size = (sdcard_size + (1 << 20) - 1) / (1 << 20);
     LOG(DEBUG) << "Size in mb is " << sdcard_mb_size;
-    CreateBlankImage(sdcard_path, sdcard_mb_size, "sdcard");
+    auto sdcard =
+        CreateBlankImageFromTemplate(sdcard_path, sdcard_mb_size, "sdcard",
+                                     instance_.instance_internal_dir());
+    if (!sdcard.ok()) {
+      LOG(ERROR) << "Failed to recreate the sdcard: "
+                 << sdcard.error().Message();
+      return false;
+    }
 
     struct OverlayFile {
       std::string name;
@@ -277,8 +326,10 @@ class ServerLoopImpl : public ServerLoop,
       auto composite_disk_path = overlay_file.composite_disk_path.c_str();
 
       unlink(overlay_path.c_str());
-      if (!CreateQcowOverlay(instance_.crosvm_binary(), composite_disk_path, overlay_path)) {
-        LOG(ERROR) << "CreateQcowOverlay failed";
+      auto overlay = CreateQcowOverlay(composite_disk_path, overlay_path);
+      if (!overlay.ok()) {
+        LOG(ERROR) << "CreateQcowOverlay failed: "
+                   << overlay.error().Message();
         return false;
       }
     }
@@ -0,0 +1,241 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures keystore operations per second when several guest clients share
+// one keymaster channel, with and without request id multiplexing. Both sides
+// run in this process over a socket pair, using the software KeyMint context.
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <gflags/gflags.h>
+#include <keymaster/android_keymaster.h>
+#include <keymaster/authorization_set.h>
+#include <keymaster/contexts/pure_soft_keymaster_context.h>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/security/keymaster_channel_multiplexed.h"
+#include "common/libs/security/keymaster_channel_sharedfd.h"
+#include "host/commands/secure_env/keymaster_responder.h"
+#include "host/commands/secure_env/multiplexed_keymaster_responder.h"
+
+DEFINE_int32(clients, 8, "Number of concurrent guest clients");
+DEFINE_int32(seconds, 5, "How long to run the load for");
+DEFINE_bool(multiplexed, true,
+            "Use the request id protocol instead of one request at a time");
+DEFINE_int32(worker_threads, 4, "Workers serving multiplexed requests");
+DEFINE_string(operation, "aes_encrypt",
+              "The keystore operation to repeat: \"aes_encrypt\" for a "
+              "begin/finish pair on an AES key, or \"get_version\"");
+
+namespace cuttlefish {
+namespace {
+
+constexpr size_t kOperationTableSize = 64;
+const auto kMessageVersion =
+    keymaster::MessageVersion(keymaster::KmVersion::KEYMINT_3, 0);
+
+// Sends one request from a client and deserializes the response. Both the
+// multiplexed and the legacy transports implement this.
+class LoadClient {
+ public:
+  virtual ~LoadClient() = default;
+  virtual ManagedKeymasterMessage Call(
+      AndroidKeymasterCommand command,
+      const keymaster::Serializable& request) = 0;
+
+  template <typename Response>
+  bool Call(AndroidKeymasterCommand command,
+            const keymaster::Serializable& request, Response* response) {
+    auto message = Call(command, request);
+    if (!message) {
+      return false;
+    }
+    const uint8_t* buffer = message->payload;
+    const uint8_t* end = message->payload + message->payload_size;
+    return response->Deserialize(&buffer, end) &&
+           response->error == KM_ERROR_OK;
+  }
+};
+
+class MultiplexedLoadClient : public LoadClient {
+ public:
+  MultiplexedLoadClient(SharedFD fd) : client_(fd, fd) {}
+
+  using LoadClient::Call;
+  ManagedKeymasterMessage Call(
+      AndroidKeymasterCommand command,
+      const keymaster::Serializable& request) override {
+    return client_.Call(command, request);
+  }
+
+ private:
+  MultiplexedKeymasterClient client_;
+};
+
+// Mirrors today's guest HAL: one request on the wire at a time.
+class SerializedLoadClient : public LoadClient {
+ public:
+  SerializedLoadClient(SharedFD fd) : channel_(fd, fd) {}
+
+  using LoadClient::Call;
+  ManagedKeymasterMessage Call(
+      AndroidKeymasterCommand command,
+      const keymaster::Serializable& request) override {
+    std::lock_guard lock(mutex_);
+    if (!channel_.SendRequest(command, request)) {
+      return {};
+    }
+    return channel_.ReceiveMessage();
+  }
+
+ private:
+  std::mutex mutex_;
+  SharedFdKeymasterChannel channel_;
+};
+
+bool GenerateAesKey(LoadClient& client, keymaster::KeymasterKeyBlob* blob) {
+  keymaster::GenerateKeyRequest request(kMessageVersion);
+  request.key_description.Reinitialize(
+      keymaster::AuthorizationSetBuilder()
+          .AesEncryptionKey(128)
+          .EcbMode()
+          .Padding(KM_PAD_NONE)
+          .Authorization(keymaster::TAG_NO_AUTH_REQUIRED));
+  keymaster::GenerateKeyResponse response(kMessageVersion);
+  if (!client.Call(keymaster::GENERATE_KEY, request, &response)) {
+    return false;
+  }
+  *blob = std::move(response.key_blob);
+  return true;
+}
+
+bool AesEncrypt(LoadClient& client, const keymaster::KeymasterKeyBlob& blob) {
+  keymaster::BeginOperationRequest begin(kMessageVersion);
+  begin.purpose = KM_PURPOSE_ENCRYPT;
+  begin.SetKeyMaterial(blob);
+  begin.additional_params.Reinitialize(keymaster::AuthorizationSetBuilder()
+                                           .EcbMode()
+                                           .Padding(KM_PAD_NONE));
+  keymaster::BeginOperationResponse begin_response(kMessageVersion);
+  if (!client.Call(keymaster::BEGIN_OPERATION, begin, &begin_response)) {
+    return false;
+  }
+  keymaster::FinishOperationRequest finish(kMessageVersion);
+  finish.op_handle = begin_response.op_handle;
+  uint8_t block[16] = {};
+  finish.input.Reinitialize(block, sizeof(block));
+  keymaster::FinishOperationResponse finish_response(kMessageVersion);
+  return client.Call(keymaster::FINISH_OPERATION, finish, &finish_response);
+}
+
+bool GetVersion(LoadClient& client) {
+  keymaster::GetVersion2Request request(kMessageVersion);
+  keymaster::GetVersion2Response response(kMessageVersion);
+  return client.Call(keymaster::GET_VERSION_2, request, &response);
+}
+
+int KeymasterLoadTestMain(int argc, char** argv) {
+  ::android::base::InitLogging(argv, android::base::StderrLogger);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  keymaster::AndroidKeymaster keymaster(
+      new keymaster::PureSoftKeymasterContext(keymaster::KmVersion::KEYMINT_3,
+                                              KM_SECURITY_LEVEL_SOFTWARE),
+      kOperationTableSize, kMessageVersion);
+
+  SharedFD client_fd;
+  SharedFD server_fd;
+  CHECK(SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &client_fd, &server_fd))
+      << "Failed to create socket pair";
+
+  std::thread server_thread;
+  std::unique_ptr<LoadClient> client;
+  if (FLAGS_multiplexed) {
+    server_thread = std::thread([server_fd, &keymaster]() {
+      SharedFdMultiplexedKeymasterChannel channel(server_fd, server_fd);
+      MultiplexedKeymasterResponder responder(channel, keymaster,
+                                              FLAGS_worker_threads);
+      responder.ProcessMessages();
+    });
+    client = std::make_unique<MultiplexedLoadClient>(client_fd);
+  } else {
+    server_thread = std::thread([server_fd, &keymaster]() {
+      SharedFdKeymasterChannel channel(server_fd, server_fd);
+      KeymasterResponder responder(channel, keymaster);
+      while (responder.ProcessMessage()) {
+      }
+    });
+    client = std::make_unique<SerializedLoadClient>(client_fd);
+  }
+
+  bool aes = FLAGS_operation == "aes_encrypt";
+  CHECK(aes || FLAGS_operation == "get_version")
+      << "Unknown operation " << FLAGS_operation;
+
+  std::atomic<uint64_t> completed = 0;
+  std::atomic<uint64_t> failed = 0;
+  std::atomic<bool> running = true;
+  std::vector<std::thread> clients;
+  for (int i = 0; i < FLAGS_clients; i++) {
+    clients.emplace_back([&]() {
+      keymaster::KeymasterKeyBlob blob;
+      if (aes && !GenerateAesKey(*client, &blob)) {
+        LOG(ERROR) << "Failed to generate an AES key";
+        failed++;
+        return;
+      }
+      while (running) {
+        bool ok = aes ? AesEncrypt(*client, blob) : GetVersion(*client);
+        ok ? completed++ : failed++;
+      }
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(FLAGS_seconds));
+  running = false;
+  for (auto& thread : clients) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << (FLAGS_multiplexed ? "multiplexed" : "serialized") << " "
+            << FLAGS_operation << ": " << FLAGS_clients << " clients, "
+            << completed << " ops in " << elapsed.count() << "s, "
+            << completed / elapsed.count() << " ops/sec, " << failed
+            << " failures\n";
+
+  server_fd->Shutdown(SHUT_RDWR);
+  client_fd->Shutdown(SHUT_RDWR);
+  client.reset();
+  server_thread.join();
+  return failed == 0 ? 0 : 1;
+}
+
+}  // namespace
+}  // namespace cuttlefish
+
+int main(int argc, char** argv) {
+  return cuttlefish::KeymasterLoadTestMain(argc, argv);
+}
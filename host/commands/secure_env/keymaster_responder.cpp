@@ -19,6 +19,14 @@
 #include <keymaster/android_keymaster_messages.h>
 
 namespace cuttlefish {
+namespace {
+
+std::unique_lock<std::mutex> LockIfSet(std::mutex* mutex) {
+  return mutex ? std::unique_lock<std::mutex>(*mutex)
+               : std::unique_lock<std::mutex>();
+}
+
+}  // namespace
 
 KeymasterResponder::KeymasterResponder(cuttlefish::KeymasterChannel& channel,
                                        keymaster::AndroidKeymaster& keymaster)
@@ -30,20 +38,41 @@ bool KeymasterResponder::ProcessMessage() {
     LOG(ERROR) << "Could not receive message";
     return false;
   }
-  const uint8_t* buffer = request->payload;
-  const uint8_t* end = request->payload + request->payload_size;
-  switch (request->cmd) {
+  return HandleKeymasterRequest(
+      keymaster_, *request,
+      [this](AndroidKeymasterCommand command,
+             const keymaster::Serializable& response) {
+        return channel_.SendResponse(command, response);
+      });
+}
+
+bool HandleKeymasterRequest(keymaster::AndroidKeymaster& keymaster,
+                            const keymaster_message& request,
+                            const KeymasterResponseSender& send_response,
+                            std::mutex* keymaster_mutex) {
+  // GetVersion2 can renegotiate the version, so it is read under the lock too.
+  int32_t version;
+  {
+    auto lock = LockIfSet(keymaster_mutex);
+    version = keymaster.message_version();
+  }
+  const uint8_t* buffer = request.payload;
+  const uint8_t* end = request.payload + request.payload_size;
+  switch (request.cmd) {
     using namespace keymaster;
 #define HANDLE_MESSAGE(ENUM_NAME, METHOD_NAME)                       \
   case ENUM_NAME: {                                                  \
-    METHOD_NAME##Request request(keymaster_.message_version());      \
+    METHOD_NAME##Request request(version);                           \
     if (!request.Deserialize(&buffer, end)) {                        \
       LOG(ERROR) << "Failed to deserialize " #METHOD_NAME "Request"; \
       return false;                                                  \
     }                                                                \
-    METHOD_NAME##Response response(keymaster_.message_version());    \
-    keymaster_.METHOD_NAME(request, &response);                      \
-    return channel_.SendResponse(ENUM_NAME, response);               \
+    METHOD_NAME##Response response(version);                         \
+    {                                                                \
+      auto lock = LockIfSet(keymaster_mutex);                        \
+      keymaster.METHOD_NAME(request, &response);                     \
+    }                                                                \
+    return send_response(ENUM_NAME, response);                       \
   }
     HANDLE_MESSAGE(GENERATE_KEY, GenerateKey)
     HANDLE_MESSAGE(BEGIN_OPERATION, BeginOperation)
@@ -73,13 +102,16 @@ bool KeymasterResponder::ProcessMessage() {
 #undef HANDLE_MESSAGE
 #define HANDLE_MESSAGE_W_RETURN(ENUM_NAME, METHOD_NAME)              \
   case ENUM_NAME: {                                                  \
-    METHOD_NAME##Request request(keymaster_.message_version());      \
+    METHOD_NAME##Request request(version);                           \
     if (!request.Deserialize(&buffer, end)) {                        \
       LOG(ERROR) << "Failed to deserialize " #METHOD_NAME "Request"; \
       return false;                                                  \
     }                                                                \
-    auto response = keymaster_.METHOD_NAME(request);                 \
-    return channel_.SendResponse(ENUM_NAME, response);               \
+    auto response = [&]() {                                          \
+      auto lock = LockIfSet(keymaster_mutex);                        \
+      return keymaster.METHOD_NAME(request);                         \
+    }();                                                             \
+    return send_response(ENUM_NAME, response);                       \
   }
     HANDLE_MESSAGE_W_RETURN(COMPUTE_SHARED_HMAC, ComputeSharedHmac)
     HANDLE_MESSAGE_W_RETURN(VERIFY_AUTHORIZATION, VerifyAuthorization)
@@ -96,8 +128,11 @@ bool KeymasterResponder::ProcessMessage() {
 #undef HANDLE_MESSAGE_W_RETURN
 #define HANDLE_MESSAGE_W_RETURN_NO_ARG(ENUM_NAME, METHOD_NAME) \
   case ENUM_NAME: {                                            \
-    auto response = keymaster_.METHOD_NAME();                  \
-    return channel_.SendResponse(ENUM_NAME, response);         \
+    auto response = [&]() {                                    \
+      auto lock = LockIfSet(keymaster_mutex);                  \
+      return keymaster.METHOD_NAME();                          \
+    }();                                                       \
+    return send_response(ENUM_NAME, response);                 \
   }
     HANDLE_MESSAGE_W_RETURN_NO_ARG(GET_HMAC_SHARING_PARAMETERS,
                                    GetHmacSharingParameters)
@@ -105,20 +140,22 @@ bool KeymasterResponder::ProcessMessage() {
     HANDLE_MESSAGE_W_RETURN_NO_ARG(GET_HW_INFO, GetHwInfo)
 #undef HANDLE_MESSAGE_W_RETURN_NO_ARG
     case ADD_RNG_ENTROPY: {
-      AddEntropyRequest request(keymaster_.message_version());
+      AddEntropyRequest request(version);
       if (!request.Deserialize(&buffer, end)) {
         LOG(ERROR) << "Failed to deserialize AddEntropyRequest";
         return false;
       }
-      AddEntropyResponse response(keymaster_.message_version());
-      ;
-      keymaster_.AddRngEntropy(request, &response);
-      return channel_.SendResponse(ADD_RNG_ENTROPY, response);
+      AddEntropyResponse response(version);
+      {
+        auto lock = LockIfSet(keymaster_mutex);
+        keymaster.AddRngEntropy(request, &response);
+      }
+      return send_response(ADD_RNG_ENTROPY, response);
     }
     case DESTROY_ATTESTATION_IDS:
       // Cuttlefish doesn't support ID attestation.
     default:
-      LOG(ERROR) << "Unknown request type: " << request->cmd;
+      LOG(ERROR) << "Unknown request type: " << request.cmd;
       return false;
   }
 }
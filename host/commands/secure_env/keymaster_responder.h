@@ -15,12 +15,31 @@
 
 #pragma once
 
+#include <functional>
+#include <mutex>
+
 #include <keymaster/android_keymaster.h>
 
 #include "common/libs/security/keymaster_channel.h"
 
 namespace cuttlefish {
 
+using KeymasterResponseSender = std::function<bool(
+    AndroidKeymasterCommand, const keymaster::Serializable&)>;
+
+/**
+ * Deserializes `request`, runs it against `keymaster` and passes the result to
+ * `send_response`. Returns false if the request is malformed or the response
+ * could not be sent.
+ *
+ * When `keymaster_mutex` is set it is only held while `keymaster` is used, so
+ * other threads can (de)serialize their messages in the meantime.
+ */
+bool HandleKeymasterRequest(keymaster::AndroidKeymaster& keymaster,
+                            const keymaster_message& request,
+                            const KeymasterResponseSender& send_response,
+                            std::mutex* keymaster_mutex = nullptr);
+
 class KeymasterResponder {
  private:
   cuttlefish::KeymasterChannel& channel_;
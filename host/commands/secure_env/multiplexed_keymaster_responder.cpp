@@ -0,0 +1,95 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/secure_env/multiplexed_keymaster_responder.h"
+
+#include <android-base/logging.h>
+#include <keymaster/android_keymaster_messages.h>
+#include <keymaster/serializable.h>
+
+#include "host/commands/secure_env/keymaster_responder.h"
+
+namespace cuttlefish {
+
+MultiplexedKeymasterResponder::MultiplexedKeymasterResponder(
+    SharedFdMultiplexedKeymasterChannel& channel,
+    keymaster::AndroidKeymaster& keymaster, std::size_t num_workers)
+    : channel_(channel), keymaster_(keymaster) {
+  CHECK(num_workers > 0) << "Need at least one keymaster worker";
+  for (std::size_t i = 0; i < num_workers; i++) {
+    workers_.emplace_back([this]() { WorkerLoop(); });
+  }
+}
+
+MultiplexedKeymasterResponder::~MultiplexedKeymasterResponder() {
+  // An empty message tells a worker to exit.
+  for (std::size_t i = 0; i < workers_.size(); i++) {
+    requests_.Push(MultiplexedKeymasterMessage{});
+  }
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void MultiplexedKeymasterResponder::ProcessMessages() {
+  while (true) {
+    auto request = channel_.ReceiveMessage();
+    if (!request.message) {
+      LOG(ERROR) << "Could not receive message";
+      return;
+    }
+    requests_.Push(std::move(request));
+  }
+}
+
+void MultiplexedKeymasterResponder::WorkerLoop() {
+  while (true) {
+    auto request = requests_.Pop();
+    if (!request.message) {
+      return;
+    }
+    Handle(request);
+  }
+}
+
+void MultiplexedKeymasterResponder::Handle(
+    const MultiplexedKeymasterMessage& request) {
+  AndroidKeymasterCommand response_command = request.message->cmd;
+  std::vector<std::uint8_t> response;
+  bool handled = HandleKeymasterRequest(
+      keymaster_, *request.message,
+      [&response_command, &response](AndroidKeymasterCommand command,
+                                     const keymaster::Serializable& message) {
+        response_command = command;
+        response.resize(message.SerializedSize());
+        message.Serialize(response.data(), response.data() + response.size());
+        return true;
+      },
+      &keymaster_mutex_);
+  if (!handled) {
+    LOG(ERROR) << "Failed to handle keymaster request " << request.request_id;
+    // The client waits for a response to every request. A serialized
+    // KeymasterResponse that isn't OK carries only its error code.
+    response.resize(sizeof(std::uint32_t));
+    keymaster::append_uint32_to_buf(
+        response.data(), response.data() + response.size(),
+        static_cast<std::uint32_t>(KM_ERROR_INVALID_ARGUMENT));
+  }
+  if (!channel_.SendResponse(request.request_id, response_command, response)) {
+    LOG(ERROR) << "Failed to send keymaster response " << request.request_id;
+  }
+}
+
+}  // namespace cuttlefish
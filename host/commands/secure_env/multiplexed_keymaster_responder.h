@@ -0,0 +1,67 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <keymaster/android_keymaster.h>
+
+#include "common/libs/concurrency/thread_safe_queue.h"
+#include "common/libs/security/keymaster_channel_multiplexed.h"
+
+namespace cuttlefish {
+
+/**
+ * Serves keymaster requests tagged with request ids. Requests are read by the
+ * caller of ProcessMessages and handed to a pool of worker threads, responses
+ * are written back as soon as each one is ready, possibly out of order.
+ *
+ * AndroidKeymaster and the TPM resource manager are not thread safe, so the
+ * calls into `keymaster` are still serialized behind one lock. Messages are
+ * read by a single thread, the workers only overlap deserializing requests and
+ * serializing and writing responses with the keymaster calls of other workers.
+ *
+ * Every request gets a response. Requests that are malformed or not supported
+ * get a KM_ERROR_INVALID_ARGUMENT response.
+ *
+ * Only tests and benchmarks use this: the bootloader and the guest HAL speak
+ * the legacy format, which secure_env serves with KeymasterResponder.
+ */
+class MultiplexedKeymasterResponder {
+ public:
+  MultiplexedKeymasterResponder(SharedFdMultiplexedKeymasterChannel& channel,
+                                keymaster::AndroidKeymaster& keymaster,
+                                std::size_t num_workers);
+  ~MultiplexedKeymasterResponder();
+
+  /** Dispatches requests until the channel fails to read a message. */
+  void ProcessMessages();
+
+ private:
+  void WorkerLoop();
+  void Handle(const MultiplexedKeymasterMessage& request);
+
+  SharedFdMultiplexedKeymasterChannel& channel_;
+  keymaster::AndroidKeymaster& keymaster_;
+  std::mutex keymaster_mutex_;
+  ThreadSafeQueue<MultiplexedKeymasterMessage> requests_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace cuttlefish
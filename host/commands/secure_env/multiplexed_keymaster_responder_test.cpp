@@ -0,0 +1,129 @@
+//
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/commands/secure_env/multiplexed_keymaster_responder.h"
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <keymaster/android_keymaster.h>
+#include <keymaster/contexts/pure_soft_keymaster_context.h>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/security/keymaster_channel_multiplexed.h"
+
+namespace cuttlefish {
+namespace {
+
+const auto kMessageVersion =
+    keymaster::MessageVersion(keymaster::KmVersion::KEYMINT_3, 0);
+
+class MultiplexedKeymasterResponderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &client_fd_,
+                                     &server_fd_));
+    client_ =
+        std::make_unique<MultiplexedKeymasterClient>(client_fd_, client_fd_);
+    server_ = std::thread([this]() {
+      SharedFdMultiplexedKeymasterChannel channel(server_fd_, server_fd_);
+      MultiplexedKeymasterResponder responder(channel, keymaster_, 4);
+      responder.ProcessMessages();
+    });
+  }
+
+  void TearDown() override {
+    // Both the client's receiving thread and the responder stop when the
+    // connection is shut down.
+    client_fd_->Shutdown(SHUT_RDWR);
+    client_.reset();
+    server_.join();
+  }
+
+  template <typename Response>
+  bool Call(AndroidKeymasterCommand command,
+            const keymaster::Serializable& request, Response* response) {
+    auto message = client_->Call(command, request);
+    if (!message) {
+      return false;
+    }
+    const uint8_t* buffer = message->payload;
+    const uint8_t* end = message->payload + message->payload_size;
+    return response->Deserialize(&buffer, end);
+  }
+
+  keymaster::AndroidKeymaster keymaster_{
+      new keymaster::PureSoftKeymasterContext(keymaster::KmVersion::KEYMINT_3,
+                                              KM_SECURITY_LEVEL_SOFTWARE),
+      16, kMessageVersion};
+  SharedFD client_fd_;
+  SharedFD server_fd_;
+  std::thread server_;
+  std::unique_ptr<MultiplexedKeymasterClient> client_;
+};
+
+TEST_F(MultiplexedKeymasterResponderTest, ConcurrentCallsGetResponses) {
+  std::vector<std::thread> callers;
+  std::atomic<int> succeeded = 0;
+  for (int i = 0; i < 8; i++) {
+    callers.emplace_back([this, &succeeded]() {
+      for (int j = 0; j < 10; j++) {
+        keymaster::GetVersion2Request request(kMessageVersion);
+        keymaster::GetVersion2Response response(kMessageVersion);
+        if (Call(keymaster::GET_VERSION_2, request, &response) &&
+            response.error == KM_ERROR_OK) {
+          succeeded++;
+        }
+      }
+    });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(succeeded, 80);
+}
+
+TEST_F(MultiplexedKeymasterResponderTest, UnsupportedRequestGetsError) {
+  // Cuttlefish doesn't support ID attestation, the responder can't handle it.
+  keymaster::GetVersion2Request request(kMessageVersion);
+  keymaster::GetVersion2Response response(kMessageVersion);
+  ASSERT_TRUE(Call(keymaster::DESTROY_ATTESTATION_IDS, request, &response));
+  EXPECT_EQ(response.error, KM_ERROR_INVALID_ARGUMENT);
+}
+
+TEST_F(MultiplexedKeymasterResponderTest, MalformedRequestGetsError) {
+  // An AddEntropyRequest is a length prefixed buffer, a lone byte is too short
+  // for the length.
+  class Truncated : public keymaster::Serializable {
+   public:
+    size_t SerializedSize() const override { return 1; }
+    uint8_t* Serialize(uint8_t* buf, const uint8_t*) const override {
+      *buf = 0xff;
+      return buf + 1;
+    }
+    bool Deserialize(const uint8_t**, const uint8_t*) override { return false; }
+  };
+  keymaster::AddEntropyResponse response(kMessageVersion);
+  ASSERT_TRUE(Call(keymaster::ADD_RNG_ENTROPY, Truncated(), &response));
+  EXPECT_EQ(response.error, KM_ERROR_INVALID_ARGUMENT);
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -29,7 +29,7 @@
 #include "common/libs/utils/flag_parser.h"
 #include "common/libs/utils/result.h"
 #include "common/libs/utils/tee_logging.h"
-#include "host/commands/run_cvd/runner_defs.h"
+#include "host/libs/command_util/launcher_control.h"
 #include "host/libs/command_util/util.h"
 #include "host/libs/config/cuttlefish_config.h"
 
@@ -85,7 +85,8 @@ std::string CalcWebAccessUrl(const WebAccessUrlParam& web_access_url_param) {
 
 Json::Value PopulateDevicesInfoFromInstance(
     const CuttlefishConfig& config,
-    const CuttlefishConfig::InstanceSpecific& instance_config) {
+    const CuttlefishConfig::InstanceSpecific& instance_config,
+    const launcher::InstanceStatus& status) {
   Json::Value device_info;
   std::string device_name = instance_config.webrtc_device_id();
   if (device_name.empty()) {
@@ -107,6 +108,17 @@ Json::Value PopulateDevicesInfoFromInstance(
         std::to_string(instance_config.display_configs()[i].dpi) + " )";
   }
   device_info["status"] = "Running";
+  device_info["uptime_seconds"] = Json::UInt64(status.uptime_ms() / 1000);
+  for (int i = 0; i < status.processes_size(); i++) {
+    const auto& process = status.processes(i);
+    Json::Value process_info;
+    process_info["name"] = process.name();
+    process_info["pid"] = process.pid();
+    process_info["state"] = process.state();
+    process_info["cpu_time_ms"] = Json::UInt64(process.cpu_time_ms());
+    process_info["rss_kb"] = Json::UInt64(process.rss_bytes() / 1024);
+    device_info["processes"][i] = process_info;
+  }
   return device_info;
 }
 
@@ -114,32 +126,47 @@ Result<void> CvdStatusMain(const StatusFlags& flag_values) {
   const CuttlefishConfig* config =
       CF_EXPECT(CuttlefishConfig::Get(), "Failed to obtain config object");
 
-  Json::Value devices_info;
   auto instance_names =
       flag_values.all_instances
           ? config->instance_names()
           : std::vector<std::string>{flag_values.instance_name};
+  // All the launchers are asked before any answer is read, so they work on
+  // their answers at the same time.
+  std::vector<CuttlefishConfig::InstanceSpecific> instance_configs;
+  std::vector<SharedFD> channels;
   for (int index = 0; index < instance_names.size(); index++) {
-    std::string instance_name = instance_names[index];
+    const auto& instance_name = instance_names[index];
     auto instance_config = instance_name.empty()
                                ? config->ForDefaultInstance()
                                : config->ForInstanceName(instance_name);
-    SharedFD monitor_socket = CF_EXPECT(GetLauncherMonitorFromInstance(
+    SharedFD channel = CF_EXPECT(OpenLauncherControlChannel(
         instance_config, flag_values.wait_for_launcher));
 
     LOG(INFO) << "Requesting status for instance "
               << instance_config.instance_name();
-    CF_EXPECT(WriteLauncherAction(monitor_socket, LauncherAction::kStatus));
-    CF_EXPECT(WaitForRead(monitor_socket, flag_values.wait_for_launcher));
-    LauncherResponse status_response =
-        CF_EXPECT(ReadLauncherResponse(monitor_socket));
-    CF_EXPECT(
-        status_response == LauncherResponse::kSuccess,
-        "Received `" << static_cast<char>(status_response)
-                     << "` response from launcher monitor for status request");
-
-    devices_info[index] =
-        PopulateDevicesInfoFromInstance(*config, instance_config);
+    launcher::ControlRequest request;
+    request.set_id(index);
+    request.mutable_status()->set_processes(true);
+    CF_EXPECT(WriteControlMessage(channel, request));
+    instance_configs.emplace_back(std::move(instance_config));
+    channels.emplace_back(std::move(channel));
+  }
+
+  Json::Value devices_info;
+  for (int index = 0; index < channels.size(); index++) {
+    const auto& instance_config = instance_configs[index];
+    CF_EXPECT(WaitForRead(channels[index], flag_values.wait_for_launcher));
+    launcher::ControlResponse response;
+    CF_EXPECT(ReadControlMessage(channels[index], response));
+    CF_EXPECT(response.id() == static_cast<uint64_t>(index),
+              "Unexpected response from launcher monitor for status request");
+    CF_EXPECT(response.error().empty(),
+              "Launcher monitor failed to report status: "
+                  << response.error());
+    CF_EXPECT(response.has_status(), "Launcher monitor sent no status");
+
+    devices_info[index] = PopulateDevicesInfoFromInstance(
+        *config, instance_config, response.status());
     LOG(INFO) << "run_cvd is active for instance "
               << instance_config.instance_name();
   }
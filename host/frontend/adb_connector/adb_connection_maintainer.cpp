@@ -15,15 +15,21 @@
  */
 #include "host/frontend/adb_connector/adb_connection_maintainer.h"
 
+#include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <iomanip>
+#include <optional>
+#include <random>
 #include <sstream>
 #include <string>
 #include <memory>
 #include <vector>
 #include <android-base/logging.h>
+#include <android-base/strings.h>
 
-#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
 
 #include "common/libs/fs/shared_buf.h"
 #include "common/libs/fs/shared_fd.h"
@@ -38,14 +44,6 @@ std::string MakeMessage(const std::string& user_message) {
   return ss.str();
 }
 
-std::string MakeShellUptimeMessage() {
-  return MakeMessage("shell,raw:cut -d. -f1 /proc/uptime");
-}
-
-std::string MakeTransportMessage(const std::string& address) {
-  return MakeMessage("host:transport:" + address);
-}
-
 std::string MakeConnectMessage(const std::string& address) {
   return MakeMessage("host:connect:" + address);
 }
@@ -54,6 +52,10 @@ std::string MakeDisconnectMessage(const std::string& address) {
   return MakeMessage("host:disconnect:" + address);
 }
 
+std::string MakeTrackDevicesMessage() {
+  return MakeMessage("host:track-devices");
+}
+
 // Response will either be OKAY or FAIL
 constexpr char kAdbOkayStatusResponse[] = "OKAY";
 constexpr std::size_t kAdbStatusResponseLength =
@@ -80,109 +82,189 @@ bool AdbSendMessage(const std::string& message) {
   return AdbSendMessage(sock, message);
 }
 
-bool AdbConnect(const std::string& address) {
-  return AdbSendMessage(MakeConnectMessage(address));
-}
-
 bool AdbDisconnect(const std::string& address) {
   return AdbSendMessage(MakeDisconnectMessage(address));
 }
 
-bool IsInteger(const std::string& str) {
+bool IsHexInteger(const std::string& str) {
   return !str.empty() && std::all_of(str.begin(), str.end(),
-                                     [](char c) { return std::isdigit(c); });
+                                     [](char c) { return std::isxdigit(c); });
 }
 
 // assumes the OKAY/FAIL status has already been read
 std::string RecvAdbResponse(const SharedFD& sock) {
   auto length_as_hex_str = RecvAll(sock, kAdbMessageLengthLength);
-  if (!IsInteger(length_as_hex_str)) {
+  if (!IsHexInteger(length_as_hex_str)) {
     return {};
   }
   auto length = std::stoi(length_as_hex_str, nullptr, 16);
   return RecvAll(sock, length);
 }
 
-// Returns a negative value if uptime result couldn't be read for
-// any reason.
-int RecvUptimeResult(const SharedFD& sock) {
-  std::vector<char> uptime_vec{};
-  std::vector<char> just_read(16);
-  do {
-    auto count = sock->Read(just_read.data(), just_read.size());
-    if (count < 0) {
-      LOG(WARNING) << "couldn't receive adb shell output";
-      return -1;
-    }
-    just_read.resize(count);
-    uptime_vec.insert(uptime_vec.end(), just_read.begin(), just_read.end());
-  } while (!just_read.empty());
-
-  if (uptime_vec.empty()) {
-    LOG(WARNING) << "empty adb shell result";
-    return -1;
+// The adb server answers OKAY whether or not it reached the device, the
+// message that follows tells which.
+bool AdbConnect(const std::string& address) {
+  auto sock = SharedFD::SocketLocalClient(kAdbDaemonPort, SOCK_STREAM);
+  if (!AdbSendMessage(sock, MakeConnectMessage(address))) {
+    return false;
   }
+  auto response = RecvAdbResponse(sock);
+  if (!android::base::StartsWith(response, "connected to") &&
+      !android::base::StartsWith(response, "already connected to")) {
+    LOG(DEBUG) << "Failed to connect to " << address << ": " << response;
+    return false;
+  }
+  return true;
+}
 
-  uptime_vec.pop_back();
+// The first attempts come quickly after adbd could have started, later ones
+// slow down so a guest that takes long to boot doesn't keep the adb server
+// busy. The jitter keeps the connectors of many instances from retrying in
+// lockstep.
+constexpr std::chrono::milliseconds kMinRetryDelay(250);
+constexpr std::chrono::milliseconds kMaxRetryDelay(5000);
 
-  auto uptime_str = std::string{uptime_vec.data(), uptime_vec.size()};
-  if (!IsInteger(uptime_str)) {
-    LOG(WARNING) << "non-numeric: uptime result: " << uptime_str;
-    return -1;
+class RetryDelay {
+ public:
+  std::chrono::milliseconds Next() {
+    std::uniform_int_distribution<int64_t> jitter(delay_.count() / 2,
+                                                  delay_.count() * 3 / 2);
+    auto next = std::chrono::milliseconds(jitter(random_));
+    delay_ = std::min(delay_ * 2, kMaxRetryDelay);
+    return next;
   }
+  void Reset() { delay_ = kMinRetryDelay; }
 
-  return std::stoi(uptime_str);
-}
+ private:
+  std::chrono::milliseconds delay_ = kMinRetryDelay;
+  std::default_random_engine random_{std::random_device{}()};
+};
 
-// There needs to be a gap between the adb commands, the daemon isn't able to
-// handle the avalanche of requests we would be sending without a sleep. Five
-// seconds is much larger than seems necessary so we should be more than okay.
-static constexpr int kAdbCommandGapTime = 5;
+// How long to wait before reconnecting a device that was connected but shows
+// as offline. The periodic reconnection keeps working without kernel log
+// events, when adbd starting makes it happen sooner.
+constexpr std::chrono::milliseconds kOfflineReconnectInterval(5000);
+// How long an offline device gets to come online after adbd started.
+constexpr std::chrono::milliseconds kOfflineAfterStartGrace(1000);
+// How often adbd started events are checked while waiting on adb.
+constexpr std::chrono::milliseconds kEventCheckInterval(250);
 
-void EstablishConnection(const std::string& address) {
-  LOG(DEBUG) << "Attempting to connect to device with address " << address;
-  while (!AdbConnect(address)) {
-    sleep(kAdbCommandGapTime);
+// The state of `address` in a device list from track-devices, with one
+// "<serial>\t<state>" line per device.
+std::optional<std::string> DeviceState(const std::string& devices,
+                                       const std::string& address) {
+  for (const auto& line : android::base::Split(devices, "\n")) {
+    auto tab = line.find('\t');
+    if (tab != std::string::npos && line.compare(0, tab, address) == 0) {
+      return line.substr(tab + 1);
+    }
   }
-  LOG(DEBUG) << "adb connect message for " << address << " successfully sent";
-  sleep(kAdbCommandGapTime);
+  return std::nullopt;
 }
 
-void WaitForAdbDisconnection(const std::string& address) {
-  // adb daemon doesn't seem to handle quick, successive messages well. The
-  // sleeps stabilize the communication.
+}  // namespace
+
+bool WaitForAdbDisconnection(const std::string& address,
+                             AdbdStartedEvents& adbd_started,
+                             int adb_server_port,
+                             std::chrono::milliseconds offline_timeout) {
   LOG(DEBUG) << "Watching for disconnect on " << address;
+  auto sock = SharedFD::SocketLocalClient(adb_server_port, SOCK_STREAM);
+  if (!AdbSendMessage(sock, MakeTrackDevicesMessage())) {
+    LOG(WARNING) << "track-devices message failed, response body: "
+                 << RecvAdbResponse(sock);
+    return false;
+  }
+  auto starts_seen = adbd_started.Count();
+  auto offline_deadline = std::chrono::steady_clock::now() + offline_timeout;
+  bool online = false;
   while (true) {
-    auto sock = SharedFD::SocketLocalClient(kAdbDaemonPort, SOCK_STREAM);
-    if (!AdbSendMessage(sock, MakeTransportMessage(address))) {
-      LOG(WARNING) << "transport message failed, response body: "
-                   << RecvAdbResponse(sock);
-      break;
+    int timeout = -1;
+    if (!online) {
+      auto now = std::chrono::steady_clock::now();
+      auto starts = adbd_started.Count();
+      if (starts != starts_seen) {
+        starts_seen = starts;
+        offline_deadline =
+            std::min(offline_deadline, now + kOfflineAfterStartGrace);
+      }
+      if (now >= offline_deadline) {
+        LOG(DEBUG) << address << " stayed offline, connecting again";
+        return online;
+      }
+      auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+          offline_deadline - now);
+      timeout = std::min(remaining, kEventCheckInterval).count();
     }
-    if (!AdbSendMessage(sock, MakeShellUptimeMessage())) {
-      LOG(WARNING) << "adb shell uptime message failed";
-      break;
+    PollSharedFd poll_fd{.fd = sock, .events = POLLIN, .revents = 0};
+    int polled = SharedFD::Poll(&poll_fd, 1, timeout);
+    if (polled < 0 && errno == EINTR) {
+      continue;
     }
-
-    auto uptime = RecvUptimeResult(sock);
-    if (uptime < 0) {
-      LOG(WARNING) << "couldn't read uptime result";
-      break;
+    if (polled < 0) {
+      PLOG(WARNING) << "Failed to poll the track-devices socket";
+      return online;
+    }
+    if (polled == 0) {
+      continue;
+    }
+    auto length_as_hex_str = RecvAll(sock, kAdbMessageLengthLength);
+    if (!IsHexInteger(length_as_hex_str)) {
+      LOG(WARNING) << "adb server stopped tracking devices";
+      return online;
+    }
+    auto devices = RecvAll(sock, std::stoi(length_as_hex_str, nullptr, 16));
+    auto state = DeviceState(devices, address);
+    if (!state) {
+      LOG(DEBUG) << address << " is no longer connected";
+      return online;
+    }
+    LOG(VERBOSE) << "device on " << address << " is " << *state;
+    if (*state == "device") {
+      online = true;
+    } else if (online) {
+      return online;
     }
-    LOG(VERBOSE) << "device on " << address << " uptime " << uptime;
-    sleep(kAdbCommandGapTime);
   }
-  LOG(DEBUG) << "Sending adb disconnect";
-  AdbDisconnect(address);
-  sleep(kAdbCommandGapTime);
 }
 
-}  // namespace
+void AdbdStartedEvents::Notify() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    count_++;
+  }
+  cv_.notify_all();
+}
+
+uint64_t AdbdStartedEvents::Count() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return count_;
+}
 
-[[noreturn]] void EstablishAndMaintainConnection(const std::string& address) {
+void AdbdStartedEvents::WaitFor(uint64_t count,
+                                std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mtx_);
+  cv_.wait_for(lock, timeout, [this, count]() { return count_ > count; });
+}
+
+[[noreturn]] void EstablishAndMaintainConnection(
+    const std::string& address, AdbdStartedEvents& adbd_started) {
+  RetryDelay retry_delay;
   while (true) {
-    EstablishConnection(address);
-    WaitForAdbDisconnection(address);
+    auto starts = adbd_started.Count();
+    LOG(DEBUG) << "Attempting to connect to device with address " << address;
+    if (!AdbConnect(address)) {
+      adbd_started.WaitFor(starts, retry_delay.Next());
+      continue;
+    }
+    LOG(DEBUG) << "adb connect message for " << address << " successfully sent";
+    if (WaitForAdbDisconnection(address, adbd_started, kAdbDaemonPort,
+                                kOfflineReconnectInterval)) {
+      retry_delay.Reset();
+    }
+    LOG(DEBUG) << "Sending adb disconnect";
+    AdbDisconnect(address);
+    adbd_started.WaitFor(adbd_started.Count(), retry_delay.Next());
   }
 }
 
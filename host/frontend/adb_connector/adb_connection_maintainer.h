@@ -15,10 +15,41 @@
  */
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
 #include <string>
 
 namespace cuttlefish {
 
-[[noreturn]] void EstablishAndMaintainConnection(const std::string& address);
+// Tells the connection maintainers that adbd started in the guest, so they
+// try to connect right away instead of waiting for their next attempt.
+class AdbdStartedEvents {
+ public:
+  void Notify();
+  // The number of notifications so far.
+  uint64_t Count();
+  // Waits until there are more than `count` notifications or `timeout`
+  // passes.
+  void WaitFor(uint64_t count, std::chrono::milliseconds timeout);
+
+ private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  uint64_t count_ = 0;
+};
+
+// Follows the device on `address` with the track-devices service of the adb
+// server on `adb_server_port` until it goes away or goes offline. A device
+// that is offline from the start is given `offline_timeout`, or a moment once
+// adbd starts, to come online. Returns whether it was online.
+bool WaitForAdbDisconnection(const std::string& address,
+                             AdbdStartedEvents& adbd_started,
+                             int adb_server_port,
+                             std::chrono::milliseconds offline_timeout);
+
+[[noreturn]] void EstablishAndMaintainConnection(
+    const std::string& address, AdbdStartedEvents& adbd_started);
 
 }  // namespace cuttlefish
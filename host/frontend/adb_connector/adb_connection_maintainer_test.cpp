@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/adb_connector/adb_connection_maintainer.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+using std::chrono::milliseconds;
+
+constexpr char kAddress[] = "127.0.0.1:6520";
+
+std::string AdbMessage(const std::string& message) {
+  char length[5];
+  snprintf(length, sizeof(length), "%04zx", message.size());
+  return length + message;
+}
+
+// Plays the adb server, answering a single track-devices request.
+class FakeAdbServer {
+ public:
+  FakeAdbServer() {
+    server_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (server_ < 0 ||
+        bind(server_, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+        listen(server_, 1) != 0 ||
+        getsockname(server_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+      return;
+    }
+    port_ = ntohs(addr.sin_port);
+  }
+  ~FakeAdbServer() {
+    for (int fd : {server_, client_}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  int port() const { return port_; }
+
+  // Accepts the track-devices request and answers it.
+  void AcceptTrackDevices() {
+    client_ = accept(server_, nullptr, nullptr);
+    ASSERT_GE(client_, 0);
+    std::string request(AdbMessage("host:track-devices").size(), '\0');
+    ASSERT_TRUE(
+        android::base::ReadFully(client_, request.data(), request.size()));
+    ASSERT_EQ(request, AdbMessage("host:track-devices"));
+    Send("OKAY");
+  }
+
+  void SendState(const std::string& state) {
+    Send(AdbMessage(std::string(kAddress) + "\t" + state + "\n"));
+  }
+  void SendNoDevices() { Send(AdbMessage("")); }
+
+ private:
+  void Send(const std::string& data) {
+    ASSERT_TRUE(android::base::WriteFully(client_, data.data(), data.size()));
+  }
+
+  int server_ = -1;
+  int client_ = -1;
+  int port_ = -1;
+};
+
+class WaitForAdbDisconnectionTest : public ::testing::Test {
+ protected:
+  void SetUp() override { ASSERT_GT(adb_.port(), 0); }
+
+  // Follows the device in the background, like a connection maintainer.
+  void Wait(milliseconds offline_timeout) {
+    wait_ = std::async(std::launch::async, [this, offline_timeout]() {
+      return WaitForAdbDisconnection(kAddress, adbd_started_, adb_.port(),
+                                     offline_timeout);
+    });
+    adb_.AcceptTrackDevices();
+  }
+
+  AdbdStartedEvents adbd_started_;
+  // Destroyed after the adb server, whose closed connection ends the wait
+  // even when a test fails.
+  std::future<bool> wait_;
+  FakeAdbServer adb_;
+};
+
+TEST_F(WaitForAdbDisconnectionTest, ReturnsWhenTheDeviceGoesOffline) {
+  Wait(std::chrono::hours(1));
+  adb_.SendState("offline");
+  adb_.SendState("device");
+  // Online devices are followed for as long as they stay online.
+  ASSERT_EQ(wait_.wait_for(milliseconds(300)), std::future_status::timeout);
+
+  adb_.SendState("offline");
+  ASSERT_EQ(wait_.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_TRUE(wait_.get());
+}
+
+TEST_F(WaitForAdbDisconnectionTest, ReturnsWhenTheDeviceGoesAway) {
+  Wait(std::chrono::hours(1));
+  adb_.SendState("device");
+  adb_.SendNoDevices();
+  ASSERT_EQ(wait_.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_TRUE(wait_.get());
+}
+
+// Without kernel log events, e.g. when there is no --events_fd, a device that
+// never comes online is still connected again periodically.
+TEST_F(WaitForAdbDisconnectionTest, GivesUpOnOfflineDevicesWithoutEvents) {
+  auto start = std::chrono::steady_clock::now();
+  Wait(milliseconds(200));
+  adb_.SendState("offline");
+  ASSERT_EQ(wait_.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_FALSE(wait_.get());
+  EXPECT_GE(std::chrono::steady_clock::now() - start, milliseconds(200));
+}
+
+TEST_F(WaitForAdbDisconnectionTest, GivesUpOnOfflineDevicesSoonAfterAdbd) {
+  Wait(std::chrono::hours(1));
+  adb_.SendState("offline");
+  ASSERT_EQ(wait_.wait_for(milliseconds(300)), std::future_status::timeout);
+
+  adbd_started_.Notify();
+  ASSERT_EQ(wait_.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_FALSE(wait_.get());
+}
+
+TEST_F(WaitForAdbDisconnectionTest, IgnoresAdbdStartsWhileOnline) {
+  Wait(std::chrono::hours(1));
+  adb_.SendState("device");
+  ASSERT_EQ(wait_.wait_for(milliseconds(300)), std::future_status::timeout);
+  adbd_started_.Notify();
+  ASSERT_EQ(wait_.wait_for(milliseconds(1500)), std::future_status::timeout);
+
+  adb_.SendNoDevices();
+  ASSERT_EQ(wait_.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_TRUE(wait_.get());
+}
+
+TEST(AdbdStartedEventsTest, WakesWaitersOnNewStartsOnly) {
+  AdbdStartedEvents events;
+  events.Notify();
+  auto count = events.Count();
+  EXPECT_EQ(count, 1);
+
+  auto start = std::chrono::steady_clock::now();
+  events.WaitFor(count, milliseconds(100));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, milliseconds(100));
+
+  auto waiter = std::async(std::launch::async, [&events, count]() {
+    events.WaitFor(count, std::chrono::hours(1));
+  });
+  events.Notify();
+  ASSERT_EQ(waiter.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  EXPECT_EQ(events.Count(), 2);
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -15,6 +15,8 @@
  */
 
 #include <algorithm>
+#include <cerrno>
+#include <functional>
 #include <iterator>
 #include <limits>
 #include <sstream>
@@ -35,11 +37,49 @@
 
 DEFINE_string(addresses, "", "Comma-separated list of addresses to "
                              "'adb connect' to");
+DEFINE_int32(events_fd, -1, "A file descriptor of kernel log events, used to "
+                            "connect as soon as adbd starts");
 
 namespace cuttlefish {
 namespace {
-void LaunchConnectionMaintainerThread(const std::string& address) {
-  std::thread(EstablishAndMaintainConnection, address).detach();
+void LaunchConnectionMaintainerThread(const std::string& address,
+                                      AdbdStartedEvents& adbd_started) {
+  std::thread(EstablishAndMaintainConnection, address,
+              std::ref(adbd_started))
+      .detach();
+}
+
+// The kernel log monitor blocks once the pipe is full, so what can't be
+// parsed is still read until the monitor closes its end. The connection
+// maintainers fall back to retrying with backoff.
+void DrainEvents(SharedFD events) {
+  char buffer[4096];
+  while (true) {
+    auto read = events->Read(buffer, sizeof(buffer));
+    if (read == 0 || (read < 0 && events->GetErrno() != EINTR)) {
+      return;
+    }
+  }
+}
+
+void LaunchEventsThread(AdbdStartedEvents& adbd_started) {
+  auto events = SharedFD::Dup(FLAGS_events_fd);
+  close(FLAGS_events_fd);
+  std::thread([events, &adbd_started]() {
+    while (events->IsOpen()) {
+      auto event = monitor::ReadEvent(events);
+      if (!event) {
+        LOG(ERROR) << "Failed to read a complete kernel log event, ignoring "
+                   << "further events";
+        DrainEvents(events);
+        return;
+      }
+      if (event->event == monitor::Event::AdbdStarted) {
+        LOG(DEBUG) << "adbd started";
+        adbd_started.Notify();
+      }
+    }
+  }).detach();
 }
 
 std::vector<std::string> ParseAddressList(std::string ports) {
@@ -62,8 +102,12 @@ int AdbConnectorMain(int argc, char* argv[]) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
   CHECK(!FLAGS_addresses.empty()) << "Must specify --addresses flag";
 
+  static AdbdStartedEvents adbd_started;
+  if (FLAGS_events_fd >= 0) {
+    LaunchEventsThread(adbd_started);
+  }
   for (const auto& address : ParseAddressList(FLAGS_addresses)) {
-    LaunchConnectionMaintainerThread(address);
+    LaunchConnectionMaintainerThread(address, adbd_started);
   }
 
   SleepForever();
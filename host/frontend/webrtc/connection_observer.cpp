@@ -20,13 +20,16 @@
 
 #include <linux/input.h>
 
+#include <algorithm>
 #include <chrono>
 #include <map>
 #include <set>
 #include <thread>
 #include <vector>
 
+#include <api/units/time_delta.h>
 #include <json/json.h>
+#include <rtc_base/thread.h>
 
 #include <android-base/logging.h>
 #include <gflags/gflags.h>
@@ -39,12 +42,16 @@
 #include "host/frontend/webrtc/kml_locations_handler.h"
 #include "host/frontend/webrtc/libdevice/camera_controller.h"
 #include "host/frontend/webrtc/location_handler.h"
+#include "host/frontend/webrtc/touch_coalescer.h"
 #include "host/libs/config/cuttlefish_config.h"
 
 DECLARE_bool(write_virtio_input);
 
 namespace cuttlefish {
 
+// Pointer moves are written to the device at most this often.
+constexpr std::chrono::milliseconds kTouchMoveInterval(16);
+
 // TODO (b/147511234): de-dup this from vnc server and here
 struct virtio_input_event {
   uint16_t type;
@@ -114,7 +121,18 @@ class ConnectionObserverImpl
         commands_to_custom_action_servers_(commands_to_custom_action_servers),
         weak_display_handler_(display_handler),
         camera_controller_(camera_controller),
-        confui_input_(confui_input) {}
+        confui_input_(confui_input),
+        touch_move_coalescer_(
+            kTouchMoveInterval,
+            [this](const std::string &display_label,
+                   const std::vector<TouchMoveCoalescer::MultiTouchPoint>
+                       &points) { WriteTouchMoves(display_label, points); },
+            [](std::chrono::milliseconds delay, std::function<void()> task) {
+              // Input events arrive on webrtc's signaling thread, the pending
+              // moves are written from there too.
+              rtc::Thread::Current()->PostDelayedTask(
+                  std::move(task), webrtc::TimeDelta::Millis(delay.count()));
+            }) {}
   virtual ~ConnectionObserverImpl() {
     auto display_handler = weak_display_handler_.lock();
     if (kernel_log_subscription_id_ != -1) {
@@ -151,6 +169,7 @@ class ConnectionObserverImpl
       }
       return;
     }
+    touch_move_coalescer_.Flush();
     auto buffer = GetEventBuffer();
     if (!buffer) {
       LOG(ERROR) << "Failed to allocate event buffer";
@@ -165,20 +184,29 @@ class ConnectionObserverImpl
                          buffer->size());
   }
 
-  void OnMultiTouchEvent(const std::string &display_label, Json::Value id,
-                         Json::Value slot, Json::Value x, Json::Value y,
-                         bool down, int size) {
+  void OnMultiTouchEvent(
+      const std::string &display_label,
+      const std::vector<webrtc_streaming::MultiTouchPoint> &points,
+      bool down) override {
+    if (!confui_input_.IsConfUiActive() && IsTouchMove(points, down)) {
+      for (const auto &point : points) {
+        touch_move_coalescer_.Move(display_label, point);
+      }
+      return;
+    }
+    touch_move_coalescer_.Flush();
+
     auto buffer = GetEventBuffer();
     if (!buffer) {
       LOG(ERROR) << "Failed to allocate event buffer";
       return;
     }
 
-    for (int i = 0; i < size; i++) {
-      auto this_slot = slot[i].asInt();
-      auto this_id = id[i].asInt();
-      auto this_x = x[i].asInt();
-      auto this_y = y[i].asInt();
+    for (const auto &point : points) {
+      auto this_slot = point.slot;
+      auto this_id = point.id;
+      auto this_x = point.x;
+      auto this_y = point.y;
 
       if (confui_input_.IsConfUiActive()) {
         if (down) {
@@ -395,6 +423,38 @@ class ConnectionObserverImpl
   }
 
  private:
+  // Whether all the contacts are down already, so the event only moves them.
+  bool IsTouchMove(
+      const std::vector<webrtc_streaming::MultiTouchPoint> &points,
+      bool down) const {
+    return down && std::all_of(points.begin(), points.end(),
+                               [this](const auto &point) {
+                                 return active_touch_slots_.count(point.slot);
+                               });
+  }
+
+  void WriteTouchMoves(
+      const std::string &display_label,
+      const std::vector<webrtc_streaming::MultiTouchPoint> &points) {
+    auto buffer = GetEventBuffer();
+    if (!buffer) {
+      LOG(ERROR) << "Failed to allocate event buffer";
+      return;
+    }
+    for (const auto &point : points) {
+      buffer->AddEvent(EV_ABS, ABS_MT_SLOT, point.slot);
+      buffer->AddEvent(EV_ABS, ABS_MT_POSITION_X, point.x);
+      buffer->AddEvent(EV_ABS, ABS_MT_POSITION_Y, point.y);
+      // send ABS_X and ABS_Y for single-touch compatibility
+      buffer->AddEvent(EV_ABS, ABS_X, point.x);
+      buffer->AddEvent(EV_ABS, ABS_Y, point.y);
+    }
+    buffer->AddEvent(EV_SYN, SYN_REPORT, 0);
+    cuttlefish::WriteAll(input_sockets_.GetTouchClientByLabel(display_label),
+                         reinterpret_cast<const char *>(buffer->data()),
+                         buffer->size());
+  }
+
   cuttlefish::InputSockets& input_sockets_;
   cuttlefish::KernelLogEventsHandler* kernel_log_events_handler_;
   int kernel_log_subscription_id_ = -1;
@@ -412,6 +472,8 @@ class ConnectionObserverImpl
   std::set<int32_t> active_touch_slots_;
   cuttlefish::CameraController *camera_controller_;
   cuttlefish::confui::HostVirtualInput &confui_input_;
+  // Last, so its final flush happens before anything it uses is destroyed.
+  TouchMoveCoalescer touch_move_coalescer_;
 };
 
 CfConnectionObserverFactory::CfConnectionObserverFactory(
@@ -26,8 +26,11 @@
 
 namespace cuttlefish {
 DisplayHandler::DisplayHandler(webrtc_streaming::Streamer& streamer,
-                               ScreenConnector& screen_connector)
-    : streamer_(streamer), screen_connector_(screen_connector) {
+                               ScreenConnector& screen_connector,
+                               FrameExporter* frame_exporter)
+    : streamer_(streamer),
+      screen_connector_(screen_connector),
+      frame_exporter_(frame_exporter) {
   screen_connector_.SetCallback(std::move(GetScreenConnectorCallback()));
   screen_connector_.SetDisplayEventCallback([this](const DisplayEvent& event) {
     std::visit(
@@ -49,6 +52,10 @@ DisplayHandler::DisplayHandler(webrtc_streaming::Streamer& streamer,
             }
 
             display_sinks_[display_number] = display;
+            if (frame_exporter_) {
+              frame_exporter_->AddDisplay(display_number, e.display_width,
+                                          e.display_height);
+            }
           } else if constexpr (std::is_same_v<DisplayDestroyedEvent, T>) {
             LOG(VERBOSE) << "Display:" << e.display_number << " destroyed.";
 
@@ -57,6 +64,9 @@ DisplayHandler::DisplayHandler(webrtc_streaming::Streamer& streamer,
                 "display_" + std::to_string(e.display_number);
             streamer_.RemoveDisplay(display_id);
             display_sinks_.erase(display_number);
+            if (frame_exporter_) {
+              frame_exporter_->RemoveDisplay(display_number);
+            }
           } else {
             static_assert("Unhandled display event.");
           }
@@ -68,7 +78,7 @@ DisplayHandler::DisplayHandler(webrtc_streaming::Streamer& streamer,
 DisplayHandler::GenerateProcessedFrameCallback DisplayHandler::GetScreenConnectorCallback() {
     // only to tell the producer how to create a ProcessedFrame to cache into the queue
     DisplayHandler::GenerateProcessedFrameCallback callback =
-        [](std::uint32_t display_number, std::uint32_t frame_width,
+        [this](std::uint32_t display_number, std::uint32_t frame_width,
            std::uint32_t frame_height, std::uint32_t frame_stride_bytes,
            std::uint8_t* frame_pixels,
            WebRtcScProcessedFrame& processed_frame) {
@@ -80,6 +90,12 @@ DisplayHandler::GenerateProcessedFrameCallback DisplayHandler::GetScreenConnecto
               processed_frame.buf_->StrideY(), processed_frame.buf_->DataU(),
               processed_frame.buf_->StrideU(), processed_frame.buf_->DataV(),
               processed_frame.buf_->StrideV(), frame_width, frame_height);
+          if (frame_exporter_) {
+            // The guest's buffer is only valid during this call.
+            frame_exporter_->OnFrame(display_number, frame_pixels,
+                                     frame_stride_bytes,
+                                     *processed_frame.buf_);
+          }
           processed_frame.is_success_ = true;
         };
     return callback;
@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "host/frontend/webrtc/cvd_video_frame_buffer.h"
+#include "host/frontend/webrtc/frame_exporter.h"
 #include "host/frontend/webrtc/libdevice/video_sink.h"
 #include "host/libs/screen_connector/screen_connector.h"
 
@@ -57,8 +58,10 @@ class DisplayHandler {
   using GenerateProcessedFrameCallback = ScreenConnector::GenerateProcessedFrameCallback;
   using WebRtcScProcessedFrame = cuttlefish::WebRtcScProcessedFrame;
 
+  // Frames are also handed to `frame_exporter` when there is one.
   DisplayHandler(webrtc_streaming::Streamer& streamer,
-                 ScreenConnector& screen_connector);
+                 ScreenConnector& screen_connector,
+                 FrameExporter* frame_exporter = nullptr);
   ~DisplayHandler() = default;
 
   [[noreturn]] void Loop();
@@ -70,6 +73,7 @@ class DisplayHandler {
       display_sinks_;
   webrtc_streaming::Streamer& streamer_;
   ScreenConnector& screen_connector_;
+  FrameExporter* frame_exporter_;
   std::shared_ptr<webrtc_streaming::VideoFrameBuffer> last_buffer_;
   std::uint32_t last_buffer_display_ = 0;
   std::mutex last_buffer_mutex_;
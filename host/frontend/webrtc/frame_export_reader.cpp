@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/frame_export_reader.h"
+
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cerrno>
+#include <thread>
+#include <utility>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_select.h"
+#include "common/libs/utils/unix_sockets.h"
+
+namespace cuttlefish {
+namespace {
+
+// The writer has to lap the whole ring during each of these copies for the
+// read to fail.
+constexpr int kMaxReadAttempts = 100;
+
+}  // namespace
+
+Result<std::unique_ptr<FrameExportReader>> FrameExportReader::Connect(
+    SharedFD connection, uint32_t display_number) {
+  CF_EXPECT(WriteAllBinary(connection, &display_number) ==
+                sizeof(display_number),
+            "Failed to send frame export request: " << connection->StrError());
+  auto message = CF_EXPECT(UnixMessageSocket(connection).ReadMessage());
+  FrameExportResponse response;
+  CF_EXPECT(message.data.size() == sizeof(response),
+            "Unexpected frame export response of " << message.data.size()
+                                                   << " bytes");
+  memcpy(&response, message.data.data(), sizeof(response));
+  CF_EXPECT(response.error == 0,
+            "Frame export request failed: " << strerror(response.error));
+  auto fds = CF_EXPECT(message.FileDescriptors());
+  CF_EXPECT(fds.size() == 2, "Expected a memfd and an eventfd, got "
+                                 << fds.size() << " file descriptors");
+  auto memfd = fds[0];
+
+  struct stat st;
+  CF_EXPECT(memfd->Fstat(&st) == 0,
+            "Failed to stat frame export memfd: " << memfd->StrError());
+  size_t size = st.st_size;
+  CF_EXPECT(size >= sizeof(FrameExportHeader), "Frame export memfd too small");
+  auto mapping = memfd->MMap(nullptr, size, PROT_READ, MAP_SHARED, 0);
+  CF_EXPECT(mapping, "Failed to map frame export memfd: " << memfd->StrError());
+  auto header = static_cast<const FrameExportHeader*>(mapping.get());
+  CF_EXPECT(header->magic == FrameExportHeader::kMagic,
+            "Not a frame export memfd");
+  CF_EXPECT(header->version == FrameExportHeader::kVersion,
+            "Unsupported frame export version " << header->version);
+  CF_EXPECT(header->slot_count > 0 &&
+                header->slot_size >= sizeof(FrameExportSlot) &&
+                mapping.WithinBounds(header->slot_offset,
+                                     header->slot_count * header->slot_size),
+            "Frame export slots don't fit in the memfd");
+  return std::unique_ptr<FrameExportReader>(
+      new FrameExportReader(connection, fds[1], std::move(mapping)));
+}
+
+FrameExportReader::FrameExportReader(SharedFD connection, SharedFD event,
+                                     ScopedMMap mapping)
+    : connection_(connection),
+      event_(event),
+      mapping_(std::move(mapping)),
+      header_(static_cast<const FrameExportHeader*>(mapping_.get())) {}
+
+bool FrameExportReader::Active() const {
+  return header_->active.load(std::memory_order_acquire) != 0;
+}
+
+Result<void> FrameExportReader::WaitForFrame() {
+  SharedFDSet read_set;
+  read_set.Set(event_);
+  CF_EXPECT(Select(&read_set, nullptr, nullptr, nullptr) >= 0,
+            "Failed to wait for a frame: " << event_->StrError());
+  // The eventfd is non blocking, another thread may have consumed the signal.
+  eventfd_t value;
+  if (event_->EventfdRead(&value) < 0) {
+    CF_EXPECT(event_->GetErrno() == EAGAIN,
+              "Failed to read frame export event: " << event_->StrError());
+  }
+  return {};
+}
+
+const FrameExportSlot* FrameExportReader::Slot(uint64_t frame_number) const {
+  auto base = static_cast<const uint8_t*>(mapping_.get());
+  return reinterpret_cast<const FrameExportSlot*>(
+      base + header_->slot_offset +
+      (frame_number % header_->slot_count) * header_->slot_size);
+}
+
+Result<bool> FrameExportReader::ReadLatest(Frame& frame) {
+  frame.data.resize(header_->slot_size);
+  for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+    if (attempt > 0) {
+      // Let the writer finish the frame it's on.
+      std::this_thread::yield();
+    }
+    auto number = header_->latest_frame.load(std::memory_order_acquire);
+    if (number == 0) {
+      return false;
+    }
+    auto slot = Slot(number);
+    auto before = slot->sequence.load(std::memory_order_acquire);
+    if (before % 2 != 0) {
+      continue;
+    }
+    memcpy(frame.data.data(), slot, header_->slot_size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->sequence.load(std::memory_order_relaxed) != before) {
+      continue;
+    }
+    // Only the copy is trusted. It may hold a frame newer than `number` if
+    // the writer lapped the ring before the sequence was loaded.
+    FrameExportSlot copy;
+    memcpy(static_cast<void*>(&copy), frame.data.data(), sizeof(copy));
+    frame.number = copy.frame_number;
+    frame.timestamp_us = copy.timestamp_us;
+    frame.width = copy.width;
+    frame.height = copy.height;
+    for (int i = 0; i < 3; i++) {
+      frame.plane_offsets[i] = copy.plane_offsets[i];
+      frame.plane_strides[i] = copy.plane_strides[i];
+    }
+    return true;
+  }
+  return CF_ERR("Frame export slots kept being overwritten while read");
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/result.h"
+#include "host/frontend/webrtc/frame_exporter.h"
+
+namespace cuttlefish {
+
+// The client side of the frame export protocol described in
+// frame_exporter.h.
+class FrameExportReader {
+ public:
+  struct Frame {
+    uint64_t number = 0;
+    // Microseconds since the epoch.
+    int64_t timestamp_us = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Offsets into data. RGBA frames only use the first plane.
+    uint32_t plane_offsets[3] = {};
+    uint32_t plane_strides[3] = {};
+    std::vector<uint8_t> data;
+
+    const uint8_t* Plane(int index) const {
+      return data.data() + plane_offsets[index];
+    }
+  };
+
+  // Sends the request for `display_number` over `connection`, a socket
+  // connected to the frame export socket, and maps the memory in the reply.
+  static Result<std::unique_ptr<FrameExportReader>> Connect(
+      SharedFD connection, uint32_t display_number);
+
+  FrameExportFormat format() const { return header_->format; }
+  uint32_t width() const { return header_->width; }
+  uint32_t height() const { return header_->height; }
+
+  // False once the display is removed.
+  bool Active() const;
+
+  // Blocks until the exporter signals a new frame or the removal of the
+  // display. A signal may cover several frames.
+  Result<void> WaitForFrame();
+
+  // Copies the latest complete frame into `frame`, reusing its buffer.
+  // Returns false until the first frame. A copy torn by the writer moving on
+  // to the same slot is thrown away and the read retried on the next latest
+  // frame, which is only an error if it keeps happening.
+  Result<bool> ReadLatest(Frame& frame);
+
+ private:
+  FrameExportReader(SharedFD connection, SharedFD event, ScopedMMap mapping);
+
+  const FrameExportSlot* Slot(uint64_t frame_number) const;
+
+  // Kept open, the exporter takes a hang up as the client leaving.
+  SharedFD connection_;
+  SharedFD event_;
+  ScopedMMap mapping_;
+  const FrameExportHeader* header_;
+};
+
+}  // namespace cuttlefish
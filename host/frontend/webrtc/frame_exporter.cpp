@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/frame_exporter.h"
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+
+#include <android-base/logging.h>
+#include <libyuv.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_select.h"
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+namespace cuttlefish {
+namespace {
+
+// Enough for a reader to finish with a frame while the next one is written.
+constexpr uint32_t kSlotCount = 3;
+constexpr size_t kPageSize = 4096;
+constexpr size_t kPlaneAlignment = 64;
+
+size_t Align(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Fills in the plane offsets and strides of a slot, returns the slot size.
+size_t LayOutSlot(FrameExportFormat format, uint32_t width, uint32_t height,
+                  FrameExportSlot& slot) {
+  size_t end = sizeof(FrameExportSlot);
+  auto add_plane = [&](int plane, uint32_t stride, uint32_t rows) {
+    auto offset = Align(end, kPlaneAlignment);
+    slot.plane_offsets[plane] = offset;
+    slot.plane_strides[plane] = stride;
+    end = offset + static_cast<size_t>(stride) * rows;
+  };
+  if (format == FrameExportFormat::kRgba) {
+    add_plane(0, width * 4, height);
+  } else {
+    add_plane(0, width, height);
+    add_plane(1, (width + 1) / 2, (height + 1) / 2);
+    add_plane(2, (width + 1) / 2, (height + 1) / 2);
+  }
+  return Align(end, kPageSize);
+}
+
+}  // namespace
+
+FrameExporter::FrameExporter(SharedFD server, FrameExportFormat format)
+    : format_(format),
+      server_(server),
+      eventfd_(SharedFD::Event()),
+      running_(true),
+      serve_thread_([this]() { ServeLoop(); }) {}
+
+FrameExporter::~FrameExporter() {
+  running_ = false;
+  eventfd_->EventfdWrite(1);
+  serve_thread_.join();
+}
+
+std::unique_ptr<FrameExporter::Display> FrameExporter::NewDisplay(
+    uint32_t display_number, uint32_t width, uint32_t height) {
+  FrameExportSlot slot_layout{};
+  auto slot_size = LayOutSlot(format_, width, height, slot_layout);
+  auto slot_offset = Align(sizeof(FrameExportHeader), kPageSize);
+  auto size = slot_offset + kSlotCount * slot_size;
+
+  auto memfd =
+      SharedFD::MemfdCreate("cvd_display_" + std::to_string(display_number),
+                            MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (!memfd->IsOpen()) {
+    LOG(ERROR) << "Failed to create memfd: " << memfd->StrError();
+    return nullptr;
+  }
+  if (memfd->Truncate(size) < 0) {
+    LOG(ERROR) << "Failed to size memfd: " << memfd->StrError();
+    return nullptr;
+  }
+  auto mapping =
+      memfd->MMap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, 0);
+  if (!mapping) {
+    LOG(ERROR) << "Failed to map memfd: " << memfd->StrError();
+    return nullptr;
+  }
+  // Clients get the same file, the seals keep them from writing to it or
+  // resizing it under us. Mappings that already exist stay writable.
+  if (memfd->Fcntl(F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+                                    F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0) {
+    LOG(WARNING) << "Failed to seal memfd, clients will be able to write to "
+                 << "it: " << memfd->StrError();
+  }
+  auto display = std::make_unique<Display>(memfd, std::move(mapping));
+
+  auto base = static_cast<uint8_t*>(display->mapping.get());
+  // The file starts zeroed, which is a valid state for the atomics.
+  auto header = reinterpret_cast<FrameExportHeader*>(base);
+  header->magic = FrameExportHeader::kMagic;
+  header->version = FrameExportHeader::kVersion;
+  header->format = format_;
+  header->width = width;
+  header->height = height;
+  header->slot_count = kSlotCount;
+  header->slot_offset = slot_offset;
+  header->slot_size = slot_size;
+  for (uint32_t i = 0; i < kSlotCount; i++) {
+    auto slot = reinterpret_cast<FrameExportSlot*>(base + slot_offset +
+                                                   i * slot_size);
+    std::copy_n(slot_layout.plane_offsets, 3, slot->plane_offsets);
+    std::copy_n(slot_layout.plane_strides, 3, slot->plane_strides);
+  }
+  header->active.store(1, std::memory_order_release);
+  return display;
+}
+
+void FrameExporter::AddDisplay(uint32_t display_number, uint32_t width,
+                               uint32_t height) {
+  RemoveDisplay(display_number);
+  std::shared_ptr<Display> display = NewDisplay(display_number, width, height);
+  if (!display) {
+    LOG(ERROR) << "Frames of display " << display_number
+               << " won't be exported";
+    return;
+  }
+  std::lock_guard lock(displays_mutex_);
+  displays_[display_number] = display;
+}
+
+void FrameExporter::RemoveDisplay(uint32_t display_number) {
+  std::lock_guard lock(displays_mutex_);
+  auto it = displays_.find(display_number);
+  if (it == displays_.end()) {
+    return;
+  }
+  auto header = static_cast<FrameExportHeader*>(it->second->mapping.get());
+  header->active.store(0, std::memory_order_release);
+  for (auto& [connection, event] : it->second->subscribers) {
+    event->EventfdWrite(1);
+  }
+  displays_.erase(it);
+  // Stop watching the connections of its clients.
+  eventfd_->EventfdWrite(1);
+}
+
+void FrameExporter::OnFrame(uint32_t display_number,
+                            const uint8_t* rgba_pixels, uint32_t rgba_stride,
+                            const CvdVideoFrameBuffer& i420) {
+  std::shared_ptr<Display> display;
+  {
+    std::lock_guard lock(displays_mutex_);
+    auto it = displays_.find(display_number);
+    if (it == displays_.end()) {
+      return;
+    }
+    display = it->second;
+  }
+  WriteFrame(*display, rgba_pixels, rgba_stride, i420);
+  std::lock_guard lock(displays_mutex_);
+  for (auto& [connection, event] : display->subscribers) {
+    event->EventfdWrite(1);
+  }
+}
+
+void FrameExporter::WriteFrame(Display& display, const uint8_t* rgba_pixels,
+                               uint32_t rgba_stride,
+                               const CvdVideoFrameBuffer& i420) {
+  std::lock_guard lock(display.write_mutex);
+  auto base = static_cast<uint8_t*>(display.mapping.get());
+  auto header = reinterpret_cast<FrameExportHeader*>(base);
+  uint32_t width = i420.width();
+  uint32_t height = i420.height();
+  if (width > header->width || height > header->height) {
+    LOG(VERBOSE) << "Not exporting " << width << "x" << height
+                 << " frame larger than its display";
+    return;
+  }
+  auto frame_number =
+      header->latest_frame.load(std::memory_order_relaxed) + 1;
+  auto slot_base = base + header->slot_offset +
+                   (frame_number % header->slot_count) * header->slot_size;
+  auto slot = reinterpret_cast<FrameExportSlot*>(slot_base);
+
+  auto sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->width = width;
+  slot->height = height;
+  slot->frame_number = frame_number;
+  slot->timestamp_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  auto plane = [&](int index) { return slot_base + slot->plane_offsets[index]; };
+  if (format_ == FrameExportFormat::kRgba) {
+    // The byte order doesn't matter for a copy.
+    libyuv::ARGBCopy(rgba_pixels, rgba_stride, plane(0),
+                     slot->plane_strides[0], width, height);
+  } else {
+    libyuv::I420Copy(i420.DataY(), i420.StrideY(), i420.DataU(),
+                     i420.StrideU(), i420.DataV(), i420.StrideV(), plane(0),
+                     slot->plane_strides[0], plane(1), slot->plane_strides[1],
+                     plane(2), slot->plane_strides[2], width, height);
+  }
+
+  slot->sequence.store(sequence + 2, std::memory_order_release);
+  header->latest_frame.store(frame_number, std::memory_order_release);
+}
+
+void FrameExporter::ServeLoop() {
+  CHECK(eventfd_->IsOpen()) << "Failed to create event fd: "
+                            << eventfd_->StrError();
+  // Clients that connected but haven't sent their request yet.
+  std::vector<SharedFD> pending_clients;
+  while (running_) {
+    SharedFDSet read_set;
+    read_set.Set(eventfd_);
+    read_set.Set(server_);
+    for (const auto& client : pending_clients) {
+      read_set.Set(client);
+    }
+    {
+      std::lock_guard lock(displays_mutex_);
+      for (const auto& [display_number, display] : displays_) {
+        for (const auto& [connection, event] : display->subscribers) {
+          read_set.Set(connection);
+        }
+      }
+    }
+    if (Select(&read_set, nullptr, nullptr, nullptr) < 0) {
+      LOG(ERROR) << "Error on select call";
+      break;
+    }
+    if (read_set.IsSet(eventfd_)) {
+      eventfd_t evt;
+      (void)eventfd_->EventfdRead(&evt);
+      continue;
+    }
+    {
+      // Clients don't send anything after their request, so this means they
+      // hung up.
+      std::lock_guard lock(displays_mutex_);
+      for (auto& [display_number, display] : displays_) {
+        auto& subscribers = display->subscribers;
+        subscribers.erase(
+            std::remove_if(subscribers.begin(), subscribers.end(),
+                           [&read_set](const auto& subscriber) {
+                             return read_set.IsSet(subscriber.first);
+                           }),
+            subscribers.end());
+      }
+    }
+    std::vector<SharedFD> still_pending;
+    for (auto& client : pending_clients) {
+      if (read_set.IsSet(client)) {
+        Subscribe(client);
+      } else {
+        still_pending.push_back(client);
+      }
+    }
+    pending_clients = std::move(still_pending);
+    if (read_set.IsSet(server_)) {
+      auto client = SharedFD::Accept(*server_);
+      if (client->IsOpen()) {
+        pending_clients.push_back(client);
+      } else {
+        LOG(ERROR) << "Failed to accept frame export client: "
+                   << client->StrError();
+      }
+    }
+  }
+}
+
+void FrameExporter::Subscribe(SharedFD client) {
+  uint32_t display_number;
+  if (ReadExactBinary(client, &display_number) != sizeof(display_number)) {
+    LOG(ERROR) << "Failed to read frame export request: "
+               << client->StrError();
+    return;
+  }
+  FrameExportResponse response{.error = 0};
+  std::lock_guard lock(displays_mutex_);
+  auto it = displays_.find(display_number);
+  if (it == displays_.end()) {
+    response.error = ENOENT;
+    WriteAllBinary(client, &response);
+    return;
+  }
+  auto event = SharedFD::Event(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (!event->IsOpen()) {
+    LOG(ERROR) << "Failed to create event fd: " << event->StrError();
+    response.error = event->GetErrno();
+    WriteAllBinary(client, &response);
+    return;
+  }
+  if (client->SendFileDescriptors(&response, sizeof(response),
+                                  it->second->memfd, event) < 0) {
+    LOG(ERROR) << "Failed to send frame export fds: " << client->StrError();
+    return;
+  }
+  it->second->subscribers.emplace_back(client, event);
+}
+
+std::optional<FrameExportFormat> ParseFrameExportFormat(
+    const std::string& name) {
+  if (name == "i420") {
+    return FrameExportFormat::kI420;
+  } else if (name == "rgba") {
+    return FrameExportFormat::kRgba;
+  }
+  return std::nullopt;
+}
+
+}  // namespace cuttlefish
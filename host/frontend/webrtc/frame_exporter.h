@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/libs/fs/shared_fd.h"
+#include "host/frontend/webrtc/cvd_video_frame_buffer.h"
+
+namespace cuttlefish {
+
+// Frames of each display are exported to local processes through shared
+// memory, so they can be read at full rate without decoding a video stream.
+//
+// A client connects to the frame export socket and sends the display number
+// as a uint32_t. The reply is a FrameExportResponse. On success it comes with
+// two file descriptors: a memfd to map read only, laid out as described below,
+// and an eventfd that is signaled after each new frame and when the display
+// goes away.
+//
+// The memfd starts with a FrameExportHeader, followed by slot_count slots of
+// slot_size bytes each starting at slot_offset. Frame n, counting from 1, is
+// written to slot n % slot_count. Each slot starts with a FrameExportSlot
+// that works as a seqlock: readers load the sequence, read the frame, and
+// load the sequence again. The frame is intact if both loads returned the same
+// even number. FrameExportReader implements this side of the protocol.
+
+enum class FrameExportFormat : uint32_t {
+  // Planes Y, U and V, with U and V subsampled by 2 in both directions.
+  kI420 = 1,
+  // A single plane, with bytes R, G, B and A for each pixel.
+  kRgba = 2,
+};
+
+struct FrameExportHeader {
+  static constexpr uint32_t kMagic = 0x46445643;  // "CVDF"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  FrameExportFormat format;
+  // The display size, no frame is larger.
+  uint32_t width;
+  uint32_t height;
+  uint32_t slot_count;
+  uint64_t slot_offset;
+  uint64_t slot_size;
+  // The number of the last complete frame, 0 until the first one.
+  std::atomic<uint64_t> latest_frame;
+  // Becomes 0 when the display is removed, no frames come after that.
+  std::atomic<uint32_t> active;
+};
+
+struct FrameExportSlot {
+  // Odd while the frame is being written.
+  std::atomic<uint32_t> sequence;
+  uint32_t width;
+  uint32_t height;
+  uint32_t reserved;
+  uint64_t frame_number;
+  // Microseconds since the epoch.
+  int64_t timestamp_us;
+  // Offsets from the start of the slot. RGBA frames only use the first plane.
+  uint32_t plane_offsets[3];
+  uint32_t plane_strides[3];
+};
+
+struct FrameExportResponse {
+  // 0 or an errno value, ENOENT when the display doesn't exist.
+  int32_t error;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "The shared memory layout needs lock free atomics");
+
+class FrameExporter {
+ public:
+  // Serves the clients that connect to `server`.
+  FrameExporter(SharedFD server, FrameExportFormat format);
+  ~FrameExporter();
+
+  void AddDisplay(uint32_t display_number, uint32_t width, uint32_t height);
+  void RemoveDisplay(uint32_t display_number);
+
+  // Takes the frame as it comes from the guest, along with its conversion to
+  // I420, and publishes whichever the exporter was created for.
+  void OnFrame(uint32_t display_number, const uint8_t* rgba_pixels,
+               uint32_t rgba_stride, const CvdVideoFrameBuffer& i420);
+
+ private:
+  struct Display {
+    Display(SharedFD memfd, ScopedMMap mapping)
+        : memfd(memfd), mapping(std::move(mapping)) {}
+
+    SharedFD memfd;
+    ScopedMMap mapping;
+    // Connections of the clients and the eventfds they were given.
+    std::vector<std::pair<SharedFD, SharedFD>> subscribers;
+    std::mutex write_mutex;
+  };
+
+  std::unique_ptr<Display> NewDisplay(uint32_t display_number, uint32_t width,
+                                      uint32_t height);
+  void WriteFrame(Display& display, const uint8_t* rgba_pixels,
+                  uint32_t rgba_stride, const CvdVideoFrameBuffer& i420);
+  void ServeLoop();
+  void Subscribe(SharedFD client);
+
+  const FrameExportFormat format_;
+  SharedFD server_;
+  SharedFD eventfd_;
+  std::atomic<bool> running_;
+  std::mutex displays_mutex_;
+  std::map<uint32_t, std::shared_ptr<Display>> displays_;
+  std::thread serve_thread_;
+};
+
+// Parses the names used in the configuration, "i420" and "rgba".
+std::optional<FrameExportFormat> ParseFrameExportFormat(
+    const std::string& name);
+
+}  // namespace cuttlefish
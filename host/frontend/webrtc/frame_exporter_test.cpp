@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/frame_exporter.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "host/frontend/webrtc/cvd_video_frame_buffer.h"
+#include "host/frontend/webrtc/frame_export_reader.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr uint32_t kDisplay = 0;
+constexpr uint32_t kWidth = 320;
+constexpr uint32_t kHeight = 240;
+
+class FrameExporterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto server = SharedFD::SocketLocalServer(socket_name_, true, SOCK_STREAM,
+                                              0600);
+    ASSERT_TRUE(server->IsOpen()) << server->StrError();
+    exporter_ =
+        std::make_unique<FrameExporter>(server, FrameExportFormat::kI420);
+    exporter_->AddDisplay(kDisplay, kWidth, kHeight);
+  }
+
+  Result<std::unique_ptr<FrameExportReader>> Connect(uint32_t display) {
+    auto client =
+        SharedFD::SocketLocalClient(socket_name_, true, SOCK_STREAM);
+    CF_EXPECT(client->IsOpen(), client->StrError());
+    return CF_EXPECT(FrameExportReader::Connect(client, display));
+  }
+
+  // Every byte of frame n is derived from n, so that a frame mixing two
+  // writes can be told apart.
+  void WriteFrame(uint64_t n) {
+    CvdVideoFrameBuffer buffer(kWidth, kHeight);
+    std::fill_n(buffer.DataY(), buffer.StrideY() * kHeight, Y(n));
+    std::fill_n(buffer.DataU(), buffer.StrideU() * (kHeight + 1) / 2, U(n));
+    std::fill_n(buffer.DataV(), buffer.StrideV() * (kHeight + 1) / 2, V(n));
+    exporter_->OnFrame(kDisplay, nullptr, 0, buffer);
+  }
+
+  static uint8_t Y(uint64_t n) { return n; }
+  static uint8_t U(uint64_t n) { return n * 3; }
+  static uint8_t V(uint64_t n) { return n * 7; }
+
+  // Whether every pixel of the frame holds the values of its number.
+  static bool IsIntact(const FrameExportReader::Frame& frame) {
+    if (frame.width != kWidth || frame.height != kHeight) {
+      return false;
+    }
+    auto plane_is = [&frame](int plane, uint32_t width, uint32_t height,
+                             uint8_t value) {
+      for (uint32_t row = 0; row < height; row++) {
+        auto begin = frame.Plane(plane) + row * frame.plane_strides[plane];
+        if (std::any_of(begin, begin + width,
+                        [value](uint8_t byte) { return byte != value; })) {
+          return false;
+        }
+      }
+      return true;
+    };
+    auto n = frame.number;
+    return plane_is(0, kWidth, kHeight, Y(n)) &&
+           plane_is(1, kWidth / 2, kHeight / 2, U(n)) &&
+           plane_is(2, kWidth / 2, kHeight / 2, V(n));
+  }
+
+  std::string socket_name_ = "frame_exporter_test_" + std::to_string(getpid());
+  std::unique_ptr<FrameExporter> exporter_;
+};
+
+TEST_F(FrameExporterTest, ReadsTheLatestFrame) {
+  auto reader = Connect(kDisplay);
+  ASSERT_TRUE(reader.ok()) << reader.error().Message();
+  EXPECT_EQ((*reader)->format(), FrameExportFormat::kI420);
+  EXPECT_EQ((*reader)->width(), kWidth);
+  EXPECT_EQ((*reader)->height(), kHeight);
+
+  FrameExportReader::Frame frame;
+  auto read = (*reader)->ReadLatest(frame);
+  ASSERT_TRUE(read.ok()) << read.error().Message();
+  EXPECT_FALSE(*read);
+
+  WriteFrame(1);
+  WriteFrame(2);
+  read = (*reader)->ReadLatest(frame);
+  ASSERT_TRUE(read.ok()) << read.error().Message();
+  ASSERT_TRUE(*read);
+  EXPECT_EQ(frame.number, 2);
+  EXPECT_TRUE(IsIntact(frame));
+}
+
+TEST_F(FrameExporterTest, UnknownDisplayIsAnError) {
+  EXPECT_FALSE(Connect(kDisplay + 1).ok());
+}
+
+TEST_F(FrameExporterTest, SignalsFramesAndRemoval) {
+  auto reader = Connect(kDisplay);
+  ASSERT_TRUE(reader.ok()) << reader.error().Message();
+  std::thread writer([this]() { WriteFrame(1); });
+  EXPECT_TRUE((*reader)->WaitForFrame().ok());
+  writer.join();
+  EXPECT_TRUE((*reader)->Active());
+
+  exporter_->RemoveDisplay(kDisplay);
+  EXPECT_TRUE((*reader)->WaitForFrame().ok());
+  EXPECT_FALSE((*reader)->Active());
+  // The last frame stays readable.
+  FrameExportReader::Frame frame;
+  auto read = (*reader)->ReadLatest(frame);
+  ASSERT_TRUE(read.ok()) << read.error().Message();
+  EXPECT_TRUE(*read);
+  EXPECT_EQ(frame.number, 1);
+}
+
+TEST_F(FrameExporterTest, ReadsFramesWhileTheWriterOverwritesSlots) {
+  constexpr int kReads = 1000;
+  auto reader = Connect(kDisplay);
+  ASSERT_TRUE(reader.ok()) << reader.error().Message();
+
+  // With only a few slots the writer keeps lapping the reader.
+  std::atomic<bool> reading = true;
+  std::atomic<uint64_t> written = 0;
+  std::thread writer([this, &reading, &written]() {
+    while (reading) {
+      WriteFrame(++written);
+    }
+  });
+  FrameExportReader::Frame frame;
+  uint64_t last = 0;
+  int reads = 0;
+  while (reads < kReads) {
+    auto read = (*reader)->ReadLatest(frame);
+    if (!read.ok() || (*read && !IsIntact(frame))) {
+      reading = false;
+      writer.join();
+      ASSERT_TRUE(read.ok()) << read.error().Message();
+      FAIL() << "frame " << frame.number << " is torn";
+    }
+    if (!*read) {
+      continue;
+    }
+    reads++;
+    EXPECT_GE(frame.number, last);
+    last = frame.number;
+  }
+  reading = false;
+  writer.join();
+
+  EXPECT_GT(last, 1);
+  auto read = (*reader)->ReadLatest(frame);
+  ASSERT_TRUE(read.ok()) << read.error().Message();
+  ASSERT_TRUE(*read);
+  EXPECT_EQ(frame.number, written);
+  EXPECT_TRUE(IsIntact(frame));
+}
+
+}  // namespace
+}  // namespace cuttlefish
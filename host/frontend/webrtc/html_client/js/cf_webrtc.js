@@ -81,6 +81,13 @@ function awaitDataChannel(pc, label, onMessage) {
   };
 }
 
+// Binary input message types, must match BinaryInputType in binary_input.h
+const BINARY_INPUT_MULTI_TOUCH = 1;
+const BINARY_INPUT_MOUSE = 2;
+const BINARY_INPUT_KEYBOARD = 3;
+// The name length and the touch point count are u8 fields.
+const BINARY_INPUT_MAX_LENGTH = 255;
+
 class DeviceConnection {
   #pc;
   #control;
@@ -252,7 +259,42 @@ class DeviceConnection {
     this.#inputChannel.send(JSON.stringify(evt));
   }
 
+  // Devices that advertise it take input events in a binary format, which
+  // costs them much less to parse than JSON. See binary_input.h for the
+  // layout. Returns the encoded name, or null if the event has to be sent as
+  // JSON instead because the name doesn't fit its length field.
+  #binaryInputName(name) {
+    if (!this.#description || !(this.#description.binary_input >= 1)) {
+      return null;
+    }
+    const nameBytes = new TextEncoder().encode(name);
+    if (nameBytes.length > BINARY_INPUT_MAX_LENGTH) {
+      return null;
+    }
+    return nameBytes;
+  }
+
+  #sendBinaryInput(type, down, nameBytes, payloadSize, writePayload) {
+    const buffer = new ArrayBuffer(3 + nameBytes.length + payloadSize);
+    const view = new DataView(buffer);
+    view.setUint8(0, type);
+    view.setUint8(1, down ? 1 : 0);
+    view.setUint8(2, nameBytes.length);
+    new Uint8Array(buffer, 3).set(nameBytes);
+    writePayload(view, 3 + nameBytes.length);
+    this.#inputChannel.send(buffer);
+  }
+
   sendMousePosition({x, y, down, display_label}) {
+    const nameBytes = this.#binaryInputName(display_label);
+    if (nameBytes) {
+      this.#sendBinaryInput(
+          BINARY_INPUT_MOUSE, down, nameBytes, 8, (view, offset) => {
+            view.setInt32(offset, x, true);
+            view.setInt32(offset + 4, y, true);
+          });
+      return;
+    }
     this.#sendJsonInput({
       type: 'mouse',
       down: down ? 1 : 0,
@@ -265,6 +307,28 @@ class DeviceConnection {
   // TODO (b/124121375): This should probably be an array of pointer events and
   // have different properties.
   sendMultiTouch({idArr, xArr, yArr, down, slotArr, display_label}) {
+    const nameBytes = this.#binaryInputName(display_label);
+    // Messages without points are invalid, those with more than the count
+    // field allows are split.
+    if (nameBytes && idArr.length > 0) {
+      for (let start = 0; start < idArr.length;
+           start += BINARY_INPUT_MAX_LENGTH) {
+        const count =
+            Math.min(idArr.length - start, BINARY_INPUT_MAX_LENGTH);
+        this.#sendBinaryInput(
+            BINARY_INPUT_MULTI_TOUCH, down, nameBytes, 1 + 16 * count,
+            (view, offset) => {
+              view.setUint8(offset++, count);
+              for (let i = start; i < start + count; i++, offset += 16) {
+                view.setInt32(offset, idArr[i], true);
+                view.setInt32(offset + 4, slotArr[i], true);
+                view.setInt32(offset + 8, xArr[i], true);
+                view.setInt32(offset + 12, yArr[i], true);
+              }
+            });
+      }
+      return;
+    }
     this.#sendJsonInput({
       type: 'multi-touch',
       id: idArr,
@@ -277,6 +341,12 @@ class DeviceConnection {
   }
 
   sendKeyEvent(code, type) {
+    const nameBytes = this.#binaryInputName(code);
+    if (nameBytes) {
+      this.#sendBinaryInput(
+          BINARY_INPUT_KEYBOARD, type == 'keydown', nameBytes, 0, () => {});
+      return;
+    }
     this.#sendJsonInput({type: 'keyboard', keycode: code, event_type: type});
   }
 
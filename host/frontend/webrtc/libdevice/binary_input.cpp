@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/libdevice/binary_input.h"
+
+#include <endian.h>
+
+#include <cstring>
+
+namespace cuttlefish {
+namespace webrtc_streaming {
+namespace {
+
+class BinaryInputReader {
+ public:
+  BinaryInputReader(const uint8_t* data, size_t size)
+      : data_(data), size_(size) {}
+
+  Result<uint8_t> U8() {
+    CF_EXPECT(size_ - offset_ >= 1, "Truncated at byte " << offset_);
+    return data_[offset_++];
+  }
+  Result<int32_t> I32() {
+    uint32_t value;
+    CF_EXPECT(size_ - offset_ >= sizeof(value),
+              "Truncated at byte " << offset_);
+    memcpy(&value, data_ + offset_, sizeof(value));
+    offset_ += sizeof(value);
+    return static_cast<int32_t>(le32toh(value));
+  }
+  Result<void> String(size_t length, std::string* str) {
+    CF_EXPECT(size_ - offset_ >= length, "Truncated at byte " << offset_);
+    str->assign(reinterpret_cast<const char*>(data_ + offset_), length);
+    offset_ += length;
+    return {};
+  }
+  size_t Remaining() const { return size_ - offset_; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t offset_ = 0;
+};
+
+}  // namespace
+
+Result<void> ParseBinaryInput(const uint8_t* data, size_t size,
+                              BinaryInputMessage* message) {
+  BinaryInputReader reader(data, size);
+  auto type = CF_EXPECT(reader.U8());
+  message->down = CF_EXPECT(reader.U8()) != 0;
+  auto name_length = CF_EXPECT(reader.U8());
+  CF_EXPECT(reader.String(name_length, &message->name));
+  switch (static_cast<BinaryInputType>(type)) {
+    case BinaryInputType::kMultiTouch: {
+      auto count = CF_EXPECT(reader.U8());
+      CF_EXPECT(count > 0, "Multi-touch message without touch points");
+      message->points.resize(count);
+      for (auto& point : message->points) {
+        point.id = CF_EXPECT(reader.I32());
+        point.slot = CF_EXPECT(reader.I32());
+        point.x = CF_EXPECT(reader.I32());
+        point.y = CF_EXPECT(reader.I32());
+      }
+      break;
+    }
+    case BinaryInputType::kMouse:
+      message->x = CF_EXPECT(reader.I32());
+      message->y = CF_EXPECT(reader.I32());
+      break;
+    case BinaryInputType::kKeyboard:
+      break;
+    default:
+      return CF_ERR("Unrecognized binary input type: " << (int)type);
+  }
+  CF_EXPECT(reader.Remaining() == 0,
+            reader.Remaining() << " unexpected trailing bytes");
+  message->type = static_cast<BinaryInputType>(type);
+  return {};
+}
+
+}  // namespace webrtc_streaming
+}  // namespace cuttlefish
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/libs/utils/result.h"
+#include "host/frontend/webrtc/libdevice/connection_observer.h"
+
+namespace cuttlefish {
+namespace webrtc_streaming {
+
+// Binary input messages, advertised to the client in the device info. All
+// integers are little endian. Every message starts with
+//   type:u8 down:u8 name_length:u8 name:char[name_length]
+// where the name is the display label, or the DOM key code for keyboard
+// events. Multi-touch messages continue with
+//   count:u8 {id:i32 slot:i32 x:i32 y:i32}[count]
+// with a count of at least 1, and mouse messages with
+//   x:i32 y:i32
+// Nothing may follow.
+enum class BinaryInputType : uint8_t {
+  kMultiTouch = 1,
+  kMouse = 2,
+  kKeyboard = 3,
+};
+
+struct BinaryInputMessage {
+  BinaryInputType type;
+  bool down;
+  std::string name;
+  // Multi-touch messages only.
+  std::vector<MultiTouchPoint> points;
+  // Mouse messages only.
+  int32_t x;
+  int32_t y;
+};
+
+// Parses the untrusted bytes of a message from the client into |message|,
+// whose buffers are reused between messages.
+Result<void> ParseBinaryInput(const uint8_t* data, size_t size,
+                              BinaryInputMessage* message);
+
+}  // namespace webrtc_streaming
+}  // namespace cuttlefish
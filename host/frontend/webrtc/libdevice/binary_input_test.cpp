@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/libdevice/binary_input.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace webrtc_streaming {
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+void AppendI32(Bytes& bytes, int32_t value) {
+  auto u = static_cast<uint32_t>(value);
+  for (int i = 0; i < 4; i++) {
+    bytes.push_back((u >> (8 * i)) & 0xff);
+  }
+}
+
+Bytes Header(uint8_t type, bool down, const std::string& name) {
+  Bytes bytes = {type, down, static_cast<uint8_t>(name.size())};
+  bytes.insert(bytes.end(), name.begin(), name.end());
+  return bytes;
+}
+
+Bytes MultiTouch(const std::string& label, bool down,
+                 const std::vector<MultiTouchPoint>& points) {
+  auto bytes = Header(1, down, label);
+  bytes.push_back(points.size());
+  for (const auto& point : points) {
+    AppendI32(bytes, point.id);
+    AppendI32(bytes, point.slot);
+    AppendI32(bytes, point.x);
+    AppendI32(bytes, point.y);
+  }
+  return bytes;
+}
+
+Bytes Mouse(const std::string& label, bool down, int32_t x, int32_t y) {
+  auto bytes = Header(2, down, label);
+  AppendI32(bytes, x);
+  AppendI32(bytes, y);
+  return bytes;
+}
+
+Result<void> Parse(const Bytes& bytes, BinaryInputMessage* message) {
+  return ParseBinaryInput(bytes.data(), bytes.size(), message);
+}
+
+TEST(BinaryInputTest, ParsesMultiTouch) {
+  BinaryInputMessage message;
+  auto result = Parse(
+      MultiTouch("display_0", true, {{1, 0, 10, 20}, {2, 1, -30, 40}}),
+      &message);
+  ASSERT_TRUE(result.ok()) << result.error().Message();
+  EXPECT_EQ(message.type, BinaryInputType::kMultiTouch);
+  EXPECT_TRUE(message.down);
+  EXPECT_EQ(message.name, "display_0");
+  ASSERT_EQ(message.points.size(), 2);
+  EXPECT_EQ(message.points[1].id, 2);
+  EXPECT_EQ(message.points[1].slot, 1);
+  EXPECT_EQ(message.points[1].x, -30);
+  EXPECT_EQ(message.points[1].y, 40);
+}
+
+TEST(BinaryInputTest, ParsesMouse) {
+  BinaryInputMessage message;
+  auto result = Parse(Mouse("display_1", false, 7, 0x12345678), &message);
+  ASSERT_TRUE(result.ok()) << result.error().Message();
+  EXPECT_EQ(message.type, BinaryInputType::kMouse);
+  EXPECT_FALSE(message.down);
+  EXPECT_EQ(message.name, "display_1");
+  EXPECT_EQ(message.x, 7);
+  EXPECT_EQ(message.y, 0x12345678);
+}
+
+TEST(BinaryInputTest, ParsesKeyboard) {
+  BinaryInputMessage message;
+  auto result = Parse(Header(3, true, "KeyA"), &message);
+  ASSERT_TRUE(result.ok()) << result.error().Message();
+  EXPECT_EQ(message.type, BinaryInputType::kKeyboard);
+  EXPECT_TRUE(message.down);
+  EXPECT_EQ(message.name, "KeyA");
+}
+
+TEST(BinaryInputTest, ParsesLongestNameAndMostPoints) {
+  std::string name(255, 'd');
+  std::vector<MultiTouchPoint> points(255);
+  for (int i = 0; i < 255; i++) {
+    points[i] = {i, i, i * 2, i * 3};
+  }
+  BinaryInputMessage message;
+  auto result = Parse(MultiTouch(name, true, points), &message);
+  ASSERT_TRUE(result.ok()) << result.error().Message();
+  EXPECT_EQ(message.name, name);
+  ASSERT_EQ(message.points.size(), 255);
+  EXPECT_EQ(message.points[254].y, 254 * 3);
+}
+
+TEST(BinaryInputTest, ReusesTheMessage) {
+  BinaryInputMessage message;
+  ASSERT_TRUE(Parse(MultiTouch("a", true, {{1, 0, 1, 1}, {2, 1, 2, 2}}),
+                    &message)
+                  .ok());
+  ASSERT_TRUE(Parse(MultiTouch("b", false, {{3, 2, 3, 3}}), &message).ok());
+  EXPECT_EQ(message.name, "b");
+  ASSERT_EQ(message.points.size(), 1);
+  EXPECT_EQ(message.points[0].id, 3);
+}
+
+TEST(BinaryInputTest, RejectsZeroPoints) {
+  BinaryInputMessage message;
+  EXPECT_FALSE(Parse(MultiTouch("display_0", true, {}), &message).ok());
+}
+
+TEST(BinaryInputTest, RejectsUnknownTypes) {
+  BinaryInputMessage message;
+  for (uint8_t type : {0, 4, 0xff}) {
+    EXPECT_FALSE(Parse(Header(type, true, "display_0"), &message).ok())
+        << "type " << (int)type;
+  }
+}
+
+TEST(BinaryInputTest, RejectsEveryTruncation) {
+  auto messages = {
+      MultiTouch("display_0", true, {{1, 0, 10, 20}, {2, 1, 30, 40}}),
+      Mouse("display_0", true, 1, 2),
+      Header(3, true, "KeyA"),
+  };
+  for (const auto& bytes : messages) {
+    for (size_t size = 0; size < bytes.size(); size++) {
+      BinaryInputMessage message;
+      EXPECT_FALSE(ParseBinaryInput(bytes.data(), size, &message).ok())
+          << "type " << (int)bytes[0] << " truncated to " << size;
+    }
+  }
+}
+
+TEST(BinaryInputTest, RejectsTrailingBytes) {
+  auto messages = {
+      MultiTouch("display_0", true, {{1, 0, 10, 20}}),
+      Mouse("display_0", true, 1, 2),
+      Header(3, true, "KeyA"),
+  };
+  for (auto bytes : messages) {
+    bytes.push_back(0);
+    BinaryInputMessage message;
+    EXPECT_FALSE(Parse(bytes, &message).ok()) << "type " << (int)bytes[0];
+  }
+}
+
+}  // namespace
+}  // namespace webrtc_streaming
+}  // namespace cuttlefish
@@ -16,13 +16,23 @@
 
 #pragma once
 
+#include <cstdint>
 #include <functional>
+#include <string>
+#include <vector>
 
 #include <json/json.h>
 
 namespace cuttlefish {
 namespace webrtc_streaming {
 
+struct MultiTouchPoint {
+  int32_t id;
+  int32_t slot;
+  int32_t x;
+  int32_t y;
+};
+
 // The ConnectionObserver is the boundary between device specific code and
 // general WebRTC streaming code. Device specific code should be left to
 // implementations of this class while code that could be shared between any
@@ -44,9 +54,9 @@ class ConnectionObserver {
 
   virtual void OnTouchEvent(const std::string& display_label, int x, int y,
                             bool down) = 0;
-  virtual void OnMultiTouchEvent(const std::string& label, Json::Value id,
-                                 Json::Value slot, Json::Value x, Json::Value y,
-                                 bool down, int size) = 0;
+  virtual void OnMultiTouchEvent(const std::string& label,
+                                 const std::vector<MultiTouchPoint>& points,
+                                 bool down) = 0;
 
   virtual void OnKeyboardEvent(uint16_t keycode, bool down) = 0;
 
@@ -19,6 +19,7 @@
 #include <android-base/logging.h>
 
 #include "host/frontend/webrtc/libcommon/utils.h"
+#include "host/frontend/webrtc/libdevice/binary_input.h"
 #include "host/frontend/webrtc/libdevice/keyboard.h"
 
 namespace cuttlefish {
@@ -77,9 +78,7 @@ class InputChannelHandler : public DataChannelHandler {
  public:
   void OnMessageInner(const webrtc::DataBuffer &msg) override {
     if (msg.binary) {
-      // TODO (jemoreira) consider binary protocol to avoid JSON parsing
-      // overhead
-      LOG(ERROR) << "Received invalid (binary) data on input channel";
+      OnBinaryMessage(msg);
       return;
     }
     auto size = msg.size();
@@ -139,8 +138,16 @@ class InputChannelHandler : public DataChannelHandler {
       auto slotArr = evt["slot"];
       int size = evt["id"].size();
 
-      observer()->OnMultiTouchEvent(label, idArr, slotArr, xArr, yArr, down,
-                                    size);
+      std::vector<MultiTouchPoint> points(size);
+      for (int i = 0; i < size; i++) {
+        points[i] = {
+            .id = idArr[i].asInt(),
+            .slot = slotArr[i].asInt(),
+            .x = xArr[i].asInt(),
+            .y = yArr[i].asInt(),
+        };
+      }
+      observer()->OnMultiTouchEvent(label, points, down);
     } else if (event_type == "keyboard") {
       auto result =
           ValidateJsonObject(evt, "keyboard",
@@ -158,6 +165,35 @@ class InputChannelHandler : public DataChannelHandler {
       return;
     }
   }
+
+ private:
+  void OnBinaryMessage(const webrtc::DataBuffer &msg) {
+    // The message is reused, pointer moves arrive at the input rate of the
+    // client.
+    auto parsed =
+        ParseBinaryInput(msg.data.cdata<uint8_t>(), msg.size(), &message_);
+    if (!parsed.ok()) {
+      LOG(ERROR) << "Received malformed binary input message: "
+                 << parsed.error().Message();
+      return;
+    }
+    switch (message_.type) {
+      case BinaryInputType::kMultiTouch:
+        observer()->OnMultiTouchEvent(message_.name, message_.points,
+                                      message_.down);
+        break;
+      case BinaryInputType::kMouse:
+        observer()->OnTouchEvent(message_.name, message_.x, message_.y,
+                                 message_.down);
+        break;
+      case BinaryInputType::kKeyboard:
+        observer()->OnKeyboardEvent(DomKeyCodeToLinux(message_.name),
+                                    message_.down);
+        break;
+    }
+  }
+
+  BinaryInputMessage message_;
 };
 
 class ControlChannelHandler : public DataChannelHandler {
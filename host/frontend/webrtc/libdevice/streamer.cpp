@@ -63,6 +63,10 @@ constexpr auto kControlPanelButtonDeviceStates = "device_states";
 constexpr auto kControlPanelButtonLidSwitchOpen = "lid_switch_open";
 constexpr auto kControlPanelButtonHingeAngleValue = "hinge_angle_value";
 constexpr auto kCustomControlPanelButtonsField = "custom_control_panel_buttons";
+// Version of the binary input message format understood by the input channel,
+// clients that don't know it keep sending JSON.
+constexpr auto kBinaryInputField = "binary_input";
+constexpr int kBinaryInputVersion = 1;
 
 constexpr int kRegistrationRetries = 3;
 constexpr int kRetryFirstIntervalMs = 1000;
@@ -431,6 +435,7 @@ void Streamer::Impl::OnOpen() {
       custom_control_panel_buttons.append(button_entry);
     }
     device_info[kCustomControlPanelButtonsField] = custom_control_panel_buttons;
+    device_info[kBinaryInputField] = kBinaryInputVersion;
     register_obj[cuttlefish::webrtc_signaling::kDeviceInfoField] = device_info;
     server_connection_->Send(register_obj);
     // Do this last as OnRegistered() is user code and may take some time to
@@ -30,6 +30,7 @@
 #include "host/frontend/webrtc/client_server.h"
 #include "host/frontend/webrtc/connection_observer.h"
 #include "host/frontend/webrtc/display_handler.h"
+#include "host/frontend/webrtc/frame_exporter.h"
 #include "host/frontend/webrtc/kernel_log_events_handler.h"
 #include "host/frontend/webrtc/libdevice/camera_controller.h"
 #include "host/frontend/webrtc/libdevice/local_recorder.h"
@@ -245,8 +246,22 @@ int main(int argc, char** argv) {
       Streamer::Create(streamer_config, local_recorder.get(), observer_factory);
   CHECK(streamer) << "Could not create streamer";
 
-  auto display_handler =
-      std::make_shared<DisplayHandler>(*streamer, screen_connector);
+  std::unique_ptr<cuttlefish::FrameExporter> frame_exporter;
+  // Configurations from before --frame_export have no value.
+  if (!instance.frame_export().empty() && instance.frame_export() != "none") {
+    auto format = cuttlefish::ParseFrameExportFormat(instance.frame_export());
+    CHECK(format) << "Unknown frame export format: "
+                  << instance.frame_export();
+    auto server = cuttlefish::SharedFD::SocketLocalServer(
+        instance.frame_export_socket_path(), false, SOCK_STREAM, 0600);
+    CHECK(server->IsOpen()) << "Could not create frame export socket: "
+                            << server->StrError();
+    frame_exporter =
+        std::make_unique<cuttlefish::FrameExporter>(server, *format);
+  }
+
+  auto display_handler = std::make_shared<DisplayHandler>(
+      *streamer, screen_connector, frame_exporter.get());
 
   if (instance.camera_server_port()) {
     auto camera_controller = streamer->AddCamera(instance.camera_server_port(),
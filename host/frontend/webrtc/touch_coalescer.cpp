@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/touch_coalescer.h"
+
+#include <utility>
+
+namespace cuttlefish {
+
+TouchMoveCoalescer::TouchMoveCoalescer(std::chrono::milliseconds interval,
+                                       Writer writer, Scheduler scheduler)
+    : interval_(interval),
+      writer_(std::move(writer)),
+      scheduler_(std::move(scheduler)),
+      self_(std::make_shared<TouchMoveCoalescer*>(this)) {}
+
+TouchMoveCoalescer::~TouchMoveCoalescer() {
+  // The last position of the contacts isn't lost when the connection closes.
+  Flush();
+}
+
+void TouchMoveCoalescer::Move(const std::string& display_label,
+                              const MultiTouchPoint& point) {
+  pending_[display_label][point.slot] = point;
+  auto now = Clock::now();
+  if (now >= next_write_) {
+    Flush();
+    return;
+  }
+  if (!timer_scheduled_) {
+    timer_scheduled_ = true;
+    std::weak_ptr<TouchMoveCoalescer*> self = self_;
+    scheduler_(std::chrono::ceil<std::chrono::milliseconds>(next_write_ - now),
+               [self]() {
+                 if (auto coalescer = self.lock()) {
+                   (*coalescer)->OnTimer();
+                 }
+               });
+  }
+}
+
+void TouchMoveCoalescer::Flush() {
+  if (pending_.empty()) {
+    return;
+  }
+  for (const auto& [display_label, slots] : pending_) {
+    points_.clear();
+    for (const auto& [slot, point] : slots) {
+      points_.push_back(point);
+    }
+    writer_(display_label, points_);
+  }
+  pending_.clear();
+  next_write_ = Clock::now() + interval_;
+}
+
+void TouchMoveCoalescer::OnTimer() {
+  timer_scheduled_ = false;
+  Flush();
+}
+
+}  // namespace cuttlefish
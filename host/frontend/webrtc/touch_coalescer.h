@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "host/frontend/webrtc/libdevice/connection_observer.h"
+
+namespace cuttlefish {
+
+// Merges the moves of touch contacts that are already down, so the device gets
+// at most one input write per display every interval with the latest position
+// of each contact. A move after an idle interval is written right away.
+//
+// Not thread safe: it must be used, and the tasks it schedules run, on a single
+// thread, the one that delivers the input events.
+class TouchMoveCoalescer {
+ public:
+  using MultiTouchPoint = webrtc_streaming::MultiTouchPoint;
+  using Writer = std::function<void(const std::string& display_label,
+                                    const std::vector<MultiTouchPoint>&)>;
+  // Runs the task once after the delay.
+  using Scheduler =
+      std::function<void(std::chrono::milliseconds, std::function<void()>)>;
+
+  TouchMoveCoalescer(std::chrono::milliseconds interval, Writer writer,
+                     Scheduler scheduler);
+  // Writes the pending moves.
+  ~TouchMoveCoalescer();
+
+  void Move(const std::string& display_label, const MultiTouchPoint& point);
+  // Writes the pending moves now. Must be called before writing any other touch
+  // event so the device sees them in order.
+  void Flush();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void OnTimer();
+
+  const std::chrono::milliseconds interval_;
+  Writer writer_;
+  Scheduler scheduler_;
+  // Scheduled tasks hold a weak reference, so they do nothing once the
+  // coalescer is gone.
+  std::shared_ptr<TouchMoveCoalescer*> self_;
+  bool timer_scheduled_ = false;
+  // Display label to slot to the latest position in that slot.
+  std::map<std::string, std::map<int32_t, MultiTouchPoint>> pending_;
+  std::vector<MultiTouchPoint> points_;
+  Clock::time_point next_write_;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/frontend/webrtc/touch_coalescer.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+using MultiTouchPoint = TouchMoveCoalescer::MultiTouchPoint;
+
+struct Write {
+  std::string display_label;
+  std::vector<MultiTouchPoint> points;
+};
+
+MultiTouchPoint Point(int32_t slot, int32_t x) {
+  return {.id = slot + 100, .slot = slot, .x = x, .y = x * 2};
+}
+
+class TouchMoveCoalescerTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<TouchMoveCoalescer> Coalescer(
+      std::chrono::milliseconds interval) {
+    return std::make_unique<TouchMoveCoalescer>(
+        interval,
+        [this](const std::string& display_label,
+               const std::vector<MultiTouchPoint>& points) {
+          writes_.push_back({display_label, points});
+        },
+        [this](std::chrono::milliseconds delay, std::function<void()> task) {
+          delays_.push_back(delay);
+          tasks_.push_back(std::move(task));
+        });
+  }
+
+  // Runs the scheduled tasks as if their delay had passed.
+  void RunTasks() {
+    auto tasks = std::move(tasks_);
+    tasks_.clear();
+    for (auto& task : tasks) {
+      task();
+    }
+  }
+
+  std::vector<Write> writes_;
+  std::vector<std::chrono::milliseconds> delays_;
+  std::vector<std::function<void()>> tasks_;
+};
+
+TEST_F(TouchMoveCoalescerTest, WritesAMoveAfterAnIdleIntervalRightAway) {
+  auto coalescer = Coalescer(std::chrono::milliseconds(10));
+  coalescer->Move("display_0", Point(0, 1));
+  ASSERT_EQ(writes_.size(), 1);
+  EXPECT_EQ(writes_[0].points[0].x, 1);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  coalescer->Move("display_0", Point(0, 2));
+  ASSERT_EQ(writes_.size(), 2);
+  EXPECT_EQ(writes_[1].points[0].x, 2);
+  EXPECT_TRUE(tasks_.empty());
+}
+
+TEST_F(TouchMoveCoalescerTest, MergesMovesUntilTheTimerFires) {
+  auto coalescer = Coalescer(std::chrono::hours(1));
+  coalescer->Move("display_0", Point(0, 1));
+  ASSERT_EQ(writes_.size(), 1);
+
+  coalescer->Move("display_0", Point(0, 2));
+  coalescer->Move("display_0", Point(1, 3));
+  coalescer->Move("display_0", Point(0, 4));
+  EXPECT_EQ(writes_.size(), 1);
+  ASSERT_EQ(tasks_.size(), 1);
+  EXPECT_GT(delays_[0], std::chrono::minutes(59));
+  EXPECT_LE(delays_[0], std::chrono::hours(1));
+
+  RunTasks();
+  ASSERT_EQ(writes_.size(), 2);
+  EXPECT_EQ(writes_[1].display_label, "display_0");
+  ASSERT_EQ(writes_[1].points.size(), 2);
+  EXPECT_EQ(writes_[1].points[0].slot, 0);
+  EXPECT_EQ(writes_[1].points[0].x, 4);
+  EXPECT_EQ(writes_[1].points[0].y, 8);
+  EXPECT_EQ(writes_[1].points[0].id, 100);
+  EXPECT_EQ(writes_[1].points[1].slot, 1);
+  EXPECT_EQ(writes_[1].points[1].x, 3);
+
+  // The timer is scheduled again for the next moves.
+  coalescer->Move("display_0", Point(0, 5));
+  EXPECT_EQ(writes_.size(), 2);
+  EXPECT_EQ(tasks_.size(), 1);
+}
+
+TEST_F(TouchMoveCoalescerTest, WritesEachDisplaySeparately) {
+  auto coalescer = Coalescer(std::chrono::hours(1));
+  coalescer->Flush();
+  coalescer->Move("display_0", Point(0, 1));
+  coalescer->Move("display_1", Point(0, 2));
+  coalescer->Move("display_0", Point(0, 3));
+  RunTasks();
+  ASSERT_EQ(writes_.size(), 3);
+  EXPECT_EQ(writes_[1].display_label, "display_0");
+  EXPECT_EQ(writes_[1].points[0].x, 3);
+  EXPECT_EQ(writes_[2].display_label, "display_1");
+  EXPECT_EQ(writes_[2].points[0].x, 2);
+}
+
+// Touch downs and ups flush the pending moves before they are written.
+TEST_F(TouchMoveCoalescerTest, FlushWritesThePendingMoves) {
+  auto coalescer = Coalescer(std::chrono::hours(1));
+  coalescer->Move("display_0", Point(0, 1));
+  coalescer->Move("display_0", Point(0, 2));
+  ASSERT_EQ(writes_.size(), 1);
+
+  coalescer->Flush();
+  ASSERT_EQ(writes_.size(), 2);
+  EXPECT_EQ(writes_[1].points[0].x, 2);
+
+  // Nothing is left for the timer.
+  RunTasks();
+  EXPECT_EQ(writes_.size(), 2);
+  coalescer->Flush();
+  EXPECT_EQ(writes_.size(), 2);
+}
+
+TEST_F(TouchMoveCoalescerTest, DestructionWritesThePendingMoves) {
+  auto coalescer = Coalescer(std::chrono::hours(1));
+  coalescer->Move("display_0", Point(0, 1));
+  coalescer->Move("display_0", Point(0, 2));
+  ASSERT_EQ(writes_.size(), 1);
+
+  coalescer.reset();
+  ASSERT_EQ(writes_.size(), 2);
+  EXPECT_EQ(writes_[1].points[0].x, 2);
+  // The timer of a destroyed coalescer does nothing.
+  RunTasks();
+  EXPECT_EQ(writes_.size(), 2);
+}
+
+}  // namespace
+}  // namespace cuttlefish
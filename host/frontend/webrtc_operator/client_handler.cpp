@@ -147,6 +147,7 @@ class PollConnectionHandler : public ClientHandler {
   PollConnectionHandler() = default;
 
   void SendDeviceMessage(const Json::Value& message) override {
+    std::lock_guard lock(mutex_);
     constexpr size_t kMaxMessagesInQueue = 1000;
     if (messages_.size() > kMaxMessagesInQueue) {
       LOG(ERROR) << "Polling client " << client_id_ << " reached "
@@ -159,6 +160,7 @@ class PollConnectionHandler : public ClientHandler {
 
   std::vector<Json::Value> PollMessages() {
     std::vector<Json::Value> ret;
+    std::lock_guard lock(mutex_);
     std::swap(ret, messages_);
     return ret;
   }
@@ -177,11 +179,14 @@ class PollConnectionHandler : public ClientHandler {
  private:
   size_t client_id_ = 0;
   std::weak_ptr<DeviceHandler> device_handler_;
+  // Device messages arrive on the device's service thread.
+  std::mutex mutex_;
   std::vector<Json::Value> messages_;
 };
 
 std::shared_ptr<PollConnectionHandler> PollConnectionStore::Get(
     const std::string& conn_id) const {
+  std::lock_guard lock(mutex_);
   if (!handlers_.count(conn_id)) {
     return nullptr;
   }
@@ -189,6 +194,7 @@ std::shared_ptr<PollConnectionHandler> PollConnectionStore::Get(
 }
 
 std::string PollConnectionStore::Add(std::shared_ptr<PollConnectionHandler> handler) {
+  std::lock_guard lock(mutex_);
   std::string conn_id;
   do {
     conn_id = RandomClientSecret(64);
@@ -15,7 +15,9 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include <json/json.h>
@@ -79,6 +81,7 @@ class PollConnectionStore {
     std::shared_ptr<PollConnectionHandler> Get(const std::string& conn_id) const;
     std::string Add(std::shared_ptr<PollConnectionHandler> handler);
   private:
+   mutable std::mutex mutex_;
    std::map<std::string, std::shared_ptr<PollConnectionHandler>>
        handlers_;
 };
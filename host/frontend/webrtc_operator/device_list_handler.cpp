@@ -15,25 +15,168 @@
 
 #include "host/frontend/webrtc_operator/device_list_handler.h"
 
+#include <utility>
+
+#include <android-base/logging.h>
+
+#include "host/frontend/webrtc_operator/constants/signaling_constants.h"
+
 namespace cuttlefish {
+namespace {
+
+constexpr auto kSubscribeType = "subscribe";
+constexpr auto kDeviceListType = "device_list";
+constexpr auto kDeviceAddedType = "device_added";
+constexpr auto kDeviceRemovedType = "device_removed";
+constexpr auto kVersionField = "version";
+constexpr auto kDevicesField = "devices";
+constexpr auto kDeviceIdField = "device_id";
+
+std::string ChangeMessage(const DeviceListChange& change) {
+  Json::Value message;
+  message[webrtc_signaling::kTypeField] =
+      change.added ? kDeviceAddedType : kDeviceRemovedType;
+  message[kVersionField] = Json::UInt64(change.version);
+  message[kDeviceIdField] = change.device_id;
+  Json::StreamWriterBuilder factory;
+  factory["indentation"] = "";
+  return Json::writeString(factory, message);
+}
+
+}  // namespace
 
 DeviceListHandler::DeviceListHandler(struct lws* wsi,
                                            DeviceRegistry& registry)
     : DynHandler(wsi), registry_(registry) {}
 
 HttpStatusCode DeviceListHandler::DoGet() {
-  Json::Value reply(Json::ValueType::arrayValue);
-
-  for (const auto& id : registry_.ListDeviceIds()) {
-    reply.append(id);
-  }
-  Json::StreamWriterBuilder json_factory;
-  auto replyAsString = Json::writeString(json_factory, reply);
-  AppendDataOut(replyAsString);
+  AppendDataOut(registry_.Snapshot()->json);
   return HttpStatusCode::Ok;
 }
 HttpStatusCode DeviceListHandler::DoPost() {
   return HttpStatusCode::NotFound;
 }
 
+DeviceListFeed::DeviceListFeed(DeviceRegistry& registry,
+                               std::function<void(const std::string&)> send)
+    : registry_(registry), send_(std::move(send)) {}
+
+// Holds the lock while catching up, so that changes delivered meanwhile wait
+// and are then skipped if the reply already covers them.
+void DeviceListFeed::Subscribe(std::optional<uint64_t> version) {
+  std::lock_guard lock(mutex_);
+  subscribed_ = true;
+  if (version) {
+    version_ = *version;
+    CatchUpLocked();
+  } else {
+    SendListLocked();
+  }
+}
+
+void DeviceListFeed::Unsubscribe() {
+  std::lock_guard lock(mutex_);
+  subscribed_ = false;
+}
+
+// Changes are delivered after the registry is unlocked, so one may overtake
+// an earlier one. Skipping the earlier one would lose it, the gap is filled
+// from the registry instead.
+void DeviceListFeed::OnDeviceListChange(const DeviceListChange& change) {
+  std::lock_guard lock(mutex_);
+  if (!subscribed_ || change.version <= version_) {
+    return;
+  }
+  if (change.version == version_ + 1) {
+    SendChangeLocked(change);
+  } else {
+    CatchUpLocked();
+  }
+}
+
+void DeviceListFeed::CatchUpLocked() {
+  auto changes = registry_.ChangesSince(version_);
+  if (!changes) {
+    SendListLocked();
+    return;
+  }
+  for (const auto& change : *changes) {
+    SendChangeLocked(change);
+  }
+}
+
+void DeviceListFeed::SendListLocked() {
+  auto snapshot = registry_.Snapshot();
+  version_ = snapshot->version;
+  // The list is already serialized, so it's spliced in rather than parsed.
+  std::string reply = std::string("{\"") + webrtc_signaling::kTypeField +
+                      "\":\"" + kDeviceListType + "\",\"" + kVersionField +
+                      "\":" + std::to_string(snapshot->version) + ",\"" +
+                      kDevicesField + "\":" + snapshot->json + "}";
+  send_(reply);
+}
+
+void DeviceListFeed::SendChangeLocked(const DeviceListChange& change) {
+  version_ = change.version;
+  send_(ChangeMessage(change));
+}
+
+DeviceListFeedHandler::DeviceListFeedHandler(struct lws* wsi,
+                                             DeviceRegistry& registry)
+    : WebSocketHandler(wsi),
+      registry_(registry),
+      feed_(registry, [this](const std::string& message) {
+        EnqueueMessage(message.c_str(), message.size());
+      }) {}
+
+// Changes are only passed on after the client subscribes.
+void DeviceListFeedHandler::OnConnected() {
+  registry_.AddObserver(weak_from_this());
+}
+
+void DeviceListFeedHandler::OnClosed() { feed_.Unsubscribe(); }
+
+void DeviceListFeedHandler::OnReceive(const uint8_t* msg, size_t len,
+                                      bool binary) {
+  Json::Value message;
+  Json::CharReaderBuilder builder;
+  std::unique_ptr<Json::CharReader> json_reader(builder.newCharReader());
+  std::string error_message;
+  auto str = reinterpret_cast<const char*>(msg);
+  if (binary ||
+      !json_reader->parse(str, str + len, &message, &error_message) ||
+      !message.isObject() ||
+      message[webrtc_signaling::kTypeField].asString() != kSubscribeType) {
+    SendError("Expected a subscribe message");
+    Close();
+    return;
+  }
+  std::optional<uint64_t> version;
+  if (message.isMember(kVersionField) && message[kVersionField].isUInt64()) {
+    version = message[kVersionField].asUInt64();
+  }
+  feed_.Subscribe(version);
+}
+
+void DeviceListFeedHandler::OnDeviceListChange(
+    const DeviceListChange& change) {
+  feed_.OnDeviceListChange(change);
+}
+
+void DeviceListFeedHandler::SendError(const std::string& error) {
+  LOG(ERROR) << error;
+  auto reply = "{\"error\":\"" + error + "\"}";
+  EnqueueMessage(reply.c_str(), reply.size());
+}
+
+DeviceListFeedHandlerFactory::DeviceListFeedHandlerFactory(
+    DeviceRegistry& registry)
+    : registry_(registry) {}
+
+std::shared_ptr<WebSocketHandler> DeviceListFeedHandlerFactory::Build(
+    struct lws* wsi) {
+  return std::shared_ptr<WebSocketHandler>(
+      new DeviceListFeedHandler(wsi, registry_));
+}
+
 }  // namespace cuttlefish
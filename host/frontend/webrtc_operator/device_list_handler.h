@@ -15,7 +15,10 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 
 #include <json/json.h>
@@ -36,4 +39,64 @@ class DeviceListHandler : public DynHandler {
   DeviceRegistry& registry_;
 };
 
+// What one client of the device list feed has seen, and the messages that
+// keep it up to date. Safe to use from several threads: changes may be
+// delivered on the threads that make them while the client subscribes.
+class DeviceListFeed {
+ public:
+  DeviceListFeed(DeviceRegistry& registry,
+                 std::function<void(const std::string&)> send);
+
+  // Sends the changes since `version`, if the client has one and they are
+  // still known, and the whole list otherwise. Later changes are sent as they
+  // happen.
+  void Subscribe(std::optional<uint64_t> version);
+  void Unsubscribe();
+
+  void OnDeviceListChange(const DeviceListChange& change);
+
+ private:
+  // Sends the changes after version_, or the whole list if they are too old.
+  void CatchUpLocked();
+  void SendListLocked();
+  void SendChangeLocked(const DeviceListChange& change);
+
+  DeviceRegistry& registry_;
+  std::function<void(const std::string&)> send_;
+  std::mutex mutex_;
+  bool subscribed_ = false;
+  uint64_t version_ = 0;
+};
+
+// Pushes changes to the device list to websocket clients, so that they don't
+// need to poll the whole list.
+class DeviceListFeedHandler
+    : public WebSocketHandler,
+      public DeviceListObserver,
+      public std::enable_shared_from_this<DeviceListFeedHandler> {
+ public:
+  DeviceListFeedHandler(struct lws* wsi, DeviceRegistry& registry);
+
+  void OnReceive(const uint8_t* msg, size_t len, bool binary) override;
+  void OnConnected() override;
+  void OnClosed() override;
+
+  void OnDeviceListChange(const DeviceListChange& change) override;
+
+ private:
+  void SendError(const std::string& error);
+
+  DeviceRegistry& registry_;
+  DeviceListFeed feed_;
+};
+
+class DeviceListFeedHandlerFactory : public WebSocketHandlerFactory {
+ public:
+  DeviceListFeedHandlerFactory(DeviceRegistry& registry);
+  std::shared_ptr<WebSocketHandler> Build(struct lws* wsi) override;
+
+ private:
+  DeviceRegistry& registry_;
+};
+
 }  // namespace cuttlefish
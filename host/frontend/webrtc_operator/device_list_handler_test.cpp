@@ -0,0 +1,211 @@
+//
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/frontend/webrtc_operator/device_list_handler.h"
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "host/frontend/webrtc_operator/constants/signaling_constants.h"
+
+namespace cuttlefish {
+namespace {
+
+using ::testing::ElementsAre;
+
+class DeviceListFeedTest : public ::testing::Test {
+ protected:
+  // What the handler does for the feed, without a websocket.
+  class Forwarder : public DeviceListObserver {
+   public:
+    explicit Forwarder(DeviceListFeed& feed) : feed_(feed) {}
+    void OnDeviceListChange(const DeviceListChange& change) override {
+      feed_.OnDeviceListChange(change);
+    }
+
+   private:
+    DeviceListFeed& feed_;
+  };
+
+  void SetUp() override { registry_.AddObserver(forwarder_); }
+
+  std::vector<Json::Value> Sent() {
+    std::lock_guard lock(mutex_);
+    return sent_;
+  }
+
+  std::vector<uint64_t> SentVersions() {
+    std::vector<uint64_t> versions;
+    for (const auto& message : Sent()) {
+      versions.push_back(message["version"].asUInt64());
+    }
+    return versions;
+  }
+
+  DeviceRegistry registry_;
+  std::mutex mutex_;
+  std::vector<Json::Value> sent_;
+  DeviceListFeed feed_{registry_, [this](const std::string& message) {
+                         Json::Value json;
+                         Json::CharReaderBuilder builder;
+                         std::unique_ptr<Json::CharReader> reader(
+                             builder.newCharReader());
+                         std::string error;
+                         EXPECT_TRUE(reader->parse(
+                             message.data(), message.data() + message.size(),
+                             &json, &error))
+                             << error;
+                         std::lock_guard lock(mutex_);
+                         sent_.push_back(json);
+                       }};
+  std::shared_ptr<Forwarder> forwarder_ = std::make_shared<Forwarder>(feed_);
+};
+
+TEST_F(DeviceListFeedTest, SendsTheWholeListWithoutVersion) {
+  registry_.RegisterDevice("a", {});
+  registry_.RegisterDevice("b", {});
+  feed_.Subscribe(std::nullopt);
+
+  auto sent = Sent();
+  ASSERT_EQ(sent.size(), 1);
+  EXPECT_EQ(sent[0][webrtc_signaling::kTypeField].asString(), "device_list");
+  EXPECT_EQ(sent[0]["version"].asUInt64(), 2);
+  ASSERT_EQ(sent[0]["devices"].size(), 2);
+  EXPECT_EQ(sent[0]["devices"][0].asString(), "a");
+  EXPECT_EQ(sent[0]["devices"][1].asString(), "b");
+}
+
+TEST_F(DeviceListFeedTest, CatchesUpFromAKnownVersion) {
+  registry_.RegisterDevice("a", {});
+  registry_.RegisterDevice("b", {});
+  registry_.UnRegisterDevice("a");
+  feed_.Subscribe(1);
+
+  auto sent = Sent();
+  ASSERT_EQ(sent.size(), 2);
+  EXPECT_EQ(sent[0][webrtc_signaling::kTypeField].asString(), "device_added");
+  EXPECT_EQ(sent[0]["device_id"].asString(), "b");
+  EXPECT_EQ(sent[0]["version"].asUInt64(), 2);
+  EXPECT_EQ(sent[1][webrtc_signaling::kTypeField].asString(), "device_removed");
+  EXPECT_EQ(sent[1]["device_id"].asString(), "a");
+  EXPECT_EQ(sent[1]["version"].asUInt64(), 3);
+}
+
+TEST_F(DeviceListFeedTest, SendsTheWholeListForAnUnknownVersion) {
+  registry_.RegisterDevice("a", {});
+  // E.g. a version from before the operator restarted.
+  feed_.Subscribe(10);
+
+  auto sent = Sent();
+  ASSERT_EQ(sent.size(), 1);
+  EXPECT_EQ(sent[0][webrtc_signaling::kTypeField].asString(), "device_list");
+  EXPECT_EQ(sent[0]["version"].asUInt64(), 1);
+}
+
+TEST_F(DeviceListFeedTest, OnlyPassesOnNewerChanges) {
+  registry_.RegisterDevice("before", {});
+  feed_.Subscribe(std::nullopt);
+  registry_.RegisterDevice("a", {});
+  // Delivered late, or again.
+  feed_.OnDeviceListChange({1, true, "before"});
+  feed_.OnDeviceListChange({2, true, "a"});
+  registry_.UnRegisterDevice("a");
+
+  EXPECT_THAT(SentVersions(), ElementsAre(1, 2, 3));
+}
+
+TEST_F(DeviceListFeedTest, FillsTheGapWhenAChangeOvertakesAnother) {
+  feed_.Subscribe(std::nullopt);
+  // Deliver the changes by hand, the later one first.
+  forwarder_.reset();
+  registry_.RegisterDevice("a", {});
+  registry_.RegisterDevice("b", {});
+  feed_.OnDeviceListChange({2, true, "b"});
+  feed_.OnDeviceListChange({1, true, "a"});
+
+  auto sent = Sent();
+  ASSERT_EQ(sent.size(), 3);
+  EXPECT_EQ(sent[1]["device_id"].asString(), "a");
+  EXPECT_EQ(sent[2]["device_id"].asString(), "b");
+  EXPECT_THAT(SentVersions(), ElementsAre(0, 1, 2));
+}
+
+TEST_F(DeviceListFeedTest, StopsAfterUnsubscribing) {
+  feed_.Subscribe(std::nullopt);
+  registry_.RegisterDevice("a", {});
+  feed_.Unsubscribe();
+  registry_.RegisterDevice("b", {});
+
+  EXPECT_THAT(SentVersions(), ElementsAre(0, 1));
+}
+
+TEST_F(DeviceListFeedTest, ConvergesWithConcurrentChanges) {
+  constexpr int kThreads = 4;
+  constexpr int kDevicesPerThread = 100;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t]() {
+      for (int i = 0; i < kDevicesPerThread; i++) {
+        auto id = std::to_string(t) + "-" + std::to_string(i);
+        registry_.RegisterDevice(id, {});
+        if (i % 3 == 0) {
+          registry_.UnRegisterDevice(id);
+        }
+      }
+    });
+  }
+  feed_.Subscribe(std::nullopt);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Replaying what was sent gives the registry's list, and no version is
+  // sent twice or out of order.
+  std::set<std::string> devices;
+  uint64_t version = 0;
+  auto sent = Sent();
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(sent[0][webrtc_signaling::kTypeField].asString(), "device_list");
+  for (const auto& message : sent) {
+    if (message[webrtc_signaling::kTypeField].asString() == "device_list") {
+      version = message["version"].asUInt64();
+      for (const auto& device : message["devices"]) {
+        devices.insert(device.asString());
+      }
+      continue;
+    }
+    EXPECT_GT(message["version"].asUInt64(), version);
+    version = message["version"].asUInt64();
+    if (message[webrtc_signaling::kTypeField].asString() == "device_added") {
+      devices.insert(message["device_id"].asString());
+    } else {
+      devices.erase(message["device_id"].asString());
+    }
+  }
+  EXPECT_EQ(version, registry_.Snapshot()->version);
+  auto listed = registry_.ListDeviceIds();
+  EXPECT_EQ(devices, std::set<std::string>(listed.begin(), listed.end()));
+}
+
+}  // namespace
+}  // namespace cuttlefish
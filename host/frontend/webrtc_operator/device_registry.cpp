@@ -15,43 +15,70 @@
 
 #include "host/frontend/webrtc_operator/device_registry.h"
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 
 #include "host/frontend/webrtc_operator/device_handler.h"
 
 namespace cuttlefish {
+namespace {
+
+// Clients further behind than this get the whole list again.
+constexpr size_t kMaxRememberedChanges = 1024;
+
+}  // namespace
 
 bool DeviceRegistry::RegisterDevice(
     const std::string& device_id,
     std::weak_ptr<DeviceHandler> device_handler) {
-  if (devices_.count(device_id) > 0) {
-    LOG(ERROR) << "Device '" << device_id << "' is already registered";
-    return false;
-  }
+  DeviceListChange change;
+  {
+    std::unique_lock lock(mutex_);
+    if (devices_.count(device_id) > 0) {
+      LOG(ERROR) << "Device '" << device_id << "' is already registered";
+      return false;
+    }
 
-  devices_.try_emplace(device_id, device_handler);
+    devices_.try_emplace(device_id, device_handler);
+    RecordChange(true, device_id);
+    change = changes_.back();
+  }
   LOG(INFO) << "Registered device: '" << device_id << "'";
+  Notify(change);
   return true;
 }
 
 void DeviceRegistry::UnRegisterDevice(const std::string& device_id) {
-  auto record = devices_.find(device_id);
-  if (record == devices_.end()) {
-    LOG(WARNING) << "Requested to unregister an unkwnown device: '" << device_id
-                 << "'";
-    return;
+  DeviceListChange change;
+  {
+    std::unique_lock lock(mutex_);
+    auto record = devices_.find(device_id);
+    if (record == devices_.end()) {
+      LOG(WARNING) << "Requested to unregister an unkwnown device: '"
+                   << device_id << "'";
+      return;
+    }
+    devices_.erase(record);
+    RecordChange(false, device_id);
+    change = changes_.back();
   }
-  devices_.erase(record);
   LOG(INFO) << "Unregistered device: '" << device_id << "'";
+  Notify(change);
 }
 
 std::shared_ptr<DeviceHandler> DeviceRegistry::GetDevice(
     const std::string& device_id) {
-  if (devices_.count(device_id) == 0) {
-    LOG(INFO) << "Requested device (" << device_id << ") is not registered";
-    return nullptr;
+  std::shared_ptr<DeviceHandler> device_handler;
+  {
+    std::shared_lock lock(mutex_);
+    auto record = devices_.find(device_id);
+    if (record == devices_.end()) {
+      LOG(INFO) << "Requested device (" << device_id << ") is not registered";
+      return nullptr;
+    }
+    device_handler = record->second.lock();
   }
-  auto device_handler = devices_[device_id].lock();
   if (!device_handler) {
     LOG(WARNING) << "Destroyed device handler detected for device '"
                  << device_id << "'";
@@ -61,6 +88,7 @@ std::shared_ptr<DeviceHandler> DeviceRegistry::GetDevice(
 }
 
 std::vector<std::string> DeviceRegistry::ListDeviceIds() const {
+  std::shared_lock lock(mutex_);
   std::vector<std::string> ret;
   for (const auto& entry: devices_) {
     ret.push_back(entry.first);
@@ -68,4 +96,68 @@ std::vector<std::string> DeviceRegistry::ListDeviceIds() const {
   return ret;
 }
 
+std::shared_ptr<const DeviceListSnapshot> DeviceRegistry::Snapshot() const {
+  std::lock_guard snapshot_lock(snapshot_mutex_);
+  std::shared_lock lock(mutex_);
+  if (snapshot_ && snapshot_->version == version_) {
+    return snapshot_;
+  }
+  Json::Value list(Json::ValueType::arrayValue);
+  for (const auto& entry : devices_) {
+    list.append(entry.first);
+  }
+  Json::StreamWriterBuilder json_factory;
+  snapshot_ = std::make_shared<DeviceListSnapshot>(
+      DeviceListSnapshot{version_, Json::writeString(json_factory, list)});
+  return snapshot_;
+}
+
+std::optional<std::vector<DeviceListChange>> DeviceRegistry::ChangesSince(
+    uint64_t version) const {
+  std::shared_lock lock(mutex_);
+  if (version > version_) {
+    return std::nullopt;
+  }
+  // Versions are consecutive, so the changes needed are the last ones.
+  auto missed = version_ - version;
+  if (missed > changes_.size()) {
+    return std::nullopt;
+  }
+  return std::vector<DeviceListChange>(changes_.end() - missed,
+                                       changes_.end());
+}
+
+void DeviceRegistry::AddObserver(std::weak_ptr<DeviceListObserver> observer) {
+  std::lock_guard lock(observers_mutex_);
+  observers_.push_back(std::move(observer));
+}
+
+void DeviceRegistry::RecordChange(bool added, const std::string& device_id) {
+  changes_.push_back({++version_, added, device_id});
+  if (changes_.size() > kMaxRememberedChanges) {
+    changes_.pop_front();
+  }
+}
+
+void DeviceRegistry::Notify(const DeviceListChange& change) {
+  std::vector<std::shared_ptr<DeviceListObserver>> observers;
+  {
+    std::lock_guard lock(observers_mutex_);
+    auto expired = [&observers](const std::weak_ptr<DeviceListObserver>& weak) {
+      auto observer = weak.lock();
+      if (!observer) {
+        return true;
+      }
+      observers.push_back(std::move(observer));
+      return false;
+    };
+    observers_.erase(
+        std::remove_if(observers_.begin(), observers_.end(), expired),
+        observers_.end());
+  }
+  for (const auto& observer : observers) {
+    observer->OnDeviceListChange(change);
+  }
+}
+
 }  // namespace cuttlefish
@@ -17,8 +17,12 @@
 
 #include <cinttypes>
 
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
@@ -28,6 +32,30 @@ namespace cuttlefish {
 
 class DeviceHandler;
 
+// A device registered or unregistered. Every change gets the next version.
+struct DeviceListChange {
+  uint64_t version;
+  bool added;
+  std::string device_id;
+};
+
+// The registered devices at some version, as the JSON array served by the
+// device list endpoint.
+struct DeviceListSnapshot {
+  uint64_t version;
+  std::string json;
+};
+
+class DeviceListObserver {
+ public:
+  virtual ~DeviceListObserver() = default;
+  virtual void OnDeviceListChange(const DeviceListChange& change) = 0;
+};
+
+// Safe to use from several threads. Observers are notified on the thread
+// making the change, after the registry is unlocked, so they may see changes
+// slightly out of order. Versions are consecutive, a gap means an earlier
+// change is still on its way and can be read with ChangesSince.
 class DeviceRegistry {
  public:
   bool RegisterDevice(const std::string& device_id,
@@ -38,8 +66,30 @@ class DeviceRegistry {
 
   std::vector<std::string> ListDeviceIds() const;
 
+  // Only serialized again after the list changes.
+  std::shared_ptr<const DeviceListSnapshot> Snapshot() const;
+
+  // The changes after `version`, oldest first, or nothing if they are too old
+  // to still be known.
+  std::optional<std::vector<DeviceListChange>> ChangesSince(
+      uint64_t version) const;
+
+  void AddObserver(std::weak_ptr<DeviceListObserver> observer);
+
  private:
+  void RecordChange(bool added, const std::string& device_id);
+  void Notify(const DeviceListChange& change);
+
+  mutable std::shared_mutex mutex_;
   std::map<std::string, std::weak_ptr<DeviceHandler>> devices_;
+  uint64_t version_ = 0;
+  std::deque<DeviceListChange> changes_;
+
+  mutable std::mutex snapshot_mutex_;
+  mutable std::shared_ptr<const DeviceListSnapshot> snapshot_;
+
+  std::mutex observers_mutex_;
+  std::vector<std::weak_ptr<DeviceListObserver>> observers_;
 };
 
 }  // namespace cuttlefish
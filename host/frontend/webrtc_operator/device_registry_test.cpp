@@ -0,0 +1,154 @@
+//
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host/frontend/webrtc_operator/device_registry.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+namespace cuttlefish {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class RecordingObserver : public DeviceListObserver {
+ public:
+  void OnDeviceListChange(const DeviceListChange& change) override {
+    std::lock_guard lock(mutex_);
+    changes_.push_back(change);
+  }
+
+  std::vector<uint64_t> Versions() {
+    std::lock_guard lock(mutex_);
+    std::vector<uint64_t> versions;
+    for (const auto& change : changes_) {
+      versions.push_back(change.version);
+    }
+    return versions;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<DeviceListChange> changes_;
+};
+
+std::vector<std::string> ParseList(const std::string& json) {
+  Json::Value list;
+  Json::CharReaderBuilder builder;
+  std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+  std::string error;
+  EXPECT_TRUE(reader->parse(json.data(), json.data() + json.size(), &list,
+                            &error))
+      << error;
+  std::vector<std::string> devices;
+  for (const auto& device : list) {
+    devices.push_back(device.asString());
+  }
+  return devices;
+}
+
+TEST(DeviceRegistryTest, EveryChangeGetsTheNextVersion) {
+  DeviceRegistry registry;
+  EXPECT_TRUE(registry.RegisterDevice("a", {}));
+  EXPECT_TRUE(registry.RegisterDevice("b", {}));
+  // Failed changes don't count.
+  EXPECT_FALSE(registry.RegisterDevice("a", {}));
+  registry.UnRegisterDevice("unknown");
+  registry.UnRegisterDevice("a");
+
+  auto changes = registry.ChangesSince(0);
+  ASSERT_TRUE(changes);
+  ASSERT_EQ(changes->size(), 3);
+  EXPECT_EQ((*changes)[0].version, 1);
+  EXPECT_TRUE((*changes)[0].added);
+  EXPECT_EQ((*changes)[0].device_id, "a");
+  EXPECT_EQ((*changes)[2].version, 3);
+  EXPECT_FALSE((*changes)[2].added);
+  EXPECT_EQ((*changes)[2].device_id, "a");
+  EXPECT_THAT(registry.ListDeviceIds(), ElementsAre("b"));
+}
+
+TEST(DeviceRegistryTest, SnapshotFollowsChanges) {
+  DeviceRegistry registry;
+  auto empty = registry.Snapshot();
+  EXPECT_EQ(empty->version, 0);
+  EXPECT_THAT(ParseList(empty->json), IsEmpty());
+
+  registry.RegisterDevice("a", {});
+  registry.RegisterDevice("b", {});
+  auto snapshot = registry.Snapshot();
+  EXPECT_EQ(snapshot->version, 2);
+  EXPECT_THAT(ParseList(snapshot->json), ElementsAre("a", "b"));
+  // Not serialized again until the list changes.
+  EXPECT_EQ(registry.Snapshot(), snapshot);
+
+  registry.UnRegisterDevice("a");
+  EXPECT_THAT(ParseList(registry.Snapshot()->json), ElementsAre("b"));
+}
+
+TEST(DeviceRegistryTest, ChangesSince) {
+  DeviceRegistry registry;
+  registry.RegisterDevice("a", {});
+  registry.RegisterDevice("b", {});
+  registry.RegisterDevice("c", {});
+
+  auto changes = registry.ChangesSince(1);
+  ASSERT_TRUE(changes);
+  ASSERT_EQ(changes->size(), 2);
+  EXPECT_EQ((*changes)[0].device_id, "b");
+  EXPECT_EQ((*changes)[1].device_id, "c");
+  changes = registry.ChangesSince(3);
+  ASSERT_TRUE(changes);
+  EXPECT_THAT(*changes, IsEmpty());
+  // From the future, e.g. from before a restart.
+  EXPECT_FALSE(registry.ChangesSince(4));
+}
+
+TEST(DeviceRegistryTest, ForgetsOldChanges) {
+  DeviceRegistry registry;
+  for (int i = 0; i < 2000; i++) {
+    registry.RegisterDevice(std::to_string(i), {});
+  }
+  EXPECT_FALSE(registry.ChangesSince(0));
+  auto recent = registry.ChangesSince(1990);
+  ASSERT_TRUE(recent);
+  EXPECT_EQ(recent->size(), 10);
+}
+
+TEST(DeviceRegistryTest, NotifiesObservers) {
+  DeviceRegistry registry;
+  auto observer = std::make_shared<RecordingObserver>();
+  registry.RegisterDevice("before", {});
+  registry.AddObserver(observer);
+  registry.RegisterDevice("a", {});
+  registry.UnRegisterDevice("a");
+  EXPECT_THAT(observer->Versions(), ElementsAre(2, 3));
+
+  // Dropped observers are forgotten.
+  std::weak_ptr<RecordingObserver> weak = observer;
+  observer.reset();
+  registry.RegisterDevice("b", {});
+  EXPECT_TRUE(weak.expired());
+}
+
+}  // namespace
+}  // namespace cuttlefish
@@ -36,12 +36,15 @@ DEFINE_string(certs_dir, "webrtc/certs",
               "server.key file and (optionally) a CA.crt file.");
 DEFINE_string(stun_server, "stun.l.google.com:19302",
               "host:port of STUN server to use for public address resolution");
+DEFINE_uint32(service_threads, 1,
+              "Threads serving connections. Each handles a share of them.");
 
 namespace {
 
 constexpr auto kRegisterDeviceUriPath = "/register_device";
 constexpr auto kConnectClientUriPath = "/connect_client";
 constexpr auto kListDevicesUriPath = "/devices";
+constexpr auto kDeviceListFeedUriPath = "/device_list_feed";
 const constexpr auto kInfraConfigPath = "/infra_config";
 const constexpr auto kConnectPath = "/connect";
 const constexpr auto kForwardPath = "/forward";
@@ -72,6 +75,12 @@ int main(int argc, char** argv) {
             new cuttlefish::DeviceListHandler(wsi, device_registry));
       });
 
+  auto device_list_feed_factory_p =
+      std::unique_ptr<cuttlefish::WebSocketHandlerFactory>(
+          new cuttlefish::DeviceListFeedHandlerFactory(device_registry));
+  wss.RegisterHandlerFactory(kDeviceListFeedUriPath,
+                             std::move(device_list_feed_factory_p));
+
   // Websocket signaling endpoints
   auto device_handler_factory_p =
       std::unique_ptr<cuttlefish::WebSocketHandlerFactory>(
@@ -108,6 +117,6 @@ int main(int argc, char** argv) {
             new cuttlefish::PollHandler(wsi, &poll_store));
       });
 
-  wss.Serve();
+  wss.Serve(FLAGS_service_threads);
   return 0;
 }
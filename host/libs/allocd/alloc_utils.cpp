@@ -15,12 +15,39 @@
  */
 #include "host/libs/allocd/alloc_utils.h"
 
+#include <grp.h>
+
 #include <cstdint>
 #include <fstream>
 
 #include "android-base/logging.h"
+#include "android-base/parseint.h"
+#include "host/libs/allocd/netlink_ops.h"
 
 namespace cuttlefish {
+namespace {
+
+constexpr char kTapGroup[] = "cvdnetwork";
+
+std::optional<int> PrefixLength(const std::string& netmask) {
+  int prefix_length;
+  if (netmask.empty() || netmask[0] != '/' ||
+      !android::base::ParseInt(netmask.substr(1), &prefix_length, 0, 32)) {
+    LOG(ERROR) << "Invalid netmask: " << netmask;
+    return std::nullopt;
+  }
+  return prefix_length;
+}
+
+}  // namespace
+
+bool ApplyLinkBatch(LinkBatch& batch) {
+  if (batch.Empty()) {
+    return true;
+  }
+  auto client = RouteNetlinkClient();
+  return client && batch.Apply(*client);
+}
 
 int RunExternalCommand(const std::string& command) {
   FILE* fp;
@@ -50,52 +77,89 @@ int RunExternalCommand(const std::string& command) {
 }
 
 bool AddTapIface(const std::string& name) {
-  std::stringstream ss;
-  ss << "ip tuntap add dev " << name << " mode tap group cvdnetwork vnet_hdr";
-  auto add_command = ss.str();
-  LOG(INFO) << "Create tap interface: " << add_command;
-  int status = RunExternalCommand(add_command);
-  return status == 0;
+  LOG(INFO) << "Create tap interface: " << name;
+  auto group = getgrnam(kTapGroup);
+  if (group == nullptr) {
+    LOG(ERROR) << "Unable to find group " << kTapGroup;
+    return false;
+  }
+  return CreateTapDevice(name, group->gr_gid);
 }
 
 bool ShutdownIface(const std::string& name) {
-  std::stringstream ss;
-  ss << "ip link set dev " << name << " down";
-  auto link_command = ss.str();
-  LOG(INFO) << "Shutdown tap interface: " << link_command;
-  int status = RunExternalCommand(link_command);
-
-  return status == 0;
+  LOG(INFO) << "Shutdown tap interface: " << name;
+  LinkBatch batch;
+  batch.SetUp(name, false);
+  return ApplyLinkBatch(batch);
 }
 
 bool BringUpIface(const std::string& name) {
-  std::stringstream ss;
-  ss << "ip link set dev " << name << " up";
-  auto link_command = ss.str();
-  LOG(INFO) << "Bring up tap interface: " << link_command;
-  int status = RunExternalCommand(link_command);
-
-  return status == 0;
+  LOG(INFO) << "Bring up tap interface: " << name;
+  LinkBatch batch;
+  batch.SetUp(name, true);
+  return ApplyLinkBatch(batch);
 }
 
 bool CreateEthernetIface(const std::string& name, const std::string& bridge_name,
                          bool has_ipv4_bridge, bool has_ipv6_bridge,
                          bool use_ebtables_legacy) {
+  LinkBatch links;
+  if (!CreateEthernetIface(name, bridge_name, has_ipv4_bridge, has_ipv6_bridge,
+                           use_ebtables_legacy, links)) {
+    return false;
+  }
+  if (!ApplyLinkBatch(links)) {
+    LOG(WARNING) << "Failed to link tap interface " << name << " to "
+                 << bridge_name;
+    DestroyEthernetIface(name, has_ipv4_bridge, has_ipv6_bridge,
+                         use_ebtables_legacy);
+    return false;
+  }
+  return true;
+}
+
+bool CreateEthernetIface(const std::string& name, const std::string& bridge_name,
+                         bool has_ipv4_bridge, bool has_ipv6_bridge,
+                         bool use_ebtables_legacy, LinkBatch& links) {
   // assume bridge exists
 
   EthernetNetworkConfig config{false, false, false};
 
-  if (!CreateTap(name)) {
+  if (!AddTapIface(name)) {
     return false;
   }
 
   config.has_tap = true;
 
-  if (!LinkTapToBridge(name, bridge_name)) {
-    CleanupEthernetIface(name, config);
-    return false;
+  if (!has_ipv4_bridge) {
+    if (!CreateEbtables(name, true, use_ebtables_legacy)) {
+      CleanupEthernetIface(name, config);
+      return false;
+    }
+    config.has_broute_ipv4 = true;
   }
 
+  if (!has_ipv6_bridge) {
+    if (!CreateEbtables(name, false, use_ebtables_legacy)) {
+      CleanupEthernetIface(name, config);
+      return false;
+    }
+    config.has_broute_ipv6 = true;
+  }
+
+  // Only added once nothing can fail anymore, so that a failed interface
+  // leaves nothing behind in the batch.
+  links.SetUp(name, true);
+  links.SetMaster(name, bridge_name);
+  return true;
+}
+
+bool AdoptEthernetIface(const std::string& warm_name, const std::string& name,
+                        bool has_ipv4_bridge, bool has_ipv6_bridge,
+                        bool use_ebtables_legacy, LinkBatch& links) {
+  // The rules match the new name, they can go in before the rename.
+  EthernetNetworkConfig config{false, false, false, use_ebtables_legacy};
+
   if (!has_ipv4_bridge) {
     if (!CreateEbtables(name, true, use_ebtables_legacy)) {
       CleanupEthernetIface(name, config);
@@ -105,13 +169,14 @@ bool CreateEthernetIface(const std::string& name, const std::string& bridge_name
   }
 
   if (!has_ipv6_bridge) {
-    if (CreateEbtables(name, false, use_ebtables_legacy)) {
+    if (!CreateEbtables(name, false, use_ebtables_legacy)) {
       CleanupEthernetIface(name, config);
       return false;
     }
     config.has_broute_ipv6 = true;
   }
 
+  links.Rename(warm_name, name);
   return true;
 }
 
@@ -130,6 +195,20 @@ std::string MobileNetworkName(const std::string& ipaddr,
 
 bool CreateMobileIface(const std::string& name, uint16_t id,
                        const std::string& ipaddr) {
+  LinkBatch links;
+  if (!CreateMobileIface(name, id, ipaddr, links)) {
+    return false;
+  }
+  if (!ApplyLinkBatch(links)) {
+    LOG(WARNING) << "Failed to set up mobile interface " << name;
+    DestroyMobileIface(name, id, ipaddr);
+    return false;
+  }
+  return true;
+}
+
+bool CreateMobileIface(const std::string& name, uint16_t id,
+                       const std::string& ipaddr, LinkBatch& links) {
   if (id > kMaxIfaceNameId) {
     LOG(ERROR) << "ID exceeds maximum value to assign a netmask: " << id;
     return false;
@@ -138,64 +217,84 @@ bool CreateMobileIface(const std::string& name, uint16_t id,
   auto netmask = "/30";
   auto gateway = MobileGatewayName(ipaddr, id);
   auto network = MobileNetworkName(ipaddr, netmask, id);
-
-  if (!CreateTap(name)) {
+  auto prefix_length = PrefixLength(netmask);
+  if (!prefix_length) {
     return false;
   }
 
-  if (!AddGateway(name, gateway, netmask)) {
-    DestroyIface(name);
+  if (!AddTapIface(name)) {
+    return false;
   }
 
   if (!IptableConfig(network, true)) {
-    DestroyGateway(name, gateway, netmask);
-    DestroyIface(name);
+    DeleteIface(name);
     return false;
   };
 
+  // Only added once nothing can fail anymore, so that a failed interface
+  // leaves nothing behind in the batch.
+  links.SetUp(name, true);
+  links.SetAddress(name, gateway, *prefix_length, true);
   return true;
 }
 
 bool DestroyMobileIface(const std::string& name, uint16_t id,
                         const std::string& ipaddr) {
+  LinkBatch links;
+  return DestroyMobileIface(name, id, ipaddr, links) && ApplyLinkBatch(links);
+}
+
+bool DestroyMobileIface(const std::string& name, uint16_t id,
+                        const std::string& ipaddr, LinkBatch& links) {
   if (id > 63) {
     LOG(ERROR) << "ID exceeds maximum value to assign a netmask: " << id;
     return false;
   }
 
   auto netmask = "/30";
-  auto gateway = MobileGatewayName(ipaddr, id);
   auto network = MobileNetworkName(ipaddr, netmask, id);
 
   IptableConfig(network, false);
-  DestroyGateway(name, gateway, netmask);
-  return DestroyIface(name);
+  // The gateway address goes away with the link.
+  links.Delete(name);
+  return true;
 }
 
 bool AddGateway(const std::string& name, const std::string& gateway,
                 const std::string& netmask) {
-  std::stringstream ss;
-  ss << "ip addr add " << gateway << netmask << " broadcast + dev " << name;
-  auto command = ss.str();
-  LOG(INFO) << "setup gateway: " << command;
-  int status = RunExternalCommand(command);
-
-  return status == 0;
+  LOG(INFO) << "setup gateway: " << gateway << netmask << " on " << name;
+  auto prefix_length = PrefixLength(netmask);
+  if (!prefix_length) {
+    return false;
+  }
+  LinkBatch batch;
+  batch.SetAddress(name, gateway, *prefix_length, true);
+  return ApplyLinkBatch(batch);
 }
 
 bool DestroyGateway(const std::string& name, const std::string& gateway,
                     const std::string& netmask) {
-  std::stringstream ss;
-  ss << "ip addr del " << gateway << netmask << " broadcast + dev " << name;
-  auto command = ss.str();
-  LOG(INFO) << "removing gateway: " << command;
-  int status = RunExternalCommand(command);
-
-  return status == 0;
+  LOG(INFO) << "removing gateway: " << gateway << netmask << " from " << name;
+  auto prefix_length = PrefixLength(netmask);
+  if (!prefix_length) {
+    return false;
+  }
+  LinkBatch batch;
+  batch.SetAddress(name, gateway, *prefix_length, false);
+  return ApplyLinkBatch(batch);
 }
 
 bool DestroyEthernetIface(const std::string& name, bool has_ipv4_bridge,
                           bool has_ipv6_bridge, bool use_ebtables_legacy) {
+  LinkBatch links;
+  return DestroyEthernetIface(name, has_ipv4_bridge, has_ipv6_bridge,
+                              use_ebtables_legacy, links) &&
+         ApplyLinkBatch(links);
+}
+
+bool DestroyEthernetIface(const std::string& name, bool has_ipv4_bridge,
+                          bool has_ipv6_bridge, bool use_ebtables_legacy,
+                          LinkBatch& links) {
   if (!has_ipv6_bridge) {
     DestroyEbtables(name, false, use_ebtables_legacy);
   }
@@ -204,7 +303,8 @@ bool DestroyEthernetIface(const std::string& name, bool has_ipv4_bridge,
     DestroyEbtables(name, true, use_ebtables_legacy);
   }
 
-  return DestroyIface(name);
+  links.Delete(name);
+  return true;
 }
 
 void CleanupEthernetIface(const std::string& name,
@@ -273,12 +373,9 @@ bool EbtablesFilter(const std::string& name, bool use_ipv4, bool add,
 
 bool LinkTapToBridge(const std::string& tap_name,
                      const std::string& bridge_name) {
-  std::stringstream ss;
-  ss << "ip link set dev " << tap_name << " master " << bridge_name;
-  auto command = ss.str();
-  int status = RunExternalCommand(command);
-
-  return status == 0;
+  LinkBatch batch;
+  batch.SetMaster(tap_name, bridge_name);
+  return ApplyLinkBatch(batch);
 }
 
 bool CreateTap(const std::string& name) {
@@ -298,13 +395,17 @@ bool CreateTap(const std::string& name) {
 }
 
 bool DeleteIface(const std::string& name) {
-  std::stringstream ss;
-  ss << "ip link delete " << name;
-  auto link_command = ss.str();
-  LOG(INFO) << "Delete tap interface: " << link_command;
-  int status = RunExternalCommand(link_command);
+  LOG(INFO) << "Delete tap interface: " << name;
+  LinkBatch batch;
+  batch.Delete(name);
+  return ApplyLinkBatch(batch);
+}
 
-  return status == 0;
+bool RenameIface(const std::string& name, const std::string& new_name) {
+  LOG(INFO) << "Rename interface " << name << " to " << new_name;
+  LinkBatch batch;
+  batch.Rename(name, new_name);
+  return ApplyLinkBatch(batch);
 }
 
 bool DestroyIface(const std::string& name) {
@@ -333,19 +434,11 @@ std::optional<std::string> GetUserName(uid_t uid) {
 }
 
 bool CreateBridge(const std::string& name) {
-  std::stringstream ss;
-  ss << "ip link add name " << name
-     << " type bridge forward_delay 0 stp_state 0";
-
-  auto command = ss.str();
-  LOG(INFO) << "create bridge: " << command;
-  int status = RunExternalCommand(command);
-
-  if (status != 0) {
-    return false;
-  }
-
-  return BringUpIface(name);
+  LOG(INFO) << "create bridge: " << name;
+  // Created up, in the same message.
+  LinkBatch batch;
+  batch.CreateBridge(name);
+  return ApplyLinkBatch(batch);
 }
 
 bool DestroyBridge(const std::string& name) { return DeleteIface(name); }
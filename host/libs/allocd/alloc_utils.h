@@ -38,6 +38,9 @@ constexpr char kWirelessIp[] = "192.168.96";
 constexpr char kMobileIp[] = "192.168.97";
 // Ethernet network prefix
 constexpr char kEthernetIp[] = "192.168.98";
+// Bridges the wireless and ethernet taps are attached to
+constexpr char kWirelessBridge[] = "cvd-wbr";
+constexpr char kEthernetBridge[] = "cvd-ebr";
 // permission bits for socket
 constexpr int kSocketMode = 0666;
 
@@ -62,9 +65,14 @@ struct GatewayConfig {
   bool has_iptable = false;
 };
 
+class LinkBatch;
+
 int RunExternalCommand(const std::string& command);
 std::optional<std::string> GetUserName(uid_t uid);
 
+// Sends the changes in `batch` with the netlink client of the calling thread.
+bool ApplyLinkBatch(LinkBatch& batch);
+
 bool AddTapIface(const std::string& name);
 bool CreateTap(const std::string& name);
 
@@ -73,6 +81,7 @@ bool ShutdownIface(const std::string& name);
 
 bool DestroyIface(const std::string& name);
 bool DeleteIface(const std::string& name);
+bool RenameIface(const std::string& name, const std::string& new_name);
 
 bool CreateBridge(const std::string& name);
 bool DestroyBridge(const std::string& name);
@@ -86,19 +95,38 @@ bool EbtablesBroute(const std::string& name, bool use_ipv4, bool add,
 bool EbtablesFilter(const std::string& name, bool use_ipv4, bool add,
                     bool use_ebtables_legacy);
 
+// The overloads taking a LinkBatch create the taps and run the commands right
+// away, but leave the link and address changes in `links`, so that those of
+// many interfaces can be sent together. When they fail, they undo what they
+// did and add nothing to `links`. The others apply their own changes.
 bool CreateMobileIface(const std::string& name, uint16_t id,
                        const std::string& ipaddr);
+bool CreateMobileIface(const std::string& name, uint16_t id,
+                       const std::string& ipaddr, LinkBatch& links);
 bool DestroyMobileIface(const std::string& name, uint16_t id,
                         const std::string& ipaddr);
+bool DestroyMobileIface(const std::string& name, uint16_t id,
+                        const std::string& ipaddr, LinkBatch& links);
 
 bool CreateEthernetIface(const std::string& name, const std::string& bridge_name,
                          bool has_ipv4_bridge, bool has_ipv6_bridge,
                          bool use_ebtables_legacy);
+bool CreateEthernetIface(const std::string& name, const std::string& bridge_name,
+                         bool has_ipv4_bridge, bool has_ipv6_bridge,
+                         bool use_ebtables_legacy, LinkBatch& links);
 bool DestroyEthernetIface(const std::string& name,
                           bool has_ipv4_bridge, bool use_ipv6,
                           bool use_ebtables_legacy);
+bool DestroyEthernetIface(const std::string& name, bool has_ipv4_bridge,
+                          bool use_ipv6, bool use_ebtables_legacy,
+                          LinkBatch& links);
 void CleanupEthernetIface(const std::string& name,
                           const EthernetNetworkConfig& config);
+// Renames a tap set up by CreateEthernetIface without ebtables rules, and adds
+// the rules the bridge configuration calls for.
+bool AdoptEthernetIface(const std::string& warm_name, const std::string& name,
+                        bool has_ipv4_bridge, bool has_ipv6_bridge,
+                        bool use_ebtables_legacy, LinkBatch& links);
 
 bool IptableConfig(const std::string& network, bool add);
 
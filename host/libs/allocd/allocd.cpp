@@ -41,6 +41,9 @@
 
 DEFINE_string(socket_path, cuttlefish::kDefaultLocation, "Socket path");
 DEFINE_bool(ebtables_legacy, false, "use ebtables-legacy instead of ebtables");
+DEFINE_uint32(warm_pool_size, 0,
+              "Number of mobile, wireless and ethernet taps of each kind to "
+              "keep set up ahead of requests");
 
 int main(int argc, char* argv[]) {
   ::android::base::InitLogging(argv, android::base::StderrLogger);
@@ -52,6 +55,7 @@ int main(int argc, char* argv[]) {
     cuttlefish::ResourceManager m;
     m.SetSocketLocation(FLAGS_socket_path);
     m.SetUseEbtablesLegacy(FLAGS_ebtables_legacy);
+    m.StartWarmPool(FLAGS_warm_pool_size);
     m.JsonServer();
   }
 
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "host/libs/allocd/iface_ids.h"
+
+#include <utility>
+
+#include "host/libs/allocd/alloc_utils.h"
+
+namespace cuttlefish {
+
+IfaceIds::Reservation::Reservation(IfaceIds* ids, IfaceType type, uint16_t id)
+    : ids_(ids), type_(type), id_(id) {}
+
+IfaceIds::Reservation::Reservation(Reservation&& other)
+    : ids_(std::exchange(other.ids_, nullptr)),
+      type_(other.type_),
+      id_(other.id_) {}
+
+IfaceIds::Reservation& IfaceIds::Reservation::operator=(Reservation&& other) {
+  if (this != &other) {
+    if (ids_) {
+      ids_->Release(type_, id_);
+    }
+    ids_ = std::exchange(other.ids_, nullptr);
+    type_ = other.type_;
+    id_ = other.id_;
+  }
+  return *this;
+}
+
+IfaceIds::Reservation::~Reservation() {
+  if (ids_) {
+    ids_->Release(type_, id_);
+  }
+}
+
+std::optional<IfaceIds::Reservation> IfaceIds::Reserve(IfaceType type,
+                                                       uint32_t hint) {
+  std::lock_guard lock(mutex_);
+  auto& taken = taken_[type];
+  for (uint32_t i = 0; i < kMaxIfaceNameId; i++) {
+    uint16_t id = (hint % kMaxIfaceNameId + i) % kMaxIfaceNameId;
+    if (taken.insert(id).second) {
+      return Reservation(this, type, id);
+    }
+  }
+  return std::nullopt;
+}
+
+void IfaceIds::Release(IfaceType type, uint16_t id) {
+  std::lock_guard lock(mutex_);
+  taken_[type].erase(id);
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+
+#include "host/libs/allocd/request.h"
+
+namespace cuttlefish {
+
+/* The small ids at the end of interface names, from which mobile taps also
+ * derive their subnet and NAT rule. The taps created on demand and the idle
+ * ones of the WarmPool take their ids from here, so that no two interfaces of
+ * the same type ever share one.
+ */
+class IfaceIds {
+ public:
+  // Keeps an id taken until it is destroyed.
+  class Reservation {
+   public:
+    Reservation(Reservation&& other);
+    Reservation& operator=(Reservation&& other);
+    ~Reservation();
+
+    uint16_t id() const { return id_; }
+
+   private:
+    friend class IfaceIds;
+    Reservation(IfaceIds* ids, IfaceType type, uint16_t id);
+
+    IfaceIds* ids_;
+    IfaceType type_;
+    uint16_t id_;
+  };
+
+  IfaceIds() = default;
+  IfaceIds(const IfaceIds&) = delete;
+  IfaceIds& operator=(const IfaceIds&) = delete;
+
+  // Takes `hint` modulo kMaxIfaceNameId, or the next free id after it, the
+  // same way for every caller. Returns nothing if all the ids of `type` are
+  // taken. Thread safe.
+  std::optional<Reservation> Reserve(IfaceType type, uint32_t hint);
+
+ private:
+  void Release(IfaceType type, uint16_t id);
+
+  std::mutex mutex_;
+  std::map<IfaceType, std::set<uint16_t>> taken_;
+};
+
+}  // namespace cuttlefish
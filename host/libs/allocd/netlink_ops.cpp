@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/allocd/netlink_ops.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/if_addr.h>
+#include <linux/if_link.h>
+#include <linux/if_tun.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include <android-base/logging.h>
+
+#include "common/libs/fs/shared_fd.h"
+
+namespace cuttlefish {
+namespace {
+
+NetlinkRequest LinkRequest(int type, int flags, const std::string& name,
+                           std::optional<bool> up) {
+  NetlinkRequest request(type, flags);
+  auto info = request.Reserve<ifinfomsg>();
+  info->ifi_family = AF_UNSPEC;
+  if (up) {
+    info->ifi_change = IFF_UP;
+    info->ifi_flags = *up ? IFF_UP : 0;
+  }
+  request.AddString(IFLA_IFNAME, name);
+  return request;
+}
+
+}  // namespace
+
+bool CreateTapDevice(const std::string& name, std::optional<gid_t> group) {
+  if (name.size() >= IFNAMSIZ) {
+    LOG(ERROR) << "Interface name too long: " << name;
+    return false;
+  }
+  auto tun = SharedFD::Open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+  if (!tun->IsOpen()) {
+    LOG(ERROR) << "Unable to open /dev/net/tun: " << tun->StrError();
+    return false;
+  }
+  struct ifreq ifr {};
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR;
+  strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+  if (tun->Ioctl(TUNSETIFF, &ifr) < 0) {
+    LOG(ERROR) << "Unable to create tap interface " << name << ": "
+               << tun->StrError();
+    return false;
+  }
+  // Until it is made persistent, the device goes away with the file
+  // descriptor if anything below fails.
+  if (group) {
+    auto gid = static_cast<uintptr_t>(*group);
+    if (tun->Ioctl(TUNSETGROUP, reinterpret_cast<void*>(gid)) < 0) {
+      LOG(ERROR) << "Unable to set the group of " << name << ": "
+                 << tun->StrError();
+      return false;
+    }
+  }
+  if (tun->Ioctl(TUNSETPERSIST, reinterpret_cast<void*>(1)) < 0) {
+    LOG(ERROR) << "Unable to make " << name << " persistent: "
+               << tun->StrError();
+    return false;
+  }
+  return true;
+}
+
+void LinkBatch::CreateBridge(const std::string& name) {
+  auto request =
+      LinkRequest(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, name, true);
+  request.PushList(IFLA_LINKINFO);
+  request.AddString(IFLA_INFO_KIND, "bridge");
+  request.PushList(IFLA_INFO_DATA);
+  request.AddInt<uint32_t>(IFLA_BR_FORWARD_DELAY, 0);
+  request.AddInt<uint32_t>(IFLA_BR_STP_STATE, 0);
+  request.PopList();
+  request.PopList();
+  requests_.emplace_back(std::move(request));
+}
+
+void LinkBatch::SetUp(const std::string& name, bool up) {
+  requests_.emplace_back(LinkRequest(RTM_SETLINK, 0, name, up));
+}
+
+void LinkBatch::SetMaster(const std::string& name, const std::string& master) {
+  uint32_t master_index = if_nametoindex(master.c_str());
+  if (master_index == 0) {
+    PLOG(ERROR) << "Unable to find interface " << master;
+    resolved_ = false;
+    return;
+  }
+  auto request = LinkRequest(RTM_SETLINK, 0, name, std::nullopt);
+  request.AddInt(IFLA_MASTER, master_index);
+  requests_.emplace_back(std::move(request));
+}
+
+void LinkBatch::Rename(const std::string& name, const std::string& new_name) {
+  uint32_t index = if_nametoindex(name.c_str());
+  if (index == 0) {
+    PLOG(ERROR) << "Unable to find interface " << name;
+    resolved_ = false;
+    return;
+  }
+  SetUp(name, false);
+  NetlinkRequest request(RTM_SETLINK, 0);
+  auto info = request.Reserve<ifinfomsg>();
+  info->ifi_family = AF_UNSPEC;
+  info->ifi_index = index;
+  request.AddString(IFLA_IFNAME, new_name);
+  requests_.emplace_back(std::move(request));
+  SetUp(new_name, true);
+}
+
+void LinkBatch::Delete(const std::string& name) {
+  requests_.emplace_back(LinkRequest(RTM_DELLINK, 0, name, std::nullopt));
+}
+
+void LinkBatch::SetAddress(const std::string& name, const std::string& address,
+                           int prefix_length, bool add) {
+  uint32_t index = if_nametoindex(name.c_str());
+  if (index == 0) {
+    PLOG(ERROR) << "Unable to find interface " << name;
+    resolved_ = false;
+    return;
+  }
+  in_addr_t local = inet_addr(address.c_str());
+  if (local == INADDR_NONE || prefix_length < 0 || prefix_length > 32) {
+    LOG(ERROR) << "Invalid address " << address << "/" << prefix_length;
+    resolved_ = false;
+    return;
+  }
+  NetlinkRequest request(add ? RTM_NEWADDR : RTM_DELADDR,
+                         add ? NLM_F_CREATE | NLM_F_EXCL : 0);
+  auto info = request.Reserve<ifaddrmsg>();
+  info->ifa_family = AF_INET;
+  info->ifa_prefixlen = prefix_length;
+  info->ifa_flags = IFA_F_PERMANENT;
+  info->ifa_scope = RT_SCOPE_UNIVERSE;
+  info->ifa_index = index;
+  request.AddInt(IFA_LOCAL, local);
+  request.AddInt(IFA_ADDRESS, local);
+  if (add) {
+    // What `broadcast +` picks: all the host bits set.
+    uint32_t host_mask =
+        prefix_length == 32 ? 0 : (UINT32_MAX >> prefix_length);
+    request.AddInt(IFA_BROADCAST, local | htonl(host_mask));
+  }
+  requests_.emplace_back(std::move(request));
+}
+
+bool LinkBatch::Apply(NetlinkClient& client) {
+  auto requests = std::move(requests_);
+  requests_.clear();
+  if (!std::exchange(resolved_, true)) {
+    LOG(ERROR) << "Not applying link changes with missing interfaces";
+    return false;
+  }
+  return client.SendBatch(requests);
+}
+
+NetlinkClient* RouteNetlinkClient() {
+  // Replies are matched to requests by sequence number, so threads can't
+  // share a socket.
+  static thread_local auto client = []() {
+    auto client = NetlinkClientFactory::Default()->New(NETLINK_ROUTE);
+    LOG_IF(ERROR, !client) << "Unable to open a netlink socket";
+    return client;
+  }();
+  return client.get();
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/libs/net/netlink_client.h"
+#include "common/libs/net/netlink_request.h"
+
+namespace cuttlefish {
+
+// Creates a persistent tap device, the equivalent of
+// `ip tuntap add dev <name> mode tap group <group> vnet_hdr`.
+bool CreateTapDevice(const std::string& name, std::optional<gid_t> group);
+
+// Collects link and address changes to send to the kernel together, the
+// equivalent of a sequence of `ip link` and `ip addr` commands.
+//
+// Links are referred to by name, so changes can follow the creation of the
+// link in the same batch. The exception are masters, addresses and renamed
+// links, which are looked up when the change is added and so must already
+// exist.
+class LinkBatch {
+ public:
+  // `ip link add name <name> type bridge forward_delay 0 stp_state 0`,
+  // followed by `ip link set dev <name> up`.
+  void CreateBridge(const std::string& name);
+  // `ip link set dev <name> up|down`.
+  void SetUp(const std::string& name, bool up);
+  // `ip link set dev <name> master <master>`.
+  void SetMaster(const std::string& name, const std::string& master);
+  // `ip link set dev <name> down`, `ip link set dev <name> name <new_name>`
+  // and `ip link set dev <new_name> up`. Links can only be renamed while down.
+  void Rename(const std::string& name, const std::string& new_name);
+  // `ip link delete <name>`.
+  void Delete(const std::string& name);
+  // `ip addr add|del <address>/<prefix_length> broadcast + dev <name>`.
+  void SetAddress(const std::string& name, const std::string& address,
+                  int prefix_length, bool add);
+
+  // Whether there is nothing to apply.
+  bool Empty() const { return requests_.empty() && resolved_; }
+
+  // Sends all the changes added so far. Returns whether they all succeeded.
+  bool Apply(NetlinkClient& client);
+
+ private:
+  std::vector<NetlinkRequest> requests_;
+  bool resolved_ = true;
+};
+
+// The NETLINK_ROUTE client of the calling thread.
+NetlinkClient* RouteNetlinkClient();
+
+}  // namespace cuttlefish
@@ -19,25 +19,39 @@
 #include <android-base/logging.h>
 
 #include "host/libs/allocd/alloc_utils.h"
+#include "host/libs/allocd/netlink_ops.h"
 
 namespace cuttlefish {
 
-bool MobileIface::AcquireResource() {
-  return CreateMobileIface(GetName(), iface_id_, ipaddr_);
+bool MobileIface::AcquireResource(LinkBatch& links) {
+  return CreateMobileIface(GetName(), iface_id_, ipaddr_, links);
 }
 
-bool MobileIface::ReleaseResource() {
-  return DestroyMobileIface(GetName(), iface_id_, ipaddr_);
+bool MobileIface::AdoptResource(const std::string& warm_name,
+                                LinkBatch& links) {
+  // The gateway and NAT rule only depend on the id, which the names share.
+  links.Rename(warm_name, GetName());
+  return true;
 }
 
-bool EthernetIface::AcquireResource() {
+bool MobileIface::ReleaseResource(LinkBatch& links) {
+  return DestroyMobileIface(GetName(), iface_id_, ipaddr_, links);
+}
+
+bool EthernetIface::AcquireResource(LinkBatch& links) {
   return CreateEthernetIface(GetName(), GetBridgeName(), has_ipv4_, has_ipv6_,
-                             use_ebtables_legacy_);
+                             use_ebtables_legacy_, links);
+}
+
+bool EthernetIface::AdoptResource(const std::string& warm_name,
+                                  LinkBatch& links) {
+  return AdoptEthernetIface(warm_name, GetName(), has_ipv4_, has_ipv6_,
+                            use_ebtables_legacy_, links);
 }
 
-bool EthernetIface::ReleaseResource() {
+bool EthernetIface::ReleaseResource(LinkBatch& links) {
   return DestroyEthernetIface(GetName(), has_ipv4_, has_ipv6_,
-                              use_ebtables_legacy_);
+                              use_ebtables_legacy_, links);
 }
 
 }  // namespace cuttlefish
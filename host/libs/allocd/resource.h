@@ -19,10 +19,16 @@
 #include <sys/types.h>
 
 #include <cstdint>
+#include <optional>
 #include <string>
+#include <utility>
+
+#include "host/libs/allocd/iface_ids.h"
 
 namespace cuttlefish {
 
+class LinkBatch;
+
 enum class ResourceType {
   Invalid = 0,
   MobileIface,
@@ -37,15 +43,26 @@ class StaticResource {
                  uint32_t global_id)
       : name_(name), uid_(uid), global_id_(global_id), ty_(ty){};
   virtual ~StaticResource() = default;
-  virtual bool ReleaseResource() = 0;
-  virtual bool AcquireResource() = 0;
+  // The link and address changes are left in `links`, for the caller to send
+  // together with those of the other resources of the same request.
+  virtual bool ReleaseResource(LinkBatch& links) = 0;
+  virtual bool AcquireResource(LinkBatch& links) = 0;
+  // Takes over an interface from the WarmPool instead of creating one.
+  virtual bool AdoptResource(const std::string& warm_name,
+                             LinkBatch& links) = 0;
 
   std::string GetName() { return name_; }
   uid_t GetUid() { return uid_; }
   ResourceType GetResourceType() { return ty_; }
   uint32_t GetGlobalID() { return global_id_; }
 
+  // Keeps the id in the name taken for as long as the resource exists.
+  void SetIdReservation(IfaceIds::Reservation reservation) {
+    id_reservation_ = std::move(reservation);
+  }
+
  private:
+  std::optional<IfaceIds::Reservation> id_reservation_;
   std::string name_{};
   uid_t uid_{};
   uint32_t global_id_{};
@@ -62,8 +79,9 @@ class MobileIface : public StaticResource {
         iface_id_(iface_id),
         ipaddr_(ipaddr) {}
 
-  bool ReleaseResource() override;
-  bool AcquireResource() override;
+  bool ReleaseResource(LinkBatch& links) override;
+  bool AcquireResource(LinkBatch& links) override;
+  bool AdoptResource(const std::string& warm_name, LinkBatch& links) override;
 
   uint16_t GetIfaceId() { return iface_id_; }
   std::string GetIpAddr() { return ipaddr_; }
@@ -88,8 +106,9 @@ class EthernetIface : public StaticResource {
         bridge_name_(bridge_name),
         ipaddr_(ipaddr) {}
 
-  bool ReleaseResource() override;
-  bool AcquireResource() override;
+  bool ReleaseResource(LinkBatch& links) override;
+  bool AcquireResource(LinkBatch& links) override;
+  bool AdoptResource(const std::string& warm_name, LinkBatch& links) override;
 
   uint16_t GetIfaceId() { return iface_id_; }
 
@@ -31,6 +31,7 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <utility>
 
 #include "common/libs/fs/shared_fd.h"
 #include "host/libs/allocd/alloc_utils.h"
@@ -45,6 +46,9 @@ namespace cuttlefish {
 uid_t GetUserIDFromSock(SharedFD client_socket);
 
 ResourceManager::~ResourceManager() {
+  // Destroys the idle interfaces.
+  warm_pool_.reset();
+
   bool success = true;
   for (auto& res : managed_sessions_) {
     success &= res.second->ReleaseAllResources();
@@ -67,6 +71,12 @@ void ResourceManager::SetUseEbtablesLegacy(bool use_legacy) {
   use_ebtables_legacy_ = use_legacy;
 }
 
+void ResourceManager::StartWarmPool(uint32_t size) {
+  warm_pool_ = std::make_unique<WarmPool>(
+      size, iface_ids_, [this]() { return AllocateResourceID(); });
+  warm_pool_->Start();
+}
+
 uint32_t ResourceManager::AllocateResourceID() {
   return global_resource_id_.fetch_add(1, std::memory_order_relaxed);
 }
@@ -75,49 +85,54 @@ uint32_t ResourceManager::AllocateSessionID() {
   return session_id_.fetch_add(1, std::memory_order_relaxed);
 }
 
+std::shared_ptr<StaticResource> ResourceManager::MakeInterface(
+    const std::string& iface, IfaceType ty, uint16_t small_id,
+    uint32_t resource_id, uid_t uid) {
+  switch (ty) {
+    case IfaceType::mtap:
+      // TODO(seungjaeyoo) : Support AddInterface for mtap uses IP prefix
+      // different from kMobileIp.
+      return std::make_shared<MobileIface>(iface, uid, small_id, resource_id,
+                                           kMobileIp);
+    case IfaceType::wtap:
+    case IfaceType::etap: {
+      auto is_wtap = ty == IfaceType::wtap;
+      auto w = std::make_shared<EthernetIface>(
+          iface, uid, small_id, resource_id,
+          is_wtap ? kWirelessBridge : kEthernetBridge,
+          is_wtap ? kWirelessIp : kEthernetIp);
+      w->SetUseEbtablesLegacy(use_ebtables_legacy_);
+      w->SetHasIpv4(use_ipv4_bridge_);
+      w->SetHasIpv6(use_ipv6_bridge_);
+      return w;
+    }
+    default:
+      return nullptr;
+  }
+}
+
 bool ResourceManager::AddInterface(const std::string& iface, IfaceType ty,
+                                   IfaceIds::Reservation small_id,
                                    uint32_t resource_id, uid_t uid) {
   bool allocatedIface = false;
   std::shared_ptr<StaticResource> res = nullptr;
 
   bool didInsert = active_interfaces_.insert(iface).second;
   if (didInsert) {
-    const char* idp = iface.c_str() + (iface.size() - 3);
-    int small_id = atoi(idp);
     switch (ty) {
       case IfaceType::wifiap:
         // TODO(seungjaeyoo) : Support AddInterface for wifiap
         break;
       case IfaceType::mtap:
-        // TODO(seungjaeyoo) : Support AddInterface for mtap uses IP prefix
-        // different from kMobileIp.
-        res = std::make_shared<MobileIface>(iface, uid, small_id, resource_id,
-                                            kMobileIp);
-        allocatedIface = res->AcquireResource();
-        pending_add_.insert({resource_id, res});
-        break;
-      case IfaceType::wtap: {
-        auto w = std::make_shared<EthernetIface>(
-            iface, uid, small_id, resource_id, "cvd-wbr", kWirelessIp);
-        w->SetUseEbtablesLegacy(use_ebtables_legacy_);
-        w->SetHasIpv4(use_ipv4_bridge_);
-        w->SetHasIpv6(use_ipv6_bridge_);
-        res = w;
-        allocatedIface = res->AcquireResource();
-        pending_add_.insert({resource_id, res});
-        break;
-      }
-      case IfaceType::etap: {
-        auto w = std::make_shared<EthernetIface>(
-            iface, uid, small_id, resource_id, "cvd-ebr", kEthernetIp);
-        w->SetUseEbtablesLegacy(use_ebtables_legacy_);
-        w->SetHasIpv4(use_ipv4_bridge_);
-        w->SetHasIpv6(use_ipv6_bridge_);
-        res = w;
-        allocatedIface = res->AcquireResource();
-        pending_add_.insert({resource_id, res});
+      case IfaceType::wtap:
+      case IfaceType::etap:
+        res = MakeInterface(iface, ty, small_id.id(), resource_id, uid);
+        res->SetIdReservation(std::move(small_id));
+        allocatedIface = res->AcquireResource(pending_links_);
+        if (allocatedIface) {
+          pending_add_.insert({resource_id, res});
+        }
         break;
-      }
       case IfaceType::wbr:
       case IfaceType::ebr:
         allocatedIface = CreateBridge(iface);
@@ -130,11 +145,9 @@ bool ResourceManager::AddInterface(const std::string& iface, IfaceType ty,
   }
 
   if (didInsert && !allocatedIface) {
+    // A failed acquisition undoes its own changes.
     LOG(WARNING) << "Failed to allocate interface: " << iface;
     active_interfaces_.erase(iface);
-    auto it = pending_add_.find(resource_id);
-    it->second->ReleaseResource();
-    pending_add_.erase(it);
   }
 
   LOG(INFO) << "Finish CreateInterface Request";
@@ -142,6 +155,32 @@ bool ResourceManager::AddInterface(const std::string& iface, IfaceType ty,
   return allocatedIface;
 }
 
+bool ResourceManager::AdoptInterface(const std::string& iface,
+                                     WarmPool::Iface warm,
+                                     uint32_t resource_id, uid_t uid) {
+  if (!active_interfaces_.insert(iface).second) {
+    LOG(WARNING) << "Interface already in use: " << iface;
+    WarmPool::Destroy(warm);
+    return false;
+  }
+
+  auto res = MakeInterface(iface, warm.type, warm.id, resource_id, uid);
+  // The final name ends with the same id.
+  if (warm.reservation) {
+    res->SetIdReservation(std::move(*warm.reservation));
+  }
+  if (!res->AdoptResource(warm.name, pending_links_)) {
+    LOG(WARNING) << "Failed to take over " << warm.name << " as " << iface;
+    active_interfaces_.erase(iface);
+    WarmPool::Destroy(warm);
+    return false;
+  }
+
+  pending_add_.insert({resource_id, res});
+  LOG(INFO) << "Took over " << warm.name << " as " << iface;
+  return true;
+}
+
 bool ResourceManager::RemoveInterface(const std::string& iface, IfaceType ty) {
   bool isManagedIface = active_interfaces_.erase(iface) > 0;
   bool removedIface = false;
@@ -337,6 +376,14 @@ void ResourceManager::JsonServer() {
       }
     }
 
+    // The links and addresses of all the interfaces go out together. Those
+    // of a failed transaction too, so that its interfaces can be released
+    // under their final names.
+    if (!ApplyLinkBatch(pending_links_) && !transaction_failed) {
+      LOG(WARNING) << "Failed to configure the requested interfaces";
+      transaction_failed = true;
+    }
+
     config_response["response_list"] = response_list;
 
     auto status =
@@ -355,9 +402,13 @@ void ResourceManager::JsonServer() {
       managed_sessions_.insert({session_id, s});
     } else {
       // be sure to release anything we've acquired if the transaction failed
+      LinkBatch links;
       for (auto& droped_resource : pending_add_) {
-        droped_resource.second->ReleaseResource();
+        active_interfaces_.erase(droped_resource.second->GetName());
+        droped_resource.second->ReleaseResource(links);
       }
+      pending_add_.clear();
+      ApplyLinkBatch(links);
     }
 
     SendJsonMsg(client_socket, config_response);
@@ -452,7 +503,7 @@ Json::Value ResourceManager::JsonHandleCreateInterfaceRequest(
   auto user_opt = GetUserName(uid);
 
   bool addedIface = false;
-  std::stringstream ss;
+  std::string iface_name;
   if (!user_opt) {
     auto err_msg = "UserName could not be matched to UID";
     LOG(WARNING) << err_msg;
@@ -462,20 +513,41 @@ Json::Value ResourceManager::JsonHandleCreateInterfaceRequest(
     auto iface_ty_name = request["iface_type"].asString();
     resp["iface_type"] = iface_ty_name;
     auto iface_type = StrToIfaceTy(iface_ty_name);
+    auto name_for = [&](uint32_t small_id) {
+      std::stringstream ss;
+      ss << "cvd-" << iface_ty_name << "-" << user_opt.value().substr(0, 4)
+         << std::setfill('0') << std::setw(2) << small_id;
+      return ss.str();
+    };
+    std::optional<WarmPool::Iface> warm;
+    if (warm_pool_) {
+      warm = warm_pool_->Take(iface_type);
+    }
+    if (warm) {
+      auto id = AllocateResourceID();
+      resp["resource_id"] = id;
+      iface_name = name_for(warm->id);
+      addedIface = AdoptInterface(iface_name, std::move(*warm), id, uid);
+    }
     auto attempts = kMaxIfaceNameId;
-    do {
+    while (!addedIface && attempts > 0) {
       auto id = AllocateResourceID();
       resp["resource_id"] = id;
-      ss << "cvd-" << iface_ty_name << "-" << user_opt.value().substr(0, 4)
-         << std::setfill('0') << std::setw(2) << (id % kMaxIfaceNameId);
-      addedIface = AddInterface(ss.str(), iface_type, id, uid);
+      auto small_id = iface_ids_.Reserve(iface_type, id);
+      if (!small_id) {
+        LOG(WARNING) << "No free id for a " << iface_ty_name;
+        break;
+      }
+      iface_name = name_for(small_id->id());
+      addedIface = AddInterface(iface_name, iface_type, std::move(*small_id),
+                                id, uid);
       --attempts;
-    } while (!addedIface && (attempts > 0));
+    }
   }
 
   if (addedIface) {
     resp["request_status"] = StatusToStr(RequestStatus::Success);
-    resp["iface_name"] = ss.str();
+    resp["iface_name"] = iface_name;
     resp["error"] = "";
   }
 
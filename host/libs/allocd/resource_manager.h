@@ -27,9 +27,11 @@
 
 #include "common/libs/fs/shared_fd.h"
 #include "host/libs/allocd/alloc_utils.h"
+#include "host/libs/allocd/netlink_ops.h"
 #include "host/libs/allocd/request.h"
 #include "host/libs/allocd/resource.h"
 #include "host/libs/allocd/utils.h"
+#include "host/libs/allocd/warm_pool.h"
 
 namespace cuttlefish {
 
@@ -53,12 +55,13 @@ class Session {
 
   bool ReleaseAllResources() {
     bool success = true;
+    LinkBatch links;
     for (auto& res : managed_resources_) {
-      success &= res.second->ReleaseResource();
+      success &= res.second->ReleaseResource(links);
     }
     managed_resources_.clear();
 
-    return success;
+    return ApplyLinkBatch(links) && success;
   }
 
   bool ReleaseResource(uint32_t resource_id) {
@@ -67,7 +70,8 @@ class Session {
       return false;
     }
 
-    auto success = it->second->ReleaseResource();
+    LinkBatch links;
+    auto success = it->second->ReleaseResource(links) && ApplyLinkBatch(links);
     if (success) {
       managed_resources_.erase(it);
     }
@@ -102,14 +106,26 @@ struct ResourceManager {
 
   void SetUseEbtablesLegacy(bool use_legacy);
 
+  // Keeps `size` taps of each type ready to hand out. See WarmPool.
+  void StartWarmPool(uint32_t size);
+
   void JsonServer();
 
  private:
   uint32_t AllocateResourceID();
   uint32_t AllocateSessionID();
 
-  bool AddInterface(const std::string& iface, IfaceType ty, uint32_t id,
-                    uid_t uid);
+  std::shared_ptr<StaticResource> MakeInterface(const std::string& iface,
+                                                IfaceType ty, uint16_t small_id,
+                                                uint32_t resource_id,
+                                                uid_t uid);
+
+  // `small_id` is the id at the end of `iface`.
+  bool AddInterface(const std::string& iface, IfaceType ty,
+                    IfaceIds::Reservation small_id, uint32_t id, uid_t uid);
+
+  bool AdoptInterface(const std::string& iface, WarmPool::Iface warm,
+                      uint32_t id, uid_t uid);
 
   bool RemoveInterface(const std::string& iface, IfaceType ty);
 
@@ -140,16 +156,22 @@ struct ResourceManager {
   std::optional<std::shared_ptr<Session>> FindSession(uint32_t id);
 
  private:
+  // Outlives everything that holds a reservation.
+  IfaceIds iface_ids_;
   std::atomic_uint32_t global_resource_id_ = 0;
   std::atomic_uint32_t session_id_ = 0;
   std::set<std::string> active_interfaces_;
   std::map<uint32_t, std::shared_ptr<Session>> managed_sessions_;
   std::map<uint32_t, std::shared_ptr<StaticResource>> pending_add_;
+  // The link and address changes of pending_add_, sent together once all the
+  // requests of a configuration have been handled.
+  LinkBatch pending_links_;
   std::string location = kDefaultLocation;
   bool use_ipv4_bridge_ = true;
   bool use_ipv6_bridge_ = true;
   bool use_ebtables_legacy_ = false;
   cuttlefish::SharedFD shutdown_socket_;
+  std::unique_ptr<WarmPool> warm_pool_;
 };
 
 }  // namespace cuttlefish
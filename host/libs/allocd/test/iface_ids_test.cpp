@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "host/libs/allocd/iface_ids.h"
+
+#include <optional>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "host/libs/allocd/alloc_utils.h"
+
+namespace cuttlefish {
+namespace {
+
+TEST(IfaceIdsTest, TakesTheHintModuloTheMaxId) {
+  IfaceIds ids;
+  auto first = ids.Reserve(IfaceType::mtap, 5);
+  ASSERT_TRUE(first);
+  EXPECT_EQ(first->id(), 5);
+  auto wrapped = ids.Reserve(IfaceType::mtap, kMaxIfaceNameId + 7);
+  ASSERT_TRUE(wrapped);
+  EXPECT_EQ(wrapped->id(), 7);
+}
+
+TEST(IfaceIdsTest, SkipsTakenIds) {
+  // The pool and the taps created on demand draw hints from the same counter
+  // with the same modulus, a taken id moves the other one along.
+  IfaceIds ids;
+  auto pooled = ids.Reserve(IfaceType::mtap, 3);
+  auto on_demand = ids.Reserve(IfaceType::mtap, kMaxIfaceNameId + 3);
+  ASSERT_TRUE(pooled && on_demand);
+  EXPECT_EQ(pooled->id(), 3);
+  EXPECT_EQ(on_demand->id(), 4);
+  auto last = ids.Reserve(IfaceType::mtap, kMaxIfaceNameId - 1);
+  auto after_last = ids.Reserve(IfaceType::mtap, kMaxIfaceNameId - 1);
+  ASSERT_TRUE(last && after_last);
+  EXPECT_EQ(last->id(), kMaxIfaceNameId - 1);
+  EXPECT_EQ(after_last->id(), 0);
+}
+
+TEST(IfaceIdsTest, TypesHaveSeparateIds) {
+  IfaceIds ids;
+  auto mobile = ids.Reserve(IfaceType::mtap, 9);
+  auto ethernet = ids.Reserve(IfaceType::etap, 9);
+  ASSERT_TRUE(mobile && ethernet);
+  EXPECT_EQ(mobile->id(), 9);
+  EXPECT_EQ(ethernet->id(), 9);
+}
+
+TEST(IfaceIdsTest, RunsOut) {
+  IfaceIds ids;
+  std::vector<IfaceIds::Reservation> taken;
+  std::set<uint16_t> distinct;
+  for (uint32_t i = 0; i < kMaxIfaceNameId; i++) {
+    auto reservation = ids.Reserve(IfaceType::wtap, 0);
+    ASSERT_TRUE(reservation);
+    EXPECT_LT(reservation->id(), kMaxIfaceNameId);
+    distinct.insert(reservation->id());
+    taken.push_back(std::move(*reservation));
+  }
+  EXPECT_EQ(distinct.size(), kMaxIfaceNameId);
+  EXPECT_FALSE(ids.Reserve(IfaceType::wtap, 0));
+  taken.pop_back();
+  EXPECT_TRUE(ids.Reserve(IfaceType::wtap, 0));
+}
+
+TEST(IfaceIdsTest, ReleasesWhenTheLastOwnerIsGone) {
+  IfaceIds ids;
+  std::optional<IfaceIds::Reservation> owner = ids.Reserve(IfaceType::mtap, 1);
+  ASSERT_TRUE(owner);
+  // Handing a warm tap over moves its reservation, which must not free it.
+  IfaceIds::Reservation adopted = std::move(*owner);
+  owner.reset();
+  auto other = ids.Reserve(IfaceType::mtap, 1);
+  ASSERT_TRUE(other);
+  EXPECT_EQ(other->id(), 2);
+
+  adopted = std::move(*other);
+  // Overwriting it releases id 1.
+  auto again = ids.Reserve(IfaceType::mtap, 1);
+  ASSERT_TRUE(again);
+  EXPECT_EQ(again->id(), 1);
+}
+
+TEST(IfaceIdsTest, ConcurrentReservationsAreDistinct) {
+  IfaceIds ids;
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 15;
+  std::vector<std::vector<IfaceIds::Reservation>> taken(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&ids, &taken, t]() {
+      for (int i = 0; i < kPerThread; i++) {
+        if (auto reservation = ids.Reserve(IfaceType::mtap, i)) {
+          taken[t].push_back(std::move(*reservation));
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::set<uint16_t> distinct;
+  for (const auto& reservations : taken) {
+    for (const auto& reservation : reservations) {
+      EXPECT_TRUE(distinct.insert(reservation.id()).second);
+    }
+  }
+  EXPECT_EQ(distinct.size(), kThreads * kPerThread);
+}
+
+}  // namespace
+}  // namespace cuttlefish
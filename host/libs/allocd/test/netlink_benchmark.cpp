@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how many tap interfaces per second allocd can attach to a bridge
+// and remove again, with the ip commands it used to run or with netlink.
+//
+// By default it runs in new user and network namespaces, so it needs no
+// privileges and leaves the host's interfaces alone.
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <gflags/gflags.h>
+
+#include "host/libs/allocd/alloc_utils.h"
+#include "host/libs/allocd/netlink_ops.h"
+
+DEFINE_uint32(interfaces, 64,
+              "Tap interfaces to allocate together in each round.");
+DEFINE_uint32(rounds, 5, "How many times to allocate and release them.");
+DEFINE_string(backend, "netlink",
+              "\"netlink\", or \"ip\" to run the commands allocd used to.");
+DEFINE_bool(unshare, true, "Run in new user and network namespaces.");
+
+namespace cuttlefish {
+namespace {
+
+constexpr char kBridge[] = "cvd-bench-br";
+
+bool EnterNamespaces() {
+  auto uid = getuid();
+  auto gid = getgid();
+  if (unshare(CLONE_NEWUSER | CLONE_NEWNET) < 0) {
+    PLOG(ERROR) << "unshare failed";
+    return false;
+  }
+  // Map ourselves to root, which has CAP_NET_ADMIN in the new namespace.
+  return android::base::WriteStringToFile("deny", "/proc/self/setgroups") &&
+         android::base::WriteStringToFile("0 " + std::to_string(uid) + " 1",
+                                          "/proc/self/uid_map") &&
+         android::base::WriteStringToFile("0 " + std::to_string(gid) + " 1",
+                                          "/proc/self/gid_map");
+}
+
+std::string TapName(uint32_t index) {
+  return "cvd-bench-" + std::to_string(index);
+}
+
+bool Command(const std::string& command) {
+  return RunExternalCommand(command) == 0;
+}
+
+// What CreateEthernetIface does for every interface of a request, minus the
+// cvdnetwork group which may not exist or be mapped in the namespace.
+bool Allocate(const std::vector<std::string>& names) {
+  if (FLAGS_backend == "ip") {
+    for (const auto& name : names) {
+      if (!Command("ip tuntap add dev " + name + " mode tap vnet_hdr") ||
+          !Command("ip link set dev " + name + " up") ||
+          !Command("ip link set dev " + name + " master " + kBridge)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  LinkBatch links;
+  for (const auto& name : names) {
+    if (!CreateTapDevice(name, std::nullopt)) {
+      return false;
+    }
+    links.SetUp(name, true);
+    links.SetMaster(name, kBridge);
+  }
+  return ApplyLinkBatch(links);
+}
+
+// What releasing a session with these interfaces does.
+bool Release(const std::vector<std::string>& names) {
+  if (FLAGS_backend == "ip") {
+    for (const auto& name : names) {
+      if (!Command("ip link set dev " + name + " down") ||
+          !Command("ip link delete " + name)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  LinkBatch links;
+  for (const auto& name : names) {
+    links.Delete(name);
+  }
+  return ApplyLinkBatch(links);
+}
+
+double PerSecond(uint32_t count, std::chrono::steady_clock::duration time) {
+  return count / std::chrono::duration<double>(time).count();
+}
+
+int BenchmarkMain() {
+  if (FLAGS_backend != "ip" && FLAGS_backend != "netlink") {
+    LOG(ERROR) << "Unknown backend " << FLAGS_backend;
+    return 1;
+  }
+  if (FLAGS_unshare && !EnterNamespaces()) {
+    return 1;
+  }
+  bool bridge_created = FLAGS_backend == "ip"
+                            ? Command(std::string("ip link add name ") +
+                                      kBridge + " type bridge") &&
+                                  Command(std::string("ip link set dev ") +
+                                          kBridge + " up")
+                            : CreateBridge(kBridge);
+  if (!bridge_created) {
+    LOG(ERROR) << "Unable to create " << kBridge;
+    return 1;
+  }
+  std::vector<std::string> names;
+  for (uint32_t i = 0; i < FLAGS_interfaces; i++) {
+    names.push_back(TapName(i));
+  }
+  std::chrono::steady_clock::duration allocating{};
+  std::chrono::steady_clock::duration releasing{};
+  for (uint32_t round = 0; round < FLAGS_rounds; round++) {
+    // One round is one request for all the interfaces, as for a
+    // multi-instance group.
+    auto start = std::chrono::steady_clock::now();
+    if (!Allocate(names)) {
+      LOG(ERROR) << "Unable to allocate the interfaces of round " << round;
+      return 1;
+    }
+    auto allocated = std::chrono::steady_clock::now();
+    if (!Release(names)) {
+      LOG(ERROR) << "Unable to release the interfaces of round " << round;
+      return 1;
+    }
+    auto released = std::chrono::steady_clock::now();
+    allocating += allocated - start;
+    releasing += released - allocated;
+    std::cout << "round " << round << ": "
+              << PerSecond(FLAGS_interfaces, allocated - start)
+              << " allocated/s, "
+              << PerSecond(FLAGS_interfaces, released - allocated)
+              << " released/s\n";
+  }
+  auto total = FLAGS_interfaces * FLAGS_rounds;
+  std::cout << std::fixed << std::setprecision(1) << FLAGS_backend << ": "
+            << PerSecond(total, allocating) << " allocated/s, "
+            << PerSecond(total, releasing) << " released/s\n";
+  DestroyBridge(kBridge);
+  return 0;
+}
+
+}  // namespace
+}  // namespace cuttlefish
+
+int main(int argc, char** argv) {
+  ::android::base::InitLogging(argv, android::base::StderrLogger);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  // alloc_utils logs every step.
+  android::base::SetMinimumLogSeverity(android::base::WARNING);
+  return cuttlefish::BenchmarkMain();
+}
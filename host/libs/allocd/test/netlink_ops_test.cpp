@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/allocd/netlink_ops.h"
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+// Records the batches instead of sending them to the kernel.
+class RecordingNetlinkClient : public NetlinkClient {
+ public:
+  bool Send(const NetlinkRequest&) override {
+    ADD_FAILURE() << "Changes are expected to be sent in batches";
+    return false;
+  }
+  bool SendBatch(const std::vector<NetlinkRequest>& messages) override {
+    auto& batch = batches.emplace_back();
+    for (const auto& message : messages) {
+      auto header = static_cast<const nlmsghdr*>(message.RequestData());
+      batch.push_back(header->nlmsg_type);
+    }
+    return succeed;
+  }
+
+  // The message types of each batch.
+  std::vector<std::vector<uint16_t>> batches;
+  bool succeed = true;
+};
+
+TEST(LinkBatchTest, SendsTheChangesInOneBatch) {
+  RecordingNetlinkClient client;
+  LinkBatch links;
+  EXPECT_TRUE(links.Empty());
+  links.CreateBridge("cvd-test-br");
+  links.SetMaster("cvd-test-tap", "lo");
+  links.SetAddress("lo", "192.168.96.1", 24, true);
+  EXPECT_FALSE(links.Empty());
+
+  EXPECT_TRUE(links.Apply(client));
+  ASSERT_EQ(client.batches.size(), 1);
+  EXPECT_EQ(client.batches[0],
+            (std::vector<uint16_t>{RTM_NEWLINK, RTM_SETLINK, RTM_NEWADDR}));
+  EXPECT_TRUE(links.Empty());
+}
+
+TEST(LinkBatchTest, RenamesDownLinks) {
+  RecordingNetlinkClient client;
+  LinkBatch links;
+  links.Rename("lo", "cvd-test-lo");
+
+  EXPECT_TRUE(links.Apply(client));
+  ASSERT_EQ(client.batches.size(), 1);
+  EXPECT_EQ(client.batches[0],
+            (std::vector<uint16_t>{RTM_SETLINK, RTM_SETLINK, RTM_SETLINK}));
+}
+
+TEST(LinkBatchTest, ReportsFailedBatches) {
+  RecordingNetlinkClient client;
+  client.succeed = false;
+  LinkBatch links;
+  links.SetUp("cvd-test-tap", true);
+  links.Delete("cvd-test-tap");
+
+  EXPECT_FALSE(links.Apply(client));
+  EXPECT_TRUE(links.Empty());
+
+  // The failed changes are not sent again with the next batch.
+  client.succeed = true;
+  links.Delete("cvd-test-br");
+  EXPECT_TRUE(links.Apply(client));
+  ASSERT_EQ(client.batches.size(), 2);
+  EXPECT_EQ(client.batches[1], std::vector<uint16_t>{RTM_DELLINK});
+}
+
+TEST(LinkBatchTest, SendsNothingWhenALinkIsMissing) {
+  RecordingNetlinkClient client;
+  LinkBatch links;
+  links.SetUp("cvd-test-tap", true);
+  links.SetMaster("cvd-test-tap", "cvd-test-missing-br");
+  EXPECT_FALSE(links.Empty());
+
+  EXPECT_FALSE(links.Apply(client));
+  EXPECT_TRUE(client.batches.empty());
+  EXPECT_TRUE(links.Empty());
+
+  links.SetUp("cvd-test-tap", true);
+  EXPECT_TRUE(links.Apply(client));
+  EXPECT_EQ(client.batches.size(), 1);
+}
+
+TEST(LinkBatchTest, RejectsInvalidAddresses) {
+  RecordingNetlinkClient client;
+  LinkBatch links;
+  links.SetAddress("lo", "192.168.96.300", 24, true);
+  links.SetAddress("lo", "192.168.96.1", 33, true);
+
+  EXPECT_FALSE(links.Apply(client));
+  EXPECT_TRUE(client.batches.empty());
+}
+
+}  // namespace
+}  // namespace cuttlefish
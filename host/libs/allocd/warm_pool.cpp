@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/allocd/warm_pool.h"
+
+#include <net/if.h>
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+#include "host/libs/allocd/alloc_utils.h"
+#include "host/libs/allocd/utils.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr char kPoolPrefix[] = "cvd-pool-";
+constexpr IfaceType kPooledTypes[] = {IfaceType::mtap, IfaceType::wtap,
+                                      IfaceType::etap};
+// How long to wait after failing to create any tap, e.g. because the bridges
+// are not there yet.
+constexpr auto kRetryDelay = std::chrono::seconds(10);
+
+std::string PoolName(IfaceType type, uint16_t id) {
+  std::stringstream ss;
+  ss << kPoolPrefix << IfaceTyToStr(type) << std::setfill('0') << std::setw(2)
+     << id;
+  return ss.str();
+}
+
+std::optional<WarmPool::Iface> ParsePoolName(const std::string& name) {
+  auto prefix_size = strlen(kPoolPrefix);
+  if (!android::base::StartsWith(name, kPoolPrefix) ||
+      name.size() < prefix_size + 2) {
+    return std::nullopt;
+  }
+  auto type = StrToIfaceTy(
+      name.substr(prefix_size, name.size() - prefix_size - 2));
+  uint16_t id;
+  if (type == IfaceType::Invalid ||
+      !android::base::ParseUint(name.substr(name.size() - 2), &id)) {
+    return std::nullopt;
+  }
+  return WarmPool::Iface{type, id, name, std::nullopt};
+}
+
+}  // namespace
+
+WarmPool::WarmPool(uint32_t size, IfaceIds& ids,
+                   std::function<uint32_t()> allocate_id)
+    : size_(size), ids_(ids), allocate_id_(std::move(allocate_id)) {}
+
+WarmPool::~WarmPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  changed_.notify_all();
+  if (refill_thread_.joinable()) {
+    refill_thread_.join();
+  }
+  for (const auto& [type, ifaces] : idle_) {
+    for (const auto& iface : ifaces) {
+      Destroy(iface);
+    }
+  }
+}
+
+void WarmPool::Start() {
+  std::vector<Iface> stale;
+  auto ifaces = if_nameindex();
+  for (auto it = ifaces; it && it->if_index != 0; it++) {
+    if (auto iface = ParsePoolName(it->if_name)) {
+      stale.push_back(std::move(*iface));
+    }
+  }
+  if_freenameindex(ifaces);
+  for (const auto& iface : stale) {
+    LOG(INFO) << "Removing idle interface left behind: " << iface.name;
+    Destroy(iface);
+  }
+
+  if (size_ > 0) {
+    refill_thread_ = std::thread([this]() { Refill(); });
+  }
+}
+
+std::optional<WarmPool::Iface> WarmPool::Take(IfaceType type) {
+  std::lock_guard lock(mutex_);
+  auto it = idle_.find(type);
+  if (it == idle_.end() || it->second.empty()) {
+    return std::nullopt;
+  }
+  auto iface = std::move(it->second.front());
+  it->second.pop_front();
+  changed_.notify_all();
+  return iface;
+}
+
+void WarmPool::Destroy(const Iface& iface) {
+  switch (iface.type) {
+    case IfaceType::mtap:
+      DestroyMobileIface(iface.name, iface.id, kMobileIp);
+      break;
+    case IfaceType::wtap:
+    case IfaceType::etap:
+      DestroyIface(iface.name);
+      break;
+    default:
+      break;
+  }
+}
+
+void WarmPool::Refill() {
+  std::unique_lock lock(mutex_);
+  while (!stopping_) {
+    // Take turns between the types, so that one which can't be created
+    // doesn't hold up the others.
+    bool missing = false;
+    bool created = false;
+    for (auto type : kPooledTypes) {
+      if (stopping_ || idle_[type].size() >= size_) {
+        continue;
+      }
+      missing = true;
+      lock.unlock();
+      auto iface = Create(type);
+      lock.lock();
+      if (iface) {
+        idle_[type].push_back(std::move(*iface));
+        created = true;
+      }
+    }
+    if (!missing) {
+      changed_.wait(lock);
+    } else if (!created) {
+      changed_.wait_for(lock, kRetryDelay);
+    }
+  }
+}
+
+std::optional<WarmPool::Iface> WarmPool::Create(IfaceType type) {
+  auto reservation = ids_.Reserve(type, allocate_id_());
+  if (!reservation) {
+    LOG(WARNING) << "No free id for an idle " << IfaceTyToStr(type);
+    return std::nullopt;
+  }
+  auto id = reservation->id();
+  auto name = PoolName(type, id);
+
+  bool created = false;
+  switch (type) {
+    case IfaceType::mtap:
+      created = CreateMobileIface(name, id, kMobileIp);
+      break;
+    case IfaceType::wtap:
+      created = CreateEthernetIface(name, kWirelessBridge, true, true, false);
+      break;
+    case IfaceType::etap:
+      created = CreateEthernetIface(name, kEthernetBridge, true, true, false);
+      break;
+    default:
+      break;
+  }
+  if (!created) {
+    LOG(WARNING) << "Failed to create idle interface: " << name;
+    return std::nullopt;
+  }
+  return Iface{type, id, name, std::move(reservation)};
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "host/libs/allocd/iface_ids.h"
+#include "host/libs/allocd/request.h"
+
+namespace cuttlefish {
+
+/* Keeps mobile, wireless and ethernet taps set up ahead of the requests for
+ * them, so that handing one out only takes renaming it.
+ *
+ * Idle taps are named cvd-pool-<type><id>. Wireless and ethernet taps are up
+ * and attached to their bridge, mobile taps have their gateway address and
+ * NAT rule. Nothing that depends on the final name, like ebtables rules, is
+ * set up in advance.
+ *
+ * A background thread tops the pool up after taps are taken. Idle taps are
+ * destroyed when the pool is, and taps left behind by an earlier daemon when
+ * it starts.
+ */
+class WarmPool {
+ public:
+  struct Iface {
+    IfaceType type;
+    // The part of the name that mobile taps derive their subnet from.
+    uint16_t id;
+    std::string name;
+    // Held from the creation of the tap until it is destroyed, by whoever
+    // owns it then. Missing for the taps left behind by an earlier daemon.
+    std::optional<IfaceIds::Reservation> reservation;
+  };
+
+  // Ids are reserved in `ids`, which the taps created on demand share, with
+  // `allocate_id` as the hint.
+  WarmPool(uint32_t size, IfaceIds& ids, std::function<uint32_t()> allocate_id);
+  ~WarmPool();
+
+  // Cleans up after an earlier daemon and starts filling the pool.
+  void Start();
+
+  // Returns an idle tap of the given type, if there is one. The caller takes
+  // ownership of it.
+  std::optional<Iface> Take(IfaceType type);
+
+  // Destroys a tap returned by Take which could not be handed out.
+  static void Destroy(const Iface& iface);
+
+ private:
+  void Refill();
+  std::optional<Iface> Create(IfaceType type);
+
+  const uint32_t size_;
+  IfaceIds& ids_;
+  std::function<uint32_t()> allocate_id_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::map<IfaceType, std::deque<Iface>> idle_;
+  bool stopping_ = false;
+  std::thread refill_thread_;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/command_util/launcher_control.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "common/libs/fs/shared_buf.h"
+#include "host/commands/run_cvd/runner_defs.h"
+#include "host/libs/command_util/util.h"
+
+namespace cuttlefish {
+namespace {
+
+// Way more than any status, it only guards against reading garbage sizes.
+constexpr uint32_t kMaxControlMessageSize = 1 << 20;
+
+}  // namespace
+
+Result<SharedFD> OpenLauncherControlChannel(
+    const CuttlefishConfig::InstanceSpecific& instance_config,
+    const int timeout_seconds) {
+  auto channel = CF_EXPECT(
+      GetLauncherMonitorFromInstance(instance_config, timeout_seconds));
+  CF_EXPECT(WriteLauncherAction(channel, LauncherAction::kControlChannel));
+  return channel;
+}
+
+Result<void> WriteControlMessage(const SharedFD& channel,
+                                 const google::protobuf::MessageLite& message) {
+  std::string serialized;
+  CF_EXPECT(message.SerializeToString(&serialized),
+            "Failed to serialize control message");
+  CF_EXPECT(serialized.size() <= kMaxControlMessageSize,
+            "Control message too large: " << serialized.size() << " bytes");
+  // Length and contents are sent together, so readers never see just one.
+  uint32_t size = serialized.size();
+  serialized.insert(0, reinterpret_cast<const char*>(&size), sizeof(size));
+  CF_EXPECT(WriteAll(channel, serialized) ==
+                static_cast<ssize_t>(serialized.size()),
+            "Failed to write control message: " << channel->StrError());
+  return {};
+}
+
+Result<void> ReadControlMessage(const SharedFD& channel,
+                                google::protobuf::MessageLite& message) {
+  uint32_t size;
+  auto read = ReadExactBinary(channel, &size);
+  CF_EXPECT(read != 0, "Control channel closed");
+  CF_EXPECT(read == sizeof(size),
+            "Failed to read control message size: " << channel->StrError());
+  CF_EXPECT(size <= kMaxControlMessageSize,
+            "Control message too large: " << size << " bytes");
+  std::string serialized(size, '\0');
+  CF_EXPECT(ReadExact(channel, &serialized) == static_cast<ssize_t>(size),
+            "Failed to read control message: " << channel->StrError());
+  CF_EXPECT(message.ParseFromString(serialized),
+            "Failed to parse control message");
+  return {};
+}
+
+Result<void> ControlMessageBuffer::ReadAvailable(const SharedFD& channel) {
+  char data[4096];
+  auto read = channel->Read(data, sizeof(data));
+  if (read < 0 && (channel->GetErrno() == EAGAIN ||
+                   channel->GetErrno() == EWOULDBLOCK)) {
+    return {};
+  }
+  CF_EXPECT(read != 0, "Control channel closed");
+  CF_EXPECT(read > 0,
+            "Failed to read control channel: " << channel->StrError());
+  Append(data, read);
+  return {};
+}
+
+void ControlMessageBuffer::Append(const char* data, size_t size) {
+  buffer_.append(data, size);
+}
+
+Result<bool> ControlMessageBuffer::Next(
+    google::protobuf::MessageLite& message) {
+  uint32_t size;
+  if (buffer_.size() < sizeof(size)) {
+    return false;
+  }
+  memcpy(&size, buffer_.data(), sizeof(size));
+  CF_EXPECT(size <= kMaxControlMessageSize,
+            "Control message too large: " << size << " bytes");
+  if (buffer_.size() - sizeof(size) < size) {
+    return false;
+  }
+  CF_EXPECT(message.ParseFromArray(buffer_.data() + sizeof(size), size),
+            "Failed to parse control message");
+  buffer_.erase(0, sizeof(size) + size);
+  return true;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <google/protobuf/message_lite.h>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/result.h"
+#include "host/libs/config/cuttlefish_config.h"
+#include "launcher_control.pb.h"
+
+namespace cuttlefish {
+
+// Connects to the launcher monitor of the instance and switches the
+// connection to the control channel described in launcher_control.proto.
+Result<SharedFD> OpenLauncherControlChannel(
+    const CuttlefishConfig::InstanceSpecific& instance_config,
+    const int timeout_seconds);
+
+Result<void> WriteControlMessage(const SharedFD& channel,
+                                 const google::protobuf::MessageLite& message);
+
+// Fails if the channel was closed before a complete message was read.
+Result<void> ReadControlMessage(const SharedFD& channel,
+                                google::protobuf::MessageLite& message);
+
+// Collects the bytes of a channel until they form whole messages, so that a
+// server can read whatever has arrived without waiting for the rest of a
+// message.
+class ControlMessageBuffer {
+ public:
+  // Reads what the channel has, with a single read. Fails if the channel was
+  // closed. A non blocking channel with nothing to read is not an error.
+  Result<void> ReadAvailable(const SharedFD& channel);
+  void Append(const char* data, size_t size);
+
+  // Takes the next message out of the buffer, returns false if it isn't
+  // complete yet. Fails on a size that is too large or a message that
+  // doesn't parse, after which the channel can't be trusted.
+  Result<bool> Next(google::protobuf::MessageLite& message);
+
+ private:
+  std::string buffer_;
+};
+
+}  // namespace cuttlefish
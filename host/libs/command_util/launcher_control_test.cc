@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/command_util/launcher_control.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "common/libs/fs/shared_buf.h"
+
+namespace cuttlefish {
+namespace {
+
+launcher::ControlRequest StatusRequest(uint64_t id) {
+  launcher::ControlRequest request;
+  request.set_id(id);
+  request.mutable_status()->set_processes(true);
+  return request;
+}
+
+// The bytes WriteControlMessage sends for `message`.
+std::string Framed(const launcher::ControlRequest& message) {
+  SharedFD reader, writer;
+  EXPECT_TRUE(SharedFD::Pipe(&reader, &writer));
+  EXPECT_TRUE(WriteControlMessage(writer, message).ok());
+  writer->Close();
+  std::string framed;
+  EXPECT_GE(ReadAll(reader, &framed), 0);
+  return framed;
+}
+
+class ControlMessageBufferTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(
+        SharedFD::SocketPair(AF_UNIX, SOCK_STREAM, 0, &client_, &server_));
+    auto flags = server_->Fcntl(F_GETFL, 0);
+    ASSERT_GE(server_->Fcntl(F_SETFL, flags | O_NONBLOCK), 0);
+  }
+
+  SharedFD client_;
+  SharedFD server_;
+  ControlMessageBuffer buffer_;
+};
+
+TEST_F(ControlMessageBufferTest, ReassemblesMessagesSplitAnywhere) {
+  auto framed = Framed(StatusRequest(7));
+  for (size_t split = 0; split <= framed.size(); split++) {
+    ControlMessageBuffer buffer;
+    launcher::ControlRequest request;
+    buffer.Append(framed.data(), split);
+    auto next = buffer.Next(request);
+    ASSERT_TRUE(next.ok()) << next.error().Message();
+    if (split < framed.size()) {
+      EXPECT_FALSE(*next) << "complete after " << split << " bytes";
+      buffer.Append(framed.data() + split, framed.size() - split);
+      next = buffer.Next(request);
+      ASSERT_TRUE(next.ok()) << next.error().Message();
+    }
+    ASSERT_TRUE(*next) << "split at " << split;
+    EXPECT_EQ(request.id(), 7);
+    EXPECT_TRUE(request.status().processes());
+  }
+}
+
+TEST_F(ControlMessageBufferTest, SplitsSeveralMessagesInOneRead) {
+  ASSERT_TRUE(WriteControlMessage(client_, StatusRequest(1)).ok());
+  ASSERT_TRUE(WriteControlMessage(client_, StatusRequest(2)).ok());
+  // An empty message is only its size.
+  ASSERT_TRUE(
+      WriteControlMessage(client_, launcher::ControlRequest()).ok());
+  ASSERT_TRUE(buffer_.ReadAvailable(server_).ok());
+
+  launcher::ControlRequest request;
+  for (uint64_t id : {1, 2, 0}) {
+    auto next = buffer_.Next(request);
+    ASSERT_TRUE(next.ok()) << next.error().Message();
+    ASSERT_TRUE(*next);
+    EXPECT_EQ(request.id(), id);
+    request.Clear();
+  }
+  auto next = buffer_.Next(request);
+  ASSERT_TRUE(next.ok()) << next.error().Message();
+  EXPECT_FALSE(*next);
+}
+
+TEST_F(ControlMessageBufferTest, PartialMessageDoesNotBlock) {
+  auto framed = Framed(StatusRequest(3));
+  // Only part of the size.
+  ASSERT_EQ(WriteAll(client_, framed.substr(0, 2)), 2);
+  ASSERT_TRUE(buffer_.ReadAvailable(server_).ok());
+  launcher::ControlRequest request;
+  auto next = buffer_.Next(request);
+  ASSERT_TRUE(next.ok()) << next.error().Message();
+  EXPECT_FALSE(*next);
+  // Nothing more to read returns right away too.
+  ASSERT_TRUE(buffer_.ReadAvailable(server_).ok());
+
+  ASSERT_EQ(WriteAll(client_, framed.substr(2)),
+            static_cast<ssize_t>(framed.size() - 2));
+  ASSERT_TRUE(buffer_.ReadAvailable(server_).ok());
+  next = buffer_.Next(request);
+  ASSERT_TRUE(next.ok()) << next.error().Message();
+  ASSERT_TRUE(*next);
+  EXPECT_EQ(request.id(), 3);
+}
+
+TEST_F(ControlMessageBufferTest, TooLargeSizeIsAnError) {
+  uint32_t size = 0xffffffff;
+  buffer_.Append(reinterpret_cast<const char*>(&size), sizeof(size));
+  launcher::ControlRequest request;
+  EXPECT_FALSE(buffer_.Next(request).ok());
+}
+
+TEST_F(ControlMessageBufferTest, ClosedChannelIsAnError) {
+  client_->Close();
+  EXPECT_FALSE(buffer_.ReadAvailable(server_).ok());
+}
+
+TEST_F(ControlMessageBufferTest, BlockingReadGetsWholeMessages) {
+  ASSERT_TRUE(WriteControlMessage(client_, StatusRequest(4)).ok());
+  ASSERT_TRUE(WriteControlMessage(client_, StatusRequest(5)).ok());
+  launcher::ControlRequest request;
+  ASSERT_TRUE(ReadControlMessage(server_, request).ok());
+  EXPECT_EQ(request.id(), 4);
+  ASSERT_TRUE(ReadControlMessage(server_, request).ok());
+  EXPECT_EQ(request.id(), 5);
+}
+
+}  // namespace
+}  // namespace cuttlefish
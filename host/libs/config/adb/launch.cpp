@@ -73,9 +73,11 @@ class AdbHelper {
   const AdbConfig& config_;
 };
 
-class AdbConnector : public CommandSource {
+class AdbConnector : public CommandSource, public KernelLogPipeConsumer {
  public:
-  INJECT(AdbConnector(const AdbHelper& helper)) : helper_(helper) {}
+  INJECT(AdbConnector(const AdbHelper& helper,
+                      KernelLogPipeProvider& log_pipe_provider))
+      : helper_(helper), log_pipe_provider_(log_pipe_provider) {}
 
   // CommandSource
   Result<std::vector<MonitorCommand>> Commands() override {
@@ -98,6 +100,7 @@ class AdbConnector : public CommandSource {
     }
     address_arg.pop_back();
     adb_connector.AddParameter(address_arg);
+    adb_connector.AddParameter("--events_fd=", kernel_log_pipe_);
 
     std::vector<MonitorCommand> commands;
     commands.emplace_back(std::move(adb_connector));
@@ -111,10 +114,17 @@ class AdbConnector : public CommandSource {
   }
 
  private:
-  std::unordered_set<SetupFeature*> Dependencies() const override { return {}; }
-  bool Setup() override { return true; }
+  std::unordered_set<SetupFeature*> Dependencies() const override {
+    return {static_cast<SetupFeature*>(&log_pipe_provider_)};
+  }
+  bool Setup() override {
+    kernel_log_pipe_ = log_pipe_provider_.KernelLogPipe();
+    return true;
+  }
 
   const AdbHelper& helper_;
+  KernelLogPipeProvider& log_pipe_provider_;
+  SharedFD kernel_log_pipe_;
 };
 
 class SocketVsockProxy : public CommandSource, public KernelLogPipeConsumer {
@@ -217,6 +227,7 @@ LaunchAdbComponent() {
       .addMultibinding<CommandSource, AdbConnector>()
       .addMultibinding<CommandSource, SocketVsockProxy>()
       .addMultibinding<SetupFeature, AdbConnector>()
+      .addMultibinding<KernelLogPipeConsumer, AdbConnector>()
       .addMultibinding<KernelLogPipeConsumer, SocketVsockProxy>()
       .addMultibinding<SetupFeature, SocketVsockProxy>();
 }
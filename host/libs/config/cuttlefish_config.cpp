@@ -339,6 +339,38 @@ std::string CuttlefishConfig::metrics_binary() const {
   return (*dictionary_)[kMetricsBinary].asString();
 }
 
+static constexpr char kLogRotateSizeMb[] = "log_rotate_size_mb";
+void CuttlefishConfig::set_log_rotate_size_mb(int size_mb) {
+  (*dictionary_)[kLogRotateSizeMb] = size_mb;
+}
+int CuttlefishConfig::log_rotate_size_mb() const {
+  return (*dictionary_)[kLogRotateSizeMb].asInt();
+}
+
+static constexpr char kLogRotateIntervalS[] = "log_rotate_interval_s";
+void CuttlefishConfig::set_log_rotate_interval_s(int interval_s) {
+  (*dictionary_)[kLogRotateIntervalS] = interval_s;
+}
+int CuttlefishConfig::log_rotate_interval_s() const {
+  return (*dictionary_)[kLogRotateIntervalS].asInt();
+}
+
+static constexpr char kLogRotateKeep[] = "log_rotate_keep";
+void CuttlefishConfig::set_log_rotate_keep(int keep) {
+  (*dictionary_)[kLogRotateKeep] = keep;
+}
+int CuttlefishConfig::log_rotate_keep() const {
+  return (*dictionary_)[kLogRotateKeep].asInt();
+}
+
+static constexpr char kLogRotateCompress[] = "log_rotate_compress";
+void CuttlefishConfig::set_log_rotate_compress(bool compress) {
+  (*dictionary_)[kLogRotateCompress] = compress;
+}
+bool CuttlefishConfig::log_rotate_compress() const {
+  return (*dictionary_)[kLogRotateCompress].asBool();
+}
+
 static constexpr char kExtraKernelCmdline[] = "extra_kernel_cmdline";
 void CuttlefishConfig::set_extra_kernel_cmdline(
     const std::string& extra_cmdline) {
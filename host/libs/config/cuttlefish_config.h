@@ -159,6 +159,17 @@ class CuttlefishConfig {
   void set_metrics_binary(const std::string& metrics_binary);
   std::string metrics_binary() const;
 
+  // Rotation of the kernel and logcat logs, forwarded to the processes that
+  // write them. A size and interval of 0 keep a single, unbounded file.
+  void set_log_rotate_size_mb(int size_mb);
+  int log_rotate_size_mb() const;
+  void set_log_rotate_interval_s(int interval_s);
+  int log_rotate_interval_s() const;
+  void set_log_rotate_keep(int keep);
+  int log_rotate_keep() const;
+  void set_log_rotate_compress(bool compress);
+  bool log_rotate_compress() const;
+
   void set_extra_kernel_cmdline(const std::string& extra_cmdline);
   std::vector<std::string> extra_kernel_cmdline() const;
 
@@ -346,6 +357,8 @@ class CuttlefishConfig {
     std::string keyboard_socket_path() const;
     std::string switches_socket_path() const;
     std::string frames_socket_path() const;
+    // Where local processes get the frames shared with --frame_export.
+    std::string frame_export_socket_path() const;
 
     std::string access_kregistry_path() const;
 
@@ -504,6 +517,7 @@ class CuttlefishConfig {
     bool enable_gnss_grpc_proxy() const;
     bool enable_bootanimation() const;
     bool record_screen() const;
+    std::string frame_export() const;
     std::string gem5_debug_file() const;
     bool protected_vm() const;
     bool mte() const;
@@ -672,6 +686,7 @@ class CuttlefishConfig {
     void set_enable_gnss_grpc_proxy(const bool enable_gnss_grpc_proxy);
     void set_enable_bootanimation(const bool enable_bootanimation);
     void set_record_screen(bool record_screen);
+    void set_frame_export(const std::string& frame_export);
     void set_gem5_debug_file(const std::string& gem5_debug_file);
     void set_protected_vm(bool protected_vm);
     void set_mte(bool mte);
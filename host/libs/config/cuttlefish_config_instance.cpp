@@ -697,6 +697,15 @@ bool CuttlefishConfig::InstanceSpecific::record_screen() const {
   return (*Dictionary())[kRecordScreen].asBool();
 }
 
+static constexpr char kFrameExport[] = "frame_export";
+void CuttlefishConfig::MutableInstanceSpecific::set_frame_export(
+    const std::string& frame_export) {
+  (*Dictionary())[kFrameExport] = frame_export;
+}
+std::string CuttlefishConfig::InstanceSpecific::frame_export() const {
+  return (*Dictionary())[kFrameExport].asString();
+}
+
 static constexpr char kGem5DebugFile[] = "gem5_debug_file";
 std::string CuttlefishConfig::InstanceSpecific::gem5_debug_file() const {
   return (*Dictionary())[kGem5DebugFile].asString();
@@ -1382,6 +1391,11 @@ std::string CuttlefishConfig::InstanceSpecific::frames_socket_path() const {
   return PerInstanceInternalUdsPath("frames.sock");
 }
 
+std::string CuttlefishConfig::InstanceSpecific::frame_export_socket_path()
+    const {
+  return PerInstanceUdsPath("frame_export.sock");
+}
+
 static constexpr char kWifiMacPrefix[] = "wifi_mac_prefix";
 int CuttlefishConfig::InstanceSpecific::wifi_mac_prefix() const {
   return (*Dictionary())[kWifiMacPrefix].asInt();
@@ -158,6 +158,33 @@ bool CreateBlankImage(
   return true;
 }
 
+Result<void> CreateBlankImageFromTemplate(const std::string& image, int num_mb,
+                                          const std::string& image_fmt,
+                                          const std::string& template_dir) {
+  if (image_fmt == "none") {
+    // Only a truncate, nothing to save.
+    CF_EXPECT(CreateBlankImage(image, num_mb, image_fmt));
+    return {};
+  }
+  auto template_path = template_dir + "/blank_" + image_fmt + "_" +
+                       std::to_string(num_mb) + "mb.img";
+  if (!FileExists(template_path)) {
+    // Renamed once complete, so a failure never leaves a broken template.
+    auto partial_path = template_path + ".partial";
+    CF_EXPECT(CreateBlankImage(partial_path, num_mb, image_fmt),
+              "Failed to create \"" << partial_path << "\"");
+    CF_EXPECT(RenameFile(partial_path, template_path));
+  }
+  auto cloned = CloneFile(template_path, image);
+  if (!cloned.ok()) {
+    LOG(DEBUG) << cloned.error().Message() << ", copying instead";
+    CF_EXPECT(Copy(template_path, image),
+              "Failed to copy \"" << template_path << "\" to \"" << image
+                                  << "\"");
+  }
+  return {};
+}
+
 std::string GetFsType(const std::string& path) {
   std::string fs_type;
   blkid_cache cache;
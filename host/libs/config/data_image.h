@@ -19,6 +19,7 @@
 
 #include <fruit/fruit.h>
 
+#include "common/libs/utils/result.h"
 #include "host/libs/config/cuttlefish_config.h"
 #include "host/libs/config/feature.h"
 
@@ -40,6 +41,13 @@ InitializeEspImageComponent();
 bool CreateBlankImage(
     const std::string& image, int num_mb, const std::string& image_fmt);
 
+// Like CreateBlankImage, but formats an image of each size and format only
+// once. The first one is kept in `template_dir` and later ones are cloned
+// from it.
+Result<void> CreateBlankImageFromTemplate(const std::string& image, int num_mb,
+                                          const std::string& image_fmt,
+                                          const std::string& template_dir);
+
 class InitializeMiscImage : public SetupFeature {};
 
 fruit::Component<fruit::Required<const CuttlefishConfig::InstanceSpecific>,
@@ -36,6 +36,15 @@ bool SetupFeature::Setup() {
 
 /* static */ Result<void> SetupFeature::RunSetup(
     const std::vector<SetupFeature*>& features) {
+  return RunSetup(features,
+                  [](const std::string&,
+                     const std::function<Result<void>()>& setup) {
+                    return setup();
+                  });
+}
+
+/* static */ Result<void> SetupFeature::RunSetup(
+    const std::vector<SetupFeature*>& features, const SetupRunner& runner) {
   std::unordered_set<SetupFeature*> enabled;
   for (const auto& feature : features) {
     CF_EXPECT(feature != nullptr, "Received null feature");
@@ -54,7 +63,9 @@ bool SetupFeature::Setup() {
   // TODO(b/189153501): This can potentially be parallelized.
   for (auto& feature : ordered_features) {
     LOG(DEBUG) << "Running setup for " << feature->Name();
-    CF_EXPECT(feature->ResultSetup(), "Setup failed for " << feature->Name());
+    CF_EXPECT(runner(feature->Name(),
+                     [feature]() { return feature->ResultSetup(); }),
+              "Setup failed for " << feature->Name());
   }
   return {};
 }
@@ -15,6 +15,7 @@
  */
 #pragma once
 
+#include <functional>
 #include <ostream>
 #include <string>
 #include <unordered_map>
@@ -46,7 +47,14 @@ class SetupFeature : public virtual Feature<SetupFeature> {
  public:
   virtual ~SetupFeature();
 
+  // Runs the setup of one feature, e.g. to time it or check for cancellation.
+  // Must call `setup` to run the feature.
+  using SetupRunner = std::function<Result<void>(
+      const std::string& name, const std::function<Result<void>()>& setup)>;
+
   static Result<void> RunSetup(const std::vector<SetupFeature*>& features);
+  static Result<void> RunSetup(const std::vector<SetupFeature*>& features,
+                               const SetupRunner& runner);
 
   virtual bool Enabled() const = 0;
 
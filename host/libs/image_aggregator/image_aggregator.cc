@@ -25,6 +25,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -147,6 +148,21 @@ struct __attribute__((packed)) QCowHeader {
 
 static_assert(sizeof(QCowHeader) == 72);
 
+struct __attribute__((packed)) QCowHeaderV3 {
+  QCowHeader v2;
+  Be64 incompatible_features;
+  Be64 compatible_features;
+  Be64 autoclear_features;
+  Be32 refcount_order;
+  Be32 header_length;
+};
+
+static_assert(sizeof(QCowHeaderV3) == 104);
+
+// The values crosvm uses for the qcow images it creates.
+constexpr std::uint32_t kQcowClusterBits = 16;
+constexpr std::uint32_t kQcowRefcountOrder = 4;  // 16 bit refcounts
+
 /*
  * Returns the expanded file size of `file_path`. Note that the raw size of
  * files doesn't match how large they may appear inside a VM.
@@ -540,28 +556,119 @@ void CreateCompositeDisk(std::vector<MultipleImagePartition> partitions,
   composite.flush();
 }
 
-void CreateQcowOverlay(const std::string& crosvm_path,
-                       const std::string& backing_file,
-                       const std::string& output_overlay_path) {
-  Command cmd(crosvm_path);
-  cmd.AddParameter("create_qcow2");
-  cmd.AddParameter("--backing-file");
-  cmd.AddParameter(backing_file);
-  cmd.AddParameter(output_overlay_path);
-
-  std::string stdout_str;
-  std::string stderr_str;
-  int success =
-      RunWithManagedStdio(std::move(cmd), nullptr, &stdout_str, &stderr_str);
-
-  if (success != 0) {
-    LOG(ERROR) << "Failed to run `" << crosvm_path
-               << " create_qcow2 --backing-file " << backing_file << " "
-               << output_overlay_path << "`";
-    LOG(ERROR) << "stdout:\n###\n" << stdout_str << "\n###";
-    LOG(ERROR) << "stderr:\n###\n" << stderr_str << "\n###";
-    LOG(FATAL) << "Return code: \"" << success << "\"";
+Result<void> CreateQcowOverlay(const std::string& backing_file,
+                               const std::string& output_overlay_path) {
+  constexpr std::uint64_t kClusterSize = 1ULL << kQcowClusterBits;
+  constexpr std::uint64_t kPointersPerCluster =
+      kClusterSize / sizeof(std::uint64_t);
+  constexpr std::uint64_t kRefcountBytes = (1ULL << kQcowRefcountOrder) / 8;
+  constexpr std::uint64_t kRefcountsPerBlock = kClusterSize / kRefcountBytes;
+  auto div_round_up = [](std::uint64_t a, std::uint64_t b) {
+    return (a + b - 1) / b;
+  };
+
+  CF_EXPECT(FileExists(backing_file),
+            "Backing file \"" << backing_file << "\" does not exist");
+  CF_EXPECT(backing_file.size() <= kClusterSize - sizeof(QCowHeaderV3),
+            "Backing file path \"" << backing_file << "\" is too long");
+  std::uint64_t size = ExpandedStorageSize(backing_file);
+
+  // Laid out the same way as by `crosvm create_qcow2`: the header and the
+  // backing file path in the first cluster, followed by the L1 table, the
+  // refcount table and the refcount blocks for all of these. L2 tables and
+  // data clusters are only allocated when the VM writes to the disk.
+  std::uint64_t clusters = div_round_up(size, kClusterSize);
+  std::uint64_t l2_tables = div_round_up(clusters, kPointersPerCluster);
+  std::uint64_t l1_clusters = div_round_up(l2_tables, kPointersPerCluster);
+  // The refcount table can't grow, so it has room for the refcount blocks of
+  // a fully allocated disk: every data cluster and L2 table on top of the
+  // metadata, including the refcount table and blocks themselves.
+  std::uint64_t allocated_clusters = 1 + l1_clusters + l2_tables + clusters;
+  std::uint64_t max_refcount_blocks = 0;
+  std::uint64_t refcount_table_clusters = 1;
+  while (true) {
+    std::uint64_t blocks = div_round_up(
+        allocated_clusters + refcount_table_clusters + max_refcount_blocks,
+        kRefcountsPerBlock);
+    std::uint64_t table_clusters = std::max<std::uint64_t>(
+        div_round_up(blocks * sizeof(std::uint64_t), kClusterSize), 1);
+    if (blocks == max_refcount_blocks &&
+        table_clusters == refcount_table_clusters) {
+      break;
+    }
+    max_refcount_blocks = blocks;
+    refcount_table_clusters = table_clusters;
+  }
+  std::uint64_t refcount_blocks = 1;
+  while (div_round_up(1 + l1_clusters + refcount_table_clusters +
+                          refcount_blocks,
+                      kRefcountsPerBlock) > refcount_blocks) {
+    refcount_blocks++;
   }
+  CF_EXPECT(refcount_blocks <= refcount_table_clusters * kPointersPerCluster,
+            "Disk of " << size << " bytes too large for a qcow overlay");
+  std::uint64_t metadata_clusters =
+      1 + l1_clusters + refcount_table_clusters + refcount_blocks;
+  std::uint64_t l1_table_offset = kClusterSize;
+  std::uint64_t refcount_table_offset = (1 + l1_clusters) * kClusterSize;
+  std::uint64_t refcount_blocks_offset =
+      refcount_table_offset + refcount_table_clusters * kClusterSize;
+
+  QCowHeaderV3 header = {
+      .v2 =
+          {
+              .magic = Be32(0x514649fb),  // QCOW2_MAGIC
+              .version = Be32(3),
+              .backing_file_offset = Be64(sizeof(QCowHeaderV3)),
+              .backing_file_size = Be32(backing_file.size()),
+              .cluster_bits = Be32(kQcowClusterBits),
+              .size = Be64(size),
+              .crypt_method = Be32(0),
+              .l1_size = Be32(l2_tables),
+              .l1_table_offset = Be64(l1_table_offset),
+              .refcount_table_offset = Be64(refcount_table_offset),
+              .refcount_table_clusters = Be32(refcount_table_clusters),
+              .nb_snapshots = Be32(0),
+              .snapshots_offset = Be64(0),
+          },
+      .incompatible_features = Be64(0),
+      .compatible_features = Be64(0),
+      .autoclear_features = Be64(0),
+      .refcount_order = Be32(kQcowRefcountOrder),
+      .header_length = Be32(sizeof(QCowHeaderV3)),
+  };
+  std::string first_cluster(reinterpret_cast<const char*>(&header),
+                            sizeof(header));
+  first_cluster += backing_file;
+
+  // Everything else starts zeroed: the L1 table has no L2 tables, so all
+  // reads go to the backing file.
+  std::vector<Be64> refcount_table(refcount_blocks);
+  for (std::uint64_t i = 0; i < refcount_blocks; i++) {
+    refcount_table[i] = Be64(refcount_blocks_offset + i * kClusterSize);
+  }
+  std::vector<Be16> refcounts(metadata_clusters, Be16(1));
+
+  auto overlay = SharedFD::Open(output_overlay_path,
+                                O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+  CF_EXPECT(overlay->IsOpen(), "Failed to create \"" << output_overlay_path
+                                                     << "\": "
+                                                     << overlay->StrError());
+  auto write_at = [&overlay](std::uint64_t offset, const void* data,
+                             std::size_t length) {
+    return overlay->LSeek(offset, SEEK_SET) == static_cast<off_t>(offset) &&
+           WriteAll(overlay, static_cast<const char*>(data), length) ==
+               static_cast<ssize_t>(length);
+  };
+  CF_EXPECT(overlay->Truncate(metadata_clusters * kClusterSize) == 0 &&
+                write_at(0, first_cluster.data(), first_cluster.size()) &&
+                write_at(refcount_table_offset, refcount_table.data(),
+                         refcount_table.size() * sizeof(Be64)) &&
+                write_at(refcount_blocks_offset, refcounts.data(),
+                         refcounts.size() * sizeof(Be16)),
+            "Failed to write \"" << output_overlay_path
+                                 << "\": " << overlay->StrError());
+  return {};
 }
 
 } // namespace cuttlefish
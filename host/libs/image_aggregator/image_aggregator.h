@@ -22,6 +22,8 @@
 #include <string>
 #include <vector>
 
+#include "common/libs/utils/result.h"
+
 namespace cuttlefish {
 
 enum ImagePartitionType {
@@ -87,12 +89,11 @@ void CreateCompositeDisk(std::vector<MultipleImagePartition> partitions,
  * files can be swapped out and replaced without affecting the original. qcow
  * is supported by QEMU and crosvm.
  *
- * The crosvm binary at `crosvm_path` is used to generate an overlay file at
- * `output_overlay_path` that functions as an overlay on the file at
- * `backing_file`.
+ * An overlay file is written at `output_overlay_path` that functions as an
+ * overlay on the file at `backing_file`, in the same form as by
+ * `crosvm create_qcow2`.
  */
-void CreateQcowOverlay(const std::string& crosvm_path,
-                       const std::string& backing_file,
-                       const std::string& output_overlay_path);
+Result<void> CreateQcowOverlay(const std::string& backing_file,
+                               const std::string& output_overlay_path);
 
 }
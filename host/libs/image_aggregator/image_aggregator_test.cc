@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/image_aggregator/image_aggregator.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/fs/shared_fd.h"
+
+namespace cuttlefish {
+namespace {
+
+std::uint64_t ReadBe(const std::string& data, std::size_t offset,
+                     std::size_t bytes) {
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < bytes; i++) {
+    value = (value << 8) | static_cast<std::uint8_t>(data[offset + i]);
+  }
+  return value;
+}
+
+std::uint64_t DivRoundUp(std::uint64_t a, std::uint64_t b) {
+  return (a + b - 1) / b;
+}
+
+// Parses an overlay as a qcow2 reader would, see docs/interop/qcow2.txt in
+// QEMU.
+class QcowOverlayTest : public ::testing::TestWithParam<std::uint64_t> {
+ protected:
+  void SetUp() override {
+    backing_ = std::string(dir_.path) + "/disk.img";
+    overlay_ = std::string(dir_.path) + "/overlay.img";
+    auto backing = SharedFD::Creat(backing_, 0600);
+    ASSERT_TRUE(backing->IsOpen()) << backing->StrError();
+    // Sparse, even the largest sizes take no space.
+    if (backing->Truncate(GetParam()) != 0) {
+      GTEST_SKIP() << "Can't create a " << GetParam()
+                   << " byte file here: " << backing->StrError();
+    }
+    backing->Close();
+
+    auto created = CreateQcowOverlay(backing_, overlay_);
+    ASSERT_TRUE(created.ok()) << created.error().Message();
+    auto overlay = SharedFD::Open(overlay_, O_RDONLY);
+    ASSERT_TRUE(overlay->IsOpen()) << overlay->StrError();
+    ASSERT_GE(ReadAll(overlay, &contents_), 0) << overlay->StrError();
+  }
+
+  std::uint64_t Header(std::size_t offset, std::size_t bytes) const {
+    return ReadBe(contents_, offset, bytes);
+  }
+
+  std::uint64_t ClusterSize() const { return 1ULL << Header(20, 4); }
+
+  std::uint64_t Refcount(std::uint64_t cluster) const {
+    auto refcount_bits = 1ULL << Header(96, 4);
+    auto refcounts_per_block = ClusterSize() * 8 / refcount_bits;
+    auto table_offset = Header(48, 8);
+    auto block_offset =
+        ReadBe(contents_, table_offset + cluster / refcounts_per_block * 8, 8);
+    if (block_offset == 0) {
+      return 0;
+    }
+    return ReadBe(contents_,
+                  block_offset +
+                      cluster % refcounts_per_block * refcount_bits / 8,
+                  refcount_bits / 8);
+  }
+
+  TemporaryDir dir_;
+  std::string backing_;
+  std::string overlay_;
+  std::string contents_;
+};
+
+TEST_P(QcowOverlayTest, HeaderDescribesTheBackingFile) {
+  ASSERT_GE(contents_.size(), 104);
+  EXPECT_EQ(Header(0, 4), 0x514649fb);  // QFI\xfb
+  EXPECT_EQ(Header(4, 4), 3);
+  EXPECT_EQ(Header(24, 8), GetParam());
+  EXPECT_EQ(Header(32, 4), 0);  // No encryption
+  EXPECT_EQ(Header(72, 8), 0);  // No incompatible features
+  EXPECT_EQ(Header(100, 4), 104);
+
+  auto path_offset = Header(8, 8);
+  auto path_size = Header(16, 4);
+  ASSERT_LE(path_offset + path_size, ClusterSize());
+  EXPECT_EQ(contents_.substr(path_offset, path_size), backing_);
+}
+
+TEST_P(QcowOverlayTest, NothingIsAllocated) {
+  auto cluster_size = ClusterSize();
+  auto l1_size = Header(36, 4);
+  auto l1_offset = Header(40, 8);
+  auto clusters = DivRoundUp(GetParam(), cluster_size);
+  EXPECT_EQ(l1_size, DivRoundUp(clusters, cluster_size / 8));
+  ASSERT_EQ(l1_offset % cluster_size, 0);
+  ASSERT_LE(l1_offset + l1_size * 8, contents_.size());
+  // Every read goes to the backing file.
+  for (std::uint64_t i = 0; i < l1_size; i++) {
+    ASSERT_EQ(ReadBe(contents_, l1_offset + i * 8, 8), 0) << "L1 entry " << i;
+  }
+}
+
+TEST_P(QcowOverlayTest, EveryClusterOfTheFileIsReferencedOnce) {
+  auto cluster_size = ClusterSize();
+  ASSERT_EQ(contents_.size() % cluster_size, 0);
+  auto file_clusters = contents_.size() / cluster_size;
+  for (std::uint64_t cluster = 0; cluster < file_clusters; cluster++) {
+    ASSERT_EQ(Refcount(cluster), 1) << "cluster " << cluster;
+  }
+  EXPECT_EQ(Refcount(file_clusters), 0);
+}
+
+TEST_P(QcowOverlayTest, RefcountTableCoversAFullyAllocatedDisk) {
+  auto cluster_size = ClusterSize();
+  auto refcount_bits = 1ULL << Header(96, 4);
+  auto refcounts_per_block = cluster_size * 8 / refcount_bits;
+  auto table_clusters = Header(56, 4);
+  auto data_clusters = DivRoundUp(GetParam(), cluster_size);
+  auto l2_tables = DivRoundUp(data_clusters, cluster_size / 8);
+  auto l1_clusters = DivRoundUp(Header(36, 4) * 8, cluster_size);
+  auto allocated = 1 + l1_clusters + l2_tables + data_clusters + table_clusters;
+  // The refcount blocks need refcounts themselves.
+  auto blocks = DivRoundUp(allocated, refcounts_per_block);
+  while (DivRoundUp(allocated + blocks, refcounts_per_block) > blocks) {
+    blocks++;
+  }
+  EXPECT_GE(table_clusters * cluster_size / 8, blocks);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Sizes, QcowOverlayTest,
+    ::testing::Values(
+        // Smaller than a cluster.
+        4096,
+        // Not a whole number of clusters, past one refcount block.
+        (3ULL << 30) + 5,
+        // The refcount blocks of the data alone just fit in a single
+        // refcount table cluster, those of the L2 tables don't.
+        8191ULL * 32768 * 65536));
+
+}  // namespace
+}  // namespace cuttlefish
@@ -22,11 +22,59 @@
 
 using gnss_grpc_proxy::GnssGrpcProxy;
 using gnss_grpc_proxy::GpsCoordinates;
+using gnss_grpc_proxy::GpsPlaybackOptions;
 using gnss_grpc_proxy::SendGpsCoordinatesReply;
 using gnss_grpc_proxy::SendGpsCoordinatesRequest;
+using gnss_grpc_proxy::StreamGpsLocationsRequest;
 using grpc::ClientContext;
 
 namespace cuttlefish {
+namespace {
+
+// Locations sent per stream message, small enough for the proxy to apply
+// backpressure and large enough to keep the per message overhead low.
+constexpr int kStreamBatchSize = 100;
+
+}  // namespace
+
+GpsLocationsStream::GpsLocationsStream(GnssGrpcProxy::Stub& stub,
+                                       const GpsPlaybackOptions& options)
+    : writer_(stub.StreamGpsLocations(&context_, &reply_)) {
+  *pending_.mutable_options() = options;
+}
+
+bool GpsLocationsStream::Write(const GpsFix& fix) {
+  GpsCoordinates* curr = pending_.add_coordinates();
+  curr->set_longitude(fix.longitude);
+  curr->set_latitude(fix.latitude);
+  curr->set_elevation(fix.elevation);
+  curr->set_timestamp_ms(int64_t(fix.time) * 1000 + fix.time_ms);
+  if (pending_.coordinates_size() < kStreamBatchSize) {
+    return true;
+  }
+  return Flush();
+}
+
+bool GpsLocationsStream::Flush() {
+  bool ok = writer_->Write(pending_);
+  pending_.Clear();
+  sent_ = true;
+  return ok;
+}
+
+Result<void> GpsLocationsStream::Finish() {
+  // The first message carries the options, even if there are no locations.
+  if (pending_.coordinates_size() > 0 || !sent_) {
+    Flush();
+  }
+  writer_->WritesDone();
+  grpc::Status status = writer_->Finish();
+  CF_EXPECT(status.ok(), "GPS data streaming failed" << status.error_code()
+                                                     << ": "
+                                                     << status.error_message());
+  LOG(DEBUG) << reply_.status();
+  return {};
+}
 
 GnssClient::GnssClient(const std::shared_ptr<grpc::Channel>& channel)
     : stub_(GnssGrpcProxy::NewStub(channel)) {}
@@ -60,4 +108,10 @@ Result<grpc::Status> GnssClient::SendGpsLocations(
   return status;
 }
 
+std::unique_ptr<GpsLocationsStream> GnssClient::StreamGpsLocations(
+    const GpsPlaybackOptions& options) {
+  return std::unique_ptr<GpsLocationsStream>(
+      new GpsLocationsStream(*stub_, options));
+}
+
 }  // namespace cuttlefish
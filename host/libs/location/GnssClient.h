@@ -19,11 +19,41 @@
 #include <grpcpp/channel.h>
 #include <grpcpp/client_context.h>
 #include <grpcpp/create_channel.h>
+
+#include <memory>
+
 #include "common/libs/utils/result.h"
 #include "gnss_grpc_proxy.grpc.pb.h"
 #include "host/libs/location/GpsFix.h"
 
 namespace cuttlefish {
+
+// Sends locations to the proxy as they are produced, in batches, so a route
+// never needs to be held in memory as a whole. The proxy applies backpressure
+// while its queue is full, so Write may block.
+class GpsLocationsStream {
+ public:
+  // Returns false once the stream is broken, Finish() reports why.
+  bool Write(const GpsFix& fix);
+  Result<void> Finish();
+
+ private:
+  friend class GnssClient;
+
+  GpsLocationsStream(gnss_grpc_proxy::GnssGrpcProxy::Stub& stub,
+                     const gnss_grpc_proxy::GpsPlaybackOptions& options);
+
+  bool Flush();
+
+  grpc::ClientContext context_;
+  gnss_grpc_proxy::SendGpsCoordinatesReply reply_;
+  std::unique_ptr<
+      grpc::ClientWriter<gnss_grpc_proxy::StreamGpsLocationsRequest>>
+      writer_;
+  gnss_grpc_proxy::StreamGpsLocationsRequest pending_;
+  bool sent_ = false;
+};
+
 class GnssClient {
  public:
   GnssClient(const std::shared_ptr<grpc::Channel>& channel);
@@ -31,6 +61,11 @@ class GnssClient {
   Result<grpc::Status> SendGpsLocations(
       int delay, const GpsFixArray& coordinates);
 
+  // Replaces the current playback with the locations written to the returned
+  // stream.
+  std::unique_ptr<GpsLocationsStream> StreamGpsLocations(
+      const gnss_grpc_proxy::GpsPlaybackOptions& options);
+
  private:
   std::unique_ptr<gnss_grpc_proxy::GnssGrpcProxy::Stub> stub_;
 };
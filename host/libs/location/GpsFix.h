@@ -18,6 +18,7 @@
 
 #include <time.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -29,8 +30,16 @@ struct GpsFix {
   float longitude = 0.0;
   float elevation = 0.0;
   time_t time = 0;
+  // Milliseconds past |time|, for documents with fractional seconds.
+  int time_ms = 0;
 
-  bool operator<(const GpsFix &other) const { return time < other.time; }
+  bool operator<(const GpsFix &other) const {
+    return time < other.time || (time == other.time && time_ms < other.time_ms);
+  }
 };
 
 typedef std::vector<GpsFix> GpsFixArray;
+
+// Receives the fixes of a document while it is parsed, returns false to stop
+// parsing.
+typedef std::function<bool(const GpsFix &)> GpsFixCallback;
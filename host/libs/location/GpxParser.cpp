@@ -15,11 +15,14 @@
  */
 
 #include "GpxParser.h"
-#include <libxml/parser.h>
+#include <ctype.h>
 #include <string.h>
 #include <time.h>
 #include <algorithm>
+#include <utility>
+#include <vector>
 #include "StringParse.h"
+#include "XmlStreamParser.h"
 
 using std::string;
 
@@ -31,193 +34,193 @@ static string formatError(const char *format, Args &&...args) {
   return buf;
 }
 
-static void cleanupXmlDoc(xmlDoc *doc) {
-  xmlFreeDoc(doc);
-  xmlCleanupParser();
-}
+static bool parseTime(const string &text, time_t *result, int *resultMs) {
+  struct tm time = {};
+  time.tm_isdst = -1;
+  int length = 0;
+  int results = sscanf(text.c_str(), "%u-%u-%uT%u:%u:%u%n", &time.tm_year,
+                       &time.tm_mon, &time.tm_mday, &time.tm_hour,
+                       &time.tm_min, &time.tm_sec, &length);
+  if (results != 6) {
+    return false;
+  }
 
-static bool parseLocation(xmlNode *ptNode, xmlDoc *doc, GpsFix *result,
-                          string *error) {
-  float latitude;
-  float longitude;
-
-  xmlAttrPtr attr;
-  xmlChar *tmpStr;
-
-  // Check for and get the latitude attribute
-  attr = xmlHasProp(ptNode, (const xmlChar *)"lat");
-  if (!attr || !(tmpStr = xmlGetProp(ptNode, (const xmlChar *)"lat"))) {
-    *error = formatError("Point missing a latitude on line %d.", ptNode->line);
-    return false;  // Return error since a point *must* have a latitude
-  } else {
-    int read = SscanfWithCLocale(reinterpret_cast<const char *>(tmpStr), "%f",
-                                 &latitude);
-    xmlFree(tmpStr);  // Caller-freed
-    if (read != 1) {
-      return false;
+  // Seconds may have a fraction, e.g. 2023-04-01T10:00:00.250Z, only the
+  // milliseconds are kept.
+  int ms = 0;
+  if (text[length] == '.') {
+    int scale = 100;
+    for (size_t i = length + 1; i < text.size() && isdigit(text[i]); i++) {
+      ms += (text[i] - '0') * scale;
+      scale /= 10;
     }
   }
 
-  // Check for and get the longitude attribute
-  attr = xmlHasProp(ptNode, (const xmlChar *)"lon");
-  if (!attr || !(tmpStr = xmlGetProp(ptNode, (const xmlChar *)"lon"))) {
-    *error = formatError("Point missing a longitude on line %d.", ptNode->line);
-    return false;  // Return error since a point *must* have a longitude
-  } else {
-    int read = SscanfWithCLocale(reinterpret_cast<const char *>(tmpStr), "%f",
-                                 &longitude);
-    xmlFree(tmpStr);  // Caller-freed
-    if (read != 1) {
-      return false;
+  // Correct according to the struct tm specification
+  time.tm_year -= 1900;  // Years since 1900
+  time.tm_mon -= 1;      // Months since January, 0-11
+
+  *result = mktime(&time);
+  *resultMs = ms;
+  return true;
+}
+
+namespace {
+
+// Reads the <wpt> children of the root, the <rtept> children of its <rte>
+// elements and the <trkpt> children of its <trk><trkseg> elements, which
+// all have the same format.
+class GpxStreamParser : public XmlStreamParser {
+ public:
+  GpxStreamParser(const GpsFixCallback &callback)
+      : XmlStreamParser("GPX"), callback_(callback) {}
+
+ protected:
+  void startElement(const char *name, const char *, int attributeCount,
+                    const xmlChar **attributes) override {
+    path_.emplace_back(name);
+    if (inPoint_) {
+      if (path_.size() == pointDepth_ + 1) {
+        field_ = name;
+        text_.clear();
+      }
+    } else if (isPoint()) {
+      startPoint(attributeCount, attributes);
     }
   }
 
-  // The result will be valid if this point is reached
-  result->latitude = latitude;
-  result->longitude = longitude;
-
-  // Check for potential children nodes (including time, elevation, name, and
-  // description) Note that none are actually required according to the GPX
-  // format.
-  int childCount = 0;
-  for (xmlNode *field = ptNode->children; field; field = field->next) {
-    tmpStr = nullptr;
-
-    if (!strcmp((const char *)field->name, "time")) {
-      if ((tmpStr = xmlNodeListGetString(doc, field->children, 1))) {
-        // Convert to a number
-        struct tm time = {};
-        time.tm_isdst = -1;
-        int results = sscanf((const char *)tmpStr, "%u-%u-%uT%u:%u:%u",
-                             &time.tm_year, &time.tm_mon, &time.tm_mday,
-                             &time.tm_hour, &time.tm_min, &time.tm_sec);
-        if (results != 6) {
-          *error = formatError(
-              "Improperly formatted time on line %d.<br/>"
-              "Times must be in ISO format.",
-              ptNode->line);
-          return false;
-        }
-
-        // Correct according to the struct tm specification
-        time.tm_year -= 1900;  // Years since 1900
-        time.tm_mon -= 1;      // Months since January, 0-11
-
-        result->time = mktime(&time);
-        xmlFree(tmpStr);  // Caller-freed
-        childCount++;
-      }
-    } else if (!strcmp((const char *)field->name, "ele")) {
-      if ((tmpStr = xmlNodeListGetString(doc, field->children, 1))) {
-        int read = SscanfWithCLocale(reinterpret_cast<const char *>(tmpStr),
-                                     "%f", &result->elevation);
-        xmlFree(tmpStr);  // Caller-freed
-        if (read != 1) {
-          return false;
-        }
-        childCount++;
-      }
-    } else if (!strcmp((const char *)field->name, "name")) {
-      if ((tmpStr = xmlNodeListGetString(doc, field->children, 1))) {
-        result->name = reinterpret_cast<const char *>(tmpStr);
-        xmlFree(tmpStr);  // Caller-freed
-        childCount++;
-      }
-    } else if (!strcmp((const char *)field->name, "desc")) {
-      if ((tmpStr = xmlNodeListGetString(doc, field->children, 1))) {
-        result->description = reinterpret_cast<const char *>(tmpStr);
-        xmlFree(tmpStr);  // Caller-freed
-        childCount++;
+  void endElement(const char *, const char *) override {
+    if (inPoint_ && path_.size() == pointDepth_ + 1) {
+      parseField();
+      field_.clear();
+    } else if (inPoint_ && path_.size() == pointDepth_) {
+      inPoint_ = false;
+      if (!callback_(point_)) {
+        fail("Parsing stopped before the end of the document.");
       }
     }
+    path_.pop_back();
+  }
 
-    // We only care about 4 potential child fields, so quit after finding those
-    if (childCount == 4) {
-      break;
+  void characters(const char *text, int len) override {
+    // Only the text directly inside the fields of a point matters
+    if (inPoint_ && !field_.empty() && path_.size() == pointDepth_ + 1) {
+      text_.append(text, len);
     }
   }
 
-  return true;
-}
-
-static bool parse(xmlDoc *doc, GpsFixArray *fixes, string *error) {
-  xmlNode *root = xmlDocGetRootElement(doc);
-  GpsFix location;
-  bool isOk;
-
-  for (xmlNode *child = root->children; child; child = child->next) {
-    // Individual <wpt> elements are parsed on their own
-    if (!strcmp((const char *)child->name, "wpt")) {
-      isOk = parseLocation(child, doc, &location, error);
-      if (!isOk) {
-        cleanupXmlDoc(doc);
+ private:
+  bool isPoint() const {
+    const string &name = path_.back();
+    switch (path_.size()) {
+      case 2:
+        return name == "wpt";
+      case 3:
+        return path_[1] == "rte" && name == "rtept";
+      case 4:
+        return path_[1] == "trk" && path_[2] == "trkseg" && name == "trkpt";
+      default:
         return false;
-      }
-      fixes->push_back(location);
     }
+  }
 
-    // <rte> elements require an additional depth of parsing
-    else if (!strcmp((const char *)child->name, "rte")) {
-      for (xmlNode *rtept = child->children; rtept; rtept = rtept->next) {
-        // <rtept> elements are parsed just like <wpt> elements
-        if (!strcmp((const char *)rtept->name, "rtept")) {
-          isOk = parseLocation(rtept, doc, &location, error);
-          if (!isOk) {
-            cleanupXmlDoc(doc);
-            return false;
-          }
-          fixes->push_back(location);
-        }
-      }
+  void startPoint(int attributeCount, const xmlChar **attributes) {
+    point_ = GpsFix();
+    pointLine_ = line();
+
+    // A point *must* have a latitude and a longitude
+    string value;
+    if (!getAttribute(attributeCount, attributes, "lat", &value)) {
+      fail(formatError("Point missing a latitude on line %d.", pointLine_));
+      return;
     }
+    if (SscanfWithCLocale(value.c_str(), "%f", &point_.latitude) != 1) {
+      fail(formatError("Malformed latitude on line %d.", pointLine_));
+      return;
+    }
+    if (!getAttribute(attributeCount, attributes, "lon", &value)) {
+      fail(formatError("Point missing a longitude on line %d.", pointLine_));
+      return;
+    }
+    if (SscanfWithCLocale(value.c_str(), "%f", &point_.longitude) != 1) {
+      fail(formatError("Malformed longitude on line %d.", pointLine_));
+      return;
+    }
+    inPoint_ = true;
+    pointDepth_ = path_.size();
+  }
 
-    // <trk> elements require two additional depths of parsing
-    else if (!strcmp((const char *)child->name, "trk")) {
-      for (xmlNode *trkseg = child->children; trkseg; trkseg = trkseg->next) {
-        // Skip non <trkseg> elements
-        if (!strcmp((const char *)trkseg->name, "trkseg")) {
-          // <trkseg> elements an additional depth of parsing
-          for (xmlNode *trkpt = trkseg->children; trkpt; trkpt = trkpt->next) {
-            // <trkpt> elements are parsed just like <wpt> elements
-            if (!strcmp((const char *)trkpt->name, "trkpt")) {
-              isOk = parseLocation(trkpt, doc, &location, error);
-              if (!isOk) {
-                cleanupXmlDoc(doc);
-                return false;
-              }
-              fixes->push_back(location);
-            }
-          }
-        }
+  // None of the fields (time, elevation, name, and description) are actually
+  // required according to the GPX format, empty ones are ignored.
+  void parseField() {
+    if (text_.empty()) {
+      return;
+    }
+    if (field_ == "time") {
+      if (!parseTime(text_, &point_.time, &point_.time_ms)) {
+        fail(formatError(
+            "Improperly formatted time on line %d.<br/>"
+            "Times must be in ISO format.",
+            pointLine_));
       }
+    } else if (field_ == "ele") {
+      if (SscanfWithCLocale(text_.c_str(), "%f", &point_.elevation) != 1) {
+        fail(formatError("Malformed elevation on line %d.", pointLine_));
+      }
+    } else if (field_ == "name") {
+      point_.name = std::move(text_);
+    } else if (field_ == "desc") {
+      point_.description = std::move(text_);
     }
   }
 
-  // Sort the values by timestamp
-  std::sort(fixes->begin(), fixes->end());
-
-  cleanupXmlDoc(doc);
-  return true;
+  const GpsFixCallback &callback_;
+  std::vector<string> path_;
+  bool inPoint_ = false;
+  size_t pointDepth_ = 0;
+  int pointLine_ = 0;
+  GpsFix point_;
+  string field_;
+  string text_;
+};
+
+GpsFixCallback appendTo(GpsFixArray *fixes) {
+  return [fixes](const GpsFix &fix) {
+    fixes->push_back(fix);
+    return true;
+  };
 }
 
+}  // namespace
+
 bool GpxParser::parseFile(const char *filePath, GpsFixArray *fixes,
                           string *error) {
-  xmlDocPtr doc = xmlReadFile(filePath, nullptr, 0);
-  if (doc == nullptr) {
-    cleanupXmlDoc(doc);
-    *error = "GPX document not parsed successfully.";
+  if (!parseFileStreaming(filePath, appendTo(fixes), error)) {
     return false;
   }
-  return parse(doc, fixes, error);
+  // Sort the values by timestamp
+  std::stable_sort(fixes->begin(), fixes->end());
+  return true;
 }
 
 bool GpxParser::parseString(const char *str, int len, GpsFixArray *fixes,
                             string *error) {
-  xmlDocPtr doc = xmlReadMemory(str, len, NULL, NULL, 0);
-  if (doc == nullptr) {
-    cleanupXmlDoc(doc);
-    *error = "GPX document not parsed successfully.";
+  if (!parseStringStreaming(str, len, appendTo(fixes), error)) {
     return false;
   }
-  return parse(doc, fixes, error);
-}
\ No newline at end of file
+  // Sort the values by timestamp
+  std::stable_sort(fixes->begin(), fixes->end());
+  return true;
+}
+
+bool GpxParser::parseFileStreaming(const char *filePath,
+                                   const GpsFixCallback &callback,
+                                   string *error) {
+  return GpxStreamParser(callback).parseFile(filePath, error);
+}
+
+bool GpxParser::parseStringStreaming(const char *str, int len,
+                                     const GpsFixCallback &callback,
+                                     string *error) {
+  return GpxStreamParser(callback).parseString(str, len, error);
+}
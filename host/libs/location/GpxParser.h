@@ -31,4 +31,15 @@ class GpxParser {
 
   static bool parseString(const char *str, int len, GpsFixArray *fixes,
                           std::string *error);
+
+  /* Like parseFile and parseString, but passes the fixes to |callback| as
+   * soon as they are read, in the order of the document rather than sorted
+   * by time. Parsing stops early if |callback| returns false.
+   */
+  static bool parseFileStreaming(const char *filePath,
+                                 const GpsFixCallback &callback,
+                                 std::string *error);
+  static bool parseStringStreaming(const char *str, int len,
+                                   const GpsFixCallback &callback,
+                                   std::string *error);
 };
\ No newline at end of file
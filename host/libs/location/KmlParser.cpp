@@ -15,199 +15,260 @@
  */
 
 #include "KmlParser.h"
-#include <libxml/parser.h>
+#include <ctype.h>
 #include <string.h>
-#include <unistd.h>
+#include <optional>
 #include <string>
 #include <utility>
 #include "StringParse.h"
+#include "XmlStreamParser.h"
 using std::string;
 
-// Coordinates can be nested arbitrarily deep within a Placemark, depending
-// on the type of object (Point, LineString, Polygon) the Placemark contains
-static xmlNode* findCoordinates(xmlNode* current) {
-  for (; current != nullptr; current = current->next) {
-    if (!strcmp((const char*)current->name, "coordinates")) {
-      return current;
+// Text of a <coordinates> element that doesn't start with a coordinate after
+// this many characters is malformed, a coordinate is much shorter.
+static constexpr size_t kMaxUnparsedCoordinates = 1024;
+
+static constexpr char kMalformedCoordinates[] =
+    "Location found with missing or malformed coordinates";
+
+namespace {
+
+// Reads the Placemarks (aka locations), which can be nested arbitrarily deep.
+class KmlStreamParser : public XmlStreamParser {
+ public:
+  KmlStreamParser(const GpsFixCallback& callback)
+      : XmlStreamParser("KML"), callback_(callback) {}
+
+ protected:
+  // not worried about case-sensitivity since .kml files
+  // are expected to be machine-generated
+  void startElement(const char* name, const char* prefix, int,
+                    const xmlChar**) override {
+    depth_++;
+    if (placemarkDepth_ == 0) {
+      if (!strcmp(name, "Placemark")) {
+        startPlacemark();
+      }
+    } else if (depth_ == placemarkDepth_ + 1) {
+      startPlacemarkChild(name, prefix);
+    } else if (geometryDepth_ != 0 && !coordinatesFound_ &&
+               !strcmp(name, "coordinates")) {
+      // Coordinates can be nested arbitrarily deep within a Placemark,
+      // depending on the type of object (Point, LineString, Polygon) the
+      // Placemark contains. Only the first ones are used.
+      coordinatesFound_ = true;
+      coordinatesDepth_ = depth_;
+      coordinatesHaveText_ = false;
+      text_.clear();
+    } else if (trackDepth_ != 0 && depth_ == trackDepth_ + 1 && isGx(prefix) &&
+               !strcmp(name, "coord")) {
+      inTrackCoord_ = true;
+      text_.clear();
     }
-    xmlNode* children = findCoordinates(current->xmlChildrenNode);
-    if (children != nullptr) {
-      return children;
+  }
+
+  void endElement(const char*, const char*) override {
+    if (depth_ == coordinatesDepth_) {
+      endCoordinates();
+      coordinatesDepth_ = 0;
+    } else if (inTrackCoord_) {
+      endTrackCoord();
+      inTrackCoord_ = false;
+    } else if (depth_ == geometryDepth_) {
+      if (!coordinatesFound_) {
+        fail(kMalformedCoordinates);
+      }
+      geometryDepth_ = 0;
+    } else if (depth_ == trackDepth_) {
+      trackDepth_ = 0;
+    } else if (depth_ == placemarkDepth_ + 1 && field_ != nullptr) {
+      *field_ = std::move(text_);
+      field_ = nullptr;
+    } else if (depth_ == placemarkDepth_) {
+      endPlacemark();
     }
+    depth_--;
   }
-  return nullptr;
-}
 
-// Coordinates have the following format:
-//        <coordinates> -112.265654928602,36.09447672602546,2357
-//                ...
-//                -112.2657374587321,36.08646312301303,2357
-//        </coordinates>
-// often entirely contained in a single string, necessitating regex
-static bool parseCoordinates(xmlNode* current, GpsFixArray* fixes) {
-  xmlNode* coordinates_node = findCoordinates(current);
-  bool result = true;
-  if (coordinates_node == nullptr ||
-      coordinates_node->xmlChildrenNode == nullptr ||
-      coordinates_node->xmlChildrenNode->content == nullptr) {
-    return false;
+  void characters(const char* text, int len) override {
+    if (coordinatesDepth_ != 0) {
+      coordinatesHaveText_ = true;
+      text_.append(text, len);
+      parseCoordinates(false);
+    } else if (inTrackCoord_ || field_ != nullptr) {
+      text_.append(text, len);
+    }
   }
 
-  const char* coordinates =
-      (const char*)(coordinates_node->xmlChildrenNode->content);
-  int coordinates_len = strlen(coordinates);
-  int offset = 0, n = 0;
-  GpsFix new_fix;
-  while (3 == SscanfWithCLocale(coordinates + offset, "%f , %f , %f%n",
-                                &new_fix.longitude, &new_fix.latitude,
-                                &new_fix.elevation, &n)) {
-    fixes->push_back(new_fix);
-    offset += n;
+ private:
+  static bool isGx(const char* prefix) {
+    return prefix != nullptr && !strcmp(prefix, "gx");
   }
 
-  // Only allow whitespace at the end of the string to remain unconsumed.
-  for (int i = offset; i < coordinates_len && result; ++i) {
-    result = isspace(coordinates[i]);
+  void startPlacemark() {
+    placemarkDepth_ = depth_;
+    name_.clear();
+    description_.clear();
+    fixCount_ = 0;
+    firstFix_.reset();
   }
 
-  return result;
-}
+  void startPlacemarkChild(const char* name, const char* prefix) {
+    if (!strcmp(name, "description")) {
+      field_ = &description_;
+      text_.clear();
+    } else if (!strcmp(name, "name")) {
+      field_ = &name_;
+      text_.clear();
+    } else if (!strcmp(name, "Point") || !strcmp(name, "LineString") ||
+               !strcmp(name, "Polygon")) {
+      geometryDepth_ = depth_;
+      coordinatesFound_ = false;
+    } else if (isGx(prefix) && !strcmp(name, "Track")) {
+      trackDepth_ = depth_;
+    }
+  }
 
-static bool parseGxTrack(xmlNode* children, GpsFixArray* fixes) {
-  bool result = true;
-  for (xmlNode* current = children; result && current != nullptr;
-       current = current->next) {
-    if (current->ns && current->ns->prefix &&
-        !strcmp((const char*)current->ns->prefix, "gx") &&
-        !strcmp((const char*)current->name, "coord")) {
-      std::string coordinates{(const char*)current->xmlChildrenNode->content};
-      GpsFix new_fix;
-      result = (3 == SscanfWithCLocale(coordinates.c_str(), "%f %f %f",
-                                       &new_fix.longitude, &new_fix.latitude,
-                                       &new_fix.elevation));
-      fixes->push_back(new_fix);
+  void endPlacemark() {
+    if (fixCount_ == 0) {
+      fail(kMalformedCoordinates);
+    } else if (firstFix_) {
+      emitFirstFix();
     }
+    placemarkDepth_ = 0;
   }
-  return result;
-}
 
-static bool parsePlacemark(xmlNode* current, GpsFixArray* fixes) {
-  string description;
-  string name;
-  size_t ind = string::npos;
-  // not worried about case-sensitivity since .kml files
-  // are expected to be machine-generated
-  for (; current != nullptr; current = current->next) {
-    const bool hasContent =
-        current->xmlChildrenNode && current->xmlChildrenNode->content;
-
-    if (hasContent && !strcmp((const char*)current->name, "description")) {
-      description = (const char*)current->xmlChildrenNode->content;
-    } else if (hasContent && !strcmp((const char*)current->name, "name")) {
-      name = (const char*)current->xmlChildrenNode->content;
-    } else if (!strcmp((const char*)current->name, "Point") ||
-               !strcmp((const char*)current->name, "LineString") ||
-               !strcmp((const char*)current->name, "Polygon")) {
-      ind = (ind != string::npos ? ind : fixes->size());
-      if (!parseCoordinates(current->xmlChildrenNode, fixes)) {
-        return false;
-      }
-    } else if (current->ns && current->ns->prefix &&
-               !strcmp((const char*)current->ns->prefix, "gx") &&
-               !strcmp((const char*)current->name, "Track")) {
-      ind = (ind != string::npos ? ind : fixes->size());
-      if (!parseGxTrack(current->xmlChildrenNode, fixes)) {
-        return false;
+  // Coordinates have the following format:
+  //        <coordinates> -112.265654928602,36.09447672602546,2357
+  //                ...
+  //                -112.2657374587321,36.08646312301303,2357
+  //        </coordinates>
+  // and may arrive in several pieces, so a coordinate at the end of the text
+  // so far is only parsed once the text is complete.
+  void parseCoordinates(bool complete) {
+    size_t offset = 0;
+    int n = 0;
+    GpsFix fix;
+    while (!failed() &&
+           3 == SscanfWithCLocale(text_.c_str() + offset, "%f , %f , %f%n",
+                                  &fix.longitude, &fix.latitude,
+                                  &fix.elevation, &n) &&
+           (complete || offset + n < text_.size())) {
+      addFix(fix);
+      offset += n;
+    }
+    text_.erase(0, offset);
+    if (complete) {
+      // Only allow whitespace at the end of the string to remain unconsumed.
+      for (char c : text_) {
+        if (!isspace(c)) {
+          fail(kMalformedCoordinates);
+          return;
+        }
       }
+    } else if (text_.size() > kMaxUnparsedCoordinates) {
+      fail(kMalformedCoordinates);
     }
   }
 
-  if (ind == string::npos || ind >= fixes->size()) {
-    return false;
+  void endCoordinates() {
+    if (!coordinatesHaveText_) {
+      fail(kMalformedCoordinates);
+      return;
+    }
+    parseCoordinates(true);
   }
 
-  // only assign name and description to the first of the
-  // points to avoid needless repetition
-  (*fixes)[ind].description = std::move(description);
-  (*fixes)[ind].name = std::move(name);
-
-  return true;
-}
+  void endTrackCoord() {
+    GpsFix fix;
+    if (3 != SscanfWithCLocale(text_.c_str(), "%f %f %f", &fix.longitude,
+                               &fix.latitude, &fix.elevation)) {
+      fail(kMalformedCoordinates);
+      return;
+    }
+    addFix(fix);
+  }
 
-// Placemarks (aka locations) can be nested arbitrarily deep
-static bool traverseSubtree(xmlNode* current, GpsFixArray* fixes,
-                            string* error) {
-  for (; current; current = current->next) {
-    if (current->name != nullptr &&
-        !strcmp((const char*)current->name, "Placemark")) {
-      if (!parsePlacemark(current->xmlChildrenNode, fixes)) {
-        *error = "Location found with missing or malformed coordinates";
-        return false;
-      }
-    } else if (current->name != nullptr &&
-               strcmp((const char*)current->name, "text") != 0) {
-      // if it's not a Placemark we must go deeper
-      if (!traverseSubtree(current->xmlChildrenNode, fixes, error)) {
-        return false;
-      }
+  // Only the first of the points of a Placemark gets its name and
+  // description, to avoid needless repetition. It is held back until the
+  // next point or the end of the Placemark in case they come after it.
+  void addFix(const GpsFix& fix) {
+    fixCount_++;
+    if (fixCount_ == 1) {
+      firstFix_ = fix;
+      return;
     }
+    if (firstFix_) {
+      emitFirstFix();
+    }
+    emit(fix);
   }
-  error->clear();
-  return true;
-}
 
-bool KmlParser::parseFile(const char* filePath, GpsFixArray* fixes,
-                          string* error) {
-  // This initializes the library and checks potential ABI mismatches between
-  // the version it was compiled for and the actual shared library used.
-  LIBXML_TEST_VERSION
-
-  xmlDocPtr doc = xmlReadFile(filePath, nullptr, 0);
-  if (doc == nullptr) {
-    *error = "KML document not parsed successfully.";
-    xmlFreeDoc(doc);
-    return false;
+  void emitFirstFix() {
+    firstFix_->name = std::move(name_);
+    firstFix_->description = std::move(description_);
+    emit(*firstFix_);
+    firstFix_.reset();
   }
 
-  xmlNodePtr cur = xmlDocGetRootElement(doc);
-  if (cur == nullptr) {
-    *error = "Could not get root element of parsed KML file.";
-    xmlFreeDoc(doc);
-    xmlCleanupParser();
-    return false;
+  void emit(const GpsFix& fix) {
+    if (!failed() && !callback_(fix)) {
+      fail("Parsing stopped before the end of the document.");
+    }
   }
-  bool isWellFormed = traverseSubtree(cur, fixes, error);
 
-  xmlFreeDoc(doc);
-  xmlCleanupParser();
+  const GpsFixCallback& callback_;
+  int depth_ = 0;
+  int placemarkDepth_ = 0;
+  int geometryDepth_ = 0;
+  int coordinatesDepth_ = 0;
+  int trackDepth_ = 0;
+  bool coordinatesFound_ = false;
+  bool coordinatesHaveText_ = false;
+  bool inTrackCoord_ = false;
+  string* field_ = nullptr;
+  string text_;
+  string name_;
+  string description_;
+  size_t fixCount_ = 0;
+  std::optional<GpsFix> firstFix_;
+};
 
-  return isWellFormed;
+GpsFixCallback appendTo(GpsFixArray* fixes) {
+  return [fixes](const GpsFix& fix) {
+    fixes->push_back(fix);
+    return true;
+  };
+}
+
+}  // namespace
+
+bool KmlParser::parseFile(const char* filePath, GpsFixArray* fixes,
+                          string* error) {
+  return parseFileStreaming(filePath, appendTo(fixes), error);
 }
 
 bool KmlParser::parseString(const char* str, int len, GpsFixArray* fixes,
                             string* error) {
-  // This initializes the library and checks potential ABI mismatches between
-  // the version it was compiled for and the actual shared library used.
-  LIBXML_TEST_VERSION
-
-  xmlDocPtr doc = xmlReadMemory(str, len, NULL, NULL, 0);
-  if (doc == nullptr) {
-    *error = "KML document not parsed successfully.";
-    xmlFreeDoc(doc);
+  return parseStringStreaming(str, len, appendTo(fixes), error);
+}
+
+bool KmlParser::parseFileStreaming(const char* filePath,
+                                   const GpsFixCallback& callback,
+                                   string* error) {
+  if (!KmlStreamParser(callback).parseFile(filePath, error)) {
     return false;
   }
+  error->clear();
+  return true;
+}
 
-  xmlNodePtr cur = xmlDocGetRootElement(doc);
-  if (cur == nullptr) {
-    *error = "Could not get root element of parsed KML file.";
-    xmlFreeDoc(doc);
-    xmlCleanupParser();
+bool KmlParser::parseStringStreaming(const char* str, int len,
+                                     const GpsFixCallback& callback,
+                                     string* error) {
+  if (!KmlStreamParser(callback).parseString(str, len, error)) {
     return false;
   }
-  bool isWellFormed = traverseSubtree(cur, fixes, error);
-
-  xmlFreeDoc(doc);
-  xmlCleanupParser();
-
-  return isWellFormed;
+  error->clear();
+  return true;
 }
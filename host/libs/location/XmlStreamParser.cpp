@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "XmlStreamParser.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <utility>
+
+// The document is read and parsed in chunks of this size.
+static constexpr size_t kChunkSize = 64 * 1024;
+
+XmlStreamParser::XmlStreamParser(const char *documentType)
+    : documentType_(documentType) {}
+
+void XmlStreamParser::onStartElement(void *parser, const xmlChar *localname,
+                                     const xmlChar *prefix, const xmlChar *,
+                                     int, const xmlChar **, int nb_attributes,
+                                     int, const xmlChar **attributes) {
+  auto self = static_cast<XmlStreamParser *>(parser);
+  if (!self->failed_) {
+    self->startElement((const char *)localname, (const char *)prefix,
+                       nb_attributes, attributes);
+  }
+}
+
+void XmlStreamParser::onEndElement(void *parser, const xmlChar *localname,
+                                   const xmlChar *prefix, const xmlChar *) {
+  auto self = static_cast<XmlStreamParser *>(parser);
+  if (!self->failed_) {
+    self->endElement((const char *)localname, (const char *)prefix);
+  }
+}
+
+void XmlStreamParser::onCharacters(void *parser, const xmlChar *text,
+                                   int len) {
+  auto self = static_cast<XmlStreamParser *>(parser);
+  if (!self->failed_) {
+    self->characters((const char *)text, len);
+  }
+}
+
+xmlSAXHandler *XmlStreamParser::saxHandler() {
+  // Only the callbacks set here are called, in particular no tree is built.
+  static xmlSAXHandler handler = [] {
+    xmlSAXHandler handler;
+    memset(&handler, 0, sizeof(handler));
+    handler.initialized = XML_SAX2_MAGIC;
+    handler.startElementNs = onStartElement;
+    handler.endElementNs = onEndElement;
+    handler.characters = onCharacters;
+    handler.cdataBlock = onCharacters;
+    return handler;
+  }();
+  return &handler;
+}
+
+bool XmlStreamParser::parseFile(const char *filePath, std::string *error) {
+  std::unique_ptr<FILE, decltype(&fclose)> file(fopen(filePath, "rb"),
+                                                &fclose);
+  if (!file || !begin(filePath, error)) {
+    *error = documentType_ + " document not parsed successfully.";
+    return false;
+  }
+  auto buffer = std::make_unique<char[]>(kChunkSize);
+  bool last = false;
+  while (!last) {
+    size_t read = fread(buffer.get(), 1, kChunkSize, file.get());
+    last = read < kChunkSize;
+    if (!feed(buffer.get(), read, last)) {
+      break;
+    }
+  }
+  return finish(error);
+}
+
+bool XmlStreamParser::parseString(const char *str, int len,
+                                  std::string *error) {
+  if (!begin(nullptr, error)) {
+    return false;
+  }
+  feed(str, len, true);
+  return finish(error);
+}
+
+bool XmlStreamParser::begin(const char *filePath, std::string *error) {
+  // This initializes the library and checks potential ABI mismatches between
+  // the version it was compiled for and the actual shared library used.
+  LIBXML_TEST_VERSION
+
+  failed_ = false;
+  error_.clear();
+  ctxt_ = xmlCreatePushParserCtxt(saxHandler(), this, nullptr, 0, filePath);
+  if (ctxt_ == nullptr) {
+    *error = documentType_ + " document not parsed successfully.";
+    return false;
+  }
+  return true;
+}
+
+bool XmlStreamParser::feed(const char *chunk, int len, bool last) {
+  return xmlParseChunk(ctxt_, chunk, len, last) == XML_ERR_OK && !failed_;
+}
+
+bool XmlStreamParser::finish(std::string *error) {
+  bool wellFormed = ctxt_->wellFormed;
+  xmlFreeParserCtxt(ctxt_);
+  ctxt_ = nullptr;
+  if (failed_) {
+    *error = error_;
+    return false;
+  }
+  if (!wellFormed) {
+    *error = documentType_ + " document not parsed successfully.";
+    return false;
+  }
+  return true;
+}
+
+void XmlStreamParser::fail(std::string error) {
+  failed_ = true;
+  error_ = std::move(error);
+  xmlStopParser(ctxt_);
+}
+
+int XmlStreamParser::line() const { return xmlSAX2GetLineNumber(ctxt_); }
+
+bool XmlStreamParser::getAttribute(int attributeCount,
+                                   const xmlChar **attributes,
+                                   const char *name, std::string *value) {
+  for (int i = 0; i < attributeCount; i++) {
+    const xmlChar **attribute = attributes + i * 5;
+    if (attribute[1] == nullptr && !strcmp((const char *)attribute[0], name)) {
+      value->assign((const char *)attribute[3], attribute[4] - attribute[3]);
+      return true;
+    }
+  }
+  return false;
+}
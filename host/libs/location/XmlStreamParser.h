@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <libxml/SAX2.h>
+#include <libxml/parser.h>
+
+#include <string>
+
+// Base of the parsers that handle a document as libxml2 reads its elements
+// instead of building its whole tree first, so memory use doesn't grow with
+// the size of the document.
+class XmlStreamParser {
+ public:
+  // |documentType| names the format in error messages, e.g. "GPX".
+  explicit XmlStreamParser(const char *documentType);
+  virtual ~XmlStreamParser() = default;
+
+  // Parses the document at |filePath| or in |str|. Returns true on success,
+  // false otherwise. If false is returned, |*error| is set to a string
+  // describing the error.
+  bool parseFile(const char *filePath, std::string *error);
+  bool parseString(const char *str, int len, std::string *error);
+
+ protected:
+  // |attributes| holds |attributeCount| sets of localname, prefix, URI, value
+  // start and value end, as passed to libxml2's startElementNsSAX2Func.
+  virtual void startElement(const char *name, const char *prefix,
+                            int attributeCount, const xmlChar **attributes) = 0;
+  virtual void endElement(const char *name, const char *prefix) = 0;
+  // The text of an element may be reported in several calls.
+  virtual void characters(const char *text, int len) = 0;
+
+  // Stops parsing, parseFile or parseString then fail with |error|.
+  void fail(std::string error);
+  bool failed() const { return failed_; }
+  // The line being parsed, for error messages.
+  int line() const;
+
+  // Finds the value of the unprefixed attribute |name| among the
+  // startElement arguments.
+  static bool getAttribute(int attributeCount, const xmlChar **attributes,
+                           const char *name, std::string *value);
+
+ private:
+  static void onStartElement(void *parser, const xmlChar *localname,
+                             const xmlChar *prefix, const xmlChar *URI,
+                             int nb_namespaces, const xmlChar **namespaces,
+                             int nb_attributes, int nb_defaulted,
+                             const xmlChar **attributes);
+  static void onEndElement(void *parser, const xmlChar *localname,
+                           const xmlChar *prefix, const xmlChar *URI);
+  static void onCharacters(void *parser, const xmlChar *text, int len);
+  static xmlSAXHandler *saxHandler();
+
+  bool begin(const char *filePath, std::string *error);
+  bool feed(const char *chunk, int len, bool last);
+  bool finish(std::string *error);
+
+  const std::string documentType_;
+  xmlParserCtxtPtr ctxt_ = nullptr;
+  bool failed_ = false;
+  std::string error_;
+};
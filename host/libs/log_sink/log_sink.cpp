@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/log_sink/log_sink.h"
+
+#include <fcntl.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <zstd.h>
+
+#include "common/libs/fs/shared_buf.h"
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+constexpr int kZstdLevel = 3;
+// How often rotation is checked for when nothing is buffered.
+constexpr std::chrono::seconds kWriteThroughCheckInterval{1};
+
+std::string SegmentPath(const std::string& path, size_t index,
+                        bool compressed) {
+  return path + "." + std::to_string(index) + (compressed ? ".zst" : "");
+}
+
+}  // namespace
+
+Result<std::unique_ptr<LogSink>> LogSink::Create(const std::string& path,
+                                                 LogSinkOptions options) {
+  CF_EXPECT(options.flush_interval.count() >= 0,
+            "Negative flush interval: " << options.flush_interval.count()
+                                        << "ms");
+  auto file = SharedFD::Open(path, O_CREAT | O_APPEND | O_WRONLY, 0666);
+  CF_EXPECT(file->IsOpen(),
+            "Could not open \"" << path << "\": " << file->StrError());
+  auto size = FileSize(path);
+  return std::unique_ptr<LogSink>(
+      new LogSink(path, std::move(options), file, size));
+}
+
+LogSink::LogSink(std::string path, LogSinkOptions options, SharedFD file,
+                 size_t file_size)
+    : path_(std::move(path)),
+      options_(std::move(options)),
+      file_(std::move(file)),
+      file_size_(file_size),
+      segment_start_(std::chrono::steady_clock::now()) {
+  buffer_.reserve(options_.batch_size);
+  background_ = std::thread([this]() { BackgroundLoop(); });
+}
+
+LogSink::~LogSink() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  background_.join();
+  auto flushed = Flush();
+  if (!flushed.ok()) {
+    LOG(ERROR) << "Failed to flush \"" << path_
+               << "\": " << flushed.error().Message();
+  }
+}
+
+Result<void> LogSink::Write(const char* data, size_t size) {
+  std::lock_guard lock(mutex_);
+  if (buffer_.size() + size > options_.batch_size) {
+    CF_EXPECT(FlushLocked());
+  }
+  if (size >= options_.batch_size || options_.flush_interval.count() == 0) {
+    // Large enough, or latency sensitive enough, to go straight to the file.
+    auto written = WriteAll(file_, data, size);
+    CF_EXPECT(written == size,
+              "Error writing to \"" << path_ << "\": " << file_->StrError());
+    file_size_ += size;
+    return {};
+  }
+  buffer_.insert(buffer_.end(), data, data + size);
+  return {};
+}
+
+Result<void> LogSink::Flush() {
+  std::lock_guard lock(mutex_);
+  CF_EXPECT(FlushLocked());
+  return {};
+}
+
+Result<void> LogSink::FlushLocked() {
+  if (buffer_.empty()) {
+    return {};
+  }
+  auto written = WriteAll(file_, buffer_.data(), buffer_.size());
+  CF_EXPECT(written == buffer_.size(),
+            "Error writing to \"" << path_ << "\": " << file_->StrError());
+  file_size_ += buffer_.size();
+  buffer_.clear();
+  return {};
+}
+
+Result<void> LogSink::RotateLocked() {
+  CF_EXPECT(FlushLocked());
+  // A segment whose compression failed stays uncompressed, so both names are
+  // shifted regardless of compress_rotated.
+  for (bool compressed : {false, true}) {
+    RemoveFile(SegmentPath(path_, options_.max_segments, compressed));
+    for (size_t i = options_.max_segments; i > 1; i--) {
+      auto older = SegmentPath(path_, i - 1, compressed);
+      if (FileExists(older)) {
+        CF_EXPECT(RenameFile(older, SegmentPath(path_, i, compressed)));
+      }
+    }
+  }
+  CF_EXPECT(RenameFile(path_, SegmentPath(path_, 1, false)));
+  // Readers following the path by name pick up the new file on their own.
+  file_ = SharedFD::Open(path_, O_CREAT | O_APPEND | O_WRONLY, 0666);
+  CF_EXPECT(file_->IsOpen(),
+            "Could not open \"" << path_ << "\": " << file_->StrError());
+  file_size_ = 0;
+  segment_start_ = std::chrono::steady_clock::now();
+  return {};
+}
+
+void LogSink::BackgroundLoop() {
+  const bool rotation_enabled = options_.max_segments > 0 &&
+                                (options_.rotate_size > 0 ||
+                                 options_.rotate_interval.count() > 0);
+  const auto interval =
+      options_.flush_interval.count() > 0
+          ? options_.flush_interval
+          : std::chrono::duration_cast<std::chrono::milliseconds>(
+                kWriteThroughCheckInterval);
+  std::unique_lock lock(mutex_);
+  while (!stopping_) {
+    wake_.wait_for(lock, interval);
+    auto flushed = FlushLocked();
+    if (!flushed.ok()) {
+      LOG(ERROR) << flushed.error().Message();
+      continue;
+    }
+    if (!rotation_enabled) {
+      continue;
+    }
+    bool too_big =
+        options_.rotate_size > 0 && file_size_ >= options_.rotate_size;
+    bool too_old = options_.rotate_interval.count() > 0 && file_size_ > 0 &&
+                   std::chrono::steady_clock::now() - segment_start_ >=
+                       options_.rotate_interval;
+    if (!too_big && !too_old) {
+      continue;
+    }
+    auto rotated = RotateLocked();
+    if (!rotated.ok()) {
+      LOG(ERROR) << "Failed to rotate \"" << path_
+                 << "\": " << rotated.error().Message();
+      continue;
+    }
+    if (!options_.compress_rotated) {
+      continue;
+    }
+    // Only this thread renames segments, so <path>.1 stays put while the
+    // producer keeps writing to the new file.
+    lock.unlock();
+    auto segment = SegmentPath(path_, 1, false);
+    auto destination = SegmentPath(path_, 1, true);
+    auto compressed = ZstdCompressFile(segment, destination);
+    if (compressed.ok()) {
+      RemoveFile(segment);
+    } else {
+      // Keep the uncompressed segment, it is rotated like any other.
+      LOG(ERROR) << "Failed to compress \"" << segment
+                 << "\": " << compressed.error().Message();
+      RemoveFile(destination);
+    }
+    lock.lock();
+  }
+}
+
+Result<void> ZstdCompressFile(const std::string& source,
+                              const std::string& destination) {
+  auto in = SharedFD::Open(source, O_RDONLY);
+  CF_EXPECT(in->IsOpen(),
+            "Could not open \"" << source << "\": " << in->StrError());
+  auto out = SharedFD::Open(destination, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+  CF_EXPECT(out->IsOpen(),
+            "Could not open \"" << destination << "\": " << out->StrError());
+
+  std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(
+      ZSTD_createCCtx(), ZSTD_freeCCtx);
+  CF_EXPECT(context.get() != nullptr, "Could not create zstd context");
+  ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, kZstdLevel);
+
+  std::vector<char> in_buffer(ZSTD_CStreamInSize());
+  std::vector<char> out_buffer(ZSTD_CStreamOutSize());
+  bool done = false;
+  while (!done) {
+    auto read = in->Read(in_buffer.data(), in_buffer.size());
+    CF_EXPECT(read >= 0,
+              "Error reading \"" << source << "\": " << in->StrError());
+    auto mode = read == 0 ? ZSTD_e_end : ZSTD_e_continue;
+    ZSTD_inBuffer input = {in_buffer.data(), static_cast<size_t>(read), 0};
+    bool finished_input = false;
+    while (!finished_input) {
+      ZSTD_outBuffer output = {out_buffer.data(), out_buffer.size(), 0};
+      size_t remaining =
+          ZSTD_compressStream2(context.get(), &output, &input, mode);
+      CF_EXPECT(!ZSTD_isError(remaining),
+                "zstd error: " << ZSTD_getErrorName(remaining));
+      auto written = WriteAll(out, out_buffer.data(), output.pos);
+      CF_EXPECT(written == output.pos,
+                "Error writing \"" << destination << "\": " << out->StrError());
+      finished_input = mode == ZSTD_e_end ? remaining == 0
+                                          : input.pos == input.size;
+    }
+    done = mode == ZSTD_e_end;
+  }
+  return {};
+}
+
+}  // namespace cuttlefish
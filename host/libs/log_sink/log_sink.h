@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/libs/fs/shared_fd.h"
+#include "common/libs/utils/result.h"
+
+namespace cuttlefish {
+
+struct LogSinkOptions {
+  // Bytes buffered before they are written out.
+  size_t batch_size = 64 * 1024;
+  // Longest time written data stays buffered. 0 writes every call through.
+  std::chrono::milliseconds flush_interval{100};
+  // Start a new segment once the log reaches this many bytes. 0 disables.
+  size_t rotate_size = 0;
+  // Start a new segment once the log is this old. 0 disables.
+  std::chrono::seconds rotate_interval{0};
+  // Rotated segments to keep, as <path>.1 (newest) to <path>.<max_segments>.
+  size_t max_segments = 4;
+  // Compress rotated segments with zstd, into <path>.<n>.zst. A segment that
+  // fails to compress is kept as <path>.<n>.
+  bool compress_rotated = false;
+};
+
+// Appends to a log file on behalf of a chatty producer.
+//
+// Writes are batched in memory and issued as one write call once the batch is
+// full or flush_interval elapses, whichever comes first. When rotation is
+// enabled a background thread moves the file aside once it grows past the
+// size or age limits, compressing the old segment if requested, so the
+// producer never waits for the compressor. Size limits are checked every
+// flush_interval (every second when writing through), so a segment may
+// overshoot by what arrives in that time.
+class LogSink {
+ public:
+  static Result<std::unique_ptr<LogSink>> Create(const std::string& path,
+                                                 LogSinkOptions options = {});
+  ~LogSink();
+
+  Result<void> Write(const char* data, size_t size);
+  Result<void> Flush();
+
+ private:
+  LogSink(std::string path, LogSinkOptions options, SharedFD file,
+          size_t file_size);
+
+  Result<void> FlushLocked();
+  Result<void> RotateLocked();
+  void BackgroundLoop();
+
+  const std::string path_;
+  const LogSinkOptions options_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+  SharedFD file_;
+  size_t file_size_;
+  std::chrono::steady_clock::time_point segment_start_;
+  std::vector<char> buffer_;
+  std::thread background_;
+};
+
+// Compresses `source` into `destination` with zstd, one buffer at a time.
+Result<void> ZstdCompressFile(const std::string& source,
+                              const std::string& destination);
+
+}  // namespace cuttlefish
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/log_sink/log_sink_flags.h"
+
+#include <gflags/gflags.h>
+
+DEFINE_int32(log_flush_interval_ms, 100,
+             "Longest time received log data is buffered before being written "
+             "to the log file. 0 writes it as soon as it is received");
+DEFINE_int32(log_rotate_size_mb, 0,
+             "Start a new log file once the current one reaches this size. 0 "
+             "keeps a single, unbounded file");
+DEFINE_int32(log_rotate_interval_s, 0,
+             "Start a new log file once the current one is this old. 0 "
+             "disables time based rotation");
+DEFINE_int32(log_rotate_keep, 4, "Number of rotated log files to keep");
+DEFINE_bool(log_rotate_compress, false,
+            "Compress rotated log files with zstd");
+
+namespace cuttlefish {
+
+Result<LogSinkOptions> LogSinkOptionsFromFlags() {
+  CF_EXPECT(FLAGS_log_flush_interval_ms >= 0,
+            "--log_flush_interval_ms can't be negative");
+  CF_EXPECT(FLAGS_log_rotate_size_mb >= 0,
+            "--log_rotate_size_mb can't be negative");
+  CF_EXPECT(FLAGS_log_rotate_interval_s >= 0,
+            "--log_rotate_interval_s can't be negative");
+  CF_EXPECT(FLAGS_log_rotate_keep >= 0, "--log_rotate_keep can't be negative");
+  LogSinkOptions options;
+  options.flush_interval =
+      std::chrono::milliseconds(FLAGS_log_flush_interval_ms);
+  options.rotate_size =
+      static_cast<size_t>(FLAGS_log_rotate_size_mb) * 1024 * 1024;
+  options.rotate_interval = std::chrono::seconds(FLAGS_log_rotate_interval_s);
+  options.max_segments = FLAGS_log_rotate_keep;
+  options.compress_rotated = FLAGS_log_rotate_compress;
+  return options;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "common/libs/utils/files.h"
+#include "common/libs/utils/result_matchers.h"
+#include "host/libs/log_sink/log_sink.h"
+
+namespace cuttlefish {
+namespace {
+
+// Polls until the background thread has caught up, or fails after a deadline
+// generous enough for a loaded test machine.
+template <typename Condition>
+bool Eventually(Condition condition) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+}  // namespace
+
+TEST(LogSink, BatchesUntilFlushed) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/log";
+  LogSinkOptions options;
+  options.flush_interval = std::chrono::hours(1);
+  auto sink = LogSink::Create(path, options);
+  ASSERT_THAT(sink, IsOk());
+
+  ASSERT_THAT((*sink)->Write("hello ", 6), IsOk());
+  ASSERT_THAT((*sink)->Write("world", 5), IsOk());
+  EXPECT_EQ(ReadFile(path), "");
+
+  ASSERT_THAT((*sink)->Flush(), IsOk());
+  EXPECT_EQ(ReadFile(path), "hello world");
+}
+
+TEST(LogSink, WritesFullBatches) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/log";
+  LogSinkOptions options;
+  options.batch_size = 4;
+  options.flush_interval = std::chrono::hours(1);
+  auto sink = LogSink::Create(path, options);
+  ASSERT_THAT(sink, IsOk());
+
+  ASSERT_THAT((*sink)->Write("abc", 3), IsOk());
+  ASSERT_THAT((*sink)->Write("def", 3), IsOk());
+  EXPECT_EQ(ReadFile(path), "abc");
+  ASSERT_THAT((*sink)->Write("ghijkl", 6), IsOk());
+  EXPECT_EQ(ReadFile(path), "abcdefghijkl");
+}
+
+TEST(LogSink, WritesThroughWithoutFlushInterval) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/log";
+  LogSinkOptions options;
+  options.flush_interval = std::chrono::milliseconds(0);
+  auto sink = LogSink::Create(path, options);
+  ASSERT_THAT(sink, IsOk());
+
+  ASSERT_THAT((*sink)->Write("abc", 3), IsOk());
+  EXPECT_EQ(ReadFile(path), "abc");
+  ASSERT_THAT((*sink)->Write("def", 3), IsOk());
+  EXPECT_EQ(ReadFile(path), "abcdef");
+}
+
+TEST(LogSink, RejectsNegativeFlushIntervals) {
+  TemporaryDir dir;
+  LogSinkOptions options;
+  options.flush_interval = std::chrono::milliseconds(-1);
+  EXPECT_THAT(LogSink::Create(std::string(dir.path) + "/log", options),
+              IsError());
+}
+
+TEST(LogSink, RotatesBySize) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/log";
+  LogSinkOptions options;
+  options.flush_interval = std::chrono::milliseconds(1);
+  options.rotate_size = 4;
+  options.max_segments = 2;
+  {
+    auto sink = LogSink::Create(path, options);
+    ASSERT_THAT(sink, IsOk());
+    for (const std::string chunk : {"aaaa", "bbbb", "cccc"}) {
+      ASSERT_THAT((*sink)->Write(chunk.data(), chunk.size()), IsOk());
+      ASSERT_TRUE(Eventually([&]() { return ReadFile(path + ".1") == chunk; }));
+    }
+  }
+  EXPECT_EQ(ReadFile(path + ".1"), "cccc");
+  EXPECT_EQ(ReadFile(path + ".2"), "bbbb");
+  EXPECT_FALSE(FileExists(path + ".3"));
+}
+
+TEST(LogSink, CompressesRotatedSegments) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/log";
+  LogSinkOptions options;
+  options.flush_interval = std::chrono::milliseconds(1);
+  options.rotate_size = 1;
+  options.compress_rotated = true;
+  {
+    auto sink = LogSink::Create(path, options);
+    ASSERT_THAT(sink, IsOk());
+    ASSERT_THAT((*sink)->Write("some log line\n", 14), IsOk());
+    ASSERT_TRUE(Eventually([&]() {
+      return FileExists(path + ".1.zst") && !FileExists(path + ".1");
+    }));
+  }
+  // zstd frames start with a fixed magic number.
+  auto compressed = ReadFile(path + ".1.zst");
+  ASSERT_GE(compressed.size(), 4);
+  EXPECT_EQ(compressed.substr(0, 4), std::string("\x28\xb5\x2f\xfd", 4));
+}
+
+TEST(LogSink, KeepsSegmentsThatFailToCompress) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/log";
+  // A non empty directory in the way makes the compression fail. With a single
+  // segment kept, rotation can't move it aside either.
+  ASSERT_EQ(mkdir((path + ".1.zst").c_str(), 0700), 0);
+  ASSERT_TRUE(android::base::WriteStringToFile("", path + ".1.zst/x"));
+  LogSinkOptions options;
+  options.flush_interval = std::chrono::milliseconds(1);
+  options.rotate_size = 1;
+  options.max_segments = 1;
+  options.compress_rotated = true;
+  {
+    auto sink = LogSink::Create(path, options);
+    ASSERT_THAT(sink, IsOk());
+    ASSERT_THAT((*sink)->Write("first\n", 6), IsOk());
+    ASSERT_TRUE(
+        Eventually([&]() { return ReadFile(path + ".1") == "first\n"; }));
+  }
+  // Destroying the sink waited for the compression attempt.
+  EXPECT_EQ(ReadFile(path + ".1"), "first\n");
+
+  // The uncompressed segment is rotated along with the compressed ones.
+  options.max_segments = 2;
+  {
+    auto sink = LogSink::Create(path, options);
+    ASSERT_THAT(sink, IsOk());
+    ASSERT_THAT((*sink)->Write("second\n", 7), IsOk());
+    ASSERT_TRUE(Eventually([&]() {
+      return FileExists(path + ".1.zst") && !FileExists(path + ".1");
+    }));
+  }
+  EXPECT_FALSE(DirectoryExists(path + ".1.zst"));
+  EXPECT_EQ(ReadFile(path + ".2"), "first\n");
+  EXPECT_TRUE(DirectoryExists(path + ".2.zst"));
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/websocket/static_asset_cache.h"
+
+#include <zlib.h>
+
+#include <cstdio>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+#include "common/libs/utils/files.h"
+
+namespace cuttlefish {
+namespace {
+
+std::string Gzip(const std::string& data) {
+  z_stream stream{};
+  // 16 more window bits select the gzip wrapper.
+  if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return "";
+  }
+  std::string out(deflateBound(&stream, data.size()), '\0');
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(out.data());
+  stream.avail_out = out.size();
+  auto status = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return status == Z_STREAM_END ? out : "";
+}
+
+std::string ETag(const std::string& content, const char* suffix = "") {
+  auto crc = crc32(0, reinterpret_cast<const Bytef*>(content.data()),
+                   content.size());
+  char etag[40];
+  snprintf(etag, sizeof(etag), "\"%08lx-%zx%s\"", crc, content.size(),
+           suffix);
+  return etag;
+}
+
+// Whether a single Accept-Encoding value, e.g. "gzip;q=0.5", accepts gzip.
+bool AcceptsGzip(const std::string& value) {
+  auto params = android::base::Split(value, ";");
+  auto coding = android::base::Trim(params[0]);
+  if (!android::base::EqualsIgnoreCase(coding, "gzip") && coding != "*") {
+    return false;
+  }
+  for (size_t i = 1; i < params.size(); i++) {
+    auto param = android::base::Trim(params[i]);
+    if (android::base::StartsWith(param, "q=") ||
+        android::base::StartsWith(param, "Q=")) {
+      // A weight of zero, e.g. "q=0" or "q=0.00", refuses the coding.
+      return param.find_first_of("123456789", 2) != std::string::npos;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool StaticAsset::ServeGzipped(const std::string& accept_encoding) const {
+  if (gzipped.empty()) {
+    return false;
+  }
+  for (const auto& value : android::base::Split(accept_encoding, ",")) {
+    if (AcceptsGzip(value)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool StaticAsset::NotModified(const std::string& if_none_match,
+                              const std::string& etag) {
+  for (auto tag : android::base::Split(if_none_match, ",")) {
+    tag = android::base::Trim(tag);
+    // If-None-Match uses the weak comparison.
+    if (android::base::StartsWith(tag, "W/")) {
+      tag = tag.substr(2);
+    }
+    if (tag == "*" || tag == etag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+StaticAssetCache StaticAssetCache::Load(const std::string& dir,
+                                        size_t max_file_size) {
+  StaticAssetCache cache;
+  size_t total = 0;
+  auto load = [&](const std::string& path) {
+    if (DirectoryExists(path) ||
+        static_cast<size_t>(FileSize(path)) > max_file_size) {
+      return true;
+    }
+    auto asset = std::make_shared<StaticAsset>();
+    asset->content = ReadFile(path);
+    asset->etag = ETag(asset->content);
+    asset->gzipped = Gzip(asset->content);
+    if (asset->gzipped.size() >= asset->content.size()) {
+      asset->gzipped.clear();
+    } else {
+      // Derived from the identity content so that the two tags change
+      // together.
+      asset->gzipped_etag = ETag(asset->content, "-gz");
+    }
+    total += asset->content.size() + asset->gzipped.size();
+    cache.assets_[path.substr(dir.size())] = std::move(asset);
+    return true;
+  };
+  auto result = WalkDirectory(dir, load);
+  if (!result.ok()) {
+    LOG(WARNING) << "Unable to cache the assets in " << dir << ": "
+                 << result.error().Message();
+  }
+  LOG(DEBUG) << "Cached " << cache.assets_.size() << " assets in " << total
+             << " bytes";
+  return cache;
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::Find(
+    std::string path) const {
+  if (path.empty() || path.back() == '/') {
+    path += "index.html";
+  }
+  if (path[0] != '/') {
+    path = "/" + path;
+  }
+  auto it = assets_.find(path);
+  return it == assets_.end() ? nullptr : it->second;
+}
+
+}  // namespace cuttlefish
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace cuttlefish {
+
+struct StaticAsset {
+  std::string etag;
+  std::string content;
+  // Empty when gzip doesn't make the file smaller. Caches store both encodings
+  // of a path, so the gzipped one has an entity tag of its own.
+  std::string gzipped;
+  std::string gzipped_etag;
+
+  // Whether a client sending these Accept-Encoding values gets the gzipped
+  // body.
+  bool ServeGzipped(const std::string& accept_encoding) const;
+  // Whether If-None-Match values name the entity tag of the served encoding,
+  // which can then be answered with 304 Not Modified.
+  static bool NotModified(const std::string& if_none_match,
+                          const std::string& etag);
+};
+
+// Keeps the files under a directory in memory along with their gzipped
+// versions, so serving them takes no disk access or compression.
+class StaticAssetCache {
+ public:
+  StaticAssetCache() = default;
+
+  // Files over `max_file_size` are left out, to be served from disk.
+  static StaticAssetCache Load(const std::string& dir, size_t max_file_size);
+
+  // Takes the request path, e.g. "/js/index.js". Paths ending in '/' refer to
+  // the index.html file of the directory.
+  std::shared_ptr<const StaticAsset> Find(std::string path) const;
+
+ private:
+  std::unordered_map<std::string, std::shared_ptr<const StaticAsset>> assets_;
+};
+
+}  // namespace cuttlefish
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/websocket/static_asset_cache.h"
+
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+std::string Gunzip(const std::string& data) {
+  z_stream stream{};
+  if (inflateInit2(&stream, MAX_WBITS + 16) != Z_OK) {
+    return "";
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  std::string out;
+  char buffer[4096];
+  int status;
+  do {
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    status = inflate(&stream, Z_NO_FLUSH);
+    out.append(buffer, sizeof(buffer) - stream.avail_out);
+  } while (status == Z_OK);
+  inflateEnd(&stream);
+  return status == Z_STREAM_END ? out : "";
+}
+
+class StaticAssetCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = dir_storage_.path;
+    ASSERT_EQ(mkdir((dir_ + "/js").c_str(), 0700), 0);
+    index_ = std::string(4096, 'a');
+    Write("/index.html", index_);
+    Write("/js/index.js", "x");
+    Write("/js/large.js", std::string(kMaxFileSize + 1, 'b'));
+  }
+
+  void Write(const std::string& path, const std::string& content) {
+    ASSERT_TRUE(android::base::WriteStringToFile(content, dir_ + path));
+  }
+
+  static constexpr size_t kMaxFileSize = 8192;
+  TemporaryDir dir_storage_;
+  std::string dir_;
+  std::string index_;
+};
+
+TEST_F(StaticAssetCacheTest, FindsTheCachedFiles) {
+  auto cache = StaticAssetCache::Load(dir_, kMaxFileSize);
+
+  auto index = cache.Find("/index.html");
+  ASSERT_NE(index, nullptr);
+  EXPECT_EQ(index->content, index_);
+  // Directories are served their index.html.
+  EXPECT_EQ(cache.Find("/"), index);
+  EXPECT_EQ(cache.Find(""), index);
+
+  auto js = cache.Find("/js/index.js");
+  ASSERT_NE(js, nullptr);
+  EXPECT_EQ(js->content, "x");
+  EXPECT_EQ(cache.Find("js/index.js"), js);
+}
+
+TEST_F(StaticAssetCacheTest, LeavesOutMissingAndLargeFiles) {
+  auto cache = StaticAssetCache::Load(dir_, kMaxFileSize);
+  EXPECT_EQ(cache.Find("/missing.html"), nullptr);
+  EXPECT_EQ(cache.Find("/js/"), nullptr);
+  EXPECT_EQ(cache.Find("/js/large.js"), nullptr);
+}
+
+TEST_F(StaticAssetCacheTest, GzipsWhenItMakesFilesSmaller) {
+  auto cache = StaticAssetCache::Load(dir_, kMaxFileSize);
+
+  auto index = cache.Find("/");
+  ASSERT_NE(index, nullptr);
+  ASSERT_FALSE(index->gzipped.empty());
+  EXPECT_LT(index->gzipped.size(), index->content.size());
+  EXPECT_EQ(Gunzip(index->gzipped), index_);
+
+  auto js = cache.Find("/js/index.js");
+  ASSERT_NE(js, nullptr);
+  EXPECT_TRUE(js->gzipped.empty());
+  EXPECT_TRUE(js->gzipped_etag.empty());
+}
+
+TEST_F(StaticAssetCacheTest, TagsEachEncodingAndContent) {
+  auto cache = StaticAssetCache::Load(dir_, kMaxFileSize);
+  auto index = cache.Find("/");
+  ASSERT_NE(index, nullptr);
+  EXPECT_EQ(index->etag.front(), '"');
+  EXPECT_EQ(index->etag.back(), '"');
+  EXPECT_NE(index->gzipped_etag, index->etag);
+  EXPECT_NE(index->gzipped_etag, "");
+
+  Write("/index.html", std::string(4096, 'c'));
+  auto changed = StaticAssetCache::Load(dir_, kMaxFileSize).Find("/");
+  ASSERT_NE(changed, nullptr);
+  EXPECT_NE(changed->etag, index->etag);
+  EXPECT_NE(changed->gzipped_etag, index->gzipped_etag);
+
+  auto reloaded = StaticAssetCache::Load(dir_, kMaxFileSize).Find("/");
+  ASSERT_NE(reloaded, nullptr);
+  EXPECT_EQ(reloaded->etag, changed->etag);
+  EXPECT_EQ(reloaded->gzipped_etag, changed->gzipped_etag);
+}
+
+TEST(StaticAssetTest, NegotiatesGzip) {
+  StaticAsset asset{.etag = "\"1\"",
+                    .content = "content",
+                    .gzipped = "gzipped",
+                    .gzipped_etag = "\"1-gz\""};
+  EXPECT_TRUE(asset.ServeGzipped("gzip"));
+  EXPECT_TRUE(asset.ServeGzipped("gzip, deflate, br"));
+  EXPECT_TRUE(asset.ServeGzipped("br;q=1.0, GZIP;q=0.5"));
+  EXPECT_TRUE(asset.ServeGzipped("*"));
+  EXPECT_FALSE(asset.ServeGzipped(""));
+  EXPECT_FALSE(asset.ServeGzipped("identity"));
+  EXPECT_FALSE(asset.ServeGzipped("deflate, br"));
+  EXPECT_FALSE(asset.ServeGzipped("x-gzip-like"));
+  EXPECT_FALSE(asset.ServeGzipped("gzip;q=0"));
+  EXPECT_FALSE(asset.ServeGzipped("gzip; q=0.000, br"));
+
+  // Files that didn't compress are always served as they are.
+  asset.gzipped.clear();
+  EXPECT_FALSE(asset.ServeGzipped("gzip"));
+}
+
+TEST(StaticAssetTest, MatchesIfNoneMatch) {
+  EXPECT_TRUE(StaticAsset::NotModified("\"1\"", "\"1\""));
+  EXPECT_TRUE(StaticAsset::NotModified("W/\"1\"", "\"1\""));
+  EXPECT_TRUE(StaticAsset::NotModified("\"0\", \"1\"", "\"1\""));
+  EXPECT_TRUE(StaticAsset::NotModified("*", "\"1\""));
+  EXPECT_FALSE(StaticAsset::NotModified("", "\"1\""));
+  EXPECT_FALSE(StaticAsset::NotModified("\"2\"", "\"1\""));
+  // The tag of one encoding doesn't validate the other.
+  EXPECT_FALSE(StaticAsset::NotModified("\"1-gz\"", "\"1\""));
+  EXPECT_FALSE(StaticAsset::NotModified("\"1\"", "\"1-gz\""));
+}
+
+}  // namespace
+}  // namespace cuttlefish
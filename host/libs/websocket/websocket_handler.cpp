@@ -30,14 +30,32 @@ void AppendData(const char* data, size_t len, std::string& buffer) {
 }
 }  // namespace
 
-WebSocketHandler::WebSocketHandler(struct lws* wsi) : wsi_(wsi) {}
+WebSocketHandler::WebSocketHandler(struct lws* wsi)
+    : wsi_(wsi),
+      context_(lws_get_context(wsi)),
+      service_thread_(std::this_thread::get_id()) {}
 
 void WebSocketHandler::EnqueueMessage(const uint8_t* data, size_t len,
                                       bool binary) {
   std::vector<uint8_t> buffer(LWS_PRE + len, 0);
   std::copy(data, data + len, buffer.begin() + LWS_PRE);
-  buffer_queue_.emplace_front(std::move(buffer), binary);
-  lws_callback_on_writable(wsi_);
+  {
+    std::lock_guard lock(mutex_);
+    buffer_queue_.emplace_front(std::move(buffer), binary);
+  }
+  RequestWritable();
+}
+
+// lws only lets the thread servicing a connection ask for writable callbacks
+// on it. Other threads flag the request and wake that thread up, which makes
+// it on their behalf.
+void WebSocketHandler::RequestWritable() {
+  if (std::this_thread::get_id() == service_thread_) {
+    lws_callback_on_writable(wsi_);
+    return;
+  }
+  writable_requested_ = true;
+  lws_cancel_service(context_);
 }
 
 // Attempts to write what's left on a websocket buffer to the websocket,
@@ -61,11 +79,15 @@ void WebSocketHandler::WriteWsBuffer(WebSocketHandler::WsBuffer& ws_buffer) {
 }
 
 bool WebSocketHandler::OnWritable() {
+  std::unique_lock lock(mutex_);
   if (buffer_queue_.empty()) {
     return close_;
   }
-  WriteWsBuffer(buffer_queue_.back());
+  auto ws_buffer = std::move(buffer_queue_.back());
   buffer_queue_.pop_back();
+  lock.unlock();
+  WriteWsBuffer(ws_buffer);
+  lock.lock();
 
   if (!buffer_queue_.empty()) {
     lws_callback_on_writable(wsi_);
@@ -75,8 +97,11 @@ bool WebSocketHandler::OnWritable() {
 }
 
 void WebSocketHandler::Close() {
-  close_ = true;
-  lws_callback_on_writable(wsi_);
+  {
+    std::lock_guard lock(mutex_);
+    close_ = true;
+  }
+  RequestWritable();
 }
 
 DynHandler::DynHandler(struct lws* wsi) : wsi_(wsi), out_buffer_(LWS_PRE, 0) {}
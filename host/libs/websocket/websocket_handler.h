@@ -15,14 +15,23 @@
 
 #pragma once
 
+#include <atomic>
 #include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 struct lws;
+struct lws_context;
 
 namespace cuttlefish {
 
+class WebSocketServer;
+
+// Handlers are created and called back by the thread servicing their
+// connection, but messages can be enqueued and the connection closed from any
+// thread.
 class WebSocketHandler {
  public:
   WebSocketHandler(struct lws* wsi);
@@ -51,9 +60,17 @@ class WebSocketHandler {
     bool binary;
   };
 
+  friend WebSocketServer;
   void WriteWsBuffer(WsBuffer& ws_buffer);
+  void RequestWritable();
+  // Whether another thread asked for a writable callback since the last call.
+  bool TakeWritableRequest() { return writable_requested_.exchange(false); }
 
   struct lws* wsi_;
+  struct lws_context* context_;
+  std::thread::id service_thread_;
+  std::atomic<bool> writable_requested_ = false;
+  std::mutex mutex_;
   bool close_ = false;
   std::deque<WsBuffer> buffer_queue_;
 };
@@ -64,8 +81,6 @@ class WebSocketHandlerFactory {
   virtual std::shared_ptr<WebSocketHandler> Build(struct lws* wsi) = 0;
 };
 
-class WebSocketServer;
-
 enum class HttpStatusCode : int {
   // From https://developer.mozilla.org/en-US/docs/Web/HTTP/Status
   Ok = 200,
@@ -16,7 +16,9 @@
 
 #include <host/libs/websocket/websocket_server.h>
 
+#include <algorithm>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
 #include <android-base/logging.h>
@@ -45,16 +47,23 @@ std::string GetPath(struct lws* wsi) {
   return path;
 }
 
-const std::vector<std::pair<std::string, std::string>> kCORSHeaders = {
+using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+// Static assets larger than this are served from disk.
+constexpr size_t kMaxCachedAssetSize = 8 << 20;
+// How much of a cached asset to write on each writable callback.
+constexpr size_t kStaticChunkSize = 16 << 10;
+
+const HttpHeaders kCORSHeaders = {
     {"Access-Control-Allow-Origin:", "*"},
     {"Access-Control-Allow-Methods:", "POST, GET, OPTIONS"},
     {"Access-Control-Allow-Headers:",
      "Content-Type, Access-Control-Allow-Headers, Authorization, "
      "X-Requested-With, Accept"}};
 
-bool AddCORSHeaders(struct lws* wsi, unsigned char** buffer_ptr,
-                    unsigned char* buffer_end) {
-  for (const auto& header : kCORSHeaders) {
+bool AddHeaders(struct lws* wsi, const HttpHeaders& headers,
+                unsigned char** buffer_ptr, unsigned char* buffer_end) {
+  for (const auto& header : headers) {
     const auto& name = header.first;
     const auto& value = header.second;
     if (lws_add_http_header_by_name(
@@ -67,8 +76,8 @@ bool AddCORSHeaders(struct lws* wsi, unsigned char** buffer_ptr,
   return true;
 }
 
-bool WriteCommonHttpHeaders(int status, const char* mime_type,
-                            size_t content_len, struct lws* wsi) {
+bool WriteHttpHeaders(int status, const char* mime_type, size_t content_len,
+                      struct lws* wsi, const HttpHeaders& headers) {
   constexpr size_t BUFF_SIZE = 2048;
   uint8_t header_buffer[LWS_PRE + BUFF_SIZE];
   const auto start = &header_buffer[LWS_PRE];
@@ -79,8 +88,8 @@ bool WriteCommonHttpHeaders(int status, const char* mime_type,
     LOG(ERROR) << "Failed to write headers for response";
     return false;
   }
-  if (!AddCORSHeaders(wsi, &p, end)) {
-    LOG(ERROR) << "Failed to write CORS headers for response";
+  if (!AddHeaders(wsi, headers, &p, end)) {
+    LOG(ERROR) << "Failed to write extra headers for response";
     return false;
   }
   if (lws_finalize_write_http_header(wsi, start, &p, end)) {
@@ -90,6 +99,29 @@ bool WriteCommonHttpHeaders(int status, const char* mime_type,
   return true;
 }
 
+bool WriteCommonHttpHeaders(int status, const char* mime_type,
+                            size_t content_len, struct lws* wsi) {
+  return WriteHttpHeaders(status, mime_type, content_len, wsi, kCORSHeaders);
+}
+
+std::string HeaderValue(struct lws* wsi, enum lws_token_indexes token) {
+  auto len = lws_hdr_total_length(wsi, token);
+  if (len <= 0) {
+    return "";
+  }
+  std::string value(len + 1, '\0');
+  if (lws_hdr_copy(wsi, value.data(), value.size(), token) < 0) {
+    return "";
+  }
+  value.resize(len);
+  return value;
+}
+
+// The file a request path refers to, relative to the assets directory.
+std::string FilePath(const std::string& path) {
+  return path.empty() || path.back() == '/' ? path + "index.html" : path;
+}
+
 }  // namespace
 WebSocketServer::WebSocketServer(const char* protocol_name,
                                  const std::string& assets_dir, int server_port)
@@ -104,16 +136,14 @@ WebSocketServer::WebSocketServer(const char* protocol_name,
       server_port_(server_port) {}
 
 void WebSocketServer::InitializeLwsObjects() {
-  std::string cert_file = certs_dir_ + "/server.crt";
-  std::string key_file = certs_dir_ + "/server.key";
-  std::string ca_file = certs_dir_ + "/CA.crt";
+  static_assets_ = StaticAssetCache::Load(assets_dir_, kMaxCachedAssetSize);
 
   retry_ = {
       .secs_since_valid_ping = 3,
       .secs_since_valid_hangup = 10,
   };
 
-  struct lws_protocols protocols[] =  //
+  protocols_ =  //
       {{
            .name = protocol_name_.c_str(),
            .callback = WebsocketCallback,
@@ -132,6 +162,15 @@ void WebSocketServer::InitializeLwsObjects() {
            .user = this,
            .tx_packet_size = 0,
        },
+       {
+           .name = "__static_assets__",
+           .callback = StaticAssetsCallback,
+           .per_session_data_size = 0,
+           .rx_buffer_size = 0,
+           .id = 0,
+           .user = this,
+           .tx_packet_size = 0,
+       },
        {
            .name = nullptr,
            .callback = nullptr,
@@ -177,8 +216,8 @@ void WebSocketServer::InitializeLwsObjects() {
       .mount_next = next_mount,
       .mountpoint = "/",
       .mountpoint_len = 1,
-      .origin = assets_dir_.c_str(),
-      .def = "index.html",
+      .origin = "__static_assets__",
+      .def = nullptr,
       .protocol = nullptr,
       .cgienv = nullptr,
       .extra_mimetypes = nullptr,
@@ -189,23 +228,35 @@ void WebSocketServer::InitializeLwsObjects() {
       .cache_reusable = 0,
       .cache_revalidate = 0,
       .cache_intermediaries = 0,
-      .origin_protocol = LWSMPRO_FILE,  // files in a dir
+      .origin_protocol = LWSMPRO_CALLBACK,  // cached, see ServeStaticAsset
       .basic_auth_login_file = nullptr,
   };
 
-  struct lws_context_creation_info info;
   headers_ = {NULL, NULL, "content-security-policy:",
               "default-src 'self' https://ajax.googleapis.com; "
               "style-src 'self' https://fonts.googleapis.com/; "
               "font-src  https://fonts.gstatic.com/; "};
+}
+
+void WebSocketServer::CreateContext(Shard& shard, bool share_port) {
+  std::string cert_file = certs_dir_ + "/server.crt";
+  std::string key_file = certs_dir_ + "/server.key";
+  std::string ca_file = certs_dir_ + "/CA.crt";
 
+  struct lws_context_creation_info info;
   memset(&info, 0, sizeof info);
   info.port = server_port_;
   info.mounts = &static_mount_;
-  info.protocols = protocols;
+  info.protocols = protocols_.data();
   info.vhost_name = "localhost";
   info.headers = &headers_;
   info.retry_and_idle_policy = &retry_;
+  info.user = &shard;
+  if (share_port) {
+#if defined(LWS_SERVER_OPTION_ALLOW_LISTEN_SHARE)
+    info.options |= LWS_SERVER_OPTION_ALLOW_LISTEN_SHARE;
+#endif
+  }
 
   if (!certs_dir_.empty()) {
     info.options |= LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
@@ -216,8 +267,8 @@ void WebSocketServer::InitializeLwsObjects() {
     }
   }
 
-  context_ = lws_create_context(&info);
-  if (!context_) {
+  shard.context = lws_create_context(&info);
+  if (!shard.context) {
     LOG(FATAL) << "Failed to create websocket context";
   }
 }
@@ -234,13 +285,55 @@ void WebSocketServer::RegisterDynHandlerFactory(
   dyn_handler_factories_[path] = std::move(handler_factory);
 }
 
-void WebSocketServer::Serve() {
+void WebSocketServer::Serve(size_t service_threads) {
   InitializeLwsObjects();
+  service_threads = std::max<size_t>(service_threads, 1);
+#if !defined(LWS_SERVER_OPTION_ALLOW_LISTEN_SHARE)
+  if (service_threads > 1) {
+    LOG(WARNING) << "libwebsockets can't share the listening port, serving "
+                 << "from a single thread";
+    service_threads = 1;
+  }
+#endif
+  {
+    std::lock_guard lock(shards_mutex_);
+    for (size_t i = 0; i < service_threads; i++) {
+      shards_.emplace_back(new Shard{.server = this});
+      CreateContext(*shards_.back(), service_threads > 1);
+    }
+  }
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < shards_.size(); i++) {
+    threads.emplace_back(ServiceShard, std::ref(*shards_[i]));
+  }
+  ServiceShard(*shards_[0]);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::lock_guard lock(shards_mutex_);
+  for (auto& shard : shards_) {
+    lws_context_destroy(shard->context);
+  }
+  shards_.clear();
+}
+
+void WebSocketServer::Stop() {
+  std::lock_guard lock(shards_mutex_);
+  stopping_ = true;
+  for (auto& shard : shards_) {
+    lws_cancel_service(shard->context);
+  }
+}
+
+void WebSocketServer::ServiceShard(Shard& shard) {
   int n = 0;
-  while (n >= 0) {
-    n = lws_service(context_, 0);
+  while (n >= 0 && !shard.server->stopping_) {
+    n = lws_service(shard.context, 0);
   }
-  lws_context_destroy(context_);
+}
+
+WebSocketServer::Shard& WebSocketServer::ShardOf(struct lws* wsi) {
+  return *reinterpret_cast<Shard*>(lws_context_user(lws_get_context(wsi)));
 }
 
 int WebSocketServer::WebsocketCallback(struct lws* wsi,
@@ -252,8 +345,8 @@ int WebSocketServer::WebsocketCallback(struct lws* wsi,
     // wsi struct is even created.
     return lws_callback_http_dummy(wsi, reason, user, in, len);
   }
-  return reinterpret_cast<WebSocketServer*>(protocol->user)
-      ->ServerCallback(wsi, reason, user, in, len);
+  auto& shard = ShardOf(wsi);
+  return shard.server->ServerCallback(shard, wsi, reason, user, in, len);
 }
 
 int WebSocketServer::DynHttpCallback(struct lws* wsi,
@@ -264,11 +357,23 @@ int WebSocketServer::DynHttpCallback(struct lws* wsi,
     LOG(ERROR) << "No protocol associated with connection";
     return 1;
   }
-  return reinterpret_cast<WebSocketServer*>(protocol->user)
-      ->DynServerCallback(wsi, reason, user, in, len);
+  auto& shard = ShardOf(wsi);
+  return shard.server->DynServerCallback(shard, wsi, reason, user, in, len);
+}
+
+int WebSocketServer::StaticAssetsCallback(struct lws* wsi,
+                                          enum lws_callback_reasons reason,
+                                          void* user, void* in, size_t len) {
+  auto protocol = lws_get_protocol(wsi);
+  if (!protocol) {
+    LOG(ERROR) << "No protocol associated with connection";
+    return 1;
+  }
+  auto& shard = ShardOf(wsi);
+  return shard.server->StaticServerCallback(shard, wsi, reason, user, in, len);
 }
 
-int WebSocketServer::DynServerCallback(struct lws* wsi,
+int WebSocketServer::DynServerCallback(Shard& shard, struct lws* wsi,
                                        enum lws_callback_reasons reason,
                                        void* user, void* in, size_t len) {
   switch (reason) {
@@ -288,13 +393,13 @@ int WebSocketServer::DynServerCallback(struct lws* wsi,
         }
         return lws_http_transaction_completed(wsi);
       }
-      dyn_handlers_[wsi] = std::move(handler);
+      shard.dyn_handlers[wsi] = std::move(handler);
       switch (method) {
         case LWSHUMETH_GET: {
-          auto status = dyn_handlers_[wsi]->DoGet();
+          auto status = shard.dyn_handlers[wsi]->DoGet();
           if (!WriteCommonHttpHeaders(static_cast<int>(status),
                                       "application/json",
-                                      dyn_handlers_[wsi]->content_len(), wsi)) {
+                                      shard.dyn_handlers[wsi]->content_len(), wsi)) {
             return 1;
           }
           // Write the response later, when the server is ready
@@ -320,7 +425,7 @@ int WebSocketServer::DynServerCallback(struct lws* wsi,
       break;
     }
     case LWS_CALLBACK_HTTP_BODY: {
-      auto handler = dyn_handlers_[wsi].get();
+      auto handler = shard.dyn_handlers[wsi].get();
       if (!handler) {
         LOG(WARNING) << "Received body for unknown wsi";
         return 1;
@@ -329,27 +434,27 @@ int WebSocketServer::DynServerCallback(struct lws* wsi,
       break;
     }
     case LWS_CALLBACK_HTTP_BODY_COMPLETION: {
-      auto handler = dyn_handlers_[wsi].get();
+      auto handler = shard.dyn_handlers[wsi].get();
       if (!handler) {
         LOG(WARNING) << "Unexpected body completion event from unknown wsi";
         return 1;
       }
       auto status = handler->DoPost();
       if (!WriteCommonHttpHeaders(static_cast<int>(status), "application/json",
-                                  dyn_handlers_[wsi]->content_len(), wsi)) {
+                                  shard.dyn_handlers[wsi]->content_len(), wsi)) {
         return 1;
       }
       lws_callback_on_writable(wsi);
       break;
     }
     case LWS_CALLBACK_HTTP_WRITEABLE: {
-      auto handler = dyn_handlers_[wsi].get();
+      auto handler = shard.dyn_handlers[wsi].get();
       if (!handler) {
         LOG(WARNING) << "Unknown wsi became writable";
         return 1;
       }
       auto ret = handler->OnWritable();
-      dyn_handlers_.erase(wsi);
+      shard.dyn_handlers.erase(wsi);
       // Make sure the connection (in HTTP 1) or stream (in HTTP 2) is closed
       // after the response is written
       return ret;
@@ -362,7 +467,7 @@ int WebSocketServer::DynServerCallback(struct lws* wsi,
   return 0;
 }
 
-int WebSocketServer::ServerCallback(struct lws* wsi,
+int WebSocketServer::ServerCallback(Shard& shard, struct lws* wsi,
                                     enum lws_callback_reasons reason,
                                     void* user, void* in, size_t len) {
   switch (reason) {
@@ -374,20 +479,20 @@ int WebSocketServer::ServerCallback(struct lws* wsi,
         lws_close_reason(wsi, LWS_CLOSE_STATUS_NOSTATUS, (uint8_t*)"404", 3);
         return -1;
       }
-      handlers_[wsi] = handler;
+      shard.handlers[wsi] = handler;
       handler->OnConnected();
       break;
     }
     case LWS_CALLBACK_CLOSED: {
-      auto handler = handlers_[wsi];
+      auto handler = shard.handlers[wsi];
       if (handler) {
         handler->OnClosed();
-        handlers_.erase(wsi);
+        shard.handlers.erase(wsi);
       }
       break;
     }
     case LWS_CALLBACK_SERVER_WRITEABLE: {
-      auto handler = handlers_[wsi];
+      auto handler = shard.handlers[wsi];
       if (handler) {
         auto should_close = handler->OnWritable();
         if (should_close) {
@@ -400,8 +505,16 @@ int WebSocketServer::ServerCallback(struct lws* wsi,
       }
       break;
     }
+    case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+      // Another thread wants to write to some of this shard's connections.
+      for (auto& [handler_wsi, handler] : shard.handlers) {
+        if (handler->TakeWritableRequest()) {
+          lws_callback_on_writable(handler_wsi);
+        }
+      }
+      break;
     case LWS_CALLBACK_RECEIVE: {
-      auto handler = handlers_[wsi];
+      auto handler = shard.handlers[wsi];
       if (handler) {
         bool is_final = (lws_remaining_packet_payload(wsi) == 0) &&
                         lws_is_final_fragment(wsi);
@@ -418,6 +531,115 @@ int WebSocketServer::ServerCallback(struct lws* wsi,
   return 0;
 }
 
+int WebSocketServer::StaticServerCallback(Shard& shard, struct lws* wsi,
+                                          enum lws_callback_reasons reason,
+                                          void* user, void* in, size_t len) {
+  switch (reason) {
+    case LWS_CALLBACK_HTTP: {
+      char* path_raw;
+      int path_len;
+      if (lws_http_get_uri_and_method(wsi, &path_raw, &path_len) < 0) {
+        return 1;
+      }
+      return ServeStaticAsset(shard, wsi, std::string(path_raw, path_len));
+    }
+    case LWS_CALLBACK_HTTP_WRITEABLE: {
+      auto it = shard.static_transfers.find(wsi);
+      if (it == shard.static_transfers.end()) {
+        // Files served from disk are written by lws itself.
+        return lws_callback_http_dummy(wsi, reason, user, in, len);
+      }
+      auto& transfer = it->second;
+      const auto& body = transfer.gzipped ? transfer.asset->gzipped
+                                          : transfer.asset->content;
+      auto chunk = std::min(kStaticChunkSize, body.size() - transfer.offset);
+      bool last = transfer.offset + chunk == body.size();
+      // For http2 there must be LWS_PRE bytes at the end as well.
+      std::vector<uint8_t> buffer(LWS_PRE + chunk + LWS_PRE);
+      std::copy_n(body.data() + transfer.offset, chunk, &buffer[LWS_PRE]);
+      auto res = lws_write(wsi, &buffer[LWS_PRE], chunk,
+                           last ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP);
+      if (res != static_cast<int>(chunk)) {
+        LOG(ERROR) << "Failed to write static asset";
+        return -1;
+      }
+      transfer.offset += chunk;
+      if (!last) {
+        lws_callback_on_writable(wsi);
+        return 0;
+      }
+      shard.static_transfers.erase(it);
+      return lws_http_transaction_completed(wsi);
+    }
+    case LWS_CALLBACK_CLOSED_HTTP:
+      shard.static_transfers.erase(wsi);
+      break;
+    default:
+      return lws_callback_http_dummy(wsi, reason, user, in, len);
+  }
+  return 0;
+}
+
+int WebSocketServer::ServeStaticAsset(Shard& shard, struct lws* wsi,
+                                      const std::string& path) {
+  auto asset = static_assets_.Find(path);
+  if (!asset) {
+    return ServeStaticFile(wsi, path);
+  }
+  bool gzipped =
+      asset->ServeGzipped(HeaderValue(wsi, WSI_TOKEN_HTTP_ACCEPT_ENCODING));
+  const auto& etag = gzipped ? asset->gzipped_etag : asset->etag;
+  HttpHeaders headers = {
+      {"etag:", etag},
+      // Have browsers revalidate on every load, which costs a 304 with no
+      // body when nothing changed.
+      {"cache-control:", "no-cache"},
+      {"vary:", "accept-encoding"},
+  };
+  if (StaticAsset::NotModified(HeaderValue(wsi, WSI_TOKEN_HTTP_IF_NONE_MATCH),
+                               etag)) {
+    if (!WriteHttpHeaders(HTTP_STATUS_NOT_MODIFIED, nullptr, 0, wsi,
+                          headers)) {
+      return 1;
+    }
+    return lws_http_transaction_completed(wsi);
+  }
+  if (gzipped) {
+    headers.emplace_back("content-encoding:", "gzip");
+  }
+  const auto& body = gzipped ? asset->gzipped : asset->content;
+  auto mime_type = lws_get_mimetype(FilePath(path).c_str(), &static_mount_);
+  if (!WriteHttpHeaders(HTTP_STATUS_OK,
+                        mime_type ? mime_type : "application/octet-stream",
+                        body.size(), wsi, headers)) {
+    return 1;
+  }
+  shard.static_transfers[wsi] = {asset, gzipped, 0};
+  lws_callback_on_writable(wsi);
+  return 0;
+}
+
+// For the assets that didn't fit in the cache or were added after the server
+// started.
+int WebSocketServer::ServeStaticFile(struct lws* wsi,
+                                     const std::string& path) {
+  if (path.find("..") != std::string::npos) {
+    if (!WriteHttpHeaders(HTTP_STATUS_FORBIDDEN, "text/plain", 0, wsi, {})) {
+      return 1;
+    }
+    return lws_http_transaction_completed(wsi);
+  }
+  auto file = assets_dir_ + FilePath(path);
+  auto mime_type = lws_get_mimetype(file.c_str(), &static_mount_);
+  auto ret = lws_serve_http_file(
+      wsi, file.c_str(), mime_type ? mime_type : "application/octet-stream",
+      nullptr, 0);
+  if (ret < 0 || (ret > 0 && lws_http_transaction_completed(wsi))) {
+    return -1;
+  }
+  return 0;
+}
+
 std::shared_ptr<WebSocketHandler> WebSocketServer::InstantiateHandler(
     const std::string& uri_path, struct lws* wsi) {
   auto it = handler_factories_.find(uri_path);
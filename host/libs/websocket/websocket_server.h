@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -23,6 +26,7 @@
 #include <android-base/logging.h>
 #include <libwebsockets.h>
 
+#include <host/libs/websocket/static_asset_cache.h>
 #include <host/libs/websocket/websocket_handler.h>
 
 namespace cuttlefish {
@@ -47,9 +51,36 @@ class WebSocketServer {
   void RegisterDynHandlerFactory(const std::string& path,
                                  DynHandlerFactory handler_factory);
 
-  void Serve();
+  // Serves connections until the server stops, spreading them over
+  // `service_threads` threads. Handlers and factories are called from all of
+  // them, so they must be thread safe when there is more than one.
+  void Serve(size_t service_threads = 1);
+  // Makes Serve return, closing the connections. Can be called from any
+  // thread, before or while serving.
+  void Stop();
 
  private:
+  // The connections serviced by one thread. Each shard has its own lws context
+  // listening on the server port and the kernel balances new connections
+  // between them.
+  struct Shard {
+    WebSocketServer* server;
+    struct lws_context* context = nullptr;
+    std::unordered_map<struct lws*, std::shared_ptr<WebSocketHandler>>
+        handlers = {};
+    std::unordered_map<struct lws*, std::unique_ptr<DynHandler>>
+        dyn_handlers = {};
+    // Static asset responses still being written.
+    struct StaticTransfer {
+      std::shared_ptr<const StaticAsset> asset;
+      bool gzipped;
+      size_t offset;
+    };
+    std::unordered_map<struct lws*, StaticTransfer> static_transfers = {};
+  };
+
+  static Shard& ShardOf(struct lws* wsi);
+
   static int WebsocketCallback(struct lws* wsi,
                                enum lws_callback_reasons reason, void* user,
                                void* in, size_t len);
@@ -57,31 +88,43 @@ class WebSocketServer {
   static int DynHttpCallback(struct lws* wsi, enum lws_callback_reasons reason,
                              void* user, void* in, size_t len);
 
-  int ServerCallback(struct lws* wsi, enum lws_callback_reasons reason,
-                            void* user, void* in, size_t len);
-  int DynServerCallback(struct lws* wsi,
-                               enum lws_callback_reasons reason, void* user,
-                               void* in, size_t len);
+  static int StaticAssetsCallback(struct lws* wsi,
+                                  enum lws_callback_reasons reason, void* user,
+                                  void* in, size_t len);
+
+  int ServerCallback(Shard& shard, struct lws* wsi,
+                     enum lws_callback_reasons reason, void* user, void* in,
+                     size_t len);
+  int DynServerCallback(Shard& shard, struct lws* wsi,
+                        enum lws_callback_reasons reason, void* user,
+                        void* in, size_t len);
+  int StaticServerCallback(Shard& shard, struct lws* wsi,
+                           enum lws_callback_reasons reason, void* user,
+                           void* in, size_t len);
+  int ServeStaticAsset(Shard& shard, struct lws* wsi, const std::string& path);
+  int ServeStaticFile(struct lws* wsi, const std::string& path);
   std::shared_ptr<WebSocketHandler> InstantiateHandler(
       const std::string& uri_path, struct lws* wsi);
   std::unique_ptr<DynHandler> InstantiateDynHandler(
       const std::string& uri_path, struct lws* wsi);
 
   void InitializeLwsObjects();
+  void CreateContext(Shard& shard, bool share_port);
+  static void ServiceShard(Shard& shard);
 
-  std::unordered_map<struct lws*, std::shared_ptr<WebSocketHandler>> handlers_ =
-      {};
   std::unordered_map<std::string, std::unique_ptr<WebSocketHandlerFactory>>
       handler_factories_ = {};
-  std::unordered_map<struct lws*, std::unique_ptr<DynHandler>> dyn_handlers_ =
-      {};
   std::unordered_map<std::string, DynHandlerFactory> dyn_handler_factories_ =
       {};
   std::string protocol_name_;
   std::string assets_dir_;
   std::string certs_dir_;
   int server_port_;
-  struct lws_context* context_;
+  std::mutex shards_mutex_;
+  std::atomic<bool> stopping_ = false;
+  std::vector<std::unique_ptr<Shard>> shards_ = {};
+  StaticAssetCache static_assets_;
+  std::vector<struct lws_protocols> protocols_ = {};
   struct lws_http_mount static_mount_;
   std::vector<struct lws_http_mount> dyn_mounts_ = {};
   struct lws_protocol_vhost_options headers_;
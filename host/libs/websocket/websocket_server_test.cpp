@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host/libs/websocket/websocket_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+
+namespace cuttlefish {
+namespace {
+
+struct HttpResponse {
+  int status = 0;
+  // With lowercase names.
+  std::string headers;
+  std::string body;
+
+  std::string Header(const std::string& name) const {
+    auto start = headers.find("\r\n" + name + ":");
+    if (start == std::string::npos) {
+      return "";
+    }
+    start += name.size() + 3;
+    auto end = headers.find("\r\n", start);
+    return android::base::Trim(headers.substr(start, end - start));
+  }
+};
+
+sockaddr_in Localhost(int port) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return addr;
+}
+
+int FreePort() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  auto addr = Localhost(0);
+  socklen_t len = sizeof(addr);
+  if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    return -1;
+  }
+  close(fd);
+  return ntohs(addr.sin_port);
+}
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  auto addr = Localhost(port);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Sends an HTTP/1.0 request, after which the server closes the connection.
+HttpResponse Get(int port, const std::string& path,
+                 const std::string& extra_headers = "") {
+  HttpResponse response;
+  int fd = Connect(port);
+  if (fd < 0) {
+    return response;
+  }
+  auto request = "GET " + path + " HTTP/1.0\r\nHost: localhost\r\n" +
+                 extra_headers + "\r\n";
+  if (!android::base::WriteFully(fd, request.data(), request.size())) {
+    close(fd);
+    return response;
+  }
+  std::string raw;
+  char buffer[4096];
+  ssize_t count;
+  while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+    raw.append(buffer, count);
+  }
+  close(fd);
+  auto headers_end = raw.find("\r\n\r\n");
+  if (headers_end == std::string::npos || raw.size() < 12) {
+    return response;
+  }
+  response.status = std::stoi(raw.substr(9, 3));
+  response.headers = raw.substr(0, headers_end + 2);
+  std::transform(response.headers.begin(), response.headers.end(),
+                 response.headers.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  response.body = raw.substr(headers_end + 4);
+  return response;
+}
+
+class WebSocketServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    port_ = FreePort();
+    ASSERT_GT(port_, 0);
+    index_ = std::string(4096, 'a');
+    ASSERT_TRUE(android::base::WriteStringToFile(
+        index_, std::string(assets_dir_.path) + "/index.html"));
+    server_ = std::make_unique<WebSocketServer>("test-protocol",
+                                                assets_dir_.path, port_);
+  }
+
+  void TearDown() override {
+    server_->Stop();
+    if (serve_thread_.joinable()) {
+      serve_thread_.join();
+    }
+  }
+
+  void Serve(size_t service_threads) {
+    serve_thread_ = std::thread(
+        [this, service_threads]() { server_->Serve(service_threads); });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    int fd;
+    while ((fd = Connect(port_)) < 0 &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_GE(fd, 0) << "The server didn't start listening";
+    close(fd);
+  }
+
+  TemporaryDir assets_dir_;
+  std::string index_;
+  int port_ = -1;
+  std::unique_ptr<WebSocketServer> server_;
+  std::thread serve_thread_;
+};
+
+TEST_F(WebSocketServerTest, ServesCachedAssetsWithEncodingTags) {
+  Serve(1);
+
+  auto identity = Get(port_, "/");
+  ASSERT_EQ(identity.status, 200) << identity.headers;
+  EXPECT_EQ(identity.body, index_);
+  EXPECT_EQ(identity.Header("content-encoding"), "");
+  EXPECT_EQ(identity.Header("vary"), "accept-encoding");
+  auto etag = identity.Header("etag");
+  ASSERT_NE(etag, "");
+
+  auto gzipped = Get(port_, "/index.html", "Accept-Encoding: gzip\r\n");
+  ASSERT_EQ(gzipped.status, 200) << gzipped.headers;
+  EXPECT_EQ(gzipped.Header("content-encoding"), "gzip");
+  EXPECT_EQ(gzipped.Header("vary"), "accept-encoding");
+  EXPECT_LT(gzipped.body.size(), index_.size());
+  auto gzipped_etag = gzipped.Header("etag");
+  ASSERT_NE(gzipped_etag, "");
+  EXPECT_NE(gzipped_etag, etag);
+}
+
+TEST_F(WebSocketServerTest, RevalidatesEachEncoding) {
+  Serve(1);
+  auto etag = Get(port_, "/").Header("etag");
+  auto gzipped_etag =
+      Get(port_, "/", "Accept-Encoding: gzip\r\n").Header("etag");
+  ASSERT_NE(etag, "");
+  ASSERT_NE(gzipped_etag, "");
+
+  auto not_modified = Get(port_, "/", "If-None-Match: " + etag + "\r\n");
+  EXPECT_EQ(not_modified.status, 304) << not_modified.headers;
+  EXPECT_EQ(not_modified.body, "");
+  EXPECT_EQ(not_modified.Header("etag"), etag);
+
+  not_modified = Get(port_, "/",
+                     "Accept-Encoding: gzip\r\nIf-None-Match: " +
+                         gzipped_etag + "\r\n");
+  EXPECT_EQ(not_modified.status, 304) << not_modified.headers;
+  EXPECT_EQ(not_modified.Header("etag"), gzipped_etag);
+
+  // A cached gzipped body doesn't stand in for the identity one.
+  auto modified = Get(port_, "/", "If-None-Match: " + gzipped_etag + "\r\n");
+  EXPECT_EQ(modified.status, 200) << modified.headers;
+  EXPECT_EQ(modified.body, index_);
+}
+
+class ThreadRecorder : public DynHandler {
+ public:
+  ThreadRecorder(struct lws* wsi, std::mutex& mutex,
+                 std::set<std::thread::id>& threads)
+      : DynHandler(wsi), mutex_(mutex), threads_(threads) {}
+
+  HttpStatusCode DoGet() override {
+    std::lock_guard lock(mutex_);
+    threads_.insert(std::this_thread::get_id());
+    AppendDataOut("{}");
+    return HttpStatusCode::Ok;
+  }
+  HttpStatusCode DoPost() override { return HttpStatusCode::MethodNotAllowed; }
+
+ private:
+  std::mutex& mutex_;
+  std::set<std::thread::id>& threads_;
+};
+
+TEST_F(WebSocketServerTest, ShardsConnectionsAcrossThreads) {
+#if !defined(LWS_SERVER_OPTION_ALLOW_LISTEN_SHARE)
+  GTEST_SKIP() << "libwebsockets can't share the listening port";
+#endif
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  server_->RegisterDynHandlerFactory(
+      "/thread", [&mutex, &threads](struct lws* wsi) {
+        return std::make_unique<ThreadRecorder>(wsi, mutex, threads);
+      });
+  Serve(4);
+
+  // The kernel picks the listener of each connection by hashing its address,
+  // so these are all but certain to reach more than one shard.
+  for (int i = 0; i < 32; i++) {
+    auto response = Get(port_, "/thread");
+    ASSERT_EQ(response.status, 200) << response.headers;
+    EXPECT_EQ(response.body, "{}");
+  }
+  std::lock_guard lock(mutex);
+  EXPECT_GT(threads.size(), 1);
+  EXPECT_LE(threads.size(), 4);
+}
+
+}  // namespace
+}  // namespace cuttlefish